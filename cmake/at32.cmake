@@ -19,6 +19,8 @@ set(CMSIS_DSP_SRC
     BasicMathFunctions/arm_sub_f32.c
     BasicMathFunctions/arm_mult_f32.c
     BasicMathFunctions/arm_offset_f32.c
+    FilteringFunctions/arm_biquad_cascade_df1_f32.c
+    FilteringFunctions/arm_biquad_cascade_df1_init_f32.c
     TransformFunctions/arm_rfft_fast_f32.c
     TransformFunctions/arm_cfft_f32.c
     TransformFunctions/arm_rfft_fast_init_f32.c
@@ -13,10 +13,20 @@ main_sources(SITL_COMMON_SRC_EXCLUDES
 
 main_sources(SITL_SRC
     config/config_streamer_file.c
+    drivers/file_sink.c
+    drivers/file_sink.h
+    drivers/flash_file.c
+    drivers/flash_file.h
     drivers/serial_tcp.c
     drivers/serial_tcp.h
+    target/SITL/sim/builtin.c
+    target/SITL/sim/builtin.h
+    target/SITL/sim/physics.c
+    target/SITL/sim/physics.h
     target/SITL/sim/realFlight.c
     target/SITL/sim/realFlight.h
+    target/SITL/sim/scenario.c
+    target/SITL/sim/scenario.h
     target/SITL/sim/simHelper.c
     target/SITL/sim/simHelper.h
     target/SITL/sim/simple_soap_client.c
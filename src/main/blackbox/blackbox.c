@@ -27,6 +27,7 @@
 #include "blackbox.h"
 #include "blackbox_encoding.h"
 #include "blackbox_io.h"
+#include "blackbox_pretrigger.h"
 
 #include "build/debug.h"
 #include "build/version.h"
@@ -99,7 +100,7 @@
 #define BLACKBOX_INVERTED_CARD_DETECTION 0
 #endif
 
-PG_REGISTER_WITH_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 3);
+PG_REGISTER_WITH_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 6);
 
 PG_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig,
     .device = DEFAULT_BLACKBOX_DEVICE,
@@ -110,6 +111,16 @@ PG_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig,
         BLACKBOX_FEATURE_MAG | BLACKBOX_FEATURE_ACC | BLACKBOX_FEATURE_ATTITUDE |
         BLACKBOX_FEATURE_RC_DATA | BLACKBOX_FEATURE_RC_COMMAND |
         BLACKBOX_FEATURE_MOTORS | BLACKBOX_FEATURE_SERVOS,
+#ifdef USE_BLACKBOX_PRETRIGGER
+    .pretrigger_ms = SETTING_BLACKBOX_PRETRIGGER_MS_DEFAULT,
+#endif
+    .groupDivider = {
+        [BLACKBOX_GROUP_RC] = SETTING_BLACKBOX_RC_DIVIDER_DEFAULT,
+        [BLACKBOX_GROUP_ATTITUDE] = SETTING_BLACKBOX_ATTITUDE_DIVIDER_DEFAULT,
+        [BLACKBOX_GROUP_NAV] = SETTING_BLACKBOX_NAV_DIVIDER_DEFAULT,
+        [BLACKBOX_GROUP_SENSORS] = SETTING_BLACKBOX_SENSORS_DIVIDER_DEFAULT,
+    },
+    .compression = SETTING_BLACKBOX_COMPRESSION_DEFAULT,
 );
 
 void blackboxIncludeFlagSet(uint32_t mask)
@@ -353,14 +364,14 @@ static const blackboxDeltaFieldDefinition_t blackboxMainFields[] = {
     {"servo",       15, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_16)},
     {"servo",       16, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_17)},
     {"servo",       17, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_18)},
-    {"servo",       18, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_18)},
-    {"servo",       19, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_19)},
-    {"servo",       20, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_20)},
-    {"servo",       21, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_21)},
-    {"servo",       22, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_22)},
-    {"servo",       23, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_23)},
-    {"servo",       24, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_24)},
-    {"servo",       25, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_25)},
+    {"servo",       18, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_19)},
+    {"servo",       19, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_20)},
+    {"servo",       20, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_21)},
+    {"servo",       21, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_22)},
+    {"servo",       22, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_23)},
+    {"servo",       23, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_24)},
+    {"servo",       24, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_25)},
+    {"servo",       25, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_26)},
     /*
     {"servo",       26, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_26)},
     {"servo",       27, UNSIGNED, .Ipredict = PREDICT(1500),    .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),      .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_SERVOS_27)},
@@ -472,13 +483,16 @@ static const blackboxSimpleFieldDefinition_t blackboxSlowFields[] = {
 typedef enum BlackboxState {
     BLACKBOX_STATE_DISABLED = 0,
     BLACKBOX_STATE_STOPPED,
+    BLACKBOX_STATE_PRETRIGGER,
     BLACKBOX_STATE_PREPARE_LOG_FILE,
     BLACKBOX_STATE_SEND_HEADER,
     BLACKBOX_STATE_SEND_MAIN_FIELD_HEADER,
     BLACKBOX_STATE_SEND_GPS_H_HEADER,
     BLACKBOX_STATE_SEND_GPS_G_HEADER,
     BLACKBOX_STATE_SEND_SLOW_HEADER,
+    BLACKBOX_STATE_SEND_GROUP_HEADER,
     BLACKBOX_STATE_SEND_SYSINFO,
+    BLACKBOX_STATE_SEND_PRETRIGGER,
     BLACKBOX_STATE_PAUSED,
     BLACKBOX_STATE_RUNNING,
     BLACKBOX_STATE_SHUTTING_DOWN
@@ -591,6 +605,115 @@ typedef struct blackboxSlowState_s {
     uint8_t activeWpNumber;
 } __attribute__((__packed__)) blackboxSlowState_t; // We pack this struct so that padding doesn't interfere with memcmp()
 
+typedef enum {
+    BLACKBOX_GROUP_FIELD_S16,
+    BLACKBOX_GROUP_FIELD_U16,
+    BLACKBOX_GROUP_FIELD_S32,
+} blackboxGroupFieldType_e;
+
+/*
+ * Fields of a group with a divider are taken out of the main frames and written in its own group frames instead.
+ * The header of the group frames is sent from the field definitions, like the one of the main frames.
+ */
+typedef struct blackboxGroupFieldDefinition_s {
+    blackboxDeltaFieldDefinition_t field;
+
+    uint8_t group;
+    uint8_t type;
+    uint16_t offset;    // Of the value in blackboxMainState_t
+} blackboxGroupFieldDefinition_t;
+
+/*
+ * "D" frames follow an "I" frame and are predicted from zero, "d" frames follow a "P" frame and are predicted from
+ * the previous group frame of the same group. Either way a group frame belongs to the main frame right before it.
+ */
+#define GROUP_FIELD(name, index, sign, group, type, member, condition) \
+    {{name, index, sign, .Ipredict = PREDICT(0), .Iencode = ENCODING(SIGNED_VB), .Ppredict = PREDICT(PREVIOUS), .Pencode = ENCODING(SIGNED_VB), \
+      CONDITION(condition)}, BLACKBOX_GROUP_ ## group, BLACKBOX_GROUP_FIELD_ ## type, offsetof(blackboxMainState_t, member)}
+
+static const blackboxGroupFieldDefinition_t blackboxGroupFields[] = {
+    GROUP_FIELD("rcData",        0, SIGNED,   RC,       S16, rcData[0],             RC_DATA),
+    GROUP_FIELD("rcData",        1, SIGNED,   RC,       S16, rcData[1],             RC_DATA),
+    GROUP_FIELD("rcData",        2, SIGNED,   RC,       S16, rcData[2],             RC_DATA),
+    GROUP_FIELD("rcData",        3, SIGNED,   RC,       S16, rcData[3],             RC_DATA),
+    GROUP_FIELD("rcCommand",     0, SIGNED,   RC,       S16, rcCommand[0],          RC_COMMAND),
+    GROUP_FIELD("rcCommand",     1, SIGNED,   RC,       S16, rcCommand[1],          RC_COMMAND),
+    GROUP_FIELD("rcCommand",     2, SIGNED,   RC,       S16, rcCommand[2],          RC_COMMAND),
+    GROUP_FIELD("rcCommand",     3, UNSIGNED, RC,       S16, rcCommand[3],          RC_COMMAND),
+
+    GROUP_FIELD("attitude",      0, SIGNED,   ATTITUDE, S16, attitude[0],           ATTITUDE),
+    GROUP_FIELD("attitude",      1, SIGNED,   ATTITUDE, S16, attitude[1],           ATTITUDE),
+    GROUP_FIELD("attitude",      2, SIGNED,   ATTITUDE, S16, attitude[2],           ATTITUDE),
+
+    GROUP_FIELD("fwAltP",       -1, SIGNED,   NAV,      S32, fwAltPID[0],           FIXED_WING_NAV),
+    GROUP_FIELD("fwAltI",       -1, SIGNED,   NAV,      S32, fwAltPID[1],           FIXED_WING_NAV),
+    GROUP_FIELD("fwAltD",       -1, SIGNED,   NAV,      S32, fwAltPID[2],           FIXED_WING_NAV),
+    GROUP_FIELD("fwAltOut",     -1, SIGNED,   NAV,      S32, fwAltPIDOutput,        FIXED_WING_NAV),
+    GROUP_FIELD("fwPosP",       -1, SIGNED,   NAV,      S32, fwPosPID[0],           FIXED_WING_NAV),
+    GROUP_FIELD("fwPosI",       -1, SIGNED,   NAV,      S32, fwPosPID[1],           FIXED_WING_NAV),
+    GROUP_FIELD("fwPosD",       -1, SIGNED,   NAV,      S32, fwPosPID[2],           FIXED_WING_NAV),
+    GROUP_FIELD("fwPosOut",     -1, SIGNED,   NAV,      S32, fwPosPIDOutput,        FIXED_WING_NAV),
+    GROUP_FIELD("mcPosAxisP",    0, SIGNED,   NAV,      S32, mcPosAxisP[0],         MC_NAV),
+    GROUP_FIELD("mcPosAxisP",    1, SIGNED,   NAV,      S32, mcPosAxisP[1],         MC_NAV),
+    GROUP_FIELD("mcPosAxisP",    2, SIGNED,   NAV,      S32, mcPosAxisP[2],         MC_NAV),
+    GROUP_FIELD("mcVelAxisP",    0, SIGNED,   NAV,      S32, mcVelAxisPID[0][0],    MC_NAV),
+    GROUP_FIELD("mcVelAxisP",    1, SIGNED,   NAV,      S32, mcVelAxisPID[0][1],    MC_NAV),
+    GROUP_FIELD("mcVelAxisP",    2, SIGNED,   NAV,      S32, mcVelAxisPID[0][2],    MC_NAV),
+    GROUP_FIELD("mcVelAxisI",    0, SIGNED,   NAV,      S32, mcVelAxisPID[1][0],    MC_NAV),
+    GROUP_FIELD("mcVelAxisI",    1, SIGNED,   NAV,      S32, mcVelAxisPID[1][1],    MC_NAV),
+    GROUP_FIELD("mcVelAxisI",    2, SIGNED,   NAV,      S32, mcVelAxisPID[1][2],    MC_NAV),
+    GROUP_FIELD("mcVelAxisD",    0, SIGNED,   NAV,      S32, mcVelAxisPID[2][0],    MC_NAV),
+    GROUP_FIELD("mcVelAxisD",    1, SIGNED,   NAV,      S32, mcVelAxisPID[2][1],    MC_NAV),
+    GROUP_FIELD("mcVelAxisD",    2, SIGNED,   NAV,      S32, mcVelAxisPID[2][2],    MC_NAV),
+    GROUP_FIELD("mcVelAxisFF",   0, SIGNED,   NAV,      S32, mcVelAxisPID[3][0],    MC_NAV),
+    GROUP_FIELD("mcVelAxisFF",   1, SIGNED,   NAV,      S32, mcVelAxisPID[3][1],    MC_NAV),
+    GROUP_FIELD("mcVelAxisFF",   2, SIGNED,   NAV,      S32, mcVelAxisPID[3][2],    MC_NAV),
+    GROUP_FIELD("mcVelAxisOut",  0, SIGNED,   NAV,      S32, mcVelAxisOutput[0],    MC_NAV),
+    GROUP_FIELD("mcVelAxisOut",  1, SIGNED,   NAV,      S32, mcVelAxisOutput[1],    MC_NAV),
+    GROUP_FIELD("mcVelAxisOut",  2, SIGNED,   NAV,      S32, mcVelAxisOutput[2],    MC_NAV),
+    GROUP_FIELD("mcSurfaceP",   -1, SIGNED,   NAV,      S32, mcSurfacePID[0],       MC_NAV),
+    GROUP_FIELD("mcSurfaceI",   -1, SIGNED,   NAV,      S32, mcSurfacePID[1],       MC_NAV),
+    GROUP_FIELD("mcSurfaceD",   -1, SIGNED,   NAV,      S32, mcSurfacePID[2],       MC_NAV),
+    GROUP_FIELD("mcSurfaceOut", -1, SIGNED,   NAV,      S32, mcSurfacePIDOutput,    MC_NAV),
+    GROUP_FIELD("navEPH",       -1, SIGNED,   NAV,      U16, navEPH,                NAV_POS),
+    GROUP_FIELD("navEPV",       -1, SIGNED,   NAV,      U16, navEPV,                NAV_POS),
+    GROUP_FIELD("navPos",        0, SIGNED,   NAV,      S32, navPos[0],             NAV_POS),
+    GROUP_FIELD("navPos",        1, SIGNED,   NAV,      S32, navPos[1],             NAV_POS),
+    GROUP_FIELD("navPos",        2, SIGNED,   NAV,      S32, navPos[2],             NAV_POS),
+    GROUP_FIELD("navVel",        0, SIGNED,   NAV,      S16, navRealVel[0],         NAV_POS),
+    GROUP_FIELD("navVel",        1, SIGNED,   NAV,      S16, navRealVel[1],         NAV_POS),
+    GROUP_FIELD("navVel",        2, SIGNED,   NAV,      S16, navRealVel[2],         NAV_POS),
+    GROUP_FIELD("navTgtVel",     0, SIGNED,   NAV,      S16, navTargetVel[0],       NAV_POS),
+    GROUP_FIELD("navTgtVel",     1, SIGNED,   NAV,      S16, navTargetVel[1],       NAV_POS),
+    GROUP_FIELD("navTgtVel",     2, SIGNED,   NAV,      S16, navTargetVel[2],       NAV_POS),
+    GROUP_FIELD("navTgtPos",     0, SIGNED,   NAV,      S32, navTargetPos[0],       NAV_POS),
+    GROUP_FIELD("navTgtPos",     1, SIGNED,   NAV,      S32, navTargetPos[1],       NAV_POS),
+    GROUP_FIELD("navTgtPos",     2, SIGNED,   NAV,      S32, navTargetPos[2],       NAV_POS),
+    GROUP_FIELD("navTgtHdg",    -1, UNSIGNED, NAV,      U16, navTargetHeading,      NAV_POS),
+    GROUP_FIELD("navSurf",      -1, SIGNED,   NAV,      S16, navSurface,            NAV_POS),
+    GROUP_FIELD("navAcc",        0, SIGNED,   NAV,      S16, navAccNEU[0],          NAV_ACC),
+    GROUP_FIELD("navAcc",        1, SIGNED,   NAV,      S16, navAccNEU[1],          NAV_ACC),
+    GROUP_FIELD("navAcc",        2, SIGNED,   NAV,      S16, navAccNEU[2],          NAV_ACC),
+
+    GROUP_FIELD("vbat",         -1, UNSIGNED, SENSORS,  U16, vbat,                  VBAT),
+    GROUP_FIELD("amperage",     -1, SIGNED,   SENSORS,  S16, amperage,              AMPERAGE),
+#ifdef USE_MAG
+    GROUP_FIELD("magADC",        0, SIGNED,   SENSORS,  S16, magADC[0],             MAG),
+    GROUP_FIELD("magADC",        1, SIGNED,   SENSORS,  S16, magADC[1],             MAG),
+    GROUP_FIELD("magADC",        2, SIGNED,   SENSORS,  S16, magADC[2],             MAG),
+#endif
+#ifdef USE_BARO
+    GROUP_FIELD("BaroAlt",      -1, SIGNED,   SENSORS,  S32, BaroAlt,               BARO),
+#endif
+#ifdef USE_PITOT
+    GROUP_FIELD("AirSpeed",     -1, SIGNED,   SENSORS,  S32, airSpeed,              PITOT),
+#endif
+#ifdef USE_RANGEFINDER
+    GROUP_FIELD("surfaceRaw",   -1, SIGNED,   SENSORS,  S32, surfaceRaw,            SURFACE),
+#endif
+    GROUP_FIELD("rssi",         -1, UNSIGNED, SENSORS,  U16, rssi,                  RSSI),
+};
+
 //From rc_controls.c
 extern boxBitmask_t rcModeActivationMask;
 
@@ -614,6 +737,12 @@ static struct {
 // Cache for FLIGHT_LOG_FIELD_CONDITION_* test results:
 static uint64_t blackboxConditionCache;
 
+// The conditions of the groups written in group frames, these are not set in blackboxConditionCache
+static uint64_t blackboxGroupConditionCache;
+static uint8_t blackboxGroupFieldCount[BLACKBOX_GROUP_COUNT];
+static uint8_t blackboxGroupFramesSkipped[BLACKBOX_GROUP_COUNT];
+static int32_t blackboxGroupHistory[ARRAYLEN(blackboxGroupFields)];
+
 STATIC_ASSERT((sizeof(blackboxConditionCache) * 8) >= FLIGHT_LOG_FIELD_CONDITION_LAST, too_many_flight_log_conditions);
 
 static uint32_t blackboxIFrameInterval;
@@ -639,14 +768,118 @@ static EXTENDED_FASTRAM blackboxMainState_t blackboxHistoryRing[3];
 // These point into blackboxHistoryRing, use them to know where to store history of a given age (0, 1 or 2 generations old)
 static EXTENDED_FASTRAM blackboxMainState_t* blackboxHistory[3];
 
+/*
+ * The PID loop only copies the main state of every logged iteration into this single-producer/single-consumer
+ * ring, TASK_BLACKBOX does the prediction and encoding. When the ring is full the iteration is dropped and the
+ * next logged iteration is written as an I-frame, so the decoder never predicts across the gap.
+ */
+#ifndef BLACKBOX_SNAPSHOT_QUEUE_SIZE
+#define BLACKBOX_SNAPSHOT_QUEUE_SIZE    8   // Power of two, at most 128
+#endif
+
+STATIC_ASSERT((BLACKBOX_SNAPSHOT_QUEUE_SIZE & (BLACKBOX_SNAPSHOT_QUEUE_SIZE - 1)) == 0 && BLACKBOX_SNAPSHOT_QUEUE_SIZE <= 128, blackbox_snapshot_queue_size_must_be_power_of_two);
+
+typedef struct blackboxSnapshot_s {
+    uint32_t iteration;
+    bool intraframe;
+    blackboxMainState_t state;
+} blackboxSnapshot_t;
+
+static EXTENDED_FASTRAM blackboxSnapshot_t blackboxSnapshotQueue[BLACKBOX_SNAPSHOT_QUEUE_SIZE];
+static uint8_t blackboxSnapshotHead;        // Written by the PID loop only
+static uint8_t blackboxSnapshotTail;        // Written by the encoder only
+static uint8_t blackboxSnapshotMaxDepth;
+static uint32_t blackboxSnapshotsDropped;   // Since boot
+static bool blackboxSnapshotResync;
+static bool blackboxGpsHomeDue;
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+/*
+ * With blackbox_pretrigger_ms set, the frames are encoded into a RAM ring while no log is being written: while
+ * disarmed, and while paused by the BLACKBOX mode. A trigger starts a log from the captured frames, so that it
+ * begins that long before the trigger. The frames keep going to the ring until the log has caught up with them.
+ */
+static bool blackboxCapturing;
+static blackboxTrigger_e blackboxPendingTrigger;
+static blackboxTrigger_e blackboxLogTrigger;        // What started the current log
+static timeMs_t blackboxPostTriggerEndTime;         // Logs triggered while disarmed end this long after the trigger
+static uint32_t blackboxLogPretriggerMs;            // How far before the trigger the current log actually starts
+static bool blackboxFinishPending;
+#endif
+
+// The log has fields for the first 8 motors only
+#define BLACKBOX_MAX_MOTORS     8
+
+#ifdef USE_BLACKBOX_GYRO_RATE
+/*
+ * With the GYRO_RATE field group, the raw gyro (and optionally the motor outputs) is sampled by the gyro task at
+ * the full gyro rate, into blocks of BLACKBOX_GYRO_RATE_BLOCK_SAMPLES. Like the snapshots, full blocks go through a
+ * single-producer/single-consumer ring to the encoder, which writes each one as an "R" frame. A block holds its own
+ * timestamps and starting values, so a dropped block is just a gap.
+ */
+#ifndef BLACKBOX_GYRO_RATE_BLOCK_SAMPLES
+#define BLACKBOX_GYRO_RATE_BLOCK_SAMPLES    32
+#endif
+
+#ifndef BLACKBOX_GYRO_RATE_QUEUE_SIZE
+#define BLACKBOX_GYRO_RATE_QUEUE_SIZE       4   // Power of two, at most 128
+#endif
+
+#if MAX_SUPPORTED_MOTORS > BLACKBOX_MAX_MOTORS
+#define BLACKBOX_GYRO_RATE_MAX_MOTORS       BLACKBOX_MAX_MOTORS
+#else
+#define BLACKBOX_GYRO_RATE_MAX_MOTORS       MAX_SUPPORTED_MOTORS
+#endif
+#define BLACKBOX_GYRO_RATE_MAX_CHANNELS     (XYZ_AXIS_COUNT + BLACKBOX_GYRO_RATE_MAX_MOTORS)
+
+STATIC_ASSERT((BLACKBOX_GYRO_RATE_QUEUE_SIZE & (BLACKBOX_GYRO_RATE_QUEUE_SIZE - 1)) == 0 && BLACKBOX_GYRO_RATE_QUEUE_SIZE <= 128, blackbox_gyro_rate_queue_size_must_be_power_of_two);
+STATIC_ASSERT(BLACKBOX_GYRO_RATE_BLOCK_SAMPLES >= 2 && BLACKBOX_GYRO_RATE_BLOCK_SAMPLES <= 255, blackbox_gyro_rate_block_samples_out_of_range);
+
+typedef struct blackboxGyroRateBlock_s {
+    uint32_t startTime;
+    uint32_t endTime;
+    int16_t samples[BLACKBOX_GYRO_RATE_BLOCK_SAMPLES][BLACKBOX_GYRO_RATE_MAX_CHANNELS];
+} blackboxGyroRateBlock_t;
+
+static EXTENDED_FASTRAM blackboxGyroRateBlock_t blackboxGyroRateQueue[BLACKBOX_GYRO_RATE_QUEUE_SIZE];
+static uint8_t blackboxGyroRateHead;        // Written by the gyro task only
+static uint8_t blackboxGyroRateTail;        // Written by the encoder only
+static uint8_t blackboxGyroRateFill;        // Samples in the block at the head
+static uint8_t blackboxGyroRateChannels;    // Gyro axes plus motors, 0 when not logged
+static uint32_t blackboxGyroRateSamplesDropped; // Since boot
+#endif
+
 static bool blackboxModeActivationConditionPresent = false;
 
+// Residuals of the average predictor are Rice coded in P frames, fixed for the whole log
+static bool blackboxRiceCoding;
+
 /**
  * Return true if it is safe to edit the Blackbox configuration.
  */
 bool blackboxMayEditConfig(void)
 {
-    return blackboxState <= BLACKBOX_STATE_STOPPED;
+    // Capturing doesn't hold the device yet, see blackboxConfigChanged()
+    return blackboxState <= BLACKBOX_STATE_PRETRIGGER;
+}
+
+/**
+ * Call after the Blackbox configuration was edited. A running capture is dropped so that it restarts with the new
+ * settings.
+ */
+void blackboxConfigChanged(void)
+{
+#ifdef USE_BLACKBOX_PRETRIGGER
+    if (blackboxState == BLACKBOX_STATE_PRETRIGGER) {
+        blackboxCapturing = false;
+        blackboxState = BLACKBOX_STATE_STOPPED;
+    }
+#endif
+}
+
+static int blackboxMotorCount(void)
+{
+    return MIN(getMotorCount(), BLACKBOX_MAX_MOTORS);
 }
 
 static bool blackboxIsOnlyLoggingIntraframes(void)
@@ -661,7 +894,7 @@ static bool testBlackboxConditionUncached(FlightLogFieldCondition condition)
         return true;
 
     case FLIGHT_LOG_FIELD_CONDITION_MOTORS:
-        return blackboxIncludeFlag(BLACKBOX_FEATURE_MOTORS);
+        return blackboxIncludeFlag(BLACKBOX_FEATURE_MOTORS) && getMotorCount() > 0;
 
     case FLIGHT_LOG_FIELD_CONDITION_AT_LEAST_MOTORS_1:
     case FLIGHT_LOG_FIELD_CONDITION_AT_LEAST_MOTORS_2:
@@ -821,6 +1054,28 @@ static void blackboxBuildConditionCache(void)
             blackboxConditionCache |= position;
         }
     }
+
+    // Move the conditions of the groups with a divider over to the group frames
+    blackboxGroupConditionCache = 0;
+    memset(blackboxGroupFieldCount, 0, sizeof(blackboxGroupFieldCount));
+
+    for (unsigned i = 0; i < ARRAYLEN(blackboxGroupFields); i++) {
+        const blackboxGroupFieldDefinition_t *def = &blackboxGroupFields[i];
+        const uint64_t position = ((uint64_t)1) << def->field.condition;
+
+        if (blackboxConfig()->groupDivider[def->group] > 1 && ((blackboxConditionCache | blackboxGroupConditionCache) & position)) {
+            blackboxGroupConditionCache |= position;
+            blackboxGroupFieldCount[def->group]++;
+        }
+    }
+
+    blackboxConditionCache &= ~blackboxGroupConditionCache;
+}
+
+static bool testBlackboxGroupCondition(FlightLogFieldCondition condition)
+{
+    const uint64_t position = ((uint64_t)1) << condition;
+    return (blackboxGroupConditionCache & position) != 0;
 }
 
 static bool testBlackboxCondition(FlightLogFieldCondition condition)
@@ -845,6 +1100,7 @@ static void blackboxSetState(BlackboxState newState)
     case BLACKBOX_STATE_SEND_GPS_G_HEADER:
     case BLACKBOX_STATE_SEND_GPS_H_HEADER:
     case BLACKBOX_STATE_SEND_SLOW_HEADER:
+    case BLACKBOX_STATE_SEND_GROUP_HEADER:
         xmitState.headerIndex = 0;
         xmitState.u.fieldIndex = -1;
         break;
@@ -856,20 +1112,34 @@ static void blackboxSetState(BlackboxState newState)
         break;
     case BLACKBOX_STATE_SHUTTING_DOWN:
         xmitState.u.startTime = millis();
+#ifdef USE_BLACKBOX_PRETRIGGER
+        blackboxCapturing = false;
+#endif
+        break;
+#ifdef USE_BLACKBOX_PRETRIGGER
+    case BLACKBOX_STATE_DISABLED:
+    case BLACKBOX_STATE_STOPPED:
+        blackboxCapturing = false;
         break;
+#endif
     default:
         ;
     }
     blackboxState = newState;
 }
 
-static void writeIntraframe(void)
+static void writeIntraframe(uint32_t iteration)
 {
     blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
 
     blackboxWrite('I');
 
-    blackboxWriteUnsignedVB(blackboxIteration);
+    // The Rice coder adapts from scratch after every I frame, so that the decoder can start at any of them
+    if (blackboxRiceCoding) {
+        blackboxRiceReset();
+    }
+
+    blackboxWriteUnsignedVB(iteration);
     blackboxWriteUnsignedVB(blackboxCurrent->time);
 
     blackboxWriteSignedVBArray(blackboxCurrent->axisPID_Setpoint, XYZ_AXIS_COUNT);
@@ -1006,7 +1276,7 @@ static void writeIntraframe(void)
         blackboxWriteUnsignedVB(blackboxCurrent->motor[0] - getThrottleIdleValue());
 
         //Motors tend to be similar to each other so use the first motor's value as a predictor of the others
-        const int motorCount = getMotorCount();
+        const int motorCount = blackboxMotorCount();
         for (int x = 1; x < motorCount; x++) {
             blackboxWriteSignedVB(blackboxCurrent->motor[x] - blackboxCurrent->motor[0]);
         }
@@ -1068,6 +1338,15 @@ static void writeIntraframe(void)
     blackboxLoggedAnyFrames = true;
 }
 
+static void blackboxWriteAveragedResidual(int32_t value)
+{
+    if (blackboxRiceCoding) {
+        blackboxWriteRice(value);
+    } else {
+        blackboxWriteSignedVB(value);
+    }
+}
+
 static void blackboxWriteArrayUsingAveragePredictor16(int arrOffsetInHistory, int count)
 {
     int16_t *curr  = (int16_t*) ((char*) (blackboxHistory[0]) + arrOffsetInHistory);
@@ -1078,7 +1357,7 @@ static void blackboxWriteArrayUsingAveragePredictor16(int arrOffsetInHistory, in
         // Predictor is the average of the previous two history states
         int32_t predictor = (prev1[i] + prev2[i]) / 2;
 
-        blackboxWriteSignedVB(curr[i] - predictor);
+        blackboxWriteAveragedResidual(curr[i] - predictor);
     }
 }
 
@@ -1092,7 +1371,7 @@ static void blackboxWriteArrayUsingAveragePredictor32(int arrOffsetInHistory, in
         // Predictor is the average of the previous two history states
         int32_t predictor = ((int64_t)prev1[i] + (int64_t)prev2[i]) / 2;
 
-        blackboxWriteSignedVB(curr[i] - predictor);
+        blackboxWriteAveragedResidual(curr[i] - predictor);
     }
 }
 
@@ -1102,6 +1381,7 @@ static void writeInterframe(void)
     blackboxMainState_t *blackboxLast = blackboxHistory[1];
 
     blackboxWrite('P');
+    blackboxRiceBeginFrame();
 
     //No need to store iteration count since its delta is always 1
 
@@ -1111,7 +1391,8 @@ static void writeInterframe(void)
      */
     blackboxWriteSignedVB((int32_t) (blackboxHistory[0]->time - 2 * blackboxHistory[1]->time + blackboxHistory[2]->time));
 
-    int32_t deltas[8];
+    // Room for all the periodically updated sensors below
+    int32_t deltas[16];
     arraySubInt32(deltas, blackboxCurrent->axisPID_Setpoint, blackboxLast->axisPID_Setpoint, XYZ_AXIS_COUNT);
     blackboxWriteSignedVBArray(deltas, XYZ_AXIS_COUNT);
 
@@ -1234,7 +1515,10 @@ static void writeInterframe(void)
         deltas[optionalFieldCount++] = (int32_t) blackboxCurrent->rssi - blackboxLast->rssi;
     }
 
-    blackboxWriteTag8_8SVB(deltas, optionalFieldCount);
+    // A tag holds at most 8 fields, a log viewer reads the rest from the next one
+    for (int i = 0; i < optionalFieldCount; i += 8) {
+        blackboxWriteTag8_8SVB(deltas + i, MIN(optionalFieldCount - i, 8));
+    }
 
     //Since gyros, accs and motors are noisy, base their predictions on the average of the history:
     blackboxWriteArrayUsingAveragePredictor16(offsetof(blackboxMainState_t, gyroADC),   XYZ_AXIS_COUNT);
@@ -1257,7 +1541,7 @@ static void writeInterframe(void)
 
     if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_ACC)) {
         blackboxWriteArrayUsingAveragePredictor16(offsetof(blackboxMainState_t, accADC), XYZ_AXIS_COUNT);
-        blackboxWriteSignedVB(blackboxCurrent->accVib - blackboxLast->accVib);
+        blackboxWriteAveragedResidual(blackboxCurrent->accVib - (blackboxHistory[1]->accVib + blackboxHistory[2]->accVib) / 2);
     }
 
     if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_ATTITUDE)) {
@@ -1269,13 +1553,16 @@ static void writeInterframe(void)
     }
 
     if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_MOTORS)) {
-        blackboxWriteArrayUsingAveragePredictor16(offsetof(blackboxMainState_t, motor),     getMotorCount());
+        blackboxWriteArrayUsingAveragePredictor16(offsetof(blackboxMainState_t, motor),     blackboxMotorCount());
     }
 
     if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_SERVOS)) {
         blackboxWriteArrayUsingAveragePredictor16(offsetof(blackboxMainState_t, servo),     getServoCount());
     }
 
+    // Each run of Rice coded fields ends on a whole byte
+    blackboxRiceFlush();
+
     blackboxWriteSignedVB(blackboxCurrent->navState - blackboxLast->navState);
 
     blackboxWriteSignedVB(blackboxCurrent->navFlags - blackboxLast->navFlags);
@@ -1292,13 +1579,14 @@ static void writeInterframe(void)
         }
 
         for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
-            blackboxWriteSignedVB(blackboxHistory[0]->navRealVel[x] - (blackboxHistory[1]->navRealVel[x] + blackboxHistory[2]->navRealVel[x]) / 2);
+            blackboxWriteAveragedResidual(blackboxHistory[0]->navRealVel[x] - (blackboxHistory[1]->navRealVel[x] + blackboxHistory[2]->navRealVel[x]) / 2);
         }
 
 
         for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
-            blackboxWriteSignedVB(blackboxHistory[0]->navTargetVel[x] - (blackboxHistory[1]->navTargetVel[x] + blackboxHistory[2]->navTargetVel[x]) / 2);
+            blackboxWriteAveragedResidual(blackboxHistory[0]->navTargetVel[x] - (blackboxHistory[1]->navTargetVel[x] + blackboxHistory[2]->navTargetVel[x]) / 2);
         }
+        blackboxRiceFlush();
 
         for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
             blackboxWriteSignedVB(blackboxHistory[0]->navTargetPos[x] - blackboxLast->navTargetPos[x]);
@@ -1310,8 +1598,9 @@ static void writeInterframe(void)
 
     if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_NAV_ACC)) {
         for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
-            blackboxWriteSignedVB(blackboxHistory[0]->navAccNEU[x] - (blackboxHistory[1]->navAccNEU[x] + blackboxHistory[2]->navAccNEU[x]) / 2);
+            blackboxWriteAveragedResidual(blackboxHistory[0]->navAccNEU[x] - (blackboxHistory[1]->navAccNEU[x] + blackboxHistory[2]->navAccNEU[x]) / 2);
         }
+        blackboxRiceFlush();
     }
 
     //Rotate our history buffers
@@ -1322,6 +1611,59 @@ static void writeInterframe(void)
     blackboxLoggedAnyFrames = true;
 }
 
+static int32_t blackboxGroupFieldValue(const blackboxMainState_t *state, const blackboxGroupFieldDefinition_t *def)
+{
+    const char *field = (const char *)state + def->offset;
+
+    switch (def->type) {
+    case BLACKBOX_GROUP_FIELD_S16:
+        return *(const int16_t *)field;
+    case BLACKBOX_GROUP_FIELD_U16:
+        return *(const uint16_t *)field;
+    default:
+        return *(const int32_t *)field;
+    }
+}
+
+/*
+ * Write a group frame: the group number, then each of the group's fields as an absolute value in a "D" frame, or
+ * as the difference from the group's previous frame in a "d" frame.
+ */
+static void writeGroupFrame(const blackboxMainState_t *state, blackboxFieldGroup_e group, bool intraframe)
+{
+    blackboxWrite(intraframe ? 'D' : 'd');
+    blackboxWriteUnsignedVB(group);
+
+    for (unsigned i = 0; i < ARRAYLEN(blackboxGroupFields); i++) {
+        const blackboxGroupFieldDefinition_t *def = &blackboxGroupFields[i];
+
+        if (def->group == group && testBlackboxGroupCondition(def->field.condition)) {
+            const int32_t value = blackboxGroupFieldValue(state, def);
+
+            blackboxWriteSignedVB(intraframe ? value : value - blackboxGroupHistory[i]);
+            blackboxGroupHistory[i] = value;
+        }
+    }
+}
+
+/*
+ * Group frames follow the main frame they were sampled with. Every "I" frame is followed by all groups, so that
+ * the log can be decoded from any "I" frame on.
+ */
+static void writeGroupFrames(const blackboxMainState_t *state, bool intraframe)
+{
+    for (int group = 0; group < BLACKBOX_GROUP_COUNT; group++) {
+        if (blackboxGroupFieldCount[group] == 0) {
+            continue;
+        }
+
+        if (intraframe || ++blackboxGroupFramesSkipped[group] >= blackboxConfig()->groupDivider[group]) {
+            writeGroupFrame(state, group, intraframe);
+            blackboxGroupFramesSkipped[group] = 0;
+        }
+    }
+}
+
 /* Write the contents of the global "slowHistory" to the log as an "S" frame. Because this data is logged so
  * infrequently, delta updates are not reasonable, so we log independent frames. */
 static void writeSlowFrame(void)
@@ -1523,22 +1865,9 @@ static void blackboxResetIterationTimers(void)
     blackboxIFrameIndex = 0;
 }
 
-/**
- * Start Blackbox logging if it is not already running. Intended to be called upon arming.
- */
-void blackboxStart(void)
+// Reset the encoder, so that the next frame it writes can start a log
+static void blackboxResetEncoder(void)
 {
-    if (blackboxState != BLACKBOX_STATE_STOPPED) {
-        return;
-    }
-
-    blackboxValidateConfig();
-
-    if (!blackboxDeviceOpen()) {
-        blackboxSetState(BLACKBOX_STATE_DISABLED);
-        return;
-    }
-
     memset(&gpsHistory, 0, sizeof(gpsHistory));
 
     blackboxHistory[0] = &blackboxHistoryRing[0];
@@ -1555,26 +1884,156 @@ void blackboxStart(void)
      * cache those now.
      */
     blackboxBuildConditionCache();
+    memset(blackboxGroupFramesSkipped, 0, sizeof(blackboxGroupFramesSkipped));
+
+    blackboxRiceCoding = blackboxConfig()->compression == BLACKBOX_COMPRESSION_RICE;
 
     blackboxModeActivationConditionPresent = isModeActivationConditionPresent(BOXBLACKBOX);
 
     blackboxResetIterationTimers();
 
+    blackboxSnapshotHead = 0;
+    blackboxSnapshotTail = 0;
+    blackboxSnapshotResync = false;
+    blackboxGpsHomeDue = false;
+
+#ifdef USE_BLACKBOX_GYRO_RATE
+    blackboxGyroRateHead = 0;
+    blackboxGyroRateTail = 0;
+    blackboxGyroRateFill = 0;
+    blackboxGyroRateChannels = 0;
+    if (blackboxIncludeFlag(BLACKBOX_FEATURE_GYRO_RATE)) {
+        blackboxGyroRateChannels = XYZ_AXIS_COUNT;
+        if (blackboxIncludeFlag(BLACKBOX_FEATURE_GYRO_RATE_MOTORS)) {
+            blackboxGyroRateChannels += MIN(getMotorCount(), BLACKBOX_GYRO_RATE_MAX_MOTORS);
+        }
+    }
+#endif
+
     /*
      * Record the beeper's current idea of the last arming beep time, so that we can detect it changing when
      * it finally plays the beep for this arming event.
      */
     blackboxLastArmingBeep = getArmingBeepTimeMicros();
     memcpy(&blackboxLastRcModeFlags, &rcModeActivationMask, sizeof(blackboxLastRcModeFlags)); // record startup status
+}
+
+/**
+ * Start Blackbox logging if it is not already running. Intended to be called upon arming.
+ */
+void blackboxStart(void)
+{
+#ifdef USE_BLACKBOX_PRETRIGGER
+    if (blackboxState == BLACKBOX_STATE_PRETRIGGER) {
+        // Start the log from the captured frames
+        blackboxTrigger(BLACKBOX_TRIGGER_ARMING);
+        return;
+    }
+#endif
+
+    if (blackboxState != BLACKBOX_STATE_STOPPED) {
+        return;
+    }
+
+    blackboxValidateConfig();
+
+    if (!blackboxDeviceOpen()) {
+        blackboxSetState(BLACKBOX_STATE_DISABLED);
+        return;
+    }
+
+    blackboxResetEncoder();
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+    blackboxLogTrigger = BLACKBOX_TRIGGER_ARMING;
+    blackboxLogPretriggerMs = 0;
+    blackboxPostTriggerEndTime = 0;
+    blackboxFinishPending = false;
+#endif
 
     blackboxSetState(BLACKBOX_STATE_PREPARE_LOG_FILE);
 }
 
+#ifdef USE_BLACKBOX_PRETRIGGER
+/*
+ * The ring holds less than blackbox_pretrigger_ms when the frames don't fit. That is reported in the log header, and
+ * by the status CLI command.
+ */
+static uint32_t blackboxPretriggerHeldMs(void)
+{
+    blackboxPretriggerInfo_t info;
+    blackboxPretriggerGetInfo(&info);
+
+    return MIN(info.span / 1000, blackboxConfig()->pretrigger_ms);
+}
+
+static void blackboxStartCapture(void)
+{
+    blackboxValidateConfig();
+    blackboxResetEncoder();
+
+    blackboxPretriggerReset();
+    blackboxCapturing = true;
+
+    blackboxSetState(BLACKBOX_STATE_PRETRIGGER);
+}
+
+// Called by blackboxUpdate() when a trigger fires while no log is open
+static void blackboxOpenCapturedLog(blackboxTrigger_e trigger)
+{
+    blackboxOpen();
+
+    if (!blackboxDeviceOpen()) {
+        blackboxSetState(BLACKBOX_STATE_DISABLED);
+        return;
+    }
+
+    blackboxLogTrigger = trigger;
+    blackboxLogPretriggerMs = blackboxPretriggerHeldMs();
+    blackboxFinishPending = false;
+
+    blackboxSetState(BLACKBOX_STATE_PREPARE_LOG_FILE);
+}
+#endif
+
+// A triggered log keeps running for the post-trigger time, even with the BLACKBOX mode off
+static bool blackboxInPostTrigger(void)
+{
+#ifdef USE_BLACKBOX_PRETRIGGER
+    return blackboxPostTriggerEndTime != 0 && (int32_t)(millis() - blackboxPostTriggerEndTime) < 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Start a log from the frames captured before the call, if blackbox_pretrigger_ms is set. The trigger is handled by
+ * the next blackboxUpdate(), so this can be called from any task.
+ */
+void blackboxTrigger(blackboxTrigger_e reason)
+{
+#ifdef USE_BLACKBOX_PRETRIGGER
+    if (blackboxPendingTrigger == BLACKBOX_TRIGGER_NONE) {
+        blackboxPendingTrigger = reason;
+    }
+#else
+    UNUSED(reason);
+#endif
+}
+
 /**
  * Begin Blackbox shutdown.
  */
 void blackboxFinish(void)
 {
+#ifdef USE_BLACKBOX_PRETRIGGER
+    // A triggered log ends once the captured frames have been written out
+    if (blackboxCapturing && blackboxState >= BLACKBOX_STATE_PREPARE_LOG_FILE && blackboxState <= BLACKBOX_STATE_SEND_PRETRIGGER) {
+        blackboxFinishPending = true;
+        return;
+    }
+#endif
+
     switch (blackboxState) {
     case BLACKBOX_STATE_DISABLED:
     case BLACKBOX_STATE_STOPPED:
@@ -1582,8 +2041,19 @@ void blackboxFinish(void)
         // We're already stopped/shutting down
         break;
 
+#ifdef USE_BLACKBOX_PRETRIGGER
+    case BLACKBOX_STATE_PRETRIGGER:
+        // Nothing has been written to the device
+        blackboxSetState(BLACKBOX_STATE_STOPPED);
+        break;
+#endif
+
     case BLACKBOX_STATE_RUNNING:
     case BLACKBOX_STATE_PAUSED:
+#ifdef USE_BLACKBOX_PRETRIGGER
+        // Drop the frames captured while paused, the log ends where it was paused
+        blackboxCapturing = false;
+#endif
         blackboxLogEvent(FLIGHT_LOG_EVENT_LOG_END, NULL);
         FALLTHROUGH;
 
@@ -1641,10 +2111,8 @@ static void writeGPSFrame(timeUs_t currentTimeUs)
 /**
  * Fill the current state of the blackbox using values read from the flight controller
  */
-static void loadMainState(timeUs_t currentTimeUs)
+static void loadMainState(blackboxMainState_t *blackboxCurrent, timeUs_t currentTimeUs)
 {
-    blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
-
     blackboxCurrent->time = currentTimeUs;
 
     const navigationPIDControllers_t *nav_pids = getNavigationPIDControllers();
@@ -1761,6 +2229,17 @@ static void loadMainState(timeUs_t currentTimeUs)
     blackboxCurrent->navSurface = navActualSurface;
 }
 
+/*
+ * With Rice coding, every main field which the P frames predict from the average of the previous two frames is Rice
+ * coded instead of signed VB. These are written by blackboxWriteAveragedResidual().
+ */
+static bool isRiceCodedField(const blackboxFieldDefinition_t *def)
+{
+    const blackboxDeltaFieldDefinition_t *deltaDef = (const blackboxDeltaFieldDefinition_t *)def;
+
+    return blackboxRiceCoding && deltaDef->Ppredict == PREDICT(AVERAGE_2) && deltaDef->Pencode == ENCODING(SIGNED_VB);
+}
+
 /**
  * Transmit the header information for the given field definitions. Transmitted header lines look like:
  *
@@ -1771,7 +2250,8 @@ static void loadMainState(timeUs_t currentTimeUs)
  * header (e.g. P, I etc). For blackboxDeltaField_t fields, also provide deltaFrameChar, otherwise set this to zero.
  *
  * Provide an array 'conditions' of FlightLogFieldCondition enums if you want these conditions to decide whether a field
- * should be included or not. Otherwise provide NULL for this parameter and NULL for secondCondition.
+ * should be included or not, and the testCondition function to check them with. Otherwise provide NULL for these
+ * parameters and NULL for secondCondition.
  *
  * Set xmitState.headerIndex to 0 and xmitState.u.fieldIndex to -1 before calling for the first time.
  *
@@ -1781,7 +2261,8 @@ static void loadMainState(timeUs_t currentTimeUs)
  * Returns true if there is still header left to transmit (so call again to continue transmission).
  */
 static bool sendFieldDefinition(char mainFrameChar, char deltaFrameChar, const void *fieldDefinitions,
-        const void *secondFieldDefinition, int fieldCount, const uint8_t *conditions, const uint8_t *secondCondition)
+        const void *secondFieldDefinition, int fieldCount, const uint8_t *conditions, const uint8_t *secondCondition,
+        bool (*testCondition)(FlightLogFieldCondition condition))
 {
     const blackboxFieldDefinition_t *def;
     unsigned int headerCount;
@@ -1824,7 +2305,7 @@ static bool sendFieldDefinition(char mainFrameChar, char deltaFrameChar, const v
     for (; xmitState.u.fieldIndex < fieldCount; xmitState.u.fieldIndex++) {
         def = (const blackboxFieldDefinition_t*) ((const char*)fieldDefinitions + definitionStride * xmitState.u.fieldIndex);
 
-        if (!conditions || testBlackboxCondition(conditions[conditionsStride * xmitState.u.fieldIndex])) {
+        if (!conditions || testCondition(conditions[conditionsStride * xmitState.u.fieldIndex])) {
             // First (over)estimate the length of the string we want to print
 
             int32_t bytesToWrite = 1; // Leading comma
@@ -1859,6 +2340,8 @@ static bool sendFieldDefinition(char mainFrameChar, char deltaFrameChar, const v
                 if (def->fieldNameIndex != -1) {
                     blackboxPrintf("[%d]", def->fieldNameIndex);
                 }
+            } else if (deltaFrameChar == 'P' && xmitState.headerIndex == BLACKBOX_DELTA_FIELD_HEADER_COUNT - 1 && isRiceCodedField(def)) {
+                blackboxPrintf("%d", FLIGHT_LOG_FIELD_ENCODING_RICE);
             } else {
                 //The other headers are integers
                 blackboxPrintf("%d", def->arr[xmitState.headerIndex - 1]);
@@ -1897,6 +2380,40 @@ static char *blackboxGetStartDateTime(char *buf)
                                                break;
 #endif
 
+/*
+ * Send the field definitions of the group frames, followed by the group of each field and the dividers. Returns true
+ * while there is more to send.
+ */
+static bool sendGroupFieldDefinition(void)
+{
+    // The group fields are the ones whose conditions were taken out of the main frames
+    if (sendFieldDefinition('D', 'd', &blackboxGroupFields[0].field, &blackboxGroupFields[1].field, ARRAYLEN(blackboxGroupFields),
+            &blackboxGroupFields[0].field.condition, &blackboxGroupFields[1].field.condition, testBlackboxGroupCondition)) {
+        return true;
+    }
+
+    // The group line, then the interval line
+    if (blackboxDeviceReserveBufferSpace(strlen("H Field D group:") + 2 * ARRAYLEN(blackboxGroupFields) + 1 + 32) != BLACKBOX_RESERVE_SUCCESS) {
+        return true;
+    }
+
+    blackboxHeaderBudget -= blackboxPrint("H Field D group:");
+    bool needComma = false;
+    for (unsigned i = 0; i < ARRAYLEN(blackboxGroupFields); i++) {
+        if (testBlackboxGroupCondition(blackboxGroupFields[i].field.condition)) {
+            blackboxHeaderBudget -= blackboxPrintf(needComma ? ",%d" : "%d", blackboxGroupFields[i].group);
+            needComma = true;
+        }
+    }
+    blackboxHeaderBudget -= blackboxPrint("\n");
+
+    blackboxPrintfHeaderLine("D interval", "%d,%d,%d,%d", blackboxConfig()->groupDivider[BLACKBOX_GROUP_RC],
+        blackboxConfig()->groupDivider[BLACKBOX_GROUP_ATTITUDE], blackboxConfig()->groupDivider[BLACKBOX_GROUP_NAV],
+        blackboxConfig()->groupDivider[BLACKBOX_GROUP_SENSORS]);
+
+    return false;
+}
+
 /**
  * Transmit a portion of the system information headers. Call the first time with xmitState.headerIndex == 0. Returns
  * true iff transmission is complete, otherwise call again later to continue transmission.
@@ -1910,13 +2427,17 @@ static bool blackboxWriteSysinfo(void)
 
     char buf[FORMATTED_DATE_TIME_BUFSIZE];
 
-    switch (xmitState.headerIndex) {
+    // MIN() and ABS() use __COUNTER__ as well, so number the lines from wherever it stands here
+    enum { BLACKBOX_SYSINFO_FIRST_LINE = __COUNTER__ + 1 };
+
+    switch (xmitState.headerIndex + BLACKBOX_SYSINFO_FIRST_LINE) {
         BLACKBOX_PRINT_HEADER_LINE("Firmware type", "%s",                   "Cleanflight");
         BLACKBOX_PRINT_HEADER_LINE("Firmware revision", "INAV %s (%s) %s",  FC_VERSION_STRING, shortGitRevision, targetName);
         BLACKBOX_PRINT_HEADER_LINE("Firmware date", "%s %s",                buildDate, buildTime);
         BLACKBOX_PRINT_HEADER_LINE("Log start datetime", "%s",              blackboxGetStartDateTime(buf));
         BLACKBOX_PRINT_HEADER_LINE("Craft name", "%s",                      systemConfig()->craftName);
         BLACKBOX_PRINT_HEADER_LINE("P interval", "%u/%u",                   blackboxConfig()->rate_num, blackboxConfig()->rate_denom);
+        BLACKBOX_PRINT_HEADER_LINE("P compression", "%d",                   blackboxRiceCoding ? BLACKBOX_COMPRESSION_RICE : BLACKBOX_COMPRESSION_NONE);
         BLACKBOX_PRINT_HEADER_LINE("minthrottle", "%d",                     getThrottleIdleValue());
         BLACKBOX_PRINT_HEADER_LINE("maxthrottle", "%d",                     getMaxThrottle());
         BLACKBOX_PRINT_HEADER_LINE("gyro_scale", "0x%x",                    castFloatBytesToInt(1.0f));
@@ -1925,7 +2446,7 @@ static bool blackboxWriteSysinfo(void)
 
 #ifdef USE_ADC
         BLACKBOX_PRINT_HEADER_LINE_CUSTOM(
-            if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_VBAT)) {
+            if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_VBAT) || testBlackboxGroupCondition(FLIGHT_LOG_FIELD_CONDITION_VBAT)) {
                 blackboxPrintfHeaderLine("vbat_scale", "%u", batteryMetersConfig()->voltage.scale / 10);
             } else {
                 xmitState.headerIndex += 2; // Skip the next two vbat fields too
@@ -2020,6 +2541,23 @@ static bool blackboxWriteSysinfo(void)
         BLACKBOX_PRINT_HEADER_LINE("rpm_gyro_harmonics", "%d",              rpmFilterConfig()->gyro_harmonics);
         BLACKBOX_PRINT_HEADER_LINE("rpm_gyro_min_hz", "%d",                 rpmFilterConfig()->gyro_min_hz);
         BLACKBOX_PRINT_HEADER_LINE("rpm_gyro_q", "%d",                      rpmFilterConfig()->gyro_q);
+#endif
+        BLACKBOX_PRINT_HEADER_LINE("snapshot_queue", "%d",                  BLACKBOX_SNAPSHOT_QUEUE_SIZE);
+        BLACKBOX_PRINT_HEADER_LINE("snapshots_dropped", "%u",               blackboxSnapshotsDropped);
+#ifdef USE_BLACKBOX_PRETRIGGER
+        BLACKBOX_PRINT_HEADER_LINE("pretrigger_ms", "%d",                   blackboxConfig()->pretrigger_ms);
+        BLACKBOX_PRINT_HEADER_LINE("pretrigger_held_ms", "%u",              blackboxLogPretriggerMs);
+        BLACKBOX_PRINT_HEADER_LINE("log_trigger", "%d",                     blackboxLogTrigger);
+#endif
+#ifdef USE_BLACKBOX_GYRO_RATE
+        // Samples per block, gyro sample interval in us, then the motors logged after gyroRaw[0..2]
+        BLACKBOX_PRINT_HEADER_LINE_CUSTOM(
+            if (blackboxGyroRateChannels > 0) {
+                blackboxPrintfHeaderLine("gyro_rate", "%d,%d,%d",           BLACKBOX_GYRO_RATE_BLOCK_SAMPLES,
+                                                                            getGyroLooptime(),
+                                                                            blackboxGyroRateChannels - XYZ_AXIS_COUNT);
+            }
+            );
 #endif
         default:
             return true;
@@ -2029,16 +2567,19 @@ static bool blackboxWriteSysinfo(void)
     return false;
 }
 
-/**
- * Write the given event to the log immediately
- */
-void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data)
+static bool blackboxIsLogging(void)
 {
-    // Only allow events to be logged after headers have been written
-    if (!(blackboxState == BLACKBOX_STATE_RUNNING || blackboxState == BLACKBOX_STATE_PAUSED)) {
-        return;
+#ifdef USE_BLACKBOX_PRETRIGGER
+    if (blackboxCapturing) {
+        return true;
     }
+#endif
 
+    return blackboxState == BLACKBOX_STATE_RUNNING || blackboxState == BLACKBOX_STATE_PAUSED;
+}
+
+static void blackboxWriteEvent(FlightLogEvent event, flightLogEventData_t *data)
+{
     //Shared header for event frames
     blackboxWrite('E');
     blackboxWrite(event);
@@ -2083,7 +2624,7 @@ static void blackboxCheckAndLogArmingBeep(void)
         blackboxLastArmingBeep = getArmingBeepTimeMicros();
         flightLogEvent_syncBeep_t eventData;
         eventData.time = blackboxLastArmingBeep;
-        blackboxLogEvent(FLIGHT_LOG_EVENT_SYNC_BEEP, (flightLogEventData_t *) &eventData);
+        blackboxWriteEvent(FLIGHT_LOG_EVENT_SYNC_BEEP, (flightLogEventData_t *) &eventData);
     }
 }
 
@@ -2096,7 +2637,7 @@ static void blackboxCheckAndLogFlightMode(void)
         eventData.lastFlags = blackboxLastRcModeFlags;
         memcpy(&blackboxLastRcModeFlags, &rcModeActivationMask, sizeof(blackboxLastRcModeFlags));
         memcpy(&eventData.flags, &rcModeActivationMask, sizeof(eventData.flags));
-        blackboxLogEvent(FLIGHT_LOG_EVENT_FLIGHTMODE, (flightLogEventData_t *)&eventData);
+        blackboxWriteEvent(FLIGHT_LOG_EVENT_FLIGHTMODE, (flightLogEventData_t *)&eventData);
     }
 }
 
@@ -2130,35 +2671,98 @@ static void blackboxAdvanceIterationTimers(void)
     }
 }
 
-// Called once every FC loop in order to log the current state
-static void blackboxLogIteration(timeUs_t currentTimeUs)
+// Called once every FC loop in order to queue the current state, if this iteration is logged
+static void blackboxQueueIteration(timeUs_t currentTimeUs)
+{
+    /*
+     * The GPS home frame is written every 128 intraframes (~10 seconds). The iteration it falls on is not
+     * necessarily a logged one, so leave the encoder a note to write it with the next frame.
+     */
+    if (blackboxPFrameIndex == (blackboxIFrameInterval / 2) && blackboxIFrameIndex % 128 == 0) {
+        blackboxGpsHomeDue = true;
+    }
+
+    // Only I-frame iterations and the P-frames selected by the user's num/denom settings are queued
+    if (!blackboxShouldLogIFrame() && !blackboxShouldLogPFrame(blackboxPFrameIndex)) {
+        return;
+    }
+
+    const uint8_t head = blackboxSnapshotHead;
+    const uint8_t depth = head - __atomic_load_n(&blackboxSnapshotTail, __ATOMIC_ACQUIRE);
+    if (depth >= BLACKBOX_SNAPSHOT_QUEUE_SIZE) {
+        blackboxSnapshotsDropped++;
+        blackboxSnapshotResync = true;
+        return;
+    }
+
+    blackboxSnapshot_t *snapshot = &blackboxSnapshotQueue[head & (BLACKBOX_SNAPSHOT_QUEUE_SIZE - 1)];
+    snapshot->iteration = blackboxIteration;
+    snapshot->intraframe = blackboxShouldLogIFrame() || blackboxSnapshotResync;
+    loadMainState(&snapshot->state, currentTimeUs);
+
+    blackboxSnapshotResync = false;
+    blackboxSnapshotMaxDepth = MAX(blackboxSnapshotMaxDepth, depth + 1);
+    __atomic_store_n(&blackboxSnapshotHead, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+}
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+/*
+ * A captured log may start at any keyframe, so each one carries the slow and GPS home frames which the decoder would
+ * otherwise only find further back.
+ */
+static void blackboxWriteCaptureKeyframe(const blackboxSnapshot_t *snapshot)
+{
+    // Old keyframes are only dropped while waiting for a trigger, a triggered log keeps all of them
+    const bool waiting = blackboxState == BLACKBOX_STATE_PRETRIGGER || blackboxState == BLACKBOX_STATE_PAUSED;
+
+    blackboxDeviceSetCapture(true);
+    blackboxPretriggerMarkKeyframe(snapshot->iteration, snapshot->state.time, waiting ? MS2US((uint32_t)blackboxConfig()->pretrigger_ms) : 0);
+
+#ifdef USE_GPS
+    if (feature(FEATURE_GPS)) {
+        writeGPSHomeFrame();
+    }
+#endif
+
+    loadSlowState(&slowHistory);
+    writeSlowFrame();
+}
+#endif
+
+static void blackboxEncodeSnapshot(const blackboxSnapshot_t *snapshot)
 {
-    // Write a keyframe every BLACKBOX_I_INTERVAL frames so we can resynchronise upon missing frames
-    if (blackboxShouldLogIFrame()) {
+    memcpy(blackboxHistory[0], &snapshot->state, sizeof(blackboxMainState_t));
+
+    if (snapshot->intraframe) {
+#ifdef USE_BLACKBOX_PRETRIGGER
+        if (blackboxCapturing) {
+            blackboxWriteCaptureKeyframe(snapshot);
+        } else
+#endif
         /*
          * Don't log a slow frame if the slow data didn't change ("I" frames are already large enough without adding
          * an additional item to write at the same time). Unless we're *only* logging "I" frames, then we have no choice.
          */
         writeSlowFrameIfNeeded(blackboxIsOnlyLoggingIntraframes());
 
-        loadMainState(currentTimeUs);
-        writeIntraframe();
+        writeIntraframe(snapshot->iteration);
+        writeGroupFrames(&snapshot->state, true);
     } else {
         blackboxCheckAndLogArmingBeep();
         blackboxCheckAndLogFlightMode();
 
-        if (blackboxShouldLogPFrame(blackboxPFrameIndex)) {
-            /*
-             * We assume that slow frames are only interesting in that they aid the interpretation of the main data stream.
-             * So only log slow frames during loop iterations where we log a main frame.
-             */
-            writeSlowFrameIfNeeded(true);
+        /*
+         * We assume that slow frames are only interesting in that they aid the interpretation of the main data stream.
+         * So only log slow frames during loop iterations where we log a main frame.
+         */
+        writeSlowFrameIfNeeded(true);
 
-            loadMainState(currentTimeUs);
-            writeInterframe();
-        }
+        writeInterframe();
+        writeGroupFrames(&snapshot->state, false);
 #ifdef USE_GPS
         if (feature(FEATURE_GPS)) {
+            const timeUs_t currentTimeUs = snapshot->state.time;
+
             /*
              * If the GPS home point has been updated, or every 128 intraframes (~10 seconds), write the
              * GPS home position.
@@ -2166,8 +2770,8 @@ static void blackboxLogIteration(timeUs_t currentTimeUs)
              * We write it periodically so that if one Home Frame goes missing, the GPS coordinates can
              * still be interpreted correctly.
              */
-            if (GPS_home.lat != gpsHistory.GPS_home[0] || GPS_home.lon != gpsHistory.GPS_home[1]
-                || (blackboxPFrameIndex == (blackboxIFrameInterval / 2) && blackboxIFrameIndex % 128 == 0)) {
+            if (GPS_home.lat != gpsHistory.GPS_home[0] || GPS_home.lon != gpsHistory.GPS_home[1] || blackboxGpsHomeDue) {
+                blackboxGpsHomeDue = false;
 
                 writeGPSHomeFrame();
                 writeGPSFrame(currentTimeUs);
@@ -2180,9 +2784,184 @@ static void blackboxLogIteration(timeUs_t currentTimeUs)
 #endif
     }
 
-    //Flush every iteration so that our runtime variance is minimized
+    //Flush every frame so that our runtime variance is minimized
+    blackboxDeviceFlush();
+}
+
+#ifdef USE_BLACKBOX_GYRO_RATE
+/*
+ * An "R" frame holds one block of gyro rate samples: the time of its first and last sample, the sample count, then
+ * each channel as a delta packed block.
+ */
+static void writeGyroRateFrame(const blackboxGyroRateBlock_t *block)
+{
+    blackboxWrite('R');
+
+    blackboxWriteUnsignedVB(block->startTime);
+    blackboxWriteUnsignedVB(block->endTime - block->startTime);
+    blackboxWriteUnsignedVB(BLACKBOX_GYRO_RATE_BLOCK_SAMPLES);
+
+    for (int channel = 0; channel < blackboxGyroRateChannels; channel++) {
+        blackboxWriteDeltaPackedBlock(&block->samples[0][channel], BLACKBOX_GYRO_RATE_BLOCK_SAMPLES, BLACKBOX_GYRO_RATE_MAX_CHANNELS);
+    }
+
+    blackboxDeviceFlush();
+}
+#endif
+
+// Encode everything the PID loop and the gyro task have queued so far
+static void blackboxEncodeQueuedSnapshots(void)
+{
+    uint8_t tail = blackboxSnapshotTail;
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+    blackboxDeviceSetCapture(blackboxCapturing);
+#endif
+
+    while (blackboxIsLogging() && tail != __atomic_load_n(&blackboxSnapshotHead, __ATOMIC_ACQUIRE)) {
+        blackboxEncodeSnapshot(&blackboxSnapshotQueue[tail & (BLACKBOX_SNAPSHOT_QUEUE_SIZE - 1)]);
+        __atomic_store_n(&blackboxSnapshotTail, ++tail, __ATOMIC_RELEASE);
+    }
+
+#ifdef USE_BLACKBOX_GYRO_RATE
+    tail = blackboxGyroRateTail;
+
+    while (blackboxIsLogging() && tail != __atomic_load_n(&blackboxGyroRateHead, __ATOMIC_ACQUIRE)) {
+        writeGyroRateFrame(&blackboxGyroRateQueue[tail & (BLACKBOX_GYRO_RATE_QUEUE_SIZE - 1)]);
+        __atomic_store_n(&blackboxGyroRateTail, ++tail, __ATOMIC_RELEASE);
+    }
+#endif
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+    blackboxDeviceSetCapture(false);
+#endif
+}
+
+void blackboxEncodeTask(timeUs_t currentTimeUs)
+{
+    UNUSED(currentTimeUs);
+
+    blackboxEncodeQueuedSnapshots();
+}
+
+/**
+ * Write the given event to the log, after the frames that are still queued
+ */
+void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data)
+{
+    // Only allow events to be logged after headers have been written
+    if (!blackboxIsLogging()) {
+        return;
+    }
+
+    blackboxEncodeQueuedSnapshots();
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+    blackboxDeviceSetCapture(blackboxCapturing);
+#endif
+
+    blackboxWriteEvent(event, data);
+    blackboxDeviceFlush();
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+    blackboxDeviceSetCapture(false);
+#endif
+}
+
+void blackboxGetSnapshotQueueInfo(blackboxSnapshotQueueInfo_t *info)
+{
+    info->size = BLACKBOX_SNAPSHOT_QUEUE_SIZE;
+    info->maxDepth = blackboxSnapshotMaxDepth;
+    info->dropped = blackboxSnapshotsDropped;
+}
+
+/**
+ * Called by the gyro task after every gyro sample
+ */
+void blackboxLogGyroSample(timeUs_t currentTimeUs)
+{
+#ifdef USE_BLACKBOX_GYRO_RATE
+    bool logging = blackboxState == BLACKBOX_STATE_RUNNING;
+#ifdef USE_BLACKBOX_PRETRIGGER
+    logging = logging || blackboxCapturing;
+#endif
+
+    // A partly filled block is dropped whenever the log stops or pauses
+    if (blackboxGyroRateChannels == 0 || !logging) {
+        blackboxGyroRateFill = 0;
+        return;
+    }
+
+    const uint8_t head = blackboxGyroRateHead;
+    if ((uint8_t)(head - __atomic_load_n(&blackboxGyroRateTail, __ATOMIC_ACQUIRE)) >= BLACKBOX_GYRO_RATE_QUEUE_SIZE) {
+        blackboxGyroRateSamplesDropped += blackboxGyroRateFill + 1;
+        blackboxGyroRateFill = 0;
+        return;
+    }
+
+    blackboxGyroRateBlock_t *block = &blackboxGyroRateQueue[head & (BLACKBOX_GYRO_RATE_QUEUE_SIZE - 1)];
+    int16_t *sample = block->samples[blackboxGyroRateFill];
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        sample[axis] = lrintf(gyro.gyroRaw[axis]);
+    }
+    for (int i = XYZ_AXIS_COUNT; i < blackboxGyroRateChannels; i++) {
+        sample[i] = motor[i - XYZ_AXIS_COUNT];
+    }
+
+    if (blackboxGyroRateFill == 0) {
+        block->startTime = currentTimeUs;
+    }
+    block->endTime = currentTimeUs;
+
+    if (++blackboxGyroRateFill == BLACKBOX_GYRO_RATE_BLOCK_SAMPLES) {
+        blackboxGyroRateFill = 0;
+        __atomic_store_n(&blackboxGyroRateHead, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+    }
+#else
+    UNUSED(currentTimeUs);
+#endif
+}
+
+bool blackboxGetGyroRateInfo(blackboxGyroRateInfo_t *info)
+{
+#ifdef USE_BLACKBOX_GYRO_RATE
+    info->channels = blackboxGyroRateChannels;
+    info->blockSamples = BLACKBOX_GYRO_RATE_BLOCK_SAMPLES;
+    info->droppedSamples = blackboxGyroRateSamplesDropped;
+    return true;
+#else
+    UNUSED(info);
+    return false;
+#endif
+}
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+// Called by blackboxUpdate() when a trigger fires while the log is paused
+static void blackboxResumeCapturedLog(blackboxTrigger_e trigger, timeUs_t currentTimeUs)
+{
+    blackboxEncodeQueuedSnapshots();
+
+    // Write a log entry so the decoder is aware that our large time/iteration skip is intended
+    flightLogEvent_loggingResume_t resume;
+    blackboxPretriggerKeyframe_t keyframe;
+
+    if (blackboxPretriggerOldestKeyframe(&keyframe)) {
+        resume.logIteration = keyframe.iteration;
+        resume.currentTimeUs = keyframe.time;
+    } else {
+        resume.logIteration = blackboxIteration;
+        resume.currentTimeUs = currentTimeUs;
+    }
+
+    blackboxWriteEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
     blackboxDeviceFlush();
+
+    blackboxLogTrigger = trigger;
+    blackboxLogPretriggerMs = blackboxPretriggerHeldMs();
+    blackboxSetState(BLACKBOX_STATE_SEND_PRETRIGGER);
 }
+#endif
 
 /**
  * Call each flight loop iteration to perform blackbox logging.
@@ -2193,7 +2972,38 @@ void blackboxUpdate(timeUs_t currentTimeUs)
         blackboxReplenishHeaderBudget();
     }
 
+#ifdef USE_BLACKBOX_PRETRIGGER
+    const blackboxTrigger_e trigger = blackboxPendingTrigger;
+    blackboxPendingTrigger = BLACKBOX_TRIGGER_NONE;
+
+    if (trigger != BLACKBOX_TRIGGER_NONE) {
+        blackboxPostTriggerEndTime = millis() + blackboxConfig()->pretrigger_ms;
+
+        // With nothing captured yet, the log has to start with an "I" frame
+        if (blackboxCapturing && blackboxPretriggerPendingBytes() == 0) {
+            blackboxSnapshotResync = true;
+        }
+    }
+
+    if (blackboxCapturing) {
+        blackboxQueueIteration(currentTimeUs);
+        blackboxAdvanceIterationTimers();
+    }
+#endif
+
     switch (blackboxState) {
+#ifdef USE_BLACKBOX_PRETRIGGER
+    case BLACKBOX_STATE_STOPPED:
+        if (blackboxConfig()->pretrigger_ms > 0 && !ARMING_FLAG(ARMED)) {
+            blackboxStartCapture();
+        }
+        break;
+    case BLACKBOX_STATE_PRETRIGGER:
+        if (trigger != BLACKBOX_TRIGGER_NONE) {
+            blackboxOpenCapturedLog(trigger);
+        }
+        break;
+#endif
     case BLACKBOX_STATE_PREPARE_LOG_FILE:
         if (blackboxDeviceBeginLog()) {
             blackboxSetState(BLACKBOX_STATE_SEND_HEADER);
@@ -2223,7 +3033,7 @@ void blackboxUpdate(timeUs_t currentTimeUs)
     case BLACKBOX_STATE_SEND_MAIN_FIELD_HEADER:
         //On entry of this state, xmitState.headerIndex is 0 and xmitState.u.fieldIndex is -1
         if (!sendFieldDefinition('I', 'P', blackboxMainFields, blackboxMainFields + 1, ARRAYLEN(blackboxMainFields),
-                &blackboxMainFields[0].condition, &blackboxMainFields[1].condition)) {
+                &blackboxMainFields[0].condition, &blackboxMainFields[1].condition, testBlackboxCondition)) {
 #ifdef USE_GPS
             if (feature(FEATURE_GPS)) {
                 blackboxSetState(BLACKBOX_STATE_SEND_GPS_H_HEADER);
@@ -2236,14 +3046,14 @@ void blackboxUpdate(timeUs_t currentTimeUs)
     case BLACKBOX_STATE_SEND_GPS_H_HEADER:
         //On entry of this state, xmitState.headerIndex is 0 and xmitState.u.fieldIndex is -1
         if (!sendFieldDefinition('H', 0, blackboxGpsHFields, blackboxGpsHFields + 1, ARRAYLEN(blackboxGpsHFields),
-                NULL, NULL)) {
+                NULL, NULL, NULL)) {
             blackboxSetState(BLACKBOX_STATE_SEND_GPS_G_HEADER);
         }
         break;
     case BLACKBOX_STATE_SEND_GPS_G_HEADER:
         //On entry of this state, xmitState.headerIndex is 0 and xmitState.u.fieldIndex is -1
         if (!sendFieldDefinition('G', 0, blackboxGpsGFields, blackboxGpsGFields + 1, ARRAYLEN(blackboxGpsGFields),
-                &blackboxGpsGFields[0].condition, &blackboxGpsGFields[1].condition)) {
+                &blackboxGpsGFields[0].condition, &blackboxGpsGFields[1].condition, testBlackboxCondition)) {
             blackboxSetState(BLACKBOX_STATE_SEND_SLOW_HEADER);
         }
         break;
@@ -2251,7 +3061,13 @@ void blackboxUpdate(timeUs_t currentTimeUs)
     case BLACKBOX_STATE_SEND_SLOW_HEADER:
         //On entry of this state, xmitState.headerIndex is 0 and xmitState.u.fieldIndex is -1
         if (!sendFieldDefinition('S', 0, blackboxSlowFields, blackboxSlowFields + 1, ARRAYLEN(blackboxSlowFields),
-                NULL, NULL)) {
+                NULL, NULL, NULL)) {
+            blackboxSetState(blackboxGroupConditionCache ? BLACKBOX_STATE_SEND_GROUP_HEADER : BLACKBOX_STATE_SEND_SYSINFO);
+        }
+        break;
+    case BLACKBOX_STATE_SEND_GROUP_HEADER:
+        //On entry of this state, xmitState.headerIndex is 0 and xmitState.u.fieldIndex is -1
+        if (!sendGroupFieldDefinition()) {
             blackboxSetState(BLACKBOX_STATE_SEND_SYSINFO);
         }
         break;
@@ -2266,11 +3082,38 @@ void blackboxUpdate(timeUs_t currentTimeUs)
              * could wipe out the end of the header if we weren't careful)
              */
             if (blackboxDeviceFlushForce()) {
+#ifdef USE_BLACKBOX_PRETRIGGER
+                if (blackboxCapturing) {
+                    blackboxSetState(BLACKBOX_STATE_SEND_PRETRIGGER);
+                } else
+#endif
                 blackboxSetState(BLACKBOX_STATE_RUNNING);
             }
         }
         break;
+#ifdef USE_BLACKBOX_PRETRIGGER
+    case BLACKBOX_STATE_SEND_PRETRIGGER:
+        // The frames captured since the trigger are in the ring too, switch to the device once it has been emptied
+        if (blackboxDeviceWritePretrigger()) {
+            blackboxCapturing = false;
+            blackboxSetState(BLACKBOX_STATE_RUNNING);
+
+            if (blackboxFinishPending) {
+                blackboxFinishPending = false;
+                blackboxFinish();
+            }
+        }
+        break;
+#endif
     case BLACKBOX_STATE_PAUSED:
+#ifdef USE_BLACKBOX_PRETRIGGER
+        if (blackboxCapturing) {
+            if (trigger != BLACKBOX_TRIGGER_NONE || IS_RC_MODE_ACTIVE(BOXBLACKBOX)) {
+                blackboxResumeCapturedLog(trigger != BLACKBOX_TRIGGER_NONE ? trigger : BLACKBOX_TRIGGER_MODE, currentTimeUs);
+            }
+            break;
+        }
+#endif
         // Only allow resume to occur during an I-frame iteration, so that we have an "I" base to work from
         if (IS_RC_MODE_ACTIVE(BOXBLACKBOX) && blackboxShouldLogIFrame()) {
             // Write a log entry so the decoder is aware that our large time/iteration skip is intended
@@ -2282,17 +3125,31 @@ void blackboxUpdate(timeUs_t currentTimeUs)
             blackboxLogEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
             blackboxSetState(BLACKBOX_STATE_RUNNING);
 
-            blackboxLogIteration(currentTimeUs);
+            blackboxQueueIteration(currentTimeUs);
         }
         // Keep the logging timers ticking so our log iteration continues to advance
         blackboxAdvanceIterationTimers();
         break;
     case BLACKBOX_STATE_RUNNING:
         // On entry to this state, blackboxIteration, blackboxPFrameIndex and blackboxIFrameIndex are reset to 0
-        if (blackboxModeActivationConditionPresent && !IS_RC_MODE_ACTIVE(BOXBLACKBOX)) {
+#ifdef USE_BLACKBOX_PRETRIGGER
+        // A log triggered while disarmed ends after the post-trigger time, unless the craft has been armed since
+        if (blackboxLogTrigger != BLACKBOX_TRIGGER_ARMING && !ARMING_FLAG(ARMED) && !blackboxInPostTrigger()) {
+            blackboxFinish();
+            break;
+        }
+
+#endif
+        if (blackboxModeActivationConditionPresent && !IS_RC_MODE_ACTIVE(BOXBLACKBOX) && !blackboxInPostTrigger()) {
             blackboxSetState(BLACKBOX_STATE_PAUSED);
+#ifdef USE_BLACKBOX_PRETRIGGER
+            if (blackboxConfig()->pretrigger_ms > 0) {
+                blackboxPretriggerReset();
+                blackboxCapturing = true;
+            }
+#endif
         } else {
-            blackboxLogIteration(currentTimeUs);
+            blackboxQueueIteration(currentTimeUs);
         }
         blackboxAdvanceIterationTimers();
         break;
@@ -2314,7 +3171,7 @@ void blackboxUpdate(timeUs_t currentTimeUs)
     }
 
     // Did we run out of room on the device? Stop!
-    if (isBlackboxDeviceFull()) {
+    if (blackboxState != BLACKBOX_STATE_PRETRIGGER && isBlackboxDeviceFull()) {
         blackboxSetState(BLACKBOX_STATE_STOPPED);
     }
 }
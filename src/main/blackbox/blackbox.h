@@ -36,24 +36,71 @@ typedef enum {
     BLACKBOX_FEATURE_GYRO_PEAKS_PITCH   = 1 << 11,
     BLACKBOX_FEATURE_GYRO_PEAKS_YAW     = 1 << 12,
     BLACKBOX_FEATURE_SERVOS             = 1 << 13,
+    BLACKBOX_FEATURE_GYRO_RATE          = 1 << 14,
+    BLACKBOX_FEATURE_GYRO_RATE_MOTORS   = 1 << 15,
 } blackboxFeatureMask_e;
+// Field groups which can be logged at a lower rate than the main frames
+typedef enum {
+    BLACKBOX_GROUP_RC = 0,
+    BLACKBOX_GROUP_ATTITUDE,
+    BLACKBOX_GROUP_NAV,
+    BLACKBOX_GROUP_SENSORS,
+    BLACKBOX_GROUP_COUNT
+} blackboxFieldGroup_e;
+
+typedef enum {
+    BLACKBOX_COMPRESSION_NONE = 0,
+    BLACKBOX_COMPRESSION_RICE,
+} blackboxCompression_e;
+
 typedef struct blackboxConfig_s {
     uint16_t rate_num;
     uint16_t rate_denom;
     uint8_t device;
     uint8_t invertedCardDetection;
     uint32_t includeFlags;
+    uint16_t pretrigger_ms;
+    uint8_t groupDivider[BLACKBOX_GROUP_COUNT];   // Log the group every this many main frames, 1 keeps it in the main frames
+    uint8_t compression;                        // blackboxCompression_e
 } blackboxConfig_t;
 
 PG_DECLARE(blackboxConfig_t, blackboxConfig);
 
+typedef struct blackboxSnapshotQueueInfo_s {
+    uint16_t size;
+    uint16_t maxDepth;
+    uint32_t dropped;
+} blackboxSnapshotQueueInfo_t;
+
+typedef enum {
+    BLACKBOX_TRIGGER_NONE = 0,
+    BLACKBOX_TRIGGER_ARMING,
+    BLACKBOX_TRIGGER_MODE,
+    BLACKBOX_TRIGGER_FAILSAFE,
+    BLACKBOX_TRIGGER_LANDING,
+    BLACKBOX_TRIGGER_LOGIC_CONDITION,
+} blackboxTrigger_e;
+
 void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data);
 
 void blackboxInit(void);
 void blackboxUpdate(timeUs_t currentTimeUs);
+void blackboxEncodeTask(timeUs_t currentTimeUs);
 void blackboxStart(void);
 void blackboxFinish(void);
+void blackboxTrigger(blackboxTrigger_e reason);
 bool blackboxMayEditConfig(void);
+void blackboxConfigChanged(void);
 void blackboxIncludeFlagSet(uint32_t mask);
 void blackboxIncludeFlagClear(uint32_t mask);
 bool blackboxIncludeFlag(uint32_t mask);
+void blackboxGetSnapshotQueueInfo(blackboxSnapshotQueueInfo_t *info);
+
+typedef struct blackboxGyroRateInfo_s {
+    uint8_t channels;
+    uint8_t blockSamples;
+    uint32_t droppedSamples;    // Since boot
+} blackboxGyroRateInfo_t;
+
+void blackboxLogGyroSample(timeUs_t currentTimeUs);
+bool blackboxGetGyroRateInfo(blackboxGyroRateInfo_t *info);
@@ -365,6 +365,186 @@ void blackboxWriteTag8_8SVB(int32_t *values, int valueCount)
     }
 }
 
+/**
+ * Write `count` samples, read `stride` values apart, using frame-of-reference bit packing of their differences:
+ *
+ * - the first sample, signed VB
+ * - the smallest difference between two consecutive samples, signed VB
+ * - a one byte bit width, enough for the largest difference above that smallest one
+ * - each difference above the smallest one in that many bits, LSB first, padded to a whole byte
+ *
+ * A noisy but continuous signal only needs a few bits per sample, and a constant one none at all.
+ */
+void blackboxWriteDeltaPackedBlock(const int16_t *samples, int count, int stride)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    blackboxWriteSignedVB(samples[0]);
+
+    if (count == 1) {
+        return;
+    }
+
+    int32_t minDelta = INT32_MAX;
+    int32_t maxDelta = INT32_MIN;
+
+    for (int i = 1; i < count; i++) {
+        const int32_t delta = samples[i * stride] - samples[(i - 1) * stride];
+
+        if (delta < minDelta) {
+            minDelta = delta;
+        }
+        if (delta > maxDelta) {
+            maxDelta = delta;
+        }
+    }
+
+    const uint32_t range = maxDelta - minDelta;
+    const int width = range ? 32 - __builtin_clz(range) : 0;
+
+    blackboxWriteSignedVB(minDelta);
+    blackboxWrite(width);
+
+    if (width == 0) {
+        return;
+    }
+
+    // At most 7 bits wait in here, plus a difference of at most 17 bits
+    uint32_t bits = 0;
+    int bitCount = 0;
+
+    for (int i = 1; i < count; i++) {
+        const uint32_t value = samples[i * stride] - samples[(i - 1) * stride] - minDelta;
+
+        bits |= value << bitCount;
+        bitCount += width;
+
+        while (bitCount >= 8) {
+            blackboxWrite(bits);
+            bits >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    if (bitCount > 0) {
+        blackboxWrite(bits);
+    }
+}
+
+/*
+ * Adaptive Rice coding for residuals which are small most of the time, like the gyro and motors after the average
+ * predictor. Each value is zigzag mapped to an unsigned u and written with a parameter k as:
+ * - u >> k in unary, as that many one bits followed by a zero bit
+ * - the low k bits of u
+ * A quotient of BLACKBOX_RICE_ESCAPE or more is written as BLACKBOX_RICE_ESCAPE one bits and u in 32 bits instead.
+ *
+ * The nth value written in a frame uses the nth context, which keeps the sum and the count of the values it has
+ * seen. k is the smallest with count << k >= sum, so it follows the magnitude of each field. The decoder repeats the
+ * same adaptation, from the same reset state at every I frame.
+ *
+ * The bits are written LSB first. A run of Rice coded values is padded to a whole byte by blackboxRiceFlush().
+ */
+#define BLACKBOX_RICE_CONTEXTS      128
+#define BLACKBOX_RICE_MAX_K         20
+#define BLACKBOX_RICE_ESCAPE        20
+#define BLACKBOX_RICE_MAX_SAMPLE    (1 << 24)   // Larger values count as this much, so the sum can't overflow
+#define BLACKBOX_RICE_HALVE_COUNT   32
+#define BLACKBOX_RICE_INITIAL_SUM   4
+
+typedef struct blackboxRiceContext_s {
+    uint32_t sum;
+    uint32_t count;
+} blackboxRiceContext_t;
+
+static blackboxRiceContext_t riceContexts[BLACKBOX_RICE_CONTEXTS];
+static unsigned riceContextIndex;
+
+// At most 7 bits wait in here between writes
+static uint32_t riceBits;
+static int riceBitCount;
+
+void blackboxRiceReset(void)
+{
+    for (int i = 0; i < BLACKBOX_RICE_CONTEXTS; i++) {
+        riceContexts[i].sum = BLACKBOX_RICE_INITIAL_SUM;
+        riceContexts[i].count = 1;
+    }
+
+    riceContextIndex = 0;
+    riceBits = 0;
+    riceBitCount = 0;
+}
+
+void blackboxRiceBeginFrame(void)
+{
+    riceContextIndex = 0;
+}
+
+// Write up to 24 bits
+static void riceWriteBits(uint32_t value, int count)
+{
+    riceBits |= value << riceBitCount;
+    riceBitCount += count;
+
+    while (riceBitCount >= 8) {
+        blackboxWrite(riceBits);
+        riceBits >>= 8;
+        riceBitCount -= 8;
+    }
+}
+
+void blackboxWriteRice(int32_t value)
+{
+    // Fields past the last context share it, the decoder does the same
+    blackboxRiceContext_t *context = &riceContexts[riceContextIndex];
+    if (riceContextIndex < BLACKBOX_RICE_CONTEXTS - 1) {
+        riceContextIndex++;
+    }
+
+    const uint32_t u = zigzagEncode(value);
+
+    // The smallest k with count << k >= sum
+    const uint32_t mean = (context->sum + context->count - 1) / context->count;
+    int k = mean > 1 ? 32 - __builtin_clz(mean - 1) : 0;
+    if (k > BLACKBOX_RICE_MAX_K) {
+        k = BLACKBOX_RICE_MAX_K;
+    }
+
+    const uint32_t quotient = u >> k;
+
+    if (quotient < BLACKBOX_RICE_ESCAPE) {
+        riceWriteBits((1 << quotient) - 1, quotient + 1);
+        if (k > 0) {
+            riceWriteBits(u & ((1 << k) - 1), k);
+        }
+    } else {
+        riceWriteBits((1 << BLACKBOX_RICE_ESCAPE) - 1, BLACKBOX_RICE_ESCAPE);
+        riceWriteBits(u & 0xFFFF, 16);
+        riceWriteBits(u >> 16, 16);
+    }
+
+    context->sum += u < BLACKBOX_RICE_MAX_SAMPLE ? u : BLACKBOX_RICE_MAX_SAMPLE;
+    context->count++;
+
+    if (context->count >= BLACKBOX_RICE_HALVE_COUNT) {
+        context->sum >>= 1;
+        context->count >>= 1;
+    }
+}
+
+// Pad the Rice coded values written so far to a whole byte
+void blackboxRiceFlush(void)
+{
+    if (riceBitCount > 0) {
+        blackboxWrite(riceBits);
+    }
+
+    riceBits = 0;
+    riceBitCount = 0;
+}
+
 /** Write unsigned integer **/
 void blackboxWriteU32(int32_t value)
 {
@@ -29,5 +29,10 @@ void blackboxWriteS16(int16_t value);
 void blackboxWriteTag2_3S32(int32_t *values);
 void blackboxWriteTag8_4S16(int32_t *values);
 void blackboxWriteTag8_8SVB(int32_t *values, int valueCount);
+void blackboxWriteDeltaPackedBlock(const int16_t *samples, int count, int stride);
+void blackboxRiceReset(void);
+void blackboxRiceBeginFrame(void);
+void blackboxWriteRice(int32_t value);
+void blackboxRiceFlush(void);
 void blackboxWriteU32(int32_t value);
 void blackboxWriteFloat(float value);
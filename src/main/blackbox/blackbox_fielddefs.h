@@ -152,7 +152,9 @@ typedef enum FlightLogFieldEncoding {
     FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB       = 6,
     FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32       = 7,
     FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16       = 8,
-    FLIGHT_LOG_FIELD_ENCODING_NULL            = 9 // Nothing is written to the file, take value to be zero
+    FLIGHT_LOG_FIELD_ENCODING_NULL            = 9, // Nothing is written to the file, take value to be zero
+    // 10 is TAG2_3SVARIABLE in other Cleanflight derived firmware
+    FLIGHT_LOG_FIELD_ENCODING_RICE            = 11 // Adaptive Rice code, consecutive fields share a bit stream padded to a byte
 } FlightLogFieldEncoding;
 
 typedef enum FlightLogFieldSign {
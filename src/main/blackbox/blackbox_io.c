@@ -19,17 +19,18 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include "platform.h"
+
 #if defined(SITL_BUILD)
 #include <stdio.h>
 #include <time.h>
 #endif
 
-#include "platform.h"
-
 #ifdef USE_BLACKBOX
 
 #include "blackbox.h"
 #include "blackbox_io.h"
+#include "blackbox_pretrigger.h"
 
 #include "common/axis.h"
 #include "common/encoding.h"
@@ -44,6 +45,11 @@
 #include "drivers/sdcard/sdcard.h"
 #endif
 
+#if defined(SITL_BUILD)
+#include "drivers/file_sink.h"
+#include "target/SITL/lockstep.h"
+#endif
+
 #include "io/asyncfatfs/asyncfatfs.h"
 #include "io/flashfs.h"
 #include "io/serial.h"
@@ -87,9 +93,33 @@ static struct {
 #endif
 
 #if defined(SITL_BUILD)
-static struct {
-    FILE *file_handler;
-} blackboxFile;
+/*
+ * The log file is written by a thread of its own, so that a slow disk doesn't stall the PID loop. Frames which
+ * don't fit the buffers while the disk is behind are dropped whole, blackboxDeviceFlush() marks where they end.
+ */
+#ifndef BLACKBOX_FILE_BUFFER_SIZE
+#define BLACKBOX_FILE_BUFFER_SIZE   (4 * 1024 * 1024)
+#endif
+
+STATIC_UNIT_TESTED fileSink_t blackboxFileSink;
+#ifndef UNIT_TEST
+static char blackboxFileName[32];
+#endif
+#endif
+
+/*
+ * Encoded bytes are staged here and handed to the device with one bulk write per frame, rather than dispatching
+ * every byte on the device type. The buffer is committed by blackboxDeviceFlush() at the end of every frame, and
+ * before anything that needs to know the device's own buffer state.
+ */
+#define BLACKBOX_FRAME_BUFFER_SIZE  256
+
+static uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+static uint16_t blackboxFrameBufferLength;
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+// While set, committed bytes go to the pre-trigger ring instead of the device
+static bool blackboxCapturing;
 #endif
 
 #ifndef UNIT_TEST
@@ -102,71 +132,83 @@ void blackboxOpen(void)
 }
 #endif // UNIT_TEST
 
-void blackboxWrite(uint8_t value)
+static void blackboxDeviceWrite(const uint8_t *data, int length)
 {
     switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
     case BLACKBOX_DEVICE_FLASH:
-        flashfsWriteByte(value); // Write byte asynchronously
+        flashfsWrite(data, length, false); // Write asynchronously
         break;
 #endif
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
-        afatfs_fputc(blackboxSDCard.logFile, value);
+        afatfs_fwrite(blackboxSDCard.logFile, data, length); // Ignore failures due to buffers filling up
         break;
 #endif
 #if defined(SITL_BUILD)
     case BLACKBOX_DEVICE_FILE:
-        fputc(value, blackboxFile.file_handler);
+        fileSinkWrite(&blackboxFileSink, data, length);
         break;
 #endif
     case BLACKBOX_DEVICE_SERIAL:
     default:
-        serialWrite(blackboxPort, value);
+        // serialWriteBuf() waits for room in the Tx buffer, only use it when it won't have to
+        if (serialTxBytesFree(blackboxPort) >= (uint32_t)length) {
+            serialWriteBuf(blackboxPort, data, length);
+        } else {
+            for (int i = 0; i < length; i++) {
+                serialWrite(blackboxPort, data[i]);
+            }
+        }
         break;
     }
 }
 
-// Print the null-terminated string 's' to the blackbox device and return the number of bytes written
-int blackboxPrint(const char *s)
+// Hand the staged bytes to the device
+static void blackboxCommitFrameBuffer(void)
 {
-    int length;
-    const uint8_t *pos;
+    if (blackboxFrameBufferLength > 0) {
+#ifdef USE_BLACKBOX_PRETRIGGER
+        if (blackboxCapturing) {
+            blackboxPretriggerWrite(blackboxFrameBuffer, blackboxFrameBufferLength);
+        } else
+#endif
+        blackboxDeviceWrite(blackboxFrameBuffer, blackboxFrameBufferLength);
+        blackboxFrameBufferLength = 0;
+    }
+}
 
-    switch (blackboxConfig()->device) {
+void blackboxWrite(uint8_t value)
+{
+    blackboxFrameBuffer[blackboxFrameBufferLength++] = value;
 
-#ifdef USE_FLASHFS
-    case BLACKBOX_DEVICE_FLASH:
-        length = strlen(s);
-        flashfsWrite((const uint8_t*) s, length, false); // Write asynchronously
-        break;
-#endif
+    if (blackboxFrameBufferLength == BLACKBOX_FRAME_BUFFER_SIZE) {
+        blackboxCommitFrameBuffer();
+    }
+}
 
-#ifdef USE_SDCARD
-    case BLACKBOX_DEVICE_SDCARD:
-        length = strlen(s);
-        afatfs_fwrite(blackboxSDCard.logFile, (const uint8_t*) s, length); // Ignore failures due to buffers filling up
-        break;
-#endif
+void blackboxWriteBuf(const uint8_t *data, int length)
+{
+    while (length > 0) {
+        const int chunk = MIN(length, BLACKBOX_FRAME_BUFFER_SIZE - blackboxFrameBufferLength);
 
-#if defined(SITL_BUILD)
-    case BLACKBOX_DEVICE_FILE:
-        length = strlen(s);
-        fputs(s, blackboxFile.file_handler);
-        break;
-#endif
+        memcpy(blackboxFrameBuffer + blackboxFrameBufferLength, data, chunk);
+        blackboxFrameBufferLength += chunk;
+        data += chunk;
+        length -= chunk;
 
-    case BLACKBOX_DEVICE_SERIAL:
-    default:
-        pos = (uint8_t*) s;
-        while (*pos) {
-            serialWrite(blackboxPort, *pos);
-            pos++;
+        if (blackboxFrameBufferLength == BLACKBOX_FRAME_BUFFER_SIZE) {
+            blackboxCommitFrameBuffer();
         }
-
-        length = pos - (uint8_t*) s;
-        break;
     }
+}
+
+// Print the null-terminated string 's' to the blackbox device and return the number of bytes written
+int blackboxPrint(const char *s)
+{
+    const int length = strlen(s);
+
+    blackboxWriteBuf((const uint8_t *)s, length);
 
     return length;
 }
@@ -178,6 +220,8 @@ int blackboxPrint(const char *s)
  */
 void blackboxDeviceFlush(void)
 {
+    blackboxCommitFrameBuffer();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
         /*
@@ -189,6 +233,12 @@ void blackboxDeviceFlush(void)
         break;
 #endif
 
+#if defined(SITL_BUILD)
+    case BLACKBOX_DEVICE_FILE:
+        fileSinkEndFrame(&blackboxFileSink);
+        break;
+#endif
+
     default:
         ;
     }
@@ -201,6 +251,8 @@ void blackboxDeviceFlush(void)
  */
 bool blackboxDeviceFlushForce(void)
 {
+    blackboxCommitFrameBuffer();
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         // Nothing to speed up flushing on serial, as serial is continuously being drained out of its buffer
@@ -221,8 +273,8 @@ bool blackboxDeviceFlushForce(void)
 
 #if defined(SITL_BUILD)
     case BLACKBOX_DEVICE_FILE:
-        fflush(blackboxFile.file_handler);
-        return true;
+        fileSinkEndFrame(&blackboxFileSink);
+        return fileSinkFlush(&blackboxFileSink);
 #endif
 
     default:
@@ -236,6 +288,8 @@ bool blackboxDeviceFlushForce(void)
 #ifndef UNIT_TEST
 bool blackboxDeviceOpen(void)
 {
+    blackboxFrameBufferLength = 0;
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         {
@@ -305,15 +359,15 @@ bool blackboxDeviceOpen(void)
         {
             const time_t now = time(NULL);
             const struct tm *t = localtime(&now);
-            char filename[32];
-            strftime(filename, sizeof(filename), "%Y_%m_%d_%H%M%S.TXT", t);
+            strftime(blackboxFileName, sizeof(blackboxFileName), "%Y_%m_%d_%H%M%S.TXT", t);
 
-            blackboxFile.file_handler = fopen(filename, "wb");
-            if (blackboxFile.file_handler == NULL) {
+            if (!fileSinkOpen(&blackboxFileSink, blackboxFileName, BLACKBOX_FILE_BUFFER_SIZE)) {
                 fprintf(stderr, "[BlackBox] Failed to create log file\n");
                 return false;
             }
-            fprintf(stderr, "[BlackBox] Created %s\n", filename);
+            // A lockstep run has to log every frame, however long the disk takes
+            fileSinkSetBlocking(&blackboxFileSink, lockstepIsEnabled());
+            fprintf(stderr, "[BlackBox] Created %s\n", blackboxFileName);
         }
 
         blackboxMaxHeaderBytesPerIteration = BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION;
@@ -332,6 +386,8 @@ bool blackboxDeviceOpen(void)
 #ifndef UNIT_TEST
 void blackboxDeviceClose(void)
 {
+    blackboxFrameBufferLength = 0;
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         // Since the serial port could be shared with other processes, we have to give it back here
@@ -354,8 +410,19 @@ void blackboxDeviceClose(void)
 #endif
 #if defined(SITL_BUILD)
     case BLACKBOX_DEVICE_FILE:
-        fclose(blackboxFile.file_handler);
-        blackboxFile.file_handler = NULL;
+        {
+            fileSinkStats_t stats;
+
+            fileSinkClose(&blackboxFileSink);
+            fileSinkGetStats(&blackboxFileSink, &stats);
+
+            fprintf(stderr, "[BlackBox] Closed %s, %llu bytes written, %llu bytes dropped, %u frames dropped\n", blackboxFileName,
+                (unsigned long long)stats.bytesWritten, (unsigned long long)stats.bytesDropped, stats.dropCount);
+            if (stats.bufferFullCount > 0 || stats.writeErrorCount > 0) {
+                fprintf(stderr, "[BlackBox] The disk fell behind %u times, %u write errors, slowest write %ums, most pending %u bytes\n",
+                    stats.bufferFullCount, stats.writeErrorCount, stats.maxWriteUs / 1000, stats.maxPendingBytes);
+            }
+        }
         break;
 #endif
     default:
@@ -505,6 +572,11 @@ bool blackboxDeviceBeginLog(void)
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
         return blackboxSDCardBeginLog();
+#endif
+#ifdef USE_FLASHFS
+    case BLACKBOX_DEVICE_FLASH:
+        flashfsBeginLog();
+        return true;
 #endif
     default:
         return true;
@@ -525,6 +597,8 @@ bool blackboxDeviceEndLog(bool retainLog)
     (void) retainLog;
 #endif
 
+    blackboxCommitFrameBuffer();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
@@ -539,6 +613,12 @@ bool blackboxDeviceEndLog(bool retainLog)
             return true;
         }
         return false;
+#endif
+#ifdef USE_FLASHFS
+    case BLACKBOX_DEVICE_FLASH:
+        // Logs can't be discarded from flash, so index it either way
+        flashfsEndLog();
+        return true;
 #endif
     default:
         return true;
@@ -586,7 +666,7 @@ bool isBlackboxDeviceWorking(void)
 #endif
 #if defined(SITL_BUILD)
         case BLACKBOX_DEVICE_FILE:
-            return blackboxFile.file_handler != NULL;
+            return fileSinkIsOpen(&blackboxFileSink);
 #endif
     default:
         return false;
@@ -605,36 +685,38 @@ int32_t blackboxGetLogNumber(void)
     }
 }
 
-/**
- * Call once every loop iteration in order to maintain the global blackboxHeaderBudget with the number of bytes we can
- * transmit this iteration.
- */
-void blackboxReplenishHeaderBudget(void)
+// How many bytes the device can take right now without overflowing its buffers
+static int32_t blackboxDeviceGetFreeBufferSpace(void)
 {
-    int32_t freeSpace;
-
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
-        freeSpace = serialTxBytesFree(blackboxPort);
-        break;
+        return serialTxBytesFree(blackboxPort);
 #ifdef USE_FLASHFS
     case BLACKBOX_DEVICE_FLASH:
-        freeSpace = flashfsGetWriteBufferFreeSpace();
-        break;
+        return flashfsGetWriteBufferFreeSpace();
 #endif
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
-        freeSpace = afatfs_getFreeBufferSpace();
-        break;
+        return afatfs_getFreeBufferSpace();
 #endif
 #if defined(SITL_BUILD)
     case BLACKBOX_DEVICE_FILE:
-        freeSpace = BLACKBOX_MAX_ACCUMULATED_HEADER_BUDGET;
-        break;
+        return fileSinkFreeSpace(&blackboxFileSink);
 #endif
     default:
-        freeSpace = 0;
+        return 0;
     }
+}
+
+/**
+ * Call once every loop iteration in order to maintain the global blackboxHeaderBudget with the number of bytes we can
+ * transmit this iteration.
+ */
+void blackboxReplenishHeaderBudget(void)
+{
+    blackboxCommitFrameBuffer();
+
+    const int32_t freeSpace = blackboxDeviceGetFreeBufferSpace();
 
     blackboxHeaderBudget = MIN(MIN(freeSpace, blackboxHeaderBudget + blackboxMaxHeaderBytesPerIteration), BLACKBOX_MAX_ACCUMULATED_HEADER_BUDGET);
 }
@@ -659,6 +741,8 @@ void blackboxReplenishHeaderBudget(void)
  */
 blackboxBufferReserveStatus_e blackboxDeviceReserveBufferSpace(int32_t bytes)
 {
+    blackboxCommitFrameBuffer();
+
     if (bytes <= blackboxHeaderBudget) {
         return BLACKBOX_RESERVE_SUCCESS;
     }
@@ -702,7 +786,7 @@ blackboxBufferReserveStatus_e blackboxDeviceReserveBufferSpace(int32_t bytes)
 
 #if defined(SITL_BUILD)
     case BLACKBOX_DEVICE_FILE:
-        // Assume that all writes will fit in the file's buffers
+        // Wait for the writer thread to free a buffer
         return BLACKBOX_RESERVE_TEMPORARY_FAILURE;
 #endif
 
@@ -711,4 +795,44 @@ blackboxBufferReserveStatus_e blackboxDeviceReserveBufferSpace(int32_t bytes)
     }
 }
 
+#ifdef USE_BLACKBOX_PRETRIGGER
+/**
+ * Choose where the frames written from now on go: the pre-trigger ring, or the device.
+ */
+void blackboxDeviceSetCapture(bool capture)
+{
+    blackboxCommitFrameBuffer();
+    blackboxCapturing = capture;
+}
+
+/**
+ * Write as much of the pre-trigger ring to the device as its buffers can take without overflowing.
+ *
+ * Returns true once the ring is empty.
+ */
+bool blackboxDeviceWritePretrigger(void)
+{
+    blackboxCommitFrameBuffer();
+
+    int32_t freeSpace = blackboxDeviceGetFreeBufferSpace();
+
+    while (freeSpace > 0) {
+        const uint8_t *data;
+        const int length = MIN(blackboxPretriggerPeek(&data), freeSpace);
+
+        if (length == 0) {
+            break;
+        }
+
+        blackboxDeviceWrite(data, length);
+        blackboxPretriggerConsume(length);
+        freeSpace -= length;
+    }
+
+    blackboxDeviceFlush();
+
+    return blackboxPretriggerPendingBytes() == 0;
+}
+#endif
+
 #endif
@@ -0,0 +1,231 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "platform.h"
+
+#ifdef USE_BLACKBOX_PRETRIGGER
+
+#include "build/build_config.h"
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "blackbox/blackbox_pretrigger.h"
+
+/*
+ * While no log is open, the encoded frames are kept in this ring so that a log started by a trigger can begin a
+ * few seconds before it. The ring is a plain byte stream, plus an index of the positions where the encoder wrote a
+ * keyframe (a self-contained "I" frame with its slow and GPS home frames). Old data is only ever dropped a whole
+ * keyframe at a time, so the stream always starts at a point the decoder can sync to.
+ */
+#ifndef BLACKBOX_PRETRIGGER_BUFFER_SIZE
+#if defined(STM32F4)
+#define BLACKBOX_PRETRIGGER_BUFFER_SIZE     (8 * 1024)
+#elif defined(STM32F7)
+#define BLACKBOX_PRETRIGGER_BUFFER_SIZE     (16 * 1024)
+#else
+#define BLACKBOX_PRETRIGGER_BUFFER_SIZE     (64 * 1024)
+#endif
+#endif
+
+#ifndef BLACKBOX_PRETRIGGER_KEYFRAMES
+#define BLACKBOX_PRETRIGGER_KEYFRAMES       (BLACKBOX_PRETRIGGER_BUFFER_SIZE / 128)
+#endif
+
+STATIC_ASSERT((BLACKBOX_PRETRIGGER_BUFFER_SIZE & (BLACKBOX_PRETRIGGER_BUFFER_SIZE - 1)) == 0, blackbox_pretrigger_buffer_size_must_be_power_of_two);
+
+static EXTENDED_FASTRAM uint8_t pretriggerBuffer[BLACKBOX_PRETRIGGER_BUFFER_SIZE];
+
+static struct {
+    // Free-running byte counters, the ring holds the bytes from tail to head
+    uint32_t head;
+    uint32_t tail;
+
+    blackboxPretriggerKeyframe_t keyframes[BLACKBOX_PRETRIGGER_KEYFRAMES];
+    uint16_t firstKeyframe;
+    uint16_t keyframeCount;
+
+    // Bytes written before the first keyframe can't be decoded and are dropped
+    bool synced;
+    uint32_t overflows;
+} pretrigger;
+
+static blackboxPretriggerKeyframe_t *keyframeAt(int index)
+{
+    return &pretrigger.keyframes[(pretrigger.firstKeyframe + index) % BLACKBOX_PRETRIGGER_KEYFRAMES];
+}
+
+static void dropOldestKeyframe(void)
+{
+    pretrigger.firstKeyframe = (pretrigger.firstKeyframe + 1) % BLACKBOX_PRETRIGGER_KEYFRAMES;
+    pretrigger.keyframeCount--;
+}
+
+// Drop the keyframes which the tail has already passed
+static void dropKeyframesBeforeTail(void)
+{
+    while (pretrigger.keyframeCount > 0 && (int32_t)(keyframeAt(0)->offset - pretrigger.tail) < 0) {
+        dropOldestKeyframe();
+    }
+}
+
+// Drop the oldest data up to the next keyframe. Returns false when there is no keyframe left to drop to.
+static bool evictToNextKeyframe(void)
+{
+    while (pretrigger.keyframeCount > 0 && keyframeAt(0)->offset == pretrigger.tail) {
+        dropOldestKeyframe();
+    }
+
+    if (pretrigger.keyframeCount == 0) {
+        return false;
+    }
+
+    pretrigger.tail = keyframeAt(0)->offset;
+    return true;
+}
+
+void blackboxPretriggerReset(void)
+{
+    pretrigger.head = 0;
+    pretrigger.tail = 0;
+    pretrigger.firstKeyframe = 0;
+    pretrigger.keyframeCount = 0;
+    pretrigger.synced = false;
+}
+
+void blackboxPretriggerWrite(const uint8_t *data, int length)
+{
+    if (!pretrigger.synced) {
+        return;
+    }
+
+    while (pretrigger.head + length - pretrigger.tail > BLACKBOX_PRETRIGGER_BUFFER_SIZE) {
+        if (!evictToNextKeyframe()) {
+            // A single keyframe interval doesn't fit, start over from the next keyframe
+            pretrigger.overflows++;
+            pretrigger.tail = pretrigger.head;
+            pretrigger.synced = false;
+            return;
+        }
+    }
+
+    while (length > 0) {
+        const uint32_t index = pretrigger.head & (BLACKBOX_PRETRIGGER_BUFFER_SIZE - 1);
+        const int chunk = MIN(length, (int)(BLACKBOX_PRETRIGGER_BUFFER_SIZE - index));
+
+        memcpy(&pretriggerBuffer[index], data, chunk);
+        pretrigger.head += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+/*
+ * Call right before writing a keyframe. With a non-zero window, the keyframes older than needed to cover the
+ * window are dropped. A zero window keeps everything while a triggered log is being written out.
+ */
+void blackboxPretriggerMarkKeyframe(uint32_t iteration, uint32_t time, uint32_t window)
+{
+    if (!pretrigger.synced) {
+        pretrigger.tail = pretrigger.head;
+        pretrigger.synced = true;
+    }
+
+    if (pretrigger.keyframeCount == BLACKBOX_PRETRIGGER_KEYFRAMES) {
+        if (keyframeAt(0)->offset == pretrigger.tail) {
+            pretrigger.tail = keyframeAt(1)->offset;
+        }
+        dropOldestKeyframe();
+    }
+
+    blackboxPretriggerKeyframe_t *keyframe = keyframeAt(pretrigger.keyframeCount);
+    keyframe->offset = pretrigger.head;
+    keyframe->iteration = iteration;
+    keyframe->time = time;
+    pretrigger.keyframeCount++;
+
+    if (window > 0) {
+        while (pretrigger.keyframeCount > 1 && time - keyframeAt(1)->time >= window) {
+            dropOldestKeyframe();
+            pretrigger.tail = keyframeAt(0)->offset;
+        }
+    }
+}
+
+uint32_t blackboxPretriggerPendingBytes(void)
+{
+    return pretrigger.head - pretrigger.tail;
+}
+
+// Return the number of bytes that can be read in one go from the oldest end of the ring
+int blackboxPretriggerPeek(const uint8_t **data)
+{
+    const uint32_t index = pretrigger.tail & (BLACKBOX_PRETRIGGER_BUFFER_SIZE - 1);
+
+    *data = &pretriggerBuffer[index];
+    return MIN(blackboxPretriggerPendingBytes(), BLACKBOX_PRETRIGGER_BUFFER_SIZE - index);
+}
+
+void blackboxPretriggerConsume(int length)
+{
+    pretrigger.tail += MIN((uint32_t)length, blackboxPretriggerPendingBytes());
+    dropKeyframesBeforeTail();
+}
+
+// The keyframe the ring starts at, if it isn't empty
+bool blackboxPretriggerOldestKeyframe(blackboxPretriggerKeyframe_t *keyframe)
+{
+    if (pretrigger.keyframeCount == 0 || keyframeAt(0)->offset != pretrigger.tail || blackboxPretriggerPendingBytes() == 0) {
+        return false;
+    }
+
+    *keyframe = *keyframeAt(0);
+    return true;
+}
+
+// Old data is dropped a whole keyframe interval at a time, so the ring holds up to one interval less than this
+static uint32_t capacityAtCurrentRate(void)
+{
+    if (pretrigger.keyframeCount < 2) {
+        return 0;
+    }
+
+    const blackboxPretriggerKeyframe_t *oldest = keyframeAt(0);
+    const blackboxPretriggerKeyframe_t *newest = keyframeAt(pretrigger.keyframeCount - 1);
+    const uint32_t bytes = newest->offset - oldest->offset;
+
+    if (bytes == 0) {
+        return 0;
+    }
+
+    return MIN((uint64_t)(newest->time - oldest->time) * BLACKBOX_PRETRIGGER_BUFFER_SIZE / bytes, UINT32_MAX);
+}
+
+void blackboxPretriggerGetInfo(blackboxPretriggerInfo_t *info)
+{
+    info->size = BLACKBOX_PRETRIGGER_BUFFER_SIZE;
+    info->used = blackboxPretriggerPendingBytes();
+    info->span = pretrigger.keyframeCount > 0 ? keyframeAt(pretrigger.keyframeCount - 1)->time - keyframeAt(0)->time : 0;
+    info->capacity = capacityAtCurrentRate();
+    info->overflows = pretrigger.overflows;
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct blackboxPretriggerKeyframe_s {
+    uint32_t offset;        // Position of the keyframe in the ring's byte stream
+    uint32_t iteration;
+    uint32_t time;          // Microseconds, as logged in the main frames
+} blackboxPretriggerKeyframe_t;
+
+typedef struct blackboxPretriggerInfo_s {
+    uint32_t size;
+    uint32_t used;
+    uint32_t span;          // Microseconds between the oldest and the newest keyframe
+    uint32_t capacity;      // Microseconds the ring can hold at the data rate of the frames in it, 0 if not known yet
+    uint32_t overflows;     // Since boot
+} blackboxPretriggerInfo_t;
+
+void blackboxPretriggerReset(void);
+void blackboxPretriggerWrite(const uint8_t *data, int length);
+void blackboxPretriggerMarkKeyframe(uint32_t iteration, uint32_t time, uint32_t window);
+
+uint32_t blackboxPretriggerPendingBytes(void);
+int blackboxPretriggerPeek(const uint8_t **data);
+void blackboxPretriggerConsume(int length);
+bool blackboxPretriggerOldestKeyframe(blackboxPretriggerKeyframe_t *keyframe);
+
+void blackboxPretriggerGetInfo(blackboxPretriggerInfo_t *info);
@@ -0,0 +1,202 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#ifdef USE_PROFILER
+
+#ifdef SITL_BUILD
+#include <stdio.h>
+#endif
+
+#include "build/profiler.h"
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/time.h"
+
+/*
+ * Durations are binned into a log-linear histogram: values below 8 ticks get their
+ * own bucket, above that every power of two is split into 4 sub-buckets, which keeps
+ * the p99 estimate within 25% of the real value over the whole 32 bit range.
+ */
+#define PROFILER_LINEAR_BUCKETS         8
+#define PROFILER_SUB_BUCKETS            4
+#define PROFILER_HISTOGRAM_BUCKETS      (PROFILER_LINEAR_BUCKETS + (32 - 3) * PROFILER_SUB_BUCKETS)
+
+typedef struct {
+    uint32_t startTicks;
+    uint32_t durationTicks;
+    uint8_t probe;
+} profileEvent_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t totalTicks;
+    uint32_t minTicks;
+    uint32_t maxTicks;
+    uint16_t histogram[PROFILER_HISTOGRAM_BUCKETS];
+} profileProbeStats_t;
+
+static const char * const profileProbeNames[PROFILE_PROBE_COUNT] = {
+    [PROFILE_PROBE_GYRO_FILTER]         = "GYRO_FILTER",
+    [PROFILE_PROBE_IMU_UPDATE_ATTITUDE] = "IMU_ATTITUDE",
+    [PROFILE_PROBE_POSITION_ESTIMATOR]  = "POS_ESTIMATOR",
+    [PROFILE_PROBE_PID_CONTROLLER]      = "PID_CONTROLLER",
+    [PROFILE_PROBE_MIXER]               = "MIXER",
+    [PROFILE_PROBE_BLACKBOX]            = "BLACKBOX",
+};
+
+static profileEvent_t profileRing[PROFILER_RING_SIZE];
+static uint32_t profileRingCount;
+static profileProbeStats_t profileStats[PROFILE_PROBE_COUNT];
+
+STATIC_ASSERT((PROFILER_RING_SIZE & (PROFILER_RING_SIZE - 1)) == 0, profiler_ring_size_must_be_power_of_two);
+
+static int profilerHistogramBucket(uint32_t ticks)
+{
+    if (ticks < PROFILER_LINEAR_BUCKETS) {
+        return ticks;
+    }
+
+    const int octave = 31 - __builtin_clz(ticks);     // >= 3
+    const int subBucket = (ticks >> (octave - 2)) & (PROFILER_SUB_BUCKETS - 1);
+    return PROFILER_LINEAR_BUCKETS + (octave - 3) * PROFILER_SUB_BUCKETS + subBucket;
+}
+
+static uint32_t profilerHistogramBucketUpperBound(int bucket)
+{
+    if (bucket < PROFILER_LINEAR_BUCKETS) {
+        return bucket;
+    }
+
+    const int octave = (bucket - PROFILER_LINEAR_BUCKETS) / PROFILER_SUB_BUCKETS + 3;
+    const int subBucket = (bucket - PROFILER_LINEAR_BUCKETS) % PROFILER_SUB_BUCKETS;
+    const uint32_t lowerBound = (uint32_t)(PROFILER_SUB_BUCKETS + subBucket) << (octave - 2);
+    return lowerBound + ((1U << (octave - 2)) - 1);
+}
+
+void FAST_CODE NOINLINE profilerRecord(profileProbeId_e probe, uint32_t startTicks, uint32_t endTicks)
+{
+    const uint32_t durationTicks = endTicks - startTicks;
+
+    profileEvent_t *event = &profileRing[profileRingCount++ & (PROFILER_RING_SIZE - 1)];
+    event->startTicks = startTicks;
+    event->durationTicks = durationTicks;
+    event->probe = probe;
+
+    profileProbeStats_t *stats = &profileStats[probe];
+    if (stats->count == 0 || durationTicks < stats->minTicks) {
+        stats->minTicks = durationTicks;
+    }
+    stats->maxTicks = MAX(stats->maxTicks, durationTicks);
+    stats->totalTicks += durationTicks;
+    stats->count++;
+
+    uint16_t *bucket = &stats->histogram[profilerHistogramBucket(durationTicks)];
+    if (++(*bucket) == UINT16_MAX) {
+        for (int ii = 0; ii < PROFILER_HISTOGRAM_BUCKETS; ii++) {
+            stats->histogram[ii] /= 2;
+        }
+    }
+}
+
+void profilerReset(void)
+{
+    memset(profileStats, 0, sizeof(profileStats));
+    profileRingCount = 0;
+}
+
+void profilerGetProbeInfo(profileProbeId_e probe, profileProbeInfo_t *info)
+{
+    const profileProbeStats_t *stats = &profileStats[probe];
+
+    info->count = stats->count;
+    info->minTicks = stats->minTicks;
+    info->maxTicks = stats->maxTicks;
+    info->averageTicks = stats->count ? stats->totalTicks / stats->count : 0;
+    info->p99Ticks = 0;
+
+    uint32_t histogramTotal = 0;
+    for (int ii = 0; ii < PROFILER_HISTOGRAM_BUCKETS; ii++) {
+        histogramTotal += stats->histogram[ii];
+    }
+
+    const uint32_t p99Count = histogramTotal - histogramTotal / 100;
+    uint32_t accumulated = 0;
+    for (int ii = 0; ii < PROFILER_HISTOGRAM_BUCKETS && histogramTotal > 0; ii++) {
+        accumulated += stats->histogram[ii];
+        if (accumulated >= p99Count) {
+            info->p99Ticks = MIN(profilerHistogramBucketUpperBound(ii), stats->maxTicks);
+            break;
+        }
+    }
+}
+
+const char *profilerProbeName(profileProbeId_e probe)
+{
+    return probe < PROFILE_PROBE_COUNT ? profileProbeNames[probe] : "";
+}
+
+uint32_t profilerTicksPerUs(void)
+{
+    return usTicks;
+}
+
+#ifdef SITL_BUILD
+/*
+ * Dump the ring buffer in Chrome trace event format, to be opened
+ * with chrome://tracing, Perfetto or speedscope
+ */
+bool profilerWriteChromeTrace(const char *fileName)
+{
+    FILE *traceFile = fopen(fileName, "w");
+    if (!traceFile) {
+        return false;
+    }
+
+    const uint32_t eventCount = MIN(profileRingCount, (uint32_t)PROFILER_RING_SIZE);
+    const uint32_t firstEvent = profileRingCount - eventCount;
+    const double ticksPerUs = profilerTicksPerUs();
+    uint64_t timestampTicks = 0;
+    uint32_t previousStartTicks = 0;
+
+    fprintf(traceFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (uint32_t ii = 0; ii < eventCount; ii++) {
+        const profileEvent_t *event = &profileRing[(firstEvent + ii) & (PROFILER_RING_SIZE - 1)];
+
+        // Start ticks wrap around, accumulate the deltas to get a monotonic timestamp
+        if (ii > 0) {
+            timestampTicks += event->startTicks - previousStartTicks;
+        }
+        previousStartTicks = event->startTicks;
+
+        fprintf(traceFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}\n",
+            ii > 0 ? "," : "", profilerProbeName(event->probe), timestampTicks / ticksPerUs, event->durationTicks / ticksPerUs);
+    }
+    fprintf(traceFile, "]}\n");
+
+    return fclose(traceFile) == 0;
+}
+#endif
+
+#endif
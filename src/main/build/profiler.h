@@ -0,0 +1,75 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+/*
+ * Hot path profiler. Probes measure the time between PROFILE_BEGIN() and PROFILE_END()
+ * in CPU cycles (DWT cycle counter) on hardware and in nanoseconds on SITL.
+ * Without USE_PROFILER the probes compile to nothing.
+ */
+
+typedef enum {
+    PROFILE_PROBE_GYRO_FILTER = 0,
+    PROFILE_PROBE_IMU_UPDATE_ATTITUDE,
+    PROFILE_PROBE_POSITION_ESTIMATOR,
+    PROFILE_PROBE_PID_CONTROLLER,
+    PROFILE_PROBE_MIXER,
+    PROFILE_PROBE_BLACKBOX,
+    PROFILE_PROBE_COUNT
+} profileProbeId_e;
+
+typedef struct {
+    uint32_t count;
+    uint32_t minTicks;
+    uint32_t averageTicks;
+    uint32_t maxTicks;
+    uint32_t p99Ticks;
+} profileProbeInfo_t;
+
+#ifdef USE_PROFILER
+
+#include "drivers/time.h"
+
+#ifndef PROFILER_RING_SIZE
+#define PROFILER_RING_SIZE  512     // Most recent probe events, power of two
+#endif
+
+#define PROFILE_BEGIN(probe)    const uint32_t profileStart_##probe = ticks()
+#define PROFILE_END(probe)      profilerRecord(probe, profileStart_##probe, ticks())
+
+void profilerRecord(profileProbeId_e probe, uint32_t startTicks, uint32_t endTicks);
+void profilerReset(void);
+void profilerGetProbeInfo(profileProbeId_e probe, profileProbeInfo_t *info);
+const char *profilerProbeName(profileProbeId_e probe);
+uint32_t profilerTicksPerUs(void);
+
+#ifdef SITL_BUILD
+bool profilerWriteChromeTrace(const char *fileName);
+#endif
+
+#else
+
+#define PROFILE_BEGIN(probe)
+#define PROFILE_END(probe)
+
+#endif
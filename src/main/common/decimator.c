@@ -0,0 +1,107 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "common/decimator.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+static void decimatorInitCic(decimatorVec3_t *decimator)
+{
+    // Two boxcars of N samples convolved, a triangle of 2N - 1 taps
+    decimator->taps = 2 * decimator->factor - 1;
+
+    for (int i = 0; i < decimator->taps; i++) {
+        decimator->coeffs[i] = decimator->factor - ABS(i - (decimator->factor - 1));
+    }
+}
+
+static void decimatorInitFir(decimatorVec3_t *decimator)
+{
+    decimator->taps = DECIMATOR_FIR_TAPS_PER_STEP * decimator->factor - 1;
+
+    // Cutoff at the Nyquist frequency of the output rate, in cycles per input sample
+    const float cutoff = 0.5f / decimator->factor;
+    const int middle = (decimator->taps - 1) / 2;
+
+    for (int i = 0; i < decimator->taps; i++) {
+        const float x = 2.0f * M_PIf * cutoff * (i - middle);
+        const float sinc = (i == middle) ? 1.0f : sin_approx(x) / x;
+        const float window = 0.54f - 0.46f * cos_approx(2.0f * M_PIf * i / (decimator->taps - 1));
+        decimator->coeffs[i] = sinc * window;
+    }
+}
+
+void decimatorVec3Init(decimatorVec3_t *decimator, decimatorType_e type, uint8_t factor)
+{
+    memset(decimator, 0, sizeof(*decimator));
+    decimator->factor = constrain(factor, 1, DECIMATOR_MAX_FACTOR);
+
+    if (type == DECIMATOR_FIR && decimator->factor > 1) {
+        decimatorInitFir(decimator);
+    } else {
+        decimatorInitCic(decimator);
+    }
+
+    // Unity gain at DC
+    float sum = 0;
+    for (int i = 0; i < decimator->taps; i++) {
+        sum += decimator->coeffs[i];
+    }
+    for (int i = 0; i < decimator->taps; i++) {
+        decimator->coeffs[i] /= sum;
+    }
+}
+
+FAST_CODE void decimatorVec3Push(decimatorVec3_t *decimator, const float *v)
+{
+    const int index = decimator->index;
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        decimator->samples[axis][index] = v[axis];
+        decimator->samples[axis][index + decimator->taps] = v[axis];
+    }
+
+    decimator->index = (index + 1 < decimator->taps) ? index + 1 : 0;
+}
+
+/*
+ * Coefficients are symmetric, the order of the taps does not matter. The window
+ * starting at index holds the last taps samples, oldest first
+ */
+FAST_CODE void decimatorVec3Apply(const decimatorVec3_t *decimator, float *v)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        const float *samples = &decimator->samples[axis][decimator->index];
+        float result = 0;
+
+        for (int i = 0; i < decimator->taps; i++) {
+            result += decimator->coeffs[i] * samples[i];
+        }
+
+        v[axis] = result;
+    }
+}
+
+float decimatorGroupDelaySamples(const decimatorVec3_t *decimator)
+{
+    return (decimator->taps - 1) / 2.0f;
+}
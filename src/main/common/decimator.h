@@ -0,0 +1,53 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "common/axis.h"
+
+#define DECIMATOR_MAX_FACTOR        8
+#define DECIMATOR_FIR_TAPS_PER_STEP 4
+#define DECIMATOR_MAX_TAPS          (DECIMATOR_FIR_TAPS_PER_STEP * DECIMATOR_MAX_FACTOR)
+
+typedef enum {
+    DECIMATOR_CIC = 0,      // second order CIC, 2N - 1 taps
+    DECIMATOR_FIR,          // Hamming windowed sinc, 4N - 1 taps
+} decimatorType_e;
+
+/*
+ * Three axis decimation filter. Samples are pushed at the input rate and the output is
+ * computed on demand from the most recent taps, so a push is only a buffer write and the
+ * filter costs one dot product per output sample. Both filter types are linear phase,
+ * group delay is (taps - 1) / 2 input samples.
+ *
+ * The CIC is evaluated in its non-recursive form (a triangular FIR), float integrators
+ * would accumulate rounding errors forever.
+ */
+typedef struct decimatorVec3_s {
+    float samples[XYZ_AXIS_COUNT][2 * DECIMATOR_MAX_TAPS];     // every sample is stored twice, so the taps are always contiguous
+    float coeffs[DECIMATOR_MAX_TAPS];
+    uint8_t factor;
+    uint8_t taps;
+    uint8_t index;
+} decimatorVec3_t;
+
+void decimatorVec3Init(decimatorVec3_t *decimator, decimatorType_e type, uint8_t factor);
+void decimatorVec3Push(decimatorVec3_t *decimator, const float *v);
+void decimatorVec3Apply(const decimatorVec3_t *decimator, float *v);
+float decimatorGroupDelaySamples(const decimatorVec3_t *decimator);
@@ -316,6 +316,50 @@ FAST_CODE void biquadFilterUpdate(biquadFilter_t *filter, float filterFreq, uint
     filter->y2 = y2;
 }
 
+/*
+ * Tabulate notch frequencies over [minHz, maxHz], maxHz has to be below Nyquist frequency
+ */
+void biquadNotchTableInit(biquadNotchTable_t *table, float minHz, float maxHz, uint32_t samplingIntervalUs, float Q)
+{
+    const float sampleRate = 1.0f / ((float)samplingIntervalUs * 0.000001f);
+
+    table->minHz = minHz;
+    table->pointsPerHz = (BIQUAD_NOTCH_TABLE_SIZE - 1) / MAX(maxHz - minHz, 1.0f);
+    table->alphaScale = 1.0f / (2 * Q);
+
+    for (int i = 0; i < BIQUAD_NOTCH_TABLE_SIZE; i++) {
+        const float omega = 2.0f * M_PIf * (minHz + i / table->pointsPerHz) / sampleRate;
+        table->cs[i] = cos_approx(omega);
+        table->sn[i] = sin_approx(omega);
+    }
+}
+
+/*
+ * Set notch coefficients for filterFreq, same as biquadFilterInit() but without
+ * the trigonometry. Frequencies outside of the table are clamped, filter state is kept
+ */
+FAST_CODE void biquadNotchTableLookup(const biquadNotchTable_t *table, float filterFreq, biquadFilter_t *filter)
+{
+    const float position = constrainf((filterFreq - table->minHz) * table->pointsPerHz, 0.0f, BIQUAD_NOTCH_TABLE_SIZE - 1);
+    const int index = MIN((int)position, BIQUAD_NOTCH_TABLE_SIZE - 2);
+    const float fraction = position - index;
+
+    // Linear interpolation cuts the arc between two points, scale the chord back to the unit circle
+    const float c = table->cs[index] + fraction * (table->cs[index + 1] - table->cs[index]);
+    const float s = table->sn[index] + fraction * (table->sn[index + 1] - table->sn[index]);
+    const float invLength = 1.0f / fast_fsqrtf(c * c + s * s);
+
+    const float cs = c * invLength;
+    const float alpha = s * invLength * table->alphaScale;
+    const float b0 = 1.0f / (1 + alpha);
+
+    filter->b0 = b0;
+    filter->b1 = -2 * cs * b0;
+    filter->b2 = b0;
+    filter->a1 = filter->b1;
+    filter->a2 = (1 - alpha) * b0;
+}
+
 void initFilter(const uint8_t filterType, filter_t *filter, const float cutoffFrequency, const uint32_t refreshRate) {
     const float dT = US2S(refreshRate);
 
@@ -68,6 +68,21 @@ typedef enum {
     FILTER_NOTCH
 } biquadFilterType_e;
 
+/*
+ * Notch coefficients for one Q and sampling rate, tabulated as cos(omega) and sin(omega)
+ * at equally spaced frequencies. Interpolated points are projected back to the unit circle,
+ * so the notch lands on the requested frequency and not between two table points.
+ */
+#define BIQUAD_NOTCH_TABLE_SIZE 64
+
+typedef struct biquadNotchTable_s {
+    float minHz;
+    float pointsPerHz;
+    float alphaScale;   // 1 / (2 * Q)
+    float cs[BIQUAD_NOTCH_TABLE_SIZE];
+    float sn[BIQUAD_NOTCH_TABLE_SIZE];
+} biquadNotchTable_t;
+
 typedef struct firFilter_s {
     float *buf;
     const float *coeffs;
@@ -133,6 +148,8 @@ float biquadFilterReset(biquadFilter_t *filter, float value);
 float biquadFilterApplyDF1(biquadFilter_t *filter, float input);
 float filterGetNotchQ(float centerFrequencyHz, float cutoffFrequencyHz);
 void biquadFilterUpdate(biquadFilter_t *filter, float filterFreq, uint32_t refreshRate, float Q, biquadFilterType_e filterType);
+void biquadNotchTableInit(biquadNotchTable_t *table, float minHz, float maxHz, uint32_t samplingIntervalUs, float Q);
+void biquadNotchTableLookup(const biquadNotchTable_t *table, float filterFreq, biquadFilter_t *filter);
 
 void alphaBetaGammaFilterInit(alphaBetaGammaFilter_t *filter, float alpha, float boostGain, float halfLife, float dT);
 float alphaBetaGammaFilterApply(alphaBetaGammaFilter_t *filter, float input);
@@ -0,0 +1,117 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "common/filter.h"
+#include "common/filter_vec3.h"
+#include "common/maths.h"
+
+void pt1FilterVec3Init(pt1FilterVec3_t *filter, float f_cut, float dT)
+{
+    // Take RC and alpha from the scalar filter so rounding is identical
+    pt1Filter_t pt1;
+    pt1FilterInit(&pt1, f_cut, dT);
+
+    filter->RC = pt1.RC;
+    filter->dT = pt1.dT;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        filter->state[axis] = 0.0f;
+        filter->alpha[axis] = pt1.alpha;
+    }
+}
+
+void pt1FilterVec3UpdateCutoff(pt1FilterVec3_t *filter, float f_cut)
+{
+    pt1Filter_t pt1 = { .dT = filter->dT };
+    pt1FilterUpdateCutoff(&pt1, f_cut);
+
+    filter->RC = pt1.RC;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        filter->alpha[axis] = pt1.alpha;
+    }
+}
+
+void FAST_CODE pt1FilterVec3Apply(pt1FilterVec3_t *filter, float *v)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        filter->state[axis] = filter->state[axis] + filter->alpha[axis] * (v[axis] - filter->state[axis]);
+        v[axis] = filter->state[axis];
+    }
+}
+
+static void biquadFilterVec3SetCoefficients(biquadFilterVec3_t *filter, int axis, const biquadFilter_t *biquad)
+{
+    filter->b0[axis] = biquad->b0;
+    filter->b1[axis] = biquad->b1;
+    filter->b2[axis] = biquad->b2;
+    filter->a1[axis] = biquad->a1;
+    filter->a2[axis] = biquad->a2;
+}
+
+void biquadFilterVec3Init(biquadFilterVec3_t *filter, uint16_t filterFreq, uint32_t samplingIntervalUs, float Q, biquadFilterType_e filterType)
+{
+    biquadFilter_t biquad;
+    biquadFilterInit(&biquad, filterFreq, samplingIntervalUs, Q, filterType);
+
+    memset(filter, 0, sizeof(*filter));
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        biquadFilterVec3SetCoefficients(filter, axis, &biquad);
+    }
+}
+
+/*
+ * Retune a single axis, filter state is preserved like in biquadFilterUpdate()
+ */
+FAST_CODE void biquadFilterVec3Update(biquadFilterVec3_t *filter, int axis, float filterFreq, uint32_t refreshRate, float Q, biquadFilterType_e filterType)
+{
+    biquadFilter_t biquad;
+    biquadFilterInit(&biquad, filterFreq, refreshRate, Q, filterType);
+
+    biquadFilterVec3SetCoefficients(filter, axis, &biquad);
+}
+
+/*
+ * Retune the notch of a single axis from a coefficient table, filter state is kept
+ */
+FAST_CODE void biquadFilterVec3UpdateNotch(biquadFilterVec3_t *filter, int axis, const biquadNotchTable_t *table, float filterFreq)
+{
+    biquadFilter_t biquad;
+    biquadNotchTableLookup(table, filterFreq, &biquad);
+
+    biquadFilterVec3SetCoefficients(filter, axis, &biquad);
+}
+
+void FAST_CODE biquadFilterVec3ApplyDF1(biquadFilterVec3_t *filter, float *v)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        const float input = v[axis];
+        const float result = filter->b0[axis] * input + filter->b1[axis] * filter->x1[axis] + filter->b2[axis] * filter->x2[axis] - filter->a1[axis] * filter->y1[axis] - filter->a2[axis] * filter->y2[axis];
+
+        filter->x2[axis] = filter->x1[axis];
+        filter->x1[axis] = input;
+
+        filter->y2[axis] = filter->y1[axis];
+        filter->y1[axis] = result;
+
+        v[axis] = result;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "common/axis.h"
+#include "common/filter.h"
+
+/*
+ * Three axis filters with the state of all axes stored side by side (structure of arrays).
+ * A single call filters the whole X/Y/Z vector in place, so the per-axis computations are
+ * independent and can be interleaved by the compiler. Every lane computes exactly the same
+ * expression as the scalar filter in filter.c, results are bit-exact with the per-axis path.
+ */
+
+typedef struct pt1FilterVec3_s {
+    float state[XYZ_AXIS_COUNT];
+    float alpha[XYZ_AXIS_COUNT];
+    float RC;
+    float dT;
+} pt1FilterVec3_t;
+
+typedef struct biquadFilterVec3_s {
+    float b0[XYZ_AXIS_COUNT], b1[XYZ_AXIS_COUNT], b2[XYZ_AXIS_COUNT], a1[XYZ_AXIS_COUNT], a2[XYZ_AXIS_COUNT];
+    float x1[XYZ_AXIS_COUNT], x2[XYZ_AXIS_COUNT], y1[XYZ_AXIS_COUNT], y2[XYZ_AXIS_COUNT];
+} biquadFilterVec3_t;
+
+void pt1FilterVec3Init(pt1FilterVec3_t *filter, float f_cut, float dT);
+void pt1FilterVec3UpdateCutoff(pt1FilterVec3_t *filter, float f_cut);
+void pt1FilterVec3Apply(pt1FilterVec3_t *filter, float *v);
+
+void biquadFilterVec3Init(biquadFilterVec3_t *filter, uint16_t filterFreq, uint32_t samplingIntervalUs, float Q, biquadFilterType_e filterType);
+void biquadFilterVec3Update(biquadFilterVec3_t *filter, int axis, float filterFreq, uint32_t refreshRate, float Q, biquadFilterType_e filterType);
+void biquadFilterVec3UpdateNotch(biquadFilterVec3_t *filter, int axis, const biquadNotchTable_t *table, float filterFreq);
+void biquadFilterVec3ApplyDF1(biquadFilterVec3_t *filter, float *v);
@@ -0,0 +1,97 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/spsc_ring.h"
+#include "common/maths.h"
+
+// Each side reads its own index plainly, and the other's with acquire to see the bytes published with it
+#define OTHER(x)        __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define PUBLISH(x, v)   __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+void spscRingInit(spscRing_t *ring, uint8_t *buffer, uint32_t size)
+{
+    ring->buffer = buffer;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+uint32_t spscRingWaiting(const spscRing_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+uint32_t spscRingFree(const spscRing_t *ring)
+{
+    return ring->size - spscRingWaiting(ring);
+}
+
+uint32_t spscRingWrite(spscRing_t *ring, const uint8_t *data, uint32_t length)
+{
+    const uint32_t head = ring->head;
+    const uint32_t free = ring->size - (head - OTHER(ring->tail));
+    const uint32_t offset = head & (ring->size - 1);
+
+    length = MIN(length, free);
+
+    const uint32_t first = MIN(length, ring->size - offset);
+    memcpy(&ring->buffer[offset], data, first);
+    memcpy(ring->buffer, data + first, length - first);
+
+    PUBLISH(ring->head, head + length);
+    return length;
+}
+
+uint32_t spscRingRead(spscRing_t *ring, uint8_t *data, uint32_t length)
+{
+    const uint32_t tail = ring->tail;
+    const uint32_t waiting = OTHER(ring->head) - tail;
+    const uint32_t offset = tail & (ring->size - 1);
+
+    length = MIN(length, waiting);
+
+    const uint32_t first = MIN(length, ring->size - offset);
+    memcpy(data, &ring->buffer[offset], first);
+    memcpy(data + first, ring->buffer, length - first);
+
+    PUBLISH(ring->tail, tail + length);
+    return length;
+}
+
+bool spscRingReadByte(spscRing_t *ring, uint8_t *byte)
+{
+    const uint32_t tail = ring->tail;
+
+    if (OTHER(ring->head) == tail) {
+        return false;
+    }
+
+    *byte = ring->buffer[tail & (ring->size - 1)];
+    PUBLISH(ring->tail, tail + 1);
+    return true;
+}
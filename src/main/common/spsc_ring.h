@@ -0,0 +1,54 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Byte ring for exactly one producer and one consumer, which may be different threads. There are no locks: head is
+ * only written by the producer and tail only by the consumer, both count up freely and wrap at 2^32. The size must be
+ * a power of two.
+ */
+
+typedef struct spscRing_s {
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t head;      // Producer
+    uint32_t tail;      // Consumer, returns how much was read
+} spscRing_t;
+
+void spscRingInit(spscRing_t *ring, uint8_t *buffer, uint32_t size);
+
+// Either side
+uint32_t spscRingWaiting(const spscRing_t *ring);
+uint32_t spscRingFree(const spscRing_t *ring);
+
+// Producer, copies as much as fits and returns how much that was
+uint32_t spscRingWrite(spscRing_t *ring, const uint8_t *data, uint32_t length);
+
+// Consumer, returns how much was read
+uint32_t spscRingRead(spscRing_t *ring, uint8_t *data, uint32_t length);
+bool spscRingReadByte(spscRing_t *ring, uint8_t *byte);
@@ -37,6 +37,7 @@
 
 #ifdef SITL_BUILD
 #include <time.h>
+#include "target/SITL/lockstep.h"
 #endif
 
 // For the "modulo 4" arithmetic to work, we need a leap base year
@@ -315,6 +316,11 @@ bool rtcHasTime(void)
 bool rtcGet(rtcTime_t *t)
 {
 #ifdef SITL_BUILD
+    if (lockstepIsEnabled()) {
+        // The host's time would make every run different
+        *t = (rtcTime_t)LOCKSTEP_RTC_EPOCH * MILLIS_PER_SECOND + millis();
+        return true;
+    }
     *t = (rtcTime_t)(time(NULL) * 1000);
     return true;
 #else 
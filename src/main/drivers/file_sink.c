@@ -0,0 +1,365 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software. You can redistribute this software
+ * and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * INAV is distributed in the hope that they will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform.h"
+
+#if defined(SITL_BUILD)
+
+#include <errno.h>
+#include <fcntl.h>
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/file_sink.h"
+
+static uint64_t nowUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+// Caller holds the lock, the writer must be idle
+static void fileSinkHandOver(fileSink_t *sink)
+{
+    sink->writeLength = sink->fillLength;
+    sink->fillIndex ^= 1;
+    sink->fillLength = 0;
+    sink->frameStart = 0;
+    pthread_cond_signal(&sink->wake);
+}
+
+/*
+ * Reserve the file's blocks ahead of the writer, so that the filesystem doesn't have to find them while we wait.
+ * The reserved space is not part of the file size, so nothing has to be trimmed on close.
+ */
+static void fileSinkPreallocate(fileSink_t *sink, uint32_t length)
+{
+#if defined(__linux__)
+    if (sink->stats.bytesWritten + length > sink->preallocatedSize) {
+        if (fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, sink->preallocatedSize, FILE_SINK_PREALLOCATE_SIZE) == 0) {
+            sink->preallocatedSize += FILE_SINK_PREALLOCATE_SIZE;
+        } else {
+            // Not supported by this filesystem, don't try again
+            sink->preallocatedSize = UINT64_MAX;
+        }
+    }
+#else
+    UNUSED(sink);
+    UNUSED(length);
+#endif
+}
+
+static bool fileSinkWriteAll(int fd, const uint8_t *data, uint32_t length)
+{
+    while (length > 0) {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static void *fileSinkWriterThread(void *arg)
+{
+    fileSink_t *sink = (fileSink_t *)arg;
+    bool timedOut = false;
+
+    pthread_mutex_lock(&sink->lock);
+
+    while (true) {
+        // Take partly filled buffers too when nothing has been handed over for a while, or at the end
+        if (sink->writeLength == 0 && sink->fillLength > 0 && (timedOut || sink->closing)) {
+            fileSinkHandOver(sink);
+        }
+
+        if (sink->writeLength > 0) {
+            const uint8_t *data = sink->buffer[sink->fillIndex ^ 1];
+            const uint32_t length = sink->writeLength;
+
+            pthread_mutex_unlock(&sink->lock);
+
+            fileSinkPreallocate(sink, length);
+            const uint64_t start = nowUs();
+            const bool ok = fileSinkWriteAll(sink->fd, data, length);
+            const uint32_t writeUs = nowUs() - start;
+
+            pthread_mutex_lock(&sink->lock);
+
+            if (ok) {
+                sink->stats.bytesWritten += length;
+            } else {
+                sink->stats.bytesDropped += length;
+                sink->stats.writeErrorCount++;
+            }
+            sink->stats.maxWriteUs = MAX(sink->stats.maxWriteUs, writeUs);
+            sink->writeLength = 0;
+            pthread_cond_broadcast(&sink->written);
+            timedOut = false;
+            continue;
+        }
+
+        if (sink->closing) {
+            break;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FILE_SINK_IDLE_FLUSH_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        timedOut = pthread_cond_timedwait(&sink->wake, &sink->lock, &deadline) == ETIMEDOUT;
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+
+    return NULL;
+}
+
+bool fileSinkOpen(fileSink_t *sink, const char *fileName, uint32_t bufferSize)
+{
+    memset(sink, 0, sizeof(*sink));
+
+    sink->fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (sink->fd < 0) {
+        return false;
+    }
+
+    sink->bufferSize = bufferSize;
+    sink->buffer[0] = malloc(bufferSize);
+    sink->buffer[1] = malloc(bufferSize);
+
+    if (!sink->buffer[0] || !sink->buffer[1] || pthread_mutex_init(&sink->lock, NULL) != 0) {
+        goto fail;
+    }
+
+    if (pthread_cond_init(&sink->wake, NULL) != 0) {
+        pthread_mutex_destroy(&sink->lock);
+        goto fail;
+    }
+
+    if (pthread_cond_init(&sink->written, NULL) != 0) {
+        pthread_cond_destroy(&sink->wake);
+        pthread_mutex_destroy(&sink->lock);
+        goto fail;
+    }
+
+    if (pthread_create(&sink->writerThread, NULL, fileSinkWriterThread, sink) != 0) {
+        pthread_cond_destroy(&sink->written);
+        pthread_cond_destroy(&sink->wake);
+        pthread_mutex_destroy(&sink->lock);
+        goto fail;
+    }
+
+    sink->isOpen = true;
+    return true;
+
+fail:
+    free(sink->buffer[0]);
+    free(sink->buffer[1]);
+    close(sink->fd);
+    return false;
+}
+
+/*
+ * Writes out everything that was accepted and closes the file. This waits for the disk.
+ */
+void fileSinkClose(fileSink_t *sink)
+{
+    if (!sink->isOpen) {
+        return;
+    }
+
+    pthread_mutex_lock(&sink->lock);
+    sink->closing = true;
+    pthread_cond_signal(&sink->wake);
+    pthread_mutex_unlock(&sink->lock);
+
+    pthread_join(sink->writerThread, NULL);
+
+    close(sink->fd);
+    free(sink->buffer[0]);
+    free(sink->buffer[1]);
+    sink->buffer[0] = sink->buffer[1] = NULL;
+    pthread_cond_destroy(&sink->written);
+    pthread_cond_destroy(&sink->wake);
+    pthread_mutex_destroy(&sink->lock);
+
+    sink->isOpen = false;
+}
+
+bool fileSinkIsOpen(const fileSink_t *sink)
+{
+    return sink->isOpen;
+}
+
+void fileSinkSetBlocking(fileSink_t *sink, bool blocking)
+{
+    pthread_mutex_lock(&sink->lock);
+    sink->blocking = blocking;
+    pthread_mutex_unlock(&sink->lock);
+}
+
+// Caller holds the lock. Takes the part of the current frame that is still in the fill buffer back out.
+static void fileSinkDropFrame(fileSink_t *sink, uint32_t length)
+{
+    const uint32_t taken = sink->fillLength - sink->frameStart;
+
+    sink->fillLength = sink->frameStart;
+    sink->frameDropped = true;
+    sink->stats.bytesAccepted -= taken;
+    sink->stats.bytesDropped += taken + length;
+    sink->stats.dropCount++;
+}
+
+/*
+ * A non-blocking sink drops the whole frame when the write doesn't fit, the frame's earlier writes included, along
+ * with its later writes up to fileSinkEndFrame(). Only a frame longer than a buffer, which has already been partly
+ * handed to the writer, can still end up cut in the file.
+ */
+uint32_t fileSinkWrite(fileSink_t *sink, const void *data, uint32_t length)
+{
+    const uint8_t *bytes = data;
+    uint32_t accepted = 0;
+
+    pthread_mutex_lock(&sink->lock);
+
+    if (sink->frameDropped) {
+        sink->stats.bytesDropped += length;
+        pthread_mutex_unlock(&sink->lock);
+        return 0;
+    }
+
+    if (!sink->blocking && length > sink->bufferSize - sink->fillLength + (sink->writeLength == 0 ? sink->bufferSize : 0)) {
+        if (sink->writeLength > 0) {
+            // The writer is still busy with the other buffer
+            sink->stats.bufferFullCount++;
+        }
+        fileSinkDropFrame(sink, length);
+        pthread_mutex_unlock(&sink->lock);
+        return 0;
+    }
+
+    while (accepted < length) {
+        if (sink->fillLength == sink->bufferSize) {
+            if (sink->writeLength > 0) {
+                // Only a blocking sink gets here, the check above made sure the rest fits otherwise
+                sink->stats.bufferFullCount++;
+                pthread_cond_wait(&sink->written, &sink->lock);
+                continue;
+            }
+            fileSinkHandOver(sink);
+        }
+
+        const uint32_t chunk = MIN(length - accepted, sink->bufferSize - sink->fillLength);
+        memcpy(sink->buffer[sink->fillIndex] + sink->fillLength, bytes + accepted, chunk);
+        sink->fillLength += chunk;
+        accepted += chunk;
+    }
+
+    // Hand a full buffer over right away, rather than waiting for the next write
+    if (sink->fillLength == sink->bufferSize && sink->writeLength == 0) {
+        fileSinkHandOver(sink);
+    }
+
+    sink->stats.bytesAccepted += accepted;
+    sink->stats.maxPendingBytes = MAX(sink->stats.maxPendingBytes, sink->fillLength + sink->writeLength);
+
+    pthread_mutex_unlock(&sink->lock);
+
+    return accepted;
+}
+
+void fileSinkEndFrame(fileSink_t *sink)
+{
+    pthread_mutex_lock(&sink->lock);
+    sink->frameStart = sink->fillLength;
+    sink->frameDropped = false;
+    pthread_mutex_unlock(&sink->lock);
+}
+
+// How many bytes fileSinkWrite() can take right now without dropping any
+uint32_t fileSinkFreeSpace(fileSink_t *sink)
+{
+    pthread_mutex_lock(&sink->lock);
+    // A blocking sink never drops anything, so don't make the answer depend on how fast the disk is
+    const uint32_t freeSpace = sink->blocking ? 2 * sink->bufferSize :
+        sink->bufferSize - sink->fillLength + (sink->writeLength == 0 ? sink->bufferSize : 0);
+    pthread_mutex_unlock(&sink->lock);
+
+    return freeSpace;
+}
+
+/*
+ * Hands the buffered data to the writer without waiting for it. Returns true once everything accepted so far
+ * has been written to the file. A blocking sink waits until it has been.
+ */
+bool fileSinkFlush(fileSink_t *sink)
+{
+    bool done;
+
+    pthread_mutex_lock(&sink->lock);
+
+    while (true) {
+        if (sink->fillLength > 0 && sink->writeLength == 0) {
+            fileSinkHandOver(sink);
+        }
+        done = sink->fillLength == 0 && sink->writeLength == 0;
+        if (done || !sink->blocking) {
+            break;
+        }
+        pthread_cond_wait(&sink->written, &sink->lock);
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+
+    return done;
+}
+
+void fileSinkGetStats(fileSink_t *sink, fileSinkStats_t *stats)
+{
+    if (sink->isOpen) {
+        pthread_mutex_lock(&sink->lock);
+        *stats = sink->stats;
+        pthread_mutex_unlock(&sink->lock);
+    } else {
+        *stats = sink->stats;
+    }
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software. You can redistribute this software
+ * and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * INAV is distributed in the hope that they will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host file output which doesn't block the caller. Writes are copied into one of two buffers, and a writer thread
+ * writes the other one to the file. When both are full the data is dropped and counted, rather than stalling the
+ * caller on the disk. Data is dropped a whole frame at a time, the caller marks where frames end with
+ * fileSinkEndFrame(). A blocking sink waits for the disk instead, for when every byte matters more than the caller's
+ * timing.
+ */
+
+#define FILE_SINK_IDLE_FLUSH_MS     250     // Data is written at least this often, even if the buffer isn't full
+#define FILE_SINK_PREALLOCATE_SIZE  (16 * 1024 * 1024)
+
+typedef struct fileSinkStats_s {
+    uint64_t bytesAccepted;
+    uint64_t bytesWritten;
+    uint64_t bytesDropped;          // Didn't fit the buffers, or the file write failed
+    uint32_t dropCount;             // Frames dropped
+    uint32_t bufferFullCount;       // The fill buffer was full while the writer was still busy
+    uint32_t writeErrorCount;
+    uint32_t maxPendingBytes;       // Most bytes waiting for the writer at once
+    uint32_t maxWriteUs;            // Slowest buffer write by the writer thread
+} fileSinkStats_t;
+
+typedef struct fileSink_s {
+    int fd;
+    bool isOpen;
+    bool closing;
+    bool blocking;                  // Wait for the writer rather than drop data
+
+    uint8_t *buffer[2];
+    uint32_t bufferSize;
+    uint8_t fillIndex;              // The buffer taking new data, the writer owns the other one
+    uint32_t fillLength;
+    uint32_t frameStart;            // Where the current frame starts in the fill buffer
+    bool frameDropped;              // The rest of the current frame is dropped too
+    uint32_t writeLength;           // Of the writer's buffer, 0 while the writer is idle
+
+    uint64_t preallocatedSize;
+
+    pthread_t writerThread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t written;         // The writer has finished a buffer
+
+    fileSinkStats_t stats;
+} fileSink_t;
+
+bool fileSinkOpen(fileSink_t *sink, const char *fileName, uint32_t bufferSize);
+void fileSinkClose(fileSink_t *sink);
+bool fileSinkIsOpen(const fileSink_t *sink);
+void fileSinkSetBlocking(fileSink_t *sink, bool blocking);
+
+// Returns the number of bytes accepted, either all of them or none
+uint32_t fileSinkWrite(fileSink_t *sink, const void *data, uint32_t length);
+void fileSinkEndFrame(fileSink_t *sink);
+uint32_t fileSinkFreeSpace(fileSink_t *sink);
+bool fileSinkFlush(fileSink_t *sink);
+
+void fileSinkGetStats(fileSink_t *sink, fileSinkStats_t *stats);
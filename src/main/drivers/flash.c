@@ -31,6 +31,7 @@
 #include "flash.h"
 #include "flash_m25p16.h"
 #include "flash_w25n01g.h"
+#include "flash_file.h"
 
 #include "common/time.h"
 
@@ -72,6 +73,20 @@ static flashDriver_t flashDrivers[] = {
 
 #endif
 
+#ifdef USE_FLASH_FILE
+    {
+        .init = flashFileInit,
+        .isReady = flashFileIsReady,
+        .waitForReady = flashFileWaitForReady,
+        .eraseSector = flashFileEraseSector,
+        .eraseCompletely = flashFileEraseCompletely,
+        .pageProgram = flashFilePageProgram,
+        .readBytes = flashFileReadBytes,
+        .getGeometry = flashFileGetGeometry,
+        .flush = NULL
+    },
+#endif
+
 };
 
 static flashDriver_t *flash;
@@ -129,7 +144,10 @@ int flashReadBytes(uint32_t address, uint8_t *buffer, int length)
 
 void flashFlush(void)
 {
-    flash->flush();
+    // NOR devices program straight away and have nothing to flush
+    if (flash->flush) {
+        flash->flush();
+    }
 }
 
 const flashGeometry_t *flashGetGeometry(void)
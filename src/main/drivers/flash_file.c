@@ -0,0 +1,159 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software. You can redistribute this software
+ * and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * INAV is distributed in the hope that they will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A NOR flash chip kept in a file, so SITL can log blackbox to dataflash and serve it over MSP like a flight
+ * controller does. Programming can only clear bits, as on a real chip.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "platform.h"
+
+#if defined(USE_FLASH_FILE)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/flash_file.h"
+
+static flashGeometry_t geometry;
+static uint8_t *flashData = NULL;
+static char flashPath[260] = FLASH_FILENAME;
+
+bool flashFileSetPath(const char *path)
+{
+    if (!path || strlen(path) >= sizeof(flashPath)) {
+        return false;
+    }
+
+    strcpy(flashPath, path);
+    return true;
+}
+
+bool flashFileInit(int flashNumToUse)
+{
+    UNUSED(flashNumToUse);
+
+    if (flashData) {
+        return true;
+    }
+
+    geometry.flashType = FLASH_TYPE_NOR;
+    geometry.pageSize = FLASH_FILE_PAGE_SIZE;
+    geometry.pagesPerSector = FLASH_FILE_PAGES_PER_SECTOR;
+    geometry.sectorSize = FLASH_FILE_PAGE_SIZE * FLASH_FILE_PAGES_PER_SECTOR;
+    geometry.sectors = FLASH_FILE_SECTORS;
+    geometry.totalSize = geometry.sectorSize * geometry.sectors;
+
+    const int fd = open(flashPath, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[FLASH] Failed to open '%s': %s\n", flashPath, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    const off_t oldSize = fstat(fd, &st) == 0 ? st.st_size : 0;
+
+    if (oldSize < (off_t)geometry.totalSize && ftruncate(fd, geometry.totalSize) != 0) {
+        fprintf(stderr, "[FLASH] Failed to resize '%s': %s\n", flashPath, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, geometry.totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "[FLASH] Failed to map '%s': %s\n", flashPath, strerror(errno));
+        return false;
+    }
+
+    flashData = data;
+
+    // The space the file grew by is erased flash
+    if (oldSize < (off_t)geometry.totalSize) {
+        memset(flashData + oldSize, 0xFF, geometry.totalSize - oldSize);
+    }
+
+    fprintf(stderr, "[FLASH] Using '%s' (%u bytes)\n", flashPath, (unsigned)geometry.totalSize);
+    return true;
+}
+
+bool flashFileIsReady(void)
+{
+    return flashData != NULL;
+}
+
+bool flashFileWaitForReady(timeMs_t timeoutMillis)
+{
+    UNUSED(timeoutMillis);
+    return flashFileIsReady();
+}
+
+void flashFileEraseSector(uint32_t address)
+{
+    address -= address % geometry.sectorSize;
+
+    if (address < geometry.totalSize) {
+        memset(flashData + address, 0xFF, geometry.sectorSize);
+    }
+}
+
+void flashFileEraseCompletely(void)
+{
+    memset(flashData, 0xFF, geometry.totalSize);
+}
+
+uint32_t flashFilePageProgram(uint32_t address, const uint8_t *data, int length)
+{
+    for (int i = 0; i < length && address < geometry.totalSize; i++, address++) {
+        flashData[address] &= data[i];
+    }
+
+    return address;
+}
+
+int flashFileReadBytes(uint32_t address, uint8_t *buffer, int length)
+{
+    if (address >= geometry.totalSize) {
+        return 0;
+    }
+
+    length = MIN((uint32_t)length, geometry.totalSize - address);
+    memcpy(buffer, flashData + address, length);
+    return length;
+}
+
+const flashGeometry_t *flashFileGetGeometry(void)
+{
+    return &geometry;
+}
+
+#endif
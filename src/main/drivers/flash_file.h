@@ -0,0 +1,41 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software. You can redistribute this software
+ * and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * INAV is distributed in the hope that they will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "drivers/flash.h"
+
+#define FLASH_FILE_PAGE_SIZE            256
+#define FLASH_FILE_PAGES_PER_SECTOR     256
+#define FLASH_FILE_SECTORS              256     // 16MB, like the larger NOR chips on flight controllers
+
+bool flashFileSetPath(const char *path);
+
+bool flashFileInit(int flashNumToUse);
+bool flashFileIsReady(void);
+bool flashFileWaitForReady(timeMs_t timeoutMillis);
+void flashFileEraseSector(uint32_t address);
+void flashFileEraseCompletely(void);
+uint32_t flashFilePageProgram(uint32_t address, const uint8_t *data, int length);
+int flashFileReadBytes(uint32_t address, uint8_t *buffer, int length);
+const flashGeometry_t *flashFileGetGeometry(void);
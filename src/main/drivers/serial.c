@@ -17,9 +17,12 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "platform.h"
 
+#include "common/maths.h"
+
 #include "serial.h"
 
 void serialPrint(serialPort_t *instance, const char *str)
@@ -91,6 +94,34 @@ void serialSetOptions(serialPort_t *instance, portOptions_t options)
     instance->vTable->setOptions(instance, options);
 }
 
+/*
+ * Copy the whole buffer into the Tx ring of a driver in at most two chunks per pass, calling txStart once
+ * per pass instead of once per byte. Like serialWriteBuf(), waits for room when the ring is full.
+ */
+void serialWriteBufToTxBuffer(serialPort_t *instance, const void *data, int count, void (*txStart)(serialPort_t *instance))
+{
+    const uint8_t *p = data;
+
+    while (count > 0) {
+        const uint32_t chunk = MIN(MIN((uint32_t)count, serialTxBytesFree(instance)), instance->txBufferSize - instance->txBufferHead);
+        if (chunk == 0) {
+            continue;
+        }
+
+        memcpy((uint8_t *)&instance->txBuffer[instance->txBufferHead], p, chunk);
+        if (instance->txBufferHead + chunk >= instance->txBufferSize) {
+            instance->txBufferHead = 0;
+        } else {
+            instance->txBufferHead += chunk;
+        }
+
+        p += chunk;
+        count -= chunk;
+
+        txStart(instance);
+    }
+}
+
 void serialWriteBufShim(void *instance, const uint8_t *data, int count)
 {
     serialWriteBuf((serialPort_t *)instance, data, count);
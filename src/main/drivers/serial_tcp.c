@@ -23,7 +23,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -37,24 +36,23 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <poll.h>
 #include <netinet/tcp.h>
 
+#include "common/maths.h"
 #include "common/utils.h"
 
 #include "drivers/serial.h"
 #include "drivers/serial_tcp.h"
+#include "target/SITL/io_reactor.h"
 #include "target/SITL/serial_proxy.h"
 
 static const struct serialPortVTable tcpVTable[];
 static tcpPort_t tcpPorts[SERIAL_PORT_COUNT];
+static uint16_t basePort = BASE_IP_ADDRESS;
+
+static bool tcpAccept(int fd, void *arg);
 
-static void *tcpReceiveThread(void* arg)
-{
-    tcpPort_t *port = (tcpPort_t*)arg;
-    while(tcpReceive(port) >= 0)
-        ;
-    return NULL;
-}
 static tcpPort_t *tcpReConfigure(tcpPort_t *port, uint32_t id)
 {
     socklen_t sockaddrlen;
@@ -66,7 +64,7 @@ static tcpPort_t *tcpReConfigure(tcpPort_t *port, uint32_t id)
         return NULL;
     }
 
-    uint16_t tcpPort = BASE_IP_ADDRESS + id - 1;
+    uint16_t tcpPort = basePort + id - 1;
     if (lookupAddress(NULL, tcpPort, SOCK_STREAM, (struct sockaddr*)&port->sockAddress, &sockaddrlen) != 0) {
             return NULL;
     }
@@ -99,8 +97,10 @@ static tcpPort_t *tcpReConfigure(tcpPort_t *port, uint32_t id)
     }
 
     port->isClientConnected = false;
+    port->closingFd = -1;
     port->isInitalized = true;
     port->id = id;
+    spscRingInit(&port->rxRing, port->rxBuffer, TCP_BUFFER_SIZE);
 
     if (bind(port->socketFd, (struct sockaddr*)&port->sockAddress, sockaddrlen) < 0) {
         fprintf(stderr, "[SOCKET] Unable to bind socket\n");
@@ -116,77 +116,111 @@ static tcpPort_t *tcpReConfigure(tcpPort_t *port, uint32_t id)
     if (addrptr != NULL) {
         fprintf(stderr, "[SOCKET] Bind TCP %s to UART%d\n", addrptr, id);
     }
+
+    if (!ioReactorAdd(port->socketFd, tcpAccept, port)) {
+        return NULL;
+    }
     return port;
 }
 
+// UART1 listens here, the others on the ports after it
+void tcpSetBasePort(uint16_t port)
+{
+    basePort = port;
+}
+
 void tcpReceiveBytes( tcpPort_t *port, const uint8_t* buffer, ssize_t recvSize ) {
-    for (ssize_t i = 0; i < recvSize; i++) {
-        if (port->serialPort.rxCallback) {
+    if (port->serialPort.rxCallback) {
+        for (ssize_t i = 0; i < recvSize; i++) {
             port->serialPort.rxCallback((uint16_t)buffer[i], port->serialPort.rxCallbackData);
-        } else {
-            pthread_mutex_lock(&port->receiveMutex);
-            port->serialPort.rxBuffer[port->serialPort.rxBufferHead] = buffer[i];
-            port->serialPort.rxBufferHead = (port->serialPort.rxBufferHead + 1) % port->serialPort.rxBufferSize;
-            pthread_mutex_unlock(&port->receiveMutex);
         }
+        return;
     }
+
+    // Like a UART, what does not fit is lost. The serial proxy checks tcpRXBytesFree() first.
+    pthread_mutex_lock(&port->receiveMutex);
+    spscRingWrite(&port->rxRing, buffer, recvSize);
+    pthread_mutex_unlock(&port->receiveMutex);
 }
 
 void tcpReceiveBytesEx( int portIndex, const uint8_t* buffer, ssize_t recvSize ) {
     tcpReceiveBytes( &tcpPorts[portIndex], buffer, recvSize );
 }
 
-int tcpReceive(tcpPort_t *port)
+static bool tcpReceive(int fd, void *arg)
 {
-    char addrbuf[IPADDRESS_PRINT_BUFLEN];
-    if (!port->isClientConnected) {
-
-        fd_set fds;
-
-        FD_ZERO(&fds);
-        FD_SET(port->socketFd, &fds);
-
-        if (select(port->socketFd + 1, &fds, NULL, NULL, NULL) < 0) {
-            fprintf(stderr, "[SOCKET] Unable to wait for connection.\n");
-            return -1;
+    tcpPort_t *port = arg;
+
+    // Receive no more than the ring can take, the rest waits in the socket until the firmware has read
+    size_t recvLength = TCP_BUFFER_SIZE;
+    if (!port->serialPort.rxCallback) {
+        recvLength = spscRingFree(&port->rxRing);
+        if (recvLength == 0) {
+            return false;
         }
-
-        socklen_t addrLen = sizeof(struct sockaddr_storage);
-        port->clientSocketFd = accept(port->socketFd,(struct sockaddr*)&port->clientAddress, &addrLen);
-        if (port->clientSocketFd < 1) {
-            fprintf(stderr, "[SOCKET] Can't accept connection.\n");
-            return -1;
-        }
-
-        char *addrptr = prettyPrintAddress((struct sockaddr *)&port->clientAddress, addrbuf, IPADDRESS_PRINT_BUFLEN);
-        if (addrptr != NULL) {
-           fprintf(stderr, "[SOCKET] %s connected to UART%d\n", addrptr, port->id);
-        }
-        port->isClientConnected = true;
     }
 
     uint8_t buffer[TCP_BUFFER_SIZE];
-    ssize_t recvSize = recv(port->clientSocketFd, buffer, TCP_BUFFER_SIZE, 0);
+    ssize_t recvSize = recv(fd, buffer, recvLength, 0);
 
     // recv() under cygwin does not recognise the closed connection under certain circumstances, but returns ECONNRESET as an error.
-    if (port->isClientConnected && (recvSize == 0 || ( recvSize == -1 && errno == ECONNRESET))) {
+    if (recvSize == 0 || (recvSize == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        char addrbuf[IPADDRESS_PRINT_BUFLEN];
         char *addrptr = prettyPrintAddress((struct sockaddr *)&port->clientAddress, addrbuf, IPADDRESS_PRINT_BUFLEN);
         if (addrptr != NULL) {
             fprintf(stderr, "[SOCKET] %s disconnected from UART%d\n", addrptr, port->id);
         }
-        close(port->clientSocketFd);
+        __atomic_store_n(&port->isClientConnected, false, __ATOMIC_RELEASE);
+        ioReactorRemove(fd);
         memset(&port->clientAddress, 0, sizeof(port->clientAddress));
-        port->isClientConnected = false;
-        return 0;
+
+        // The firmware may be sending to fd right now, closing it here would let the number be reused by another
+        // client. tcpFlushAll() closes it and takes the next client.
+        __atomic_store_n(&port->closingFd, fd, __ATOMIC_RELEASE);
+        return true;
     }
 
-    if (recvSize < 0) {
-        recvSize = 0;
+    if (recvSize > 0) {
+        tcpReceiveBytes( port, buffer, recvSize );
     }
+    return true;
+}
 
-    tcpReceiveBytes( port, buffer, recvSize );
+// One client at a time, others wait in the listen queue until it disconnects
+static bool tcpAccept(int fd, void *arg)
+{
+    tcpPort_t *port = arg;
 
-    return (int)recvSize;
+    socklen_t addrLen = sizeof(struct sockaddr_storage);
+    const int clientFd = accept(fd, (struct sockaddr*)&port->clientAddress, &addrLen);
+    if (clientFd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            fprintf(stderr, "[SOCKET] Can't accept connection.\n");
+        }
+        return true;
+    }
+
+    char addrbuf[IPADDRESS_PRINT_BUFLEN];
+    char *addrptr = prettyPrintAddress((struct sockaddr *)&port->clientAddress, addrbuf, IPADDRESS_PRINT_BUFLEN);
+    if (addrptr != NULL) {
+       fprintf(stderr, "[SOCKET] %s connected to UART%d\n", addrptr, port->id);
+    }
+
+    int one = 1;
+    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL, 0) | O_NONBLOCK);
+
+    ioReactorRemove(fd);
+    if (!ioReactorAdd(clientFd, tcpReceive, port)) {
+        close(clientFd);
+        ioReactorAdd(fd, tcpAccept, port);
+        return true;
+    }
+
+    // The firmware only uses clientSocketFd once it sees the client connected
+    port->clientSocketFd = clientFd;
+    __atomic_store_n(&port->isClientConnected, true, __ATOMIC_RELEASE);
+    return true;
 }
 
 serialPort_t *tcpOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback, void *rxCallbackData, uint32_t baudRate, portMode_t mode, portOptions_t options)
@@ -208,95 +242,147 @@ serialPort_t *tcpOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
     port->serialPort.vTable = tcpVTable;
     port->serialPort.rxCallback = callback;
     port->serialPort.rxCallbackData = rxCallbackData;
-    port->serialPort.rxBufferHead = port->serialPort.rxBufferTail = 0;
     port->serialPort.rxBufferSize = TCP_BUFFER_SIZE;
     port->serialPort.rxBuffer = port->rxBuffer;
+    port->serialPort.txBufferSize = TCP_TX_BUFFER_SIZE;
+    port->serialPort.txBuffer = port->txBuffer;
+    port->txHead = port->txTail = 0;
     port->serialPort.mode = mode;
     port->serialPort.baudRate = baudRate;
     port->serialPort.options = options;
 
-    int err = pthread_create(&port->receiveThread, NULL, tcpReceiveThread, (void*)port);
-    if (err < 0){
-        fprintf(stderr, "[SOCKET] Unable to create receive thread for UART%d\n", id);
-        return NULL;
-    }
     return (serialPort_t*)port;
 }
 
 uint8_t tcpRead(serialPort_t *instance)
 {
-    uint8_t ch;
-    tcpPort_t *port = (tcpPort_t*)instance;
-    pthread_mutex_lock(&port->receiveMutex);
-
-    ch = port->serialPort.rxBuffer[port->serialPort.rxBufferTail];
-    port->serialPort.rxBufferTail = (port->serialPort.rxBufferTail + 1) % port->serialPort.rxBufferSize;
-
-    pthread_mutex_unlock(&port->receiveMutex);
-
+    uint8_t ch = 0;
+    spscRingReadByte(&((tcpPort_t*)instance)->rxRing, &ch);
     return ch;
 }
 
-void tcpWritBuf(serialPort_t *instance, const void *data, int count)
+static bool tcpSendPending(tcpPort_t *port, bool wait)
 {
-    tcpPort_t *port = (tcpPort_t*)instance;
-
-    if (!port->isClientConnected) {
-        return;
+    if (!__atomic_load_n(&port->isClientConnected, __ATOMIC_ACQUIRE)) {
+        port->txHead = port->txTail = 0;
+        return false;
     }
 
-    send(port->clientSocketFd, data, count, 0);
-}
+    // Stays open until tcpFlushAll() closes it, even if the client disconnects meanwhile
+    const int fd = port->clientSocketFd;
+
+    while (port->txTail < port->txHead) {
+        ssize_t sent = send(fd, &port->txBuffer[port->txTail], port->txHead - port->txTail, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait) {
+                struct pollfd pollFd = { .fd = fd, .events = POLLOUT };
+                poll(&pollFd, 1, 100);
+                if (!__atomic_load_n(&port->isClientConnected, __ATOMIC_ACQUIRE)) {
+                    port->txHead = port->txTail = 0;
+                    return false;
+                }
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // The reactor notices the broken connection
+                port->txHead = port->txTail = 0;
+            }
+            break;
+        }
+        port->txTail += sent;
+    }
 
-int getTcpPortIndex(const serialPort_t *instance) {
-    for (int i = 0; i < SERIAL_PORT_COUNT; i++) {
-        if ( &(tcpPorts[i].serialPort) == instance) return i;
+    if (port->txTail == port->txHead) {
+        port->txHead = port->txTail = 0;
     }
-    return -1;
+    return true;
 }
 
-void tcpWrite(serialPort_t *instance, uint8_t ch)
+void tcpFlushAll(void)
 {
-    tcpWritBuf(instance, (void*)&ch, 1);
+    for (int i = 0; i < SERIAL_PORT_COUNT; i++) {
+        tcpPort_t *port = &tcpPorts[i];
+
+        if (!port->isInitalized) {
+            continue;
+        }
+
+        // Close a disconnected client here, on the thread that sends to it, then take the next one
+        const int closingFd = __atomic_exchange_n(&port->closingFd, -1, __ATOMIC_ACQUIRE);
+        if (closingFd >= 0) {
+            close(closingFd);
+            port->txHead = port->txTail = 0;
+            ioReactorAdd(port->socketFd, tcpAccept, port);
+        }
 
-    int index = getTcpPortIndex(instance);
-    if ( !serialFCProxy && serialProxyIsConnected() && (index == (serialUartIndex-1)) ) {
-            serialProxyWriteData( (unsigned char *)&ch, 1);
+        if (port->txHead != port->txTail) {
+            tcpSendPending(port, false);
+        }
     }
 }
 
-uint32_t tcpTotalRxBytesWaiting(const serialPort_t *instance)
+void tcpWritBuf(serialPort_t *instance, const void *data, int count)
 {
     tcpPort_t *port = (tcpPort_t*)instance;
-    uint32_t count;
 
-    pthread_mutex_lock(&port->receiveMutex);
+    if ( !serialFCProxy && serialProxyIsConnected() && (port->id == serialUartIndex) ) {
+        serialProxyWriteData( (unsigned char *)data, count);
+    }
 
-    if (port->serialPort.rxBufferHead >= port->serialPort.rxBufferTail) {
-        count = port->serialPort.rxBufferHead - port->serialPort.rxBufferTail;
-    } else {
-        count = port->serialPort.rxBufferSize + port->serialPort.rxBufferHead - port->serialPort.rxBufferTail;
+    if (!__atomic_load_n(&port->isClientConnected, __ATOMIC_ACQUIRE)) {
+        return;
     }
 
-    pthread_mutex_unlock(&port->receiveMutex);
+    const uint8_t *bytes = data;
+    while (count > 0) {
+        if (port->txHead == TCP_TX_BUFFER_SIZE) {
+            // Full, this is the only place where the firmware waits for the client
+            if (!tcpSendPending(port, true)) {
+                return;
+            }
+            if (port->txTail > 0) {
+                memmove(port->txBuffer, &port->txBuffer[port->txTail], port->txHead - port->txTail);
+                port->txHead -= port->txTail;
+                port->txTail = 0;
+            }
+        }
 
-    return count;
+        const uint32_t chunk = MIN((uint32_t)count, TCP_TX_BUFFER_SIZE - port->txHead);
+        memcpy(&port->txBuffer[port->txHead], bytes, chunk);
+        port->txHead += chunk;
+        bytes += chunk;
+        count -= chunk;
+    }
+}
+
+void tcpWrite(serialPort_t *instance, uint8_t ch)
+{
+    tcpWritBuf(instance, &ch, 1);
+}
+
+uint32_t tcpTotalRxBytesWaiting(const serialPort_t *instance)
+{
+    return spscRingWaiting(&((const tcpPort_t*)instance)->rxRing);
 }
 
 uint32_t tcpRXBytesFree(int portIndex) {
-    return tcpPorts[portIndex].serialPort.rxBufferSize - tcpTotalRxBytesWaiting( &tcpPorts[portIndex].serialPort);
+    return spscRingFree(&tcpPorts[portIndex].rxRing);
 }
 
 uint32_t tcpTotalTxBytesFree(const serialPort_t *instance)
 {
-    UNUSED(instance);
-    return TCP_MAX_PACKET_SIZE;
+    const tcpPort_t *port = (const tcpPort_t*)instance;
+    return TCP_TX_BUFFER_SIZE - (port->txHead - port->txTail);
 }
 
 bool isTcpTransmitBufferEmpty(const serialPort_t *instance)
 {
-    UNUSED(instance);
-    return true;
+    tcpPort_t *port = (tcpPort_t*)instance;
+    tcpSendPending(port, false);
+    return port->txHead == port->txTail;
 }
 
 bool tcpIsConnected(const serialPort_t *instance)
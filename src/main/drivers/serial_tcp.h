@@ -26,33 +26,43 @@
 #include <netinet/in.h>
 #include <netdb.h>
 
+#include "common/spsc_ring.h"
+
 #include "drivers/serial.h"
 
 #define BASE_IP_ADDRESS 5760
-#define TCP_BUFFER_SIZE 2048
+#define TCP_BUFFER_SIZE 8192        // Power of two for the ring
+#define TCP_TX_BUFFER_SIZE 16384
 #define TCP_MAX_PACKET_SIZE 65535
 
 typedef struct
 {
     serialPort_t serialPort;
 
+    // Filled by the I/O reactor thread and read by the firmware without a lock
+    spscRing_t rxRing;
     uint8_t rxBuffer[TCP_BUFFER_SIZE];
 
+    // Written by the firmware and sent in one piece by tcpFlushAll() after every scheduler pass
+    uint8_t txBuffer[TCP_TX_BUFFER_SIZE];
+    uint32_t txHead;
+    uint32_t txTail;
+
     uint8_t id;
     bool isInitalized;
-    pthread_mutex_t receiveMutex;
-    pthread_t receiveThread;
+    pthread_mutex_t receiveMutex;   // Between the producers only, on Cygwin the serial proxy feeds its UART from the main loop
     int socketFd;
-    int clientSocketFd;
+    int clientSocketFd;             // Only changes while there is no client and closingFd has been closed
+    int closingFd;                  // Disconnected client, the firmware may still send to it until tcpFlushAll() closes it
     struct sockaddr_storage sockAddress;
     struct sockaddr_storage clientAddress;
     bool isClientConnected;
 } tcpPort_t;
 
 
+void tcpSetBasePort(uint16_t port);
 serialPort_t *tcpOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback, void *rxCallbackData, uint32_t baudRate, portMode_t mode, portOptions_t options);
 
-extern void tcpSend(tcpPort_t *port);
-extern int tcpReceive(tcpPort_t *port);
+extern void tcpFlushAll(void);
 extern void tcpReceiveBytesEx( int portIndex, const uint8_t* buffer, ssize_t recvSize );
 extern uint32_t tcpRXBytesFree(int portIndex);
\ No newline at end of file
@@ -242,6 +242,17 @@ void uartWrite(serialPort_t *instance, uint8_t ch)
     USART_ITConfig(s->USARTx, USART_IT_TXE, ENABLE);
 }
 
+static void uartTxStart(serialPort_t *instance)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    USART_ITConfig(s->USARTx, USART_IT_TXE, ENABLE);
+}
+
+void uartWriteBuf(serialPort_t *instance, const void *data, int count)
+{
+    serialWriteBufToTxBuffer(instance, data, count, uartTxStart);
+}
+
 bool isUartIdle(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t *)instance;
@@ -264,7 +275,7 @@ const struct serialPortVTable uartVTable[] = {
         .setMode = uartSetMode,
         .setOptions = uartSetOptions,
         .isConnected = NULL,
-        .writeBuf = NULL,
+        .writeBuf = uartWriteBuf,
         .beginWrite = NULL,
         .endWrite = NULL,
         .isIdle = isUartIdle,
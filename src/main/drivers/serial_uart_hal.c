@@ -253,6 +253,17 @@ void uartWrite(serialPort_t *instance, uint8_t ch)
     __HAL_UART_ENABLE_IT(&s->Handle, UART_IT_TXE);
 }
 
+static void uartTxStart(serialPort_t *instance)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    __HAL_UART_ENABLE_IT(&s->Handle, UART_IT_TXE);
+}
+
+void uartWriteBuf(serialPort_t *instance, const void *data, int count)
+{
+    serialWriteBufToTxBuffer(instance, data, count, uartTxStart);
+}
+
 bool isUartIdle(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t *)instance;
@@ -275,7 +286,7 @@ const struct serialPortVTable uartVTable[] = {
         .setMode = uartSetMode,
         .setOptions = uartSetOptions,
         .isConnected = NULL,
-        .writeBuf = NULL,
+        .writeBuf = uartWriteBuf,
         .beginWrite = NULL,
         .endWrite = NULL,
         .isIdle = isUartIdle,
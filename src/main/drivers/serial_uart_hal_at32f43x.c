@@ -246,6 +246,17 @@ void uartWrite(serialPort_t *instance, uint8_t ch)
 
 }
 
+static void uartTxStart(serialPort_t *instance)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    usart_interrupt_enable (s->USARTx, USART_TDBE_INT, TRUE);
+}
+
+void uartWriteBuf(serialPort_t *instance, const void *data, int count)
+{
+    serialWriteBufToTxBuffer(instance, data, count, uartTxStart);
+}
+
 bool isUartIdle(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t *)instance;
@@ -269,7 +280,7 @@ const struct serialPortVTable uartVTable[] = {
         .setMode = uartSetMode,
         .setOptions = uartSetOptions,
         .isConnected = NULL,
-        .writeBuf = NULL,
+        .writeBuf = uartWriteBuf,
         .beginWrite = NULL,
         .endWrite = NULL,
         .isIdle = isUartIdle,
@@ -28,6 +28,7 @@
 bool cliMode = false;
 
 #include "blackbox/blackbox.h"
+#include "blackbox/blackbox_pretrigger.h"
 
 #include "build/assert.h"
 #include "build/build_config.h"
@@ -126,6 +127,7 @@ bool cliMode = false;
 
 #include "telemetry/telemetry.h"
 #include "build/debug.h"
+#include "build/profiler.h"
 
 extern timeDelta_t cycleTime; // FIXME dependency on mw.c
 extern uint8_t detectedSensors[SENSOR_INDEX_COUNT];
@@ -184,6 +186,8 @@ static const char * const blackboxIncludeFlagNames[] = {
     "PEAKS_P",
     "PEAKS_Y",
     "SERVOS",
+    "GYRO_RATE",
+    "GYRO_RATE_MOTORS",
     NULL
 };
 #endif
@@ -3819,6 +3823,37 @@ static void cliStatus(char *cmdline)
         hardwareSensorStatusNames[getHwGPSStatus()]
     );
 
+    gyroDecimationInfo_t decimationInfo;
+    if (gyroGetDecimationInfo(&decimationInfo)) {
+        cliPrintLinef("Gyro decimation: %dx %s, %d taps, %d MAC/loop, delay %dus",
+            decimationInfo.factor, decimationInfo.filter == DECIMATOR_FIR ? "FIR" : "CIC",
+            decimationInfo.taps, decimationInfo.taps * XYZ_AXIS_COUNT, (int)decimationInfo.groupDelayUs);
+    }
+
+#ifdef USE_BLACKBOX
+    if (feature(FEATURE_BLACKBOX)) {
+        blackboxSnapshotQueueInfo_t snapshotQueueInfo;
+        blackboxGetSnapshotQueueInfo(&snapshotQueueInfo);
+        cliPrintLinef("Blackbox snapshots: queue %d, max depth %d, dropped %u",
+            snapshotQueueInfo.size, snapshotQueueInfo.maxDepth, (unsigned)snapshotQueueInfo.dropped);
+#ifdef USE_BLACKBOX_PRETRIGGER
+        if (blackboxConfig()->pretrigger_ms > 0) {
+            blackboxPretriggerInfo_t pretriggerInfo;
+            blackboxPretriggerGetInfo(&pretriggerInfo);
+            cliPrintLinef("Blackbox pre-trigger: %u ms in %u/%u bytes, room for %u of %u ms, overflows %u",
+                (unsigned)(pretriggerInfo.span / 1000), (unsigned)pretriggerInfo.used, (unsigned)pretriggerInfo.size,
+                (unsigned)MIN(pretriggerInfo.capacity / 1000, blackboxConfig()->pretrigger_ms), (unsigned)blackboxConfig()->pretrigger_ms,
+                (unsigned)pretriggerInfo.overflows);
+        }
+#endif
+        blackboxGyroRateInfo_t gyroRateInfo;
+        if (blackboxGetGyroRateInfo(&gyroRateInfo) && gyroRateInfo.channels > 0) {
+            cliPrintLinef("Blackbox gyro rate: %d channels, %d samples per block, dropped %u",
+                gyroRateInfo.channels, gyroRateInfo.blockSamples, (unsigned)gyroRateInfo.droppedSamples);
+        }
+    }
+#endif
+
 #ifdef USE_ESC_SENSOR
     uint8_t motorCount = getMotorCount();
     if (STATE(ESC_SENSOR_ENABLED) && motorCount > 0) {
@@ -3967,9 +4002,57 @@ static void cliStatus(char *cmdline)
     }
 }
 
+static void cliTasksHistogramRow(const char *label, const uint16_t *histogram)
+{
+    cliPrintf("%20s", label);
+    for (int bucket = 0; bucket < TASK_HISTOGRAM_BUCKET_COUNT; bucket++) {
+        cliPrintf(" %5d", histogram[bucket]);
+    }
+    cliPrintLinefeed();
+}
+
+static void cliTasksHistogram(void)
+{
+    cliPrintf("Task histograms (us)");
+    for (int bucket = 0; bucket < TASK_HISTOGRAM_BUCKET_COUNT; bucket++) {
+        const uint32_t upperBound = taskHistogramBucketUpperBound(bucket);
+        char label[8];
+        if (upperBound == 0) {
+            tfp_sprintf(label, "more");
+        } else if (upperBound >= 1000) {
+            tfp_sprintf(label, "<%dk", (int)(upperBound / 1000));
+        } else {
+            tfp_sprintf(label, "<%d", (int)upperBound);
+        }
+        cliPrintf(" %5s", label);
+    }
+    cliPrintLinefeed();
+
+    for (cfTaskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+        cfTaskInfo_t taskInfo;
+        getTaskInfo(taskId, &taskInfo);
+        if (taskInfo.isEnabled) {
+            cfTaskHistogram_t histogram;
+            getTaskHistogram(taskId, &histogram);
+            cliPrintLinef("%2d - %s", taskId, taskInfo.taskName);
+            cliTasksHistogramRow("start latency", histogram.startLatency);
+            cliTasksHistogramRow("execution time", histogram.executionTime);
+        }
+    }
+}
+
 static void cliTasks(char *cmdline)
 {
-    UNUSED(cmdline);
+    if (sl_strncasecmp(cmdline, "histo", 5) == 0) {
+        const char *arg = nextArg(cmdline);
+        if (arg && sl_strcasecmp(arg, "reset") == 0) {
+            schedulerResetTaskHistograms();
+        } else {
+            cliTasksHistogram();
+        }
+        return;
+    }
+
     int maxLoadSum = 0;
     int averageLoadSum = 0;
     cfCheckFuncInfo_t checkFuncInfo;
@@ -3996,6 +4079,38 @@ static void cliTasks(char *cmdline)
     cliPrintLinef("Total (excluding SERIAL) %21d.%1d%% %4d.%1d%%", maxLoadSum/10, maxLoadSum%10, averageLoadSum/10, averageLoadSum%10);
 }
 
+#ifdef USE_PROFILER
+static void cliProfiler(char *cmdline)
+{
+    if (sl_strcasecmp(cmdline, "reset") == 0) {
+        profilerReset();
+        return;
+    }
+#ifdef SITL_BUILD
+    if (sl_strncasecmp(cmdline, "trace", 5) == 0) {
+        const char *fileName = nextArg(cmdline);
+        if (isEmpty(fileName)) {
+            fileName = "profiler_trace.json";
+        }
+        if (profilerWriteChromeTrace(fileName)) {
+            cliPrintLinef("Trace written to %s", fileName);
+        } else {
+            cliPrintErrorLinef("Unable to write %s", fileName);
+        }
+        return;
+    }
+#endif
+
+    cliPrintLinef("Probe (ticks, %d per us)   count      min      avg      max      p99", (int)profilerTicksPerUs());
+    for (profileProbeId_e probe = 0; probe < PROFILE_PROBE_COUNT; probe++) {
+        profileProbeInfo_t info;
+        profilerGetProbeInfo(probe, &info);
+        cliPrintLinef("%2d - %16s %9u %8u %8u %8u %8u", probe, profilerProbeName(probe),
+            (unsigned)info.count, (unsigned)info.minTicks, (unsigned)info.averageTicks, (unsigned)info.maxTicks, (unsigned)info.p99Ticks);
+    }
+}
+#endif
+
 static void cliVersion(char *cmdline)
 {
     UNUSED(cmdline);
@@ -4549,6 +4664,13 @@ const clicmd_t cmdTable[] = {
     CLI_COMMAND_DEF("msc", "switch into msc mode", NULL, cliMsc),
 #endif
     CLI_COMMAND_DEF("play_sound", NULL, "[<index>]\r\n", cliPlaySound),
+#ifdef USE_PROFILER
+#ifdef SITL_BUILD
+    CLI_COMMAND_DEF("profiler", "show hot path probe stats", "[reset|trace [<file>]]", cliProfiler),
+#else
+    CLI_COMMAND_DEF("profiler", "show hot path probe stats", "[reset]", cliProfiler),
+#endif
+#endif
     CLI_COMMAND_DEF("control_profile", "change control profile", "[<index>]", cliControlProfile),
     CLI_COMMAND_DEF("mixer_profile", "change mixer profile", "[<index>]", cliMixerProfile),
     CLI_COMMAND_DEF("battery_profile", "change battery profile", "[<index>]", cliBatteryProfile),
@@ -4589,7 +4711,7 @@ const clicmd_t cmdTable[] = {
 #endif
     CLI_COMMAND_DEF("showdebug", "Show debug fields.", NULL, cliCmdDebug),
     CLI_COMMAND_DEF("status", "show status", NULL, cliStatus),
-    CLI_COMMAND_DEF("tasks", "show task stats", NULL, cliTasks),
+    CLI_COMMAND_DEF("tasks", "show task stats", "[histo [reset]]", cliTasks),
 #ifdef USE_TEMPERATURE_SENSOR
     CLI_COMMAND_DEF("temp_sensor", "change temp sensor settings", NULL, cliTempSensor),
 #endif
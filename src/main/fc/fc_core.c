@@ -24,6 +24,7 @@
 #include "blackbox/blackbox.h"
 
 #include "build/debug.h"
+#include "build/profiler.h"
 
 #include "common/maths.h"
 #include "common/axis.h"
@@ -837,7 +838,6 @@ void processRx(timeUs_t currentTimeUs)
 
 // Function for loop trigger
 void FAST_CODE taskGyro(timeUs_t currentTimeUs) {
-    UNUSED(currentTimeUs);
     // getTaskDeltaTime() returns delta time frozen at the moment of entering the scheduler. currentTime is frozen at the very same point.
     // To make busy-waiting timeout work we need to account for time spent within busy-waiting loop
     const timeDelta_t currentDeltaTime = getTaskDeltaTime(TASK_SELF);
@@ -845,6 +845,12 @@ void FAST_CODE taskGyro(timeUs_t currentTimeUs) {
     /* Update actual hardware readings */
     gyroUpdate();
 
+#ifdef USE_BLACKBOX
+    blackboxLogGyroSample(currentTimeUs);
+#else
+    UNUSED(currentTimeUs);
+#endif
+
 #ifdef USE_OPFLOW
     if (sensors(SENSOR_OPFLOW)) {
         opflowGyroUpdateCallback(currentDeltaTime);
@@ -905,10 +911,14 @@ void taskMainPidLoop(timeUs_t currentTimeUs)
     if (ARMING_FLAG(SIMULATOR_MODE_HITL) || lockMainPID()) {
 #endif
 
+    PROFILE_BEGIN(PROFILE_PROBE_GYRO_FILTER);
     gyroFilter();
+    PROFILE_END(PROFILE_PROBE_GYRO_FILTER);
 
     imuUpdateAccelerometer();
+    PROFILE_BEGIN(PROFILE_PROBE_IMU_UPDATE_ATTITUDE);
     imuUpdateAttitude(currentTimeUs);
+    PROFILE_END(PROFILE_PROBE_IMU_UPDATE_ATTITUDE);
 
 #if defined(SITL_BUILD)
     }
@@ -927,7 +937,9 @@ void taskMainPidLoop(timeUs_t currentTimeUs)
     }
     isRXDataNew = false;
 
+    PROFILE_BEGIN(PROFILE_PROBE_POSITION_ESTIMATOR);
     updatePositionEstimator();
+    PROFILE_END(PROFILE_PROBE_POSITION_ESTIMATOR);
     applyWaypointNavigationAndAltitudeHold();
 
     // Apply throttle tilt compensation
@@ -938,9 +950,13 @@ void taskMainPidLoop(timeUs_t currentTimeUs)
 #endif
 
     // Calculate stabilisation
+    PROFILE_BEGIN(PROFILE_PROBE_PID_CONTROLLER);
     pidController(dT);
+    PROFILE_END(PROFILE_PROBE_PID_CONTROLLER);
 
+    PROFILE_BEGIN(PROFILE_PROBE_MIXER);
     mixTable();
+    PROFILE_END(PROFILE_PROBE_MIXER);
 
     if (isMixerUsingServos()) {
         servoMixer(dT);
@@ -975,7 +991,9 @@ void taskMainPidLoop(timeUs_t currentTimeUs)
 
 #ifdef USE_BLACKBOX
     if (!cliMode && feature(FEATURE_BLACKBOX)) {
+        PROFILE_BEGIN(PROFILE_PROBE_BLACKBOX);
         blackboxUpdate(micros());
+        PROFILE_END(PROFILE_PROBE_BLACKBOX);
     }
 #endif
 }
@@ -28,6 +28,7 @@
 #include "blackbox/blackbox.h"
 
 #include "build/debug.h"
+#include "build/profiler.h"
 #include "build/version.h"
 
 #include "common/axis.h"
@@ -86,6 +87,7 @@
 
 #include "io/adsb.h"
 #include "io/asyncfatfs/asyncfatfs.h"
+#include "io/dataflash_stream.h"
 #include "io/flashfs.h"
 #include "io/gps.h"
 #include "io/gps_ublox.h"
@@ -864,6 +866,22 @@ static bool mspFcProcessOutCommand(uint16_t cmdMSP, sbuf_t *dst, mspPostProcessF
         sbufWriteU8(dst, batteryMetersConfig()->capacity_unit);
         break;
 
+#ifdef USE_PROFILER
+    case MSP2_INAV_PROFILER:
+        sbufWriteU32(dst, profilerTicksPerUs());
+        sbufWriteU8(dst, PROFILE_PROBE_COUNT);
+        for (profileProbeId_e probe = 0; probe < PROFILE_PROBE_COUNT; probe++) {
+            profileProbeInfo_t info;
+            profilerGetProbeInfo(probe, &info);
+            sbufWriteU32(dst, info.count);
+            sbufWriteU32(dst, info.minTicks);
+            sbufWriteU32(dst, info.averageTicks);
+            sbufWriteU32(dst, info.maxTicks);
+            sbufWriteU32(dst, info.p99Ticks);
+        }
+        break;
+#endif
+
     case MSP2_INAV_MISC2:
         // Timers
         sbufWriteU32(dst, micros() / 1000000); // On time (seconds)
@@ -1745,6 +1763,27 @@ static mspResult_e mspFcSafeHomeOutCommand(sbuf_t *dst, sbuf_t *src)
 }
 #endif
 
+static mspResult_e mspFcTaskHistogramCommand(sbuf_t *dst, sbuf_t *src)
+{
+    uint8_t taskId;
+    if (!sbufReadU8Safe(&taskId, src) || taskId >= TASK_COUNT) {
+        return MSP_RESULT_ERROR;
+    }
+
+    cfTaskHistogram_t histogram;
+    getTaskHistogram(taskId, &histogram);
+
+    sbufWriteU8(dst, taskId);
+    sbufWriteU8(dst, TASK_HISTOGRAM_BUCKET_COUNT);
+    for (int bucket = 0; bucket < TASK_HISTOGRAM_BUCKET_COUNT; bucket++) {
+        sbufWriteU16(dst, histogram.startLatency[bucket]);
+    }
+    for (int bucket = 0; bucket < TASK_HISTOGRAM_BUCKET_COUNT; bucket++) {
+        sbufWriteU16(dst, histogram.executionTime[bucket]);
+    }
+    return MSP_RESULT_ACK;
+}
+
 #ifdef USE_FW_AUTOLAND
 static mspResult_e mspFwApproachOutCommand(sbuf_t *dst, sbuf_t *src)
 {
@@ -1817,6 +1856,95 @@ static void mspFcDataFlashReadCommand(sbuf_t *dst, sbuf_t *src)
 
     serializeDataflashReadReply(dst, readAddress, readLength);
 }
+
+#define MSP_BLACKBOX_LOG_LIST_MAX_ENTRIES 32
+
+static void mspFcBlackboxLogListCommand(sbuf_t *dst, sbuf_t *src)
+{
+    uint16_t firstLog = 0;
+
+    // Request payload:
+    //  uint16_t    - first log to list (optional)
+    sbufReadU16Safe(&firstLog, src);
+
+    const int logCount = flashfsGetLogCount();
+
+    sbufWriteU16(dst, logCount);
+    sbufWriteU16(dst, firstLog);
+
+    // Damaged index entries are sent as zeros
+    for (int i = firstLog; i < logCount && i < firstLog + MSP_BLACKBOX_LOG_LIST_MAX_ENTRIES; i++) {
+        flashfsLogEntry_t entry;
+
+        flashfsGetLog(i, &entry);
+        sbufWriteU32(dst, entry.start);
+        sbufWriteU32(dst, entry.length);
+        sbufWriteU32(dst, entry.timestamp);
+        sbufWriteU16(dst, entry.duration);
+        sbufWriteU8(dst, entry.flags);
+    }
+}
+
+static bool mspFcBlackboxLogReadCommand(sbuf_t *dst, sbuf_t *src)
+{
+    uint16_t logIndex;
+    uint32_t offset;
+    uint16_t size;
+    flashfsLogEntry_t entry;
+
+    // Request payload:
+    //  uint16_t    - log to read from
+    //  uint32_t    - offset in the log
+    //  uint16_t    - size of block to read, the reply holds less at the end of the log or if it doesn't fit
+    if (!sbufReadU16Safe(&logIndex, src) || !sbufReadU32Safe(&offset, src) || !sbufReadU16Safe(&size, src)) {
+        return false;
+    }
+
+    if (!flashfsGetLog(logIndex, &entry) || offset > entry.length) {
+        return false;
+    }
+
+    sbufWriteU16(dst, logIndex);
+    sbufWriteU32(dst, offset);
+
+    const uint32_t readLength = MIN(MIN(size, (uint32_t)sbufBytesRemaining(dst)), entry.length - offset);
+    const int bytesRead = flashfsReadAbs(entry.start + offset, sbufPtr(dst), readLength);
+    sbufAdvance(dst, bytesRead);
+
+    return true;
+}
+
+static bool mspFcBlackboxStreamStartCommand(sbuf_t *dst, sbuf_t *src, mspPostProcessFnPtr *mspPostProcessFn)
+{
+    dataflashStreamRequest_t request;
+
+    // Request payload:
+    //  uint32_t    - flash address to start at
+    //  uint32_t    - bytes to send, 0 stops the stream
+    //  uint16_t    - flash bytes per frame
+    //  uint8_t     - frames sent ahead of the acknowledgements
+    //  uint8_t     - DATAFLASH_STREAM_* flags
+    if (!sbufReadU32Safe(&request.address, src) || !sbufReadU32Safe(&request.length, src)
+            || !sbufReadU16Safe(&request.chunkSize, src) || !sbufReadU8Safe(&request.window, src)
+            || !sbufReadU8Safe(&request.flags, src) || ARMING_FLAG(ARMED)) {
+        return false;
+    }
+
+    dataflashStreamRequest(&request);
+
+    // The reply holds the request as it was clipped. The stream starts once the reply was sent
+    sbufWriteU32(dst, request.address);
+    sbufWriteU32(dst, request.length);
+    sbufWriteU16(dst, request.chunkSize);
+    sbufWriteU8(dst, request.window);
+    sbufWriteU8(dst, request.flags);
+
+    if (mspPostProcessFn && request.length > 0) {
+        *mspPostProcessFn = dataflashStreamAttach;
+    }
+
+    return true;
+}
 #endif
 
 static mspResult_e mspFcProcessInCommand(uint16_t cmdMSP, sbuf_t *src)
@@ -2588,6 +2716,7 @@ static mspResult_e mspFcProcessInCommand(uint16_t cmdMSP, sbuf_t *src)
             blackboxConfigMutable()->rate_num = sbufReadU16(src);
             blackboxConfigMutable()->rate_denom = sbufReadU16(src);
             blackboxConfigMutable()->includeFlags = sbufReadU32(src);
+            blackboxConfigChanged();
         } else
             return MSP_RESULT_ERROR;
         break;
@@ -2734,8 +2863,18 @@ static mspResult_e mspFcProcessInCommand(uint16_t cmdMSP, sbuf_t *src)
 
 #ifdef USE_FLASHFS
     case MSP_DATAFLASH_ERASE:
+        dataflashStreamStop();
         flashfsEraseCompletely();
         break;
+
+    case MSP2_BLACKBOX_STREAM_ACK:
+        if (dataSize < 5) {
+            return MSP_RESULT_ERROR;
+        } else {
+            const uint32_t address = sbufReadU32(src);
+            dataflashStreamAck(address, sbufReadU8(src));
+        }
+        break;
 #endif
 
 #ifdef USE_GPS
@@ -3796,6 +3935,15 @@ bool mspFCProcessInOutCommand(uint16_t cmdMSP, sbuf_t *dst, sbuf_t *src, mspResu
         mspFcDataFlashReadCommand(dst, src);
         *ret = MSP_RESULT_ACK;
         break;
+
+    case MSP2_BLACKBOX_LOG_LIST:
+        mspFcBlackboxLogListCommand(dst, src);
+        *ret = MSP_RESULT_ACK;
+        break;
+
+    case MSP2_BLACKBOX_LOG_READ:
+        *ret = mspFcBlackboxLogReadCommand(dst, src) ? MSP_RESULT_ACK : MSP_RESULT_ERROR;
+        break;
 #endif
 
     case MSP2_COMMON_SETTING:
@@ -3855,6 +4003,10 @@ bool mspFCProcessInOutCommand(uint16_t cmdMSP, sbuf_t *dst, sbuf_t *src, mspResu
         *ret = mspFcSafeHomeOutCommand(dst, src);
         break;
 #endif
+    case MSP2_INAV_TASK_HISTOGRAM:
+        *ret = mspFcTaskHistogramCommand(dst, src);
+        break;
+
 #ifdef USE_FW_AUTOLAND
     case MSP2_INAV_FW_APPROACH:
         *ret = mspFwApproachOutCommand(dst, src);
@@ -4153,6 +4305,10 @@ mspResult_e mspFcProcessCommand(mspPacket_t *cmd, mspPacket_t *reply, mspPostPro
     } else if (cmdMSP == MSP_SET_PASSTHROUGH) {
         mspFcSetPassthroughCommand(dst, src, mspPostProcessFn);
         ret = MSP_RESULT_ACK;
+#if defined(USE_FLASHFS)
+    } else if (cmdMSP == MSP2_BLACKBOX_STREAM_START) {
+        ret = mspFcBlackboxStreamStartCommand(dst, src, mspPostProcessFn) ? MSP_RESULT_ACK : MSP_RESULT_ERROR;
+#endif
     } else {
         if (!mspFCProcessInOutCommand(cmdMSP, dst, src, &ret)) {
             ret = mspFcProcessInCommand(cmdMSP, src);
@@ -21,6 +21,8 @@
 
 #include "platform.h"
 
+#include "blackbox/blackbox.h"
+
 #include "cms/cms.h"
 
 #include "common/axis.h"
@@ -60,6 +62,7 @@
 #include "io/beeper.h"
 #include "io/lights.h"
 #include "io/dashboard.h"
+#include "io/dataflash_stream.h"
 #include "io/gps.h"
 #include "io/ledstrip.h"
 #include "io/osd.h"
@@ -125,6 +128,9 @@ void taskHandleSerial(timeUs_t currentTimeUs)
 #endif
 #endif
 
+#ifdef USE_FLASHFS
+    dataflashStreamProcess(currentTimeUs);
+#endif
 }
 void taskUpdateBattery(timeUs_t currentTimeUs)
 {
@@ -342,6 +348,7 @@ void taskUpdateAux(timeUs_t currentTimeUs)
 void fcTasksInit(void)
 {
     schedulerInit();
+    schedulerSetMode(systemConfig()->schedulerMode);
 
     rescheduleTask(TASK_PID, getLooptime());
     setTaskEnabled(TASK_PID, true);
@@ -450,6 +457,11 @@ void fcTasksInit(void)
     ));
 #endif
 
+#ifdef USE_BLACKBOX
+    rescheduleTask(TASK_BLACKBOX, getLooptime());
+    setTaskEnabled(TASK_BLACKBOX, feature(FEATURE_BLACKBOX));
+#endif
+
 #if defined(SITL_BUILD)
     serialProxyStart();
 #endif
@@ -740,4 +752,13 @@ cfTask_t cfTasks[TASK_COUNT] = {
     },
 #endif
 
+#ifdef USE_BLACKBOX
+    [TASK_BLACKBOX] = {
+        .taskName = "BLACKBOX",
+        .taskFunc = blackboxEncodeTask,
+        .desiredPeriod = TASK_PERIOD_HZ(1000),      // Rescheduled to the PID looptime
+        .staticPriority = TASK_PRIORITY_MEDIUM_HIGH,
+    },
+#endif
+
 };
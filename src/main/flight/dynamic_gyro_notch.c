@@ -34,29 +34,24 @@
 
 void dynamicGyroNotchFiltersInit(dynamicGyroNotchState_t *state) {
 
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
-            state->filtersApplyFn[axis][i] = nullFilterApply;
-        }
-    }
-
     state->dynNotchQ = gyroConfig()->dynamicGyroNotchQ / 100.0f;
     state->enabled = gyroConfig()->dynamicGyroNotchEnabled;
     state->looptime = getLooptime();
 
     if (state->enabled) {
+        /*
+         * Notch Q and looptime do not change in flight, so the coefficients are tabulated
+         * once and every frequency update is a table lookup
+         */
+        biquadNotchTableInit(&state->notchTable, 0.0f, DYNAMIC_NOTCH_TABLE_MAX_RATIO * 1000000.0f / state->looptime, state->looptime, state->dynNotchQ);
+
         /*
          * Step 1 - init all filters even if they will not be used further down the road
+         * Any initial notch Q is valid sice it will be updated immediately after
          */
-        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-            //Any initial notch Q is valid sice it will be updated immediately after
-            for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
-                biquadFilterInit(&state->filters[axis][i], DYNAMIC_NOTCH_DEFAULT_CENTER_HZ, state->looptime, 1.0f, FILTER_NOTCH);
-                state->filtersApplyFn[axis][i] = (filterApplyFnPtr)biquadFilterApplyDF1;
-            }
-        
+        for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
+            biquadFilterVec3Init(&state->filters[i], DYNAMIC_NOTCH_DEFAULT_CENTER_HZ, state->looptime, 1.0f, FILTER_NOTCH);
         }
-
     }
 }
 
@@ -69,24 +64,19 @@ void dynamicGyroNotchFiltersUpdate(dynamicGyroNotchState_t *state, int axis, flo
 
             // Filter update happens only if peak was detected 
             if (frequency[i] > 0.0f) {
-                biquadFilterUpdate(&state->filters[axis][i], frequency[i], state->looptime, state->dynNotchQ, FILTER_NOTCH);
+                biquadFilterVec3UpdateNotch(&state->filters[i], axis, &state->notchTable, frequency[i]);
             }
         }
     }
 }
 
-float dynamicGyroNotchFiltersApply(dynamicGyroNotchState_t *state, int axis, float input) {
-    float output = input; 
-
-    /*
-     * We always apply all filters. If a filter dimension is disabled, one of
-     * the function pointers will be a null apply function
-     */
+/*
+ * Filters all three axes at once, called only when dynamic notch is enabled
+ */
+void dynamicGyroNotchFiltersApply(dynamicGyroNotchState_t *state, float *gyroADCf) {
     for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
-        output = state->filtersApplyFn[axis][i]((filter_t *)&state->filters[axis][i], output);
+        biquadFilterVec3ApplyDF1(&state->filters[i], gyroADCf);
     }
-
-    return output;
 }
 
 #endif
\ No newline at end of file
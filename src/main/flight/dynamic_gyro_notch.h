@@ -27,9 +27,16 @@
 #include <stdint.h>
 #include "common/axis.h"
 #include "common/filter.h"
+#include "common/filter_vec3.h"
 
 #define DYNAMIC_NOTCH_DEFAULT_CENTER_HZ 350
 
+/*
+ * Dynamic notch coefficients are tabulated from 0Hz up to this fraction of the loop rate,
+ * which keeps the notches below Nyquist frequency
+ */
+#define DYNAMIC_NOTCH_TABLE_MAX_RATIO 0.48f
+
 /*
  * Number of peaks to detect with Dynamic Notch Filter aka Matrix Filter. This is equal to the number of dynamic notch filters
  */
@@ -40,10 +47,10 @@ typedef struct dynamicGyroNotchState_s {
     uint32_t looptime;
     uint8_t enabled;
     
-    biquadFilter_t filters[XYZ_AXIS_COUNT][DYN_NOTCH_PEAK_COUNT];
-    filterApplyFnPtr filtersApplyFn[XYZ_AXIS_COUNT][DYN_NOTCH_PEAK_COUNT];
+    biquadNotchTable_t notchTable;
+    biquadFilterVec3_t filters[DYN_NOTCH_PEAK_COUNT];
 } dynamicGyroNotchState_t;
 
 void dynamicGyroNotchFiltersInit(dynamicGyroNotchState_t *state);
 void dynamicGyroNotchFiltersUpdate(dynamicGyroNotchState_t *state, int axis, float frequency[]);
-float dynamicGyroNotchFiltersApply(dynamicGyroNotchState_t *state, int axis, float input);
+void dynamicGyroNotchFiltersApply(dynamicGyroNotchState_t *state, float *gyroADCf);
@@ -24,6 +24,8 @@
 
 #include "build/debug.h"
 
+#include "blackbox/blackbox.h"
+
 #include "common/axis.h"
 
 #include "config/feature.h"
@@ -247,6 +249,10 @@ static void failsafeActivate(failsafePhase_e newPhase)
 #endif
 
     failsafeState.events++;
+
+#ifdef USE_BLACKBOX
+    blackboxTrigger(BLACKBOX_TRIGGER_FAILSAFE);
+#endif
 }
 
 void failsafeUpdateRcCommandValues(void)
@@ -24,6 +24,8 @@
  * test pilots icr4sh, UAV Tech, Flint723
  */
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 
 #include "platform.h"
 
@@ -45,20 +47,33 @@
 
 #include "gyroanalyse.h"
 
+/*
+ * The real FFT of windowSize samples is computed as a complex FFT of windowSize / 2 points
+ * followed by a split step. The work is cut into steps of bounded size, one step is
+ * executed per gyroDataAnalyse() call, so the worst case cost per call does not depend
+ * on the window size, only the number of calls needed to analyse an axis does.
+ *
+ * The sliding DFT analyser updates the spectrum of every axis with each new sample
+ * and skips straight from waiting to computing the windowed magnitudes.
+ */
 enum {
-    STEP_ARM_CFFT_F32,
-    STEP_BITREVERSAL_AND_STAGE_RFFT_F32,
-    STEP_MAGNITUDE_AND_FREQUENCY,
-    STEP_UPDATE_FILTERS_AND_HANNING,
+    STEP_WAIT_FOR_WINDOW,
+    STEP_SDFT_MAGNITUDE,
+    STEP_WINDOW_AND_BITREVERSAL,
+    STEP_BUTTERFLIES,
+    STEP_SPLIT_AND_MAGNITUDE,
+    STEP_FIND_PEAKS,
+    STEP_UPDATE_FILTERS,
     STEP_COUNT
 };
 
-// The FFT splits the frequency domain into an number of bins
-// A sampling frequency of 1000 and max frequency of 500 at a window size of 32 gives 16 frequency bins each 31.25Hz wide
-// Eg [0,31), [31,62), [62, 93) etc
-// for gyro loop >= 4KHz, sample rate 2000 defines FFT range to 1000Hz, 16 bins each 62.5 Hz wide
-// NB  FFT_WINDOW_SIZE is set to 32 in gyroanalyse.h
-#define FFT_BIN_COUNT             (FFT_WINDOW_SIZE / 2)
+// Work done in a single step
+#define FFT_WINDOW_POINTS_PER_STEP  32      // complex points (two gyro samples each)
+#define FFT_BUTTERFLIES_PER_STEP    32      // radix-2 butterflies
+#define FFT_SPLIT_PAIRS_PER_STEP    16      // bin pairs, two magnitudes each
+#define FFT_PEAK_BINS_PER_STEP      64
+#define SDFT_MAGNITUDE_BINS_PER_STEP 64
+
 // smoothing frequency for FFT centre frequency
 #define DYN_NOTCH_SMOOTH_FREQ_HZ  25
 
@@ -66,33 +81,118 @@ enum {
  * Slow down gyro sample acquisition. This lowers the max frequency but increases the resolution.
  * On default 500us looptime and denominator 1, max frequency is 1000Hz with a resolution of 31.25Hz
  * On default 500us looptime and denominator 2, max frequency is 500Hz with a resolution of 15.6Hz
+ * Doubling the FFT window size halves the resolution again
  */
 #define FFT_SAMPLING_DENOMINATOR 2
 
+static uint16_t stepsFor(uint16_t work, uint16_t workPerStep)
+{
+    return (work + workPerStep - 1) / workPerStep;
+}
+
+/*
+ * Number of gyroDataAnalyse() calls needed to analyse one axis, not counting the wait for new samples
+ */
+uint16_t gyroDataAnalyseStepsPerAxis(const gyroAnalyseState_t *state)
+{
+    const uint16_t complexPoints = state->windowSize / 2;
+    const uint16_t butterflies = (complexPoints / 2) * (31 - __builtin_clz(complexPoints));
+    const uint16_t peakBins = state->binCount - 2 - state->fftStartBin;
+
+    if (state->analyser == DYNAMIC_NOTCH_ANALYSER_SDFT) {
+        return stepsFor(state->binCount - state->fftStartBin, SDFT_MAGNITUDE_BINS_PER_STEP) +
+            stepsFor(MAX(peakBins, 1), FFT_PEAK_BINS_PER_STEP) +
+            1;
+    }
+
+    return stepsFor(complexPoints, FFT_WINDOW_POINTS_PER_STEP) +
+        stepsFor(butterflies, FFT_BUTTERFLIES_PER_STEP) +
+        stepsFor(complexPoints / 2, FFT_SPLIT_PAIRS_PER_STEP) +
+        stepsFor(MAX(peakBins, 1), FFT_PEAK_BINS_PER_STEP) +
+        1;
+}
+
+static void fftInit(gyroAnalyseState_t *state)
+{
+    for (int i = 0; i < state->windowSize; i++) {
+        state->fft.hanningWindow[i] = (0.5f - 0.5f * cos_approx(2 * M_PIf * i / (state->windowSize - 1)));
+    }
+
+    const int complexPoints = state->windowSize / 2;
+    const int bits = 31 - __builtin_clz(complexPoints);
+    for (int i = 0; i < complexPoints; i++) {
+        state->fft.twiddleCos[i] = cosf(2 * M_PIf * i / state->windowSize);
+        state->fft.twiddleSin[i] = sinf(2 * M_PIf * i / state->windowSize);
+
+        int reversed = 0;
+        for (int bit = 0; bit < bits; bit++) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        state->fft.bitReverse[i] = reversed;
+    }
+}
+
+static void sdftInit(gyroAnalyseState_t *state)
+{
+    // Magnitudes from fftStartBin up are needed, the frequency domain window also uses the neighbour bins
+    state->sdft.startBin = state->fftStartBin - 1;
+    state->sdft.dampingN = powf(DYN_NOTCH_SDFT_DAMPING, state->windowSize);
+
+    for (int k = 0; k <= state->binCount; k++) {
+        state->sdft.twiddleRe[k] = DYN_NOTCH_SDFT_DAMPING * cosf(2 * M_PIf * k / state->windowSize);
+        state->sdft.twiddleIm[k] = DYN_NOTCH_SDFT_DAMPING * sinf(2 * M_PIf * k / state->windowSize);
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int k = 0; k <= state->binCount; k++) {
+            state->sdft.re[axis][k] = 0.0f;
+            state->sdft.im[axis][k] = 0.0f;
+        }
+    }
+}
+
 void gyroDataAnalyseStateInit(
     gyroAnalyseState_t *state, 
     uint16_t minFrequency,
-    uint32_t targetLooptimeUs
+    uint32_t targetLooptimeUs,
+    uint16_t windowSize,
+    bool overlap,
+    uint8_t analyser
 ) {
+    state->analyser = analyser;
     state->minFrequency = minFrequency;
+    state->windowSize = constrain(windowSize, 64, DYN_NOTCH_FFT_MAX_WINDOW_SIZE);
+    state->binCount = state->windowSize / 2;
+    // The sliding DFT always covers the most recent samples
+    state->windowHop = (overlap || analyser == DYNAMIC_NOTCH_ANALYSER_SDFT) ? 0 : state->windowSize;
 
     state->fftSamplingRateHz = 1e6f / targetLooptimeUs / FFT_SAMPLING_DENOMINATOR;
     state->maxFrequency = state->fftSamplingRateHz / 2; //max possible frequency is half the sampling rate
-    state->fftResolution = (float)state->maxFrequency / FFT_BIN_COUNT;
+    state->fftResolution = (float)state->maxFrequency / state->binCount;
 
-    state->fftStartBin = state->minFrequency / lrintf(state->fftResolution);
+    state->fftStartBin = constrain(state->minFrequency / state->fftResolution, 1, state->binCount - 3);
 
-    for (int i = 0; i < FFT_WINDOW_SIZE; i++) {
-        state->hanningWindow[i] = (0.5f - 0.5f * cos_approx(2 * M_PIf * i / (FFT_WINDOW_SIZE - 1)));
+    if (state->analyser == DYNAMIC_NOTCH_ANALYSER_SDFT) {
+        sdftInit(state);
+    } else {
+        fftInit(state);
     }
 
-    arm_rfft_fast_init_f32(&state->fftInstance, FFT_WINDOW_SIZE);
+    // The sliding DFT removes samples leaving the window, they have to be the ones that were added
+    memset(state->downsampledGyroData, 0, sizeof(state->downsampledGyroData));
+    state->circularBufferIdx = 0;
+    state->samplingIndex = 0;
+    state->sampleCount = 0;
+    state->updateStep = STEP_WAIT_FOR_WINDOW;
+    state->updateAxis = 0;
 
-    // Frequency filter is executed every 12 cycles. 4 steps per cycle, 3 axises
-    const uint32_t filterUpdateUs = targetLooptimeUs * STEP_COUNT * XYZ_AXIS_COUNT;
+    // Every axis gets analysed once per 3 analyses, unless waiting for a fresh window takes longer
+    const uint32_t updateLoops = MAX((uint32_t)gyroDataAnalyseStepsPerAxis(state) * XYZ_AXIS_COUNT, (uint32_t)state->windowHop * FFT_SAMPLING_DENOMINATOR);
+    const uint32_t filterUpdateUs = targetLooptimeUs * updateLoops;
 
     for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        
+        state->windowSampleCount[axis] = 0;
+
         for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
             state->centerFrequency[axis][i] = state->maxFrequency;
             pt1FilterInit(&state->detectedFrequencyFilter[axis][i], DYN_NOTCH_SMOOTH_FREQ_HZ, US2S(filterUpdateUs));
@@ -108,6 +208,24 @@ void gyroDataAnalysePush(gyroAnalyseState_t *state, const int axis, const float
 
 static void gyroDataAnalyseUpdate(gyroAnalyseState_t *state);
 
+/*
+ * Sliding DFT, X[k] of the last windowSize samples is rotated by one sample with
+ * X[k] = (X[k] + newSample - oldSample) * e^(j * 2 * pi * k / windowSize)
+ */
+static void FAST_CODE sdftPush(gyroAnalyseState_t *state, int axis, float newSample, float oldSample)
+{
+    const float delta = newSample - state->sdft.dampingN * oldSample;
+    float *re = state->sdft.re[axis];
+    float *im = state->sdft.im[axis];
+
+    for (int k = state->sdft.startBin; k <= state->binCount; k++) {
+        const float binRe = re[k] + delta;
+        const float binIm = im[k];
+        re[k] = binRe * state->sdft.twiddleRe[k] - binIm * state->sdft.twiddleIm[k];
+        im[k] = binRe * state->sdft.twiddleIm[k] + binIm * state->sdft.twiddleRe[k];
+    }
+}
+
 /*
  * Collect gyro data, to be analysed in gyroDataAnalyseUpdate function
  */
@@ -115,33 +233,32 @@ void gyroDataAnalyse(gyroAnalyseState_t *state)
 {
     state->filterUpdateExecute = false; //This will be changed to true only if new data is present
 
-    static uint8_t samplingIndex = 0;
-
-    if (samplingIndex == 0) {
+    if (state->samplingIndex == 0) {
         // calculate mean value of accumulated samples
         for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-            state->downsampledGyroData[axis][state->circularBufferIdx] = state->currentSample[axis];
+            float *sample = &state->downsampledGyroData[axis][state->circularBufferIdx];
+            if (state->analyser == DYNAMIC_NOTCH_ANALYSER_SDFT) {
+                sdftPush(state, axis, state->currentSample[axis], *sample);
+            }
+            *sample = state->currentSample[axis];
         }
 
-        state->circularBufferIdx = (state->circularBufferIdx + 1) % FFT_WINDOW_SIZE;
+        state->circularBufferIdx = (state->circularBufferIdx + 1) & (state->windowSize - 1);
+        state->sampleCount++;
     }
 
-    samplingIndex = (samplingIndex + 1) % FFT_SAMPLING_DENOMINATOR;
+    state->samplingIndex = (state->samplingIndex + 1) % FFT_SAMPLING_DENOMINATOR;
 
     gyroDataAnalyseUpdate(state);
 }
 
-void stage_rfft_f32(arm_rfft_fast_instance_f32 *S, float32_t *p, float32_t *pOut);
-void arm_cfft_radix8by4_f32(arm_cfft_instance_f32 *S, float32_t *p1);
-void arm_bitreversal_32(uint32_t *pSrc, const uint16_t bitRevLen, const uint16_t *pBitRevTable);
-
 static float computeParabolaMean(gyroAnalyseState_t *state, uint8_t peakBinIndex) {
     float preciseBin = peakBinIndex;
 
     // Height of peak bin (y1) and shoulder bins (y0, y2)
-    const float y0 = state->fftData[peakBinIndex - 1];
-    const float y1 = state->fftData[peakBinIndex];
-    const float y2 = state->fftData[peakBinIndex - 1];
+    const float y0 = state->fftMagnitude[peakBinIndex - 1];
+    const float y1 = state->fftMagnitude[peakBinIndex];
+    const float y2 = state->fftMagnitude[peakBinIndex + 1];
 
     // Estimate true peak position aka. preciseBin (fit parabola y(x) over y0, y1 and y2, solve dy/dx=0 for x)
     const float denom = 2.0f * (y0 - 2 * y1 + y2);
@@ -154,64 +271,241 @@ static float computeParabolaMean(gyroAnalyseState_t *state, uint8_t peakBinIndex
 }
 
 /*
- * Analyse last gyro data from the last FFT_WINDOW_SIZE milliseconds
+ * Apply hanning window to the oldest to newest samples of the analysed axis and pack
+ * sample pairs as complex points in bit reversed order
+ */
+static void fftWindowAndBitReversal(gyroAnalyseState_t *state)
+{
+    const float *samples = state->downsampledGyroData[state->updateAxis];
+    const uint16_t mask = state->windowSize - 1;
+    const uint16_t end = MIN(state->updateIndex + FFT_WINDOW_POINTS_PER_STEP, state->binCount);
+
+    // Points are read in chronological order, so the samples that arrive meanwhile overwrite only already packed ones
+    for (uint16_t point = state->updateIndex; point < end; point++) {
+        const uint16_t sample = point * 2;
+        float *dst = &state->fft.data[state->fft.bitReverse[point] * 2];
+
+        dst[0] = samples[(state->windowStartIdx + sample) & mask] * state->fft.hanningWindow[sample];
+        dst[1] = samples[(state->windowStartIdx + sample + 1) & mask] * state->fft.hanningWindow[sample + 1];
+    }
+
+    state->updateIndex = end;
+}
+
+/*
+ * Iterative radix-2 decimation in time, butterflies of all stages are numbered
+ * continuously so that any step can stop and resume in the middle of a stage
+ */
+static bool fftButterflies(gyroAnalyseState_t *state)
+{
+    const uint16_t complexPoints = state->binCount;
+
+    for (int budget = FFT_BUTTERFLIES_PER_STEP; budget > 0; budget--) {
+        const uint16_t halfSize = state->butterflyHalfSize;
+        const uint16_t j = state->updateIndex & (halfSize - 1);
+        const uint16_t top = ((state->updateIndex - j) << 1) + j;
+        const uint16_t twiddle = j * (complexPoints / halfSize);
+
+        const float wr = state->fft.twiddleCos[twiddle];
+        const float wi = -state->fft.twiddleSin[twiddle];
+        float *pTop = &state->fft.data[top * 2];
+        float *pBottom = &state->fft.data[(top + halfSize) * 2];
+
+        const float tr = wr * pBottom[0] - wi * pBottom[1];
+        const float ti = wr * pBottom[1] + wi * pBottom[0];
+        pBottom[0] = pTop[0] - tr;
+        pBottom[1] = pTop[1] - ti;
+        pTop[0] += tr;
+        pTop[1] += ti;
+
+        if (++state->updateIndex == complexPoints / 2) {
+            state->updateIndex = 0;
+            state->butterflyHalfSize <<= 1;
+            if (state->butterflyHalfSize == complexPoints) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Turn the half size complex FFT into the spectrum of the real signal, X[k] and X[N/2 - k]
+ * are computed together from Z[k] and Z[N/2 - k]. Only magnitudes are kept.
+ */
+static void fftSplitAndMagnitude(gyroAnalyseState_t *state)
+{
+    const uint16_t complexPoints = state->binCount;
+    const float *z = state->fft.data;
+
+    if (state->updateIndex == 0) {
+        state->fftMagnitude[0] = fabsf(z[0] + z[1]);
+        state->updateIndex = 1;
+    }
+
+    const uint16_t end = MIN(state->updateIndex + FFT_SPLIT_PAIRS_PER_STEP, complexPoints / 2 + 1);
+
+    for (uint16_t k = state->updateIndex; k < end; k++) {
+        const uint16_t mk = complexPoints - k;
+
+        // Even and odd sample spectra
+        const float evenRe = (z[k * 2] + z[mk * 2]) * 0.5f;
+        const float evenIm = (z[k * 2 + 1] - z[mk * 2 + 1]) * 0.5f;
+        const float oddRe = (z[k * 2 + 1] + z[mk * 2 + 1]) * 0.5f;
+        const float oddIm = (z[mk * 2] - z[k * 2]) * 0.5f;
+
+        const float c = state->fft.twiddleCos[k];
+        const float s = state->fft.twiddleSin[k];
+        const float rotRe = c * oddRe + s * oddIm;
+        const float rotIm = c * oddIm - s * oddRe;
+
+        state->fftMagnitude[k] = sqrtf(sq(evenRe + rotRe) + sq(evenIm + rotIm));
+        if (mk != k) {
+            state->fftMagnitude[mk] = sqrtf(sq(evenRe - rotRe) + sq(rotIm - evenIm));
+        }
+    }
+
+    state->updateIndex = end;
+}
+
+/*
+ * Hanning window applied in the frequency domain, Y[k] = 0.5 * X[k] - 0.25 * (X[k - 1] + X[k + 1])
+ */
+static void sdftMagnitude(gyroAnalyseState_t *state)
+{
+    const float *re = state->sdft.re[state->updateAxis];
+    const float *im = state->sdft.im[state->updateAxis];
+    const uint16_t end = MIN(state->updateIndex + SDFT_MAGNITUDE_BINS_PER_STEP, state->binCount);
+
+    for (uint16_t k = state->updateIndex; k < end; k++) {
+        const float windowedRe = 0.5f * re[k] - 0.25f * (re[k - 1] + re[k + 1]);
+        const float windowedIm = 0.5f * im[k] - 0.25f * (im[k - 1] + im[k + 1]);
+        state->fftMagnitude[k] = sqrtf(sq(windowedRe) + sq(windowedIm));
+    }
+
+    state->updateIndex = end;
+}
+
+static void findPeaks(gyroAnalyseState_t *state)
+{
+    const float *fftData = state->fftMagnitude;
+    const int end = MIN(state->updateIndex + FFT_PEAK_BINS_PER_STEP, state->binCount - 1);
+    int bin;
+
+    for (bin = state->updateIndex; bin < end; bin++) {
+        /*
+         * Peak is defined if the current bin is greater than the previous bin and the next bin
+         */
+        if (
+            fftData[bin] > fftData[bin - 1] && 
+            fftData[bin] > fftData[bin + 1]
+        ) {
+            /*
+             * We are only interested in N biggest peaks
+             * Check previously found peaks and update the structure if necessary
+             */
+            for (int p = 0; p < DYN_NOTCH_PEAK_COUNT; p++) {
+                if (fftData[bin] > state->peaks[p].value) {
+                    for (int k = DYN_NOTCH_PEAK_COUNT - 1; k > p; k--) {
+                        state->peaks[k] = state->peaks[k - 1];
+                    }
+                    state->peaks[p].bin = bin;
+                    state->peaks[p].value = fftData[bin];
+                    break;
+                }
+            }
+            bin++; // If bin is peak, next bin can't be peak => jump it
+        }
+    }
+
+    state->updateIndex = bin;
+}
+
+static void startPeakSearch(gyroAnalyseState_t *state)
+{
+    //Zero the data structure
+    for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
+        state->peaks[i].bin = 0;
+        state->peaks[i].value = 0.0f;
+    }
+
+    state->updateIndex = state->fftStartBin + 1;
+    state->updateStep = STEP_FIND_PEAKS;
+}
+
+/*
+ * Analyse last gyro data from the last windowSize samples
  */
 static NOINLINE void gyroDataAnalyseUpdate(gyroAnalyseState_t *state)
 {
+    if (state->updateStep == STEP_WAIT_FOR_WINDOW) {
+        // Without overlap, every analysis of an axis needs a window of samples that were not analysed before
+        if (state->sampleCount - state->windowSampleCount[state->updateAxis] < state->windowHop) {
+            return;
+        }
 
-    arm_cfft_instance_f32 *Sint = &(state->fftInstance.Sint);
+        state->windowSampleCount[state->updateAxis] = state->sampleCount;
+        state->windowStartIdx = state->circularBufferIdx;
+
+        if (state->analyser == DYNAMIC_NOTCH_ANALYSER_SDFT) {
+            state->updateIndex = state->fftStartBin;
+            state->updateStep = STEP_SDFT_MAGNITUDE;
+        } else {
+            state->updateIndex = 0;
+            state->updateStep = STEP_WINDOW_AND_BITREVERSAL;
+        }
+    }
 
     switch (state->updateStep) {
-        case STEP_ARM_CFFT_F32:
+        case STEP_SDFT_MAGNITUDE:
         {
-            // Important this works only with FFT windows size of 64 elements!
-            arm_cfft_radix8by4_f32(Sint, state->fftData);
+            sdftMagnitude(state);
+
+            if (state->updateIndex == state->binCount) {
+                startPeakSearch(state);
+            }
             break;
         }
-        case STEP_BITREVERSAL_AND_STAGE_RFFT_F32:
+        case STEP_WINDOW_AND_BITREVERSAL:
         {
-            arm_bitreversal_32((uint32_t*) state->fftData, Sint->bitRevLength, Sint->pBitRevTable);
-            stage_rfft_f32(&state->fftInstance, state->fftData, state->rfftData);
+            fftWindowAndBitReversal(state);
+
+            if (state->updateIndex == state->binCount) {
+                state->updateIndex = 0;
+                state->butterflyHalfSize = 1;
+                state->updateStep = STEP_BUTTERFLIES;
+            }
             break;
         }
-        case STEP_MAGNITUDE_AND_FREQUENCY:
+        case STEP_BUTTERFLIES:
         {
-            // 8us
-            arm_cmplx_mag_f32(state->rfftData, state->fftData, FFT_BIN_COUNT);
-
-            //Zero the data structure
-            for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
-                state->peaks[i].bin = 0;
-                state->peaks[i].value = 0.0f;
+            if (fftButterflies(state)) {
+                state->updateIndex = 0;
+                state->updateStep = STEP_SPLIT_AND_MAGNITUDE;
             }
+            break;
+        }
+        case STEP_SPLIT_AND_MAGNITUDE:
+        {
+            fftSplitAndMagnitude(state);
 
-            // Find peaks
-            for (int bin = (state->fftStartBin + 1); bin < FFT_BIN_COUNT - 1; bin++) {
-                /*
-                 * Peak is defined if the current bin is greater than the previous bin and the next bin
-                 */
-                if (
-                    state->fftData[bin] > state->fftData[bin - 1] && 
-                    state->fftData[bin] > state->fftData[bin + 1]
-                ) {
-                    /*
-                     * We are only interested in N biggest peaks
-                     * Check previously found peaks and update the structure if necessary
-                     */
-                    for (int p = 0; p < DYN_NOTCH_PEAK_COUNT; p++) {
-                        if (state->fftData[bin] > state->peaks[p].value) {
-                            for (int k = DYN_NOTCH_PEAK_COUNT - 1; k > p; k--) {
-                                state->peaks[k] = state->peaks[k - 1];
-                            }
-                            state->peaks[p].bin = bin;
-                            state->peaks[p].value = state->fftData[bin];
-                            break;
-                        }
-                    }
-                    bin++; // If bin is peak, next bin can't be peak => jump it
-                }
+            if (state->updateIndex > state->binCount / 2) {
+                startPeakSearch(state);
             }
+            break;
+        }
+        case STEP_FIND_PEAKS:
+        {
+            findPeaks(state);
 
+            if (state->updateIndex >= state->binCount - 1) {
+                state->updateStep = STEP_UPDATE_FILTERS;
+            }
+            break;
+        }
+        case STEP_UPDATE_FILTERS:
+        {
             // Sort N biggest peaks in ascending bin order (example: 3, 8, 25, 0, 0, ..., 0)
             for (int p = DYN_NOTCH_PEAK_COUNT - 1; p > 0; p--) {
                 for (int k = 0; k < p; k++) {
@@ -225,18 +519,13 @@ static NOINLINE void gyroDataAnalyseUpdate(gyroAnalyseState_t *state)
                 }
             }
 
-            break;
-        }
-        case STEP_UPDATE_FILTERS_AND_HANNING:
-        {
-
             /*
              * Update frequencies
              */
             for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
 
                 if (state->peaks[i].bin > 0) {
-                    const int bin = constrain(state->peaks[i].bin, state->fftStartBin, FFT_BIN_COUNT - 1);
+                    const int bin = constrain(state->peaks[i].bin, state->fftStartBin + 1, state->binCount - 2);
                     float frequency = computeParabolaMean(state, bin) * state->fftResolution;
 
                     state->centerFrequency[state->updateAxis][i] = pt1FilterApply(&state->detectedFrequencyFilter[state->updateAxis][i], frequency);
@@ -253,14 +542,10 @@ static NOINLINE void gyroDataAnalyseUpdate(gyroAnalyseState_t *state)
 
             //Switch to the next axis
             state->updateAxis = (state->updateAxis + 1) % XYZ_AXIS_COUNT;
-            
-            // apply hanning window to gyro samples and store result in fftData
-            // hanning starts and ends with 0, could be skipped for minor speed improvement
-            arm_mult_f32(state->downsampledGyroData[state->updateAxis], state->hanningWindow, state->fftData, FFT_WINDOW_SIZE);
+            state->updateStep = STEP_WAIT_FOR_WINDOW;
+            break;
         }
     }
-
-    state->updateStep = (state->updateStep + 1) % STEP_COUNT;
 }
 
 #endif // USE_DYNAMIC_FILTERS
@@ -22,14 +22,29 @@
 
 #ifdef USE_DYNAMIC_FILTERS
 
-#include "arm_math.h"
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "common/filter.h"
+#include "common/utils.h"
+#include "flight/dynamic_gyro_notch.h"
+
+/*
+ * Largest supported FFT window, all buffers are sized for it. 64, 128 and 256
+ * point windows are selectable with dynamic_gyro_notch_fft_size, larger ones
+ * than the target supports are limited to this. Families or targets with RAM
+ * to spare raise it.
+ */
+#ifndef DYN_NOTCH_FFT_MAX_WINDOW_SIZE
+#define DYN_NOTCH_FFT_MAX_WINDOW_SIZE 64
+#endif
 
 /*
- * Current code works only with 64 window size. Changing it do a different size would require
- * adapting the gyroDataAnalyseUpdate in STEP_ARM_CFFT_F32 step
+ * The sliding DFT pole is moved slightly inside the unit circle to keep
+ * rounding errors from accumulating, older samples in the window are
+ * weighted by DYN_NOTCH_SDFT_DAMPING ^ age
  */
-#define FFT_WINDOW_SIZE 64
+#define DYN_NOTCH_SDFT_DAMPING 0.9999f
 
 typedef struct peak_s {
     int bin;
@@ -41,16 +56,49 @@ typedef struct gyroAnalyseState_s {
     float currentSample[XYZ_AXIS_COUNT];
 
     // downsampled gyro data circular buffer for frequency analysis
-    uint8_t circularBufferIdx;
-    float downsampledGyroData[XYZ_AXIS_COUNT][FFT_WINDOW_SIZE];
+    uint8_t samplingIndex;
+    uint16_t circularBufferIdx;
+    uint32_t sampleCount;
+    float downsampledGyroData[XYZ_AXIS_COUNT][DYN_NOTCH_FFT_MAX_WINDOW_SIZE];
 
-    // update state machine step information
+    // window size in samples, FFT bins are half of that
+    uint16_t windowSize;
+    uint16_t binCount;
+    // new samples required between analyses of the same axis, 0 for sliding window
+    uint16_t windowHop;
+    uint32_t windowSampleCount[XYZ_AXIS_COUNT];
+    uint16_t windowStartIdx;
+
+    // update state machine step information, each step does a bounded amount of work
     uint8_t updateStep;
     uint8_t updateAxis;
+    uint16_t updateIndex;
+    uint16_t butterflyHalfSize;
+
+    // dynamicGyroNotchAnalyser_e
+    uint8_t analyser;
 
-    arm_rfft_fast_instance_f32 fftInstance;
-    float fftData[FFT_WINDOW_SIZE];
-    float rfftData[FFT_WINDOW_SIZE];
+    union {
+        // Block FFT, windowSize / 2 complex values, real FFT computed as a half size complex FFT
+        struct {
+            float data[DYN_NOTCH_FFT_MAX_WINDOW_SIZE];
+            float twiddleCos[DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2];
+            float twiddleSin[DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2];
+            uint8_t bitReverse[DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2];
+            // Hanning window, see https://en.wikipedia.org/wiki/Window_function#Hann_.28Hanning.29_window
+            float hanningWindow[DYN_NOTCH_FFT_MAX_WINDOW_SIZE];
+        } fft;
+        // Sliding DFT, bins 0 to windowSize / 2 of every axis updated with each new sample
+        struct {
+            float re[XYZ_AXIS_COUNT][DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2 + 1];
+            float im[XYZ_AXIS_COUNT][DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2 + 1];
+            float twiddleRe[DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2 + 1];
+            float twiddleIm[DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2 + 1];
+            float dampingN;
+            uint8_t startBin;
+        } sdft;
+    };
+    float fftMagnitude[DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2];
 
     pt1Filter_t detectedFrequencyFilter[XYZ_AXIS_COUNT][DYN_NOTCH_PEAK_COUNT];
     float centerFrequency[XYZ_AXIS_COUNT][DYN_NOTCH_PEAK_COUNT];
@@ -66,18 +114,20 @@ typedef struct gyroAnalyseState_s {
     float fftResolution;
     uint16_t minFrequency;
     uint16_t maxFrequency;
-
-    // Hanning window, see https://en.wikipedia.org/wiki/Window_function#Hann_.28Hanning.29_window
-    float hanningWindow[FFT_WINDOW_SIZE];
 } gyroAnalyseState_t;
 
-STATIC_ASSERT(FFT_WINDOW_SIZE <= (uint8_t) -1, window_size_greater_than_underlying_type);
+STATIC_ASSERT(DYN_NOTCH_FFT_MAX_WINDOW_SIZE / 2 <= (uint8_t) -1 + 1, window_size_greater_than_bit_reverse_type);
+STATIC_ASSERT((DYN_NOTCH_FFT_MAX_WINDOW_SIZE & (DYN_NOTCH_FFT_MAX_WINDOW_SIZE - 1)) == 0, window_size_must_be_power_of_two);
 
 void gyroDataAnalyseStateInit(
     gyroAnalyseState_t *state, 
     uint16_t minFrequency,
-    uint32_t targetLooptimeUs
+    uint32_t targetLooptimeUs,
+    uint16_t windowSize,
+    bool overlap,
+    uint8_t analyser
 );
 void gyroDataAnalysePush(gyroAnalyseState_t *gyroAnalyse, int axis, float sample);
 void gyroDataAnalyse(gyroAnalyseState_t *gyroAnalyse);
-#endif
\ No newline at end of file
+uint16_t gyroDataAnalyseStepsPerAxis(const gyroAnalyseState_t *state);
+#endif
@@ -22,6 +22,8 @@
  * along with this program. If not, see http://www.gnu.org/licenses/.
  */
 
+#include <string.h>
+
 #include "platform.h"
 
 #include "flight/rpm_filter.h"
@@ -42,10 +44,18 @@
 
 #ifdef USE_RPM_FILTER
 
+#ifdef USE_ARM_MATH
+#include "arm_math.h"
+#endif
+
 #define HZ_TO_RPM 1/60.0f
 #define RPM_FILTER_RPM_LPF_HZ 150
 #define RPM_FILTER_HARMONICS 3
 
+#define RPM_FILTER_MAX_STAGES       (MAX_SUPPORTED_MOTORS * RPM_FILTER_HARMONICS)
+#define RPM_FILTER_STAGE_COEFFS     5
+#define RPM_FILTER_STAGE_STATE      4
+
 PG_REGISTER_WITH_RESET_TEMPLATE(rpmFilterConfig_t, rpmFilterConfig, PG_RPM_FILTER_CONFIG, 1);
 
 PG_RESET_TEMPLATE(rpmFilterConfig_t, rpmFilterConfig,
@@ -54,16 +64,29 @@ PG_RESET_TEMPLATE(rpmFilterConfig_t, rpmFilterConfig,
                   .gyro_min_hz = SETTING_RPM_GYRO_MIN_HZ_DEFAULT,
                   .gyro_q = SETTING_RPM_GYRO_Q_DEFAULT, );
 
+/*
+ * All notches of all motors form a single biquad cascade per axis, stage index is
+ * motor * harmonics + harmonic. Coefficients are the same for every axis, so they
+ * are stored once, in the CMSIS arm_biquad_cascade_df1_f32 layout: {b0, b1, b2, -a1, -a2}
+ * per stage. State is {x[n-1], x[n-2], y[n-1], y[n-2]} per stage and axis.
+ */
 typedef struct
 {
     float q;
     float minHz;
     float maxHz;
     uint8_t harmonics;
-    biquadFilter_t filters[XYZ_AXIS_COUNT][MAX_SUPPORTED_MOTORS][RPM_FILTER_HARMONICS];
+    uint8_t stageCount;
+    uint16_t frequencyHz[RPM_FILTER_MAX_STAGES];
+    biquadNotchTable_t notchTable;
+    float coeffs[RPM_FILTER_MAX_STAGES * RPM_FILTER_STAGE_COEFFS];
+    float state[XYZ_AXIS_COUNT][RPM_FILTER_MAX_STAGES * RPM_FILTER_STAGE_STATE];
+#ifdef USE_ARM_MATH
+    arm_biquad_casd_df1_inst_f32 cascade[XYZ_AXIS_COUNT];
+#endif
 } rpmFilterBank_t;
 
-typedef float (*rpmFilterApplyFnPtr)(rpmFilterBank_t *filter, uint8_t axis, float input);
+typedef void (*rpmFilterApplyFnPtr)(rpmFilterBank_t *filter, float *gyroADCf);
 typedef void (*rpmFilterUpdateFnPtr)(rpmFilterBank_t *filterBank, uint8_t motor, float baseFrequency);
 
 static EXTENDED_FASTRAM pt1Filter_t motorFrequencyFilter[MAX_SUPPORTED_MOTORS];
@@ -71,11 +94,10 @@ static EXTENDED_FASTRAM rpmFilterBank_t gyroRpmFilters;
 static EXTENDED_FASTRAM rpmFilterApplyFnPtr rpmGyroApplyFn;
 static EXTENDED_FASTRAM rpmFilterUpdateFnPtr rpmGyroUpdateFn;
 
-float nullRpmFilterApply(rpmFilterBank_t *filter, uint8_t axis, float input)
+void nullRpmFilterApply(rpmFilterBank_t *filter, float *gyroADCf)
 {
     UNUSED(filter);
-    UNUSED(axis);
-    return input;
+    UNUSED(gyroADCf);
 }
 
 void nullRpmFilterUpdate(rpmFilterBank_t *filterBank, uint8_t motor, float baseFrequency) {
@@ -84,22 +106,50 @@ void nullRpmFilterUpdate(rpmFilterBank_t *filterBank, uint8_t motor, float baseF
     UNUSED(baseFrequency);
 }
 
-float rpmFilterApply(rpmFilterBank_t *filterBank, uint8_t axis, float input)
+void FAST_CODE rpmFilterApply(rpmFilterBank_t *filterBank, float *gyroADCf)
 {
-    float output = input;
+#ifdef USE_ARM_MATH
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        arm_biquad_cascade_df1_f32(&filterBank->cascade[axis], &gyroADCf[axis], &gyroADCf[axis], 1);
+    }
+#else
+    /*
+     * Portable equivalent of arm_biquad_cascade_df1_f32(), with the axes interleaved
+     * within every stage. Each axis sees the same operations in the same order as the
+     * CMSIS kernel and the scalar biquadFilterApplyDF1() cascade.
+     */
+    const float *coeffs = filterBank->coeffs;
 
-    for (uint8_t motor = 0; motor < getMotorCount(); motor++)
-    {
-        for (int harmonicIndex = 0; harmonicIndex < filterBank->harmonics; harmonicIndex++)
-        {
-            output = biquadFilterApplyDF1(
-                &filterBank->filters[axis][motor][harmonicIndex],
-                output
-            );
+    for (int stage = 0; stage < filterBank->stageCount; stage++, coeffs += RPM_FILTER_STAGE_COEFFS) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            float *state = &filterBank->state[axis][stage * RPM_FILTER_STAGE_STATE];
+            const float input = gyroADCf[axis];
+            const float result = coeffs[0] * input + coeffs[1] * state[0] + coeffs[2] * state[1] + coeffs[3] * state[2] + coeffs[4] * state[3];
+
+            state[1] = state[0];
+            state[0] = input;
+            state[3] = state[2];
+            state[2] = result;
+
+            gyroADCf[axis] = result;
         }
     }
+#endif
+}
 
-    return output;
+static void rpmFilterSetStage(rpmFilterBank_t *filterBank, int stage, uint16_t frequencyHz)
+{
+    biquadFilter_t notch;
+    biquadNotchTableLookup(&filterBank->notchTable, frequencyHz, &notch);
+
+    float *coeffs = &filterBank->coeffs[stage * RPM_FILTER_STAGE_COEFFS];
+    coeffs[0] = notch.b0;
+    coeffs[1] = notch.b1;
+    coeffs[2] = notch.b2;
+    coeffs[3] = -notch.a1;
+    coeffs[4] = -notch.a2;
+
+    filterBank->frequencyHz[stage] = frequencyHz;
 }
 
 static void rpmFilterInit(rpmFilterBank_t *filter, uint16_t q, uint8_t minHz, uint8_t harmonics)
@@ -107,31 +157,34 @@ static void rpmFilterInit(rpmFilterBank_t *filter, uint16_t q, uint8_t minHz, ui
     filter->q = q / 100.0f;
     filter->minHz = minHz;
     filter->harmonics = harmonics;
+    filter->stageCount = getMotorCount() * harmonics;
     /*
      * Max frequency has to be lower than Nyquist frequency for looptime
      */
     filter->maxHz = 0.48f * 1000000.0f / getLooptime();
 
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++)
+    biquadNotchTableInit(&filter->notchTable, filter->minHz, filter->maxHz, getLooptime(), filter->q);
+
+    memset(filter->state, 0, sizeof(filter->state));
+
+    for (int motor = 0; motor < getMotorCount(); motor++)
     {
-        for (int motor = 0; motor < getMotorCount(); motor++)
+        /*
+         * Harmonics are indexed from 1 where 1 means base frequency
+         * C indexes arrays from 0, so we need to shift
+         */
+        for (int harmonicIndex = 0; harmonicIndex < harmonics; harmonicIndex++)
         {
-
-            /*
-             * Harmonics are indexed from 1 where 1 means base frequency
-             * C indexes arrays from 0, so we need to shift
-             */
-            for (int harmonicIndex = 0; harmonicIndex < harmonics; harmonicIndex++)
-            {
-                biquadFilterInit(
-                    &filter->filters[axis][motor][harmonicIndex],
-                    filter->minHz * (harmonicIndex + 1),
-                    getLooptime(),
-                    filter->q,
-                    FILTER_NOTCH);
-            }
+            rpmFilterSetStage(filter, motor * harmonics + harmonicIndex, filter->minHz * (harmonicIndex + 1));
         }
     }
+
+#ifdef USE_ARM_MATH
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++)
+    {
+        arm_biquad_cascade_df1_init_f32(&filter->cascade[axis], filter->stageCount, filter->coeffs, filter->state[axis]);
+    }
+#endif
 }
 
 void disableRpmFilters(void) {
@@ -140,19 +193,20 @@ void disableRpmFilters(void) {
 
 void rpmFilterUpdate(rpmFilterBank_t *filterBank, uint8_t motor, float baseFrequency)
 {
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++)
+    for (int harmonicIndex = 0; harmonicIndex < filterBank->harmonics; harmonicIndex++)
     {
-        for (int harmonicIndex = 0; harmonicIndex < filterBank->harmonics; harmonicIndex++)
-        {
-            float harmonicFrequency = baseFrequency * (harmonicIndex + 1);
-            harmonicFrequency = constrainf(harmonicFrequency, filterBank->minHz, filterBank->maxHz);
-
-            biquadFilterUpdate(
-                &filterBank->filters[axis][motor][harmonicIndex],
-                harmonicFrequency,
-                getLooptime(),
-                filterBank->q,
-                FILTER_NOTCH);
+        float harmonicFrequency = baseFrequency * (harmonicIndex + 1);
+        harmonicFrequency = constrainf(harmonicFrequency, filterBank->minHz, filterBank->maxHz);
+
+        /*
+         * Notch coefficients are updated in whole Hz steps, so the bank is touched
+         * only when the harmonic moved to another 1Hz step
+         */
+        const uint16_t frequencyHz = harmonicFrequency;
+        const int stage = motor * filterBank->harmonics + harmonicIndex;
+
+        if (frequencyHz != filterBank->frequencyHz[stage]) {
+            rpmFilterSetStage(filterBank, stage, frequencyHz);
         }
     }
 }
@@ -195,9 +249,9 @@ void rpmFilterUpdateTask(timeUs_t currentTimeUs)
     }
 }
 
-float rpmFilterGyroApply(uint8_t axis, float input)
+void rpmFilterGyroApply(float *gyroADCf)
 {
-    return rpmGyroApplyFn(&gyroRpmFilters, axis, input);
+    rpmGyroApplyFn(&gyroRpmFilters, gyroADCf);
 }
 
 #endif
@@ -49,4 +49,4 @@ PG_DECLARE(rpmFilterConfig_t, rpmFilterConfig);
 void disableRpmFilters(void);
 void rpmFiltersInit(void);
 void rpmFilterUpdateTask(timeUs_t currentTimeUs);
-float rpmFilterGyroApply(uint8_t axis, float input);
\ No newline at end of file
+void rpmFilterGyroApply(float *gyroADCf);
\ No newline at end of file
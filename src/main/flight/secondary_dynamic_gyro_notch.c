@@ -28,6 +28,7 @@
 
 #include <stdint.h>
 #include "secondary_dynamic_gyro_notch.h"
+#include "dynamic_gyro_notch.h"
 #include "fc/config.h"
 #include "build/debug.h"
 #include "sensors/gyro.h"
@@ -36,32 +37,17 @@
 
 void secondaryDynamicGyroNotchFiltersInit(secondaryDynamicGyroNotchState_t *state) {
 
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        state->filtersApplyFn[axis] = nullFilterApply;
-    }
-
     state->dynNotchQ = gyroConfig()->dynamicGyroNotch3dQ / 100.0f;
-    state->enabled = gyroConfig()->dynamicGyroNotchMode != DYNAMIC_NOTCH_MODE_2D;
+    state->enabled = gyroConfig()->dynamicGyroNotchMode == DYNAMIC_NOTCH_MODE_3D;
     state->looptime = getLooptime();
 
-    if (gyroConfig()->dynamicGyroNotchMode == DYNAMIC_NOTCH_MODE_3D) {
-        /* 
-         * Enable ROLL filter
-         */
-        biquadFilterInit(&state->filters[FD_ROLL], SECONDARY_DYNAMIC_NOTCH_DEFAULT_CENTER_HZ, state->looptime, 1.0f, FILTER_NOTCH);
-        state->filtersApplyFn[FD_ROLL] = (filterApplyFnPtr)biquadFilterApplyDF1;
-    
-        /* 
-         * Enable PITCH filter
-         */
-        biquadFilterInit(&state->filters[FD_PITCH], SECONDARY_DYNAMIC_NOTCH_DEFAULT_CENTER_HZ, state->looptime, 1.0f, FILTER_NOTCH);
-        state->filtersApplyFn[FD_PITCH] = (filterApplyFnPtr)biquadFilterApplyDF1;
-    
+    if (state->enabled) {
+        biquadNotchTableInit(&state->notchTable, 0.0f, DYNAMIC_NOTCH_TABLE_MAX_RATIO * 1000000.0f / state->looptime, state->looptime, state->dynNotchQ);
+
         /* 
-         * Enable YAW filter
+         * Enable ROLL, PITCH and YAW filters
          */
-        biquadFilterInit(&state->filters[FD_YAW], SECONDARY_DYNAMIC_NOTCH_DEFAULT_CENTER_HZ, state->looptime, 1.0f, FILTER_NOTCH);
-        state->filtersApplyFn[FD_YAW] = (filterApplyFnPtr)biquadFilterApplyDF1;
+        biquadFilterVec3Init(&state->filters, SECONDARY_DYNAMIC_NOTCH_DEFAULT_CENTER_HZ, state->looptime, 1.0f, FILTER_NOTCH);
     }
 }
 
@@ -77,13 +63,15 @@ void secondaryDynamicGyroNotchFiltersUpdate(secondaryDynamicGyroNotchState_t *st
 
         // Filter update happens only if peak was detected 
         if (frequency[0] > 0.0f) {
-            biquadFilterUpdate(&state->filters[axis], state->frequency[axis], state->looptime, state->dynNotchQ, FILTER_NOTCH);
+            biquadFilterVec3UpdateNotch(&state->filters, axis, &state->notchTable, frequency[0]);
         }
     }
 }
 
-float secondaryDynamicGyroNotchFiltersApply(secondaryDynamicGyroNotchState_t *state, int axis, float input) {
-    return state->filtersApplyFn[axis]((filter_t *)&state->filters[axis], input);
+void secondaryDynamicGyroNotchFiltersApply(secondaryDynamicGyroNotchState_t *state, float *gyroADCf) {
+    if (state->enabled) {
+        biquadFilterVec3ApplyDF1(&state->filters, gyroADCf);
+    }
 }
 
 #endif
\ No newline at end of file
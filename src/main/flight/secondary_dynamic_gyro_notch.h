@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include "common/axis.h"
 #include "common/filter.h"
+#include "common/filter_vec3.h"
 
 typedef struct secondaryDynamicGyroNotchState_s {
     uint16_t frequency[XYZ_AXIS_COUNT];
@@ -34,10 +35,10 @@ typedef struct secondaryDynamicGyroNotchState_s {
     uint32_t looptime;
     uint8_t enabled;
     
-    biquadFilter_t filters[XYZ_AXIS_COUNT];
-    filterApplyFnPtr filtersApplyFn[XYZ_AXIS_COUNT];
+    biquadNotchTable_t notchTable;
+    biquadFilterVec3_t filters;
 } secondaryDynamicGyroNotchState_t;
 
 void secondaryDynamicGyroNotchFiltersInit(secondaryDynamicGyroNotchState_t *state);
 void secondaryDynamicGyroNotchFiltersUpdate(secondaryDynamicGyroNotchState_t *state, int axis, float frequency[]);
-float secondaryDynamicGyroNotchFiltersApply(secondaryDynamicGyroNotchState_t *state, int axis, float input);
\ No newline at end of file
+void secondaryDynamicGyroNotchFiltersApply(secondaryDynamicGyroNotchState_t *state, float *gyroADCf);
\ No newline at end of file
@@ -0,0 +1,234 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software. You can redistribute this software
+ * and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * INAV is distributed in the hope that they will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streams a range of the dataflash to the MSP port which asked for it, without a request per chunk. Frames are sent
+ * as long as no more than a window of them is waiting for an acknowledgement. Every MSPv2 frame carries a CRC, and the
+ * receiver acknowledges the address up to which it has received everything. When a frame is lost it acknowledges
+ * with DATAFLASH_STREAM_ACK_RESEND, and sending starts again from there. Lost acknowledgements are covered by a
+ * timeout which does the same.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#if defined(USE_FLASHFS)
+
+#include "common/maths.h"
+#include "common/streambuf.h"
+#include "common/utils.h"
+
+#include "drivers/serial.h"
+#include "drivers/time.h"
+
+#include "fc/runtime_config.h"
+
+#include "io/dataflash_stream.h"
+#include "io/flashfs.h"
+
+#include "msp/msp.h"
+#include "msp/msp_protocol_v2_inav.h"
+#include "msp/msp_serial.h"
+
+#include "scheduler/scheduler.h"
+
+// "$X>", flags, command, size and the CRC
+#define MSP_V2_FRAME_OVERHEAD   9
+
+static struct {
+    mspPort_t *mspPort;             // NULL while there is no stream
+    uint32_t end;
+    uint32_t sendAddress;           // Of the next frame to send
+    uint32_t ackAddress;            // Everything before this was received
+    uint16_t chunkSize;
+    uint8_t window;
+    uint8_t flags;
+    timeMs_t lastAckMs;
+    timeMs_t lastProgressMs;
+    timeDelta_t serialTaskPeriod;   // To restore when the stream ends
+} stream;
+
+static dataflashStreamRequest_t pendingRequest;
+
+/*
+ * Clips the request to the flash and the limits of the stream, and stops any stream in progress. The stream starts
+ * when dataflashStreamAttach() is called with the port the reply went out on.
+ */
+void dataflashStreamRequest(dataflashStreamRequest_t *request)
+{
+    dataflashStreamStop();
+
+    const uint32_t size = flashfsGetSize();
+
+    request->address = MIN(request->address, size);
+    request->length = MIN(request->length, size - request->address);
+    request->chunkSize = constrain(request->chunkSize, 1, DATAFLASH_STREAM_MAX_CHUNK);
+    request->window = constrain(request->window, 1, DATAFLASH_STREAM_MAX_WINDOW);
+
+    pendingRequest = *request;
+}
+
+void dataflashStreamAttach(serialPort_t *port)
+{
+    mspPort_t *mspPort = mspSerialPortFind(port);
+
+    if (!mspPort || pendingRequest.length == 0) {
+        return;
+    }
+
+    stream.end = pendingRequest.address + pendingRequest.length;
+    stream.sendAddress = pendingRequest.address;
+    stream.ackAddress = pendingRequest.address;
+    stream.chunkSize = pendingRequest.chunkSize;
+    stream.window = pendingRequest.window;
+    stream.flags = pendingRequest.flags;
+    stream.lastAckMs = stream.lastProgressMs = millis();
+
+    // The default rate of the serial task would limit the stream to one frame per 10ms on most ports
+    stream.serialTaskPeriod = cfTasks[TASK_SERIAL].desiredPeriod;
+    rescheduleTask(TASK_SERIAL, MIN(stream.serialTaskPeriod, DATAFLASH_STREAM_TASK_PERIOD_US));
+
+    stream.mspPort = mspPort;
+    pendingRequest.length = 0;
+}
+
+void dataflashStreamStop(void)
+{
+    if (stream.mspPort) {
+        rescheduleTask(TASK_SERIAL, stream.serialTaskPeriod);
+        stream.mspPort = NULL;
+    }
+}
+
+bool dataflashStreamIsActive(void)
+{
+    return stream.mspPort != NULL;
+}
+
+void dataflashStreamAck(uint32_t address, uint8_t flags)
+{
+    // Ignore acknowledgements of frames we haven't sent, or of an earlier stream
+    if (!stream.mspPort || address < stream.ackAddress || address > stream.sendAddress) {
+        return;
+    }
+
+    const timeMs_t now = millis();
+
+    if (address > stream.ackAddress) {
+        stream.lastProgressMs = now;
+    }
+    stream.ackAddress = address;
+    stream.lastAckMs = now;
+
+    if (flags & DATAFLASH_STREAM_ACK_RESEND) {
+        stream.sendAddress = address;
+    }
+}
+
+static bool dataflashStreamIsErased(const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Sends the next frame if the window and the transmit buffer have room for it. Returns false if they don't.
+ */
+static bool dataflashStreamSendFrame(void)
+{
+    if (stream.sendAddress >= stream.end || stream.sendAddress - stream.ackAddress >= (uint32_t)stream.window * stream.chunkSize) {
+        return false;
+    }
+
+    const uint16_t length = MIN(stream.chunkSize, stream.end - stream.sendAddress);
+    serialPort_t *port = stream.mspPort->port;
+
+    // Check before reading the flash, like mspSerialEncode() does after
+    if (!isSerialTransmitBufferEmpty(port) && serialTxBytesFree(port) < (uint32_t)(MSP_V2_FRAME_OVERHEAD + DATAFLASH_STREAM_DATA_HEADER_SIZE + length)) {
+        return false;
+    }
+
+    uint8_t buffer[DATAFLASH_STREAM_DATA_HEADER_SIZE + DATAFLASH_STREAM_MAX_CHUNK];
+    mspPacket_t packet = {
+        .buf = { .ptr = buffer, .end = ARRAYEND(buffer), },
+        .cmd = MSP2_BLACKBOX_STREAM_DATA,
+        .flags = 0,
+        .result = MSP_RESULT_ACK,
+    };
+    uint8_t *data = buffer + DATAFLASH_STREAM_DATA_HEADER_SIZE;
+
+    const int bytesRead = flashfsReadAbs(stream.sendAddress, data, length);
+    if (bytesRead != length) {
+        return false;
+    }
+
+    const bool erased = (stream.flags & DATAFLASH_STREAM_SKIP_ERASED) && dataflashStreamIsErased(data, length);
+
+    sbufWriteU32(&packet.buf, stream.sendAddress);
+    sbufWriteU16(&packet.buf, length);
+    sbufWriteU8(&packet.buf, erased ? DATAFLASH_STREAM_CHUNK_ERASED : 0);
+    if (!erased) {
+        sbufAdvance(&packet.buf, length);
+    }
+    sbufSwitchToReader(&packet.buf, buffer);
+
+    if (mspSerialPushPacket(stream.mspPort, &packet, MSP_V2_NATIVE) == 0) {
+        return false;
+    }
+
+    stream.sendAddress += length;
+    return true;
+}
+
+/*
+ * Call from the serial task, after the MSP commands have been processed.
+ */
+void dataflashStreamProcess(timeUs_t currentTimeUs)
+{
+    if (!stream.mspPort) {
+        return;
+    }
+
+    const timeMs_t now = millis();
+
+    // Done, given up on, or the port was taken over by the CLI. Don't keep the serial task busy once armed either
+    if (stream.ackAddress >= stream.end || now - stream.lastProgressMs > DATAFLASH_STREAM_TIMEOUT_MS
+            || !stream.mspPort->port || ARMING_FLAG(ARMED)) {
+        dataflashStreamStop();
+        return;
+    }
+
+    if (stream.sendAddress > stream.ackAddress && now - stream.lastAckMs > DATAFLASH_STREAM_RESEND_MS) {
+        stream.sendAddress = stream.ackAddress;
+        stream.lastAckMs = now;
+    }
+
+    while (micros() - currentTimeUs < DATAFLASH_STREAM_TIME_BUDGET_US && dataflashStreamSendFrame()) {
+    }
+}
+
+#endif
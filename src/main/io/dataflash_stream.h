@@ -0,0 +1,63 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software. You can redistribute this software
+ * and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * INAV is distributed in the hope that they will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/time.h"
+
+#define DATAFLASH_STREAM_MAX_CHUNK          2048
+#define DATAFLASH_STREAM_MAX_WINDOW         32
+#define DATAFLASH_STREAM_DATA_HEADER_SIZE   7       // Address, length and flags in front of the data of each frame
+#define DATAFLASH_STREAM_TASK_PERIOD_US     1000    // The serial task runs at least this often while streaming
+#define DATAFLASH_STREAM_TIME_BUDGET_US     500     // Stop sending for this serial task run after this long
+#define DATAFLASH_STREAM_RESEND_MS          250     // Send again from the last acknowledged address after this long without an ack
+#define DATAFLASH_STREAM_TIMEOUT_MS         2000    // Give up when nothing was acknowledged for this long
+
+typedef enum {
+    DATAFLASH_STREAM_SKIP_ERASED    = 1 << 0,   // Send chunks which are all 0xFF without their data
+} dataflashStreamFlags_e;
+
+typedef enum {
+    DATAFLASH_STREAM_CHUNK_ERASED   = 1 << 0,   // The chunk is all 0xFF and its data was left out
+} dataflashStreamChunkFlags_e;
+
+typedef enum {
+    DATAFLASH_STREAM_ACK_RESEND     = 1 << 0,   // A frame was lost, send again from the acknowledged address
+} dataflashStreamAckFlags_e;
+
+typedef struct dataflashStreamRequest_s {
+    uint32_t address;
+    uint32_t length;            // 0 stops the stream
+    uint16_t chunkSize;         // Bytes of flash per frame
+    uint8_t window;             // Frames sent ahead of the acknowledgements
+    uint8_t flags;
+} dataflashStreamRequest_t;
+
+struct serialPort_s;
+
+void dataflashStreamRequest(dataflashStreamRequest_t *request);
+void dataflashStreamAttach(struct serialPort_s *port);
+void dataflashStreamAck(uint32_t address, uint8_t flags);
+void dataflashStreamStop(void);
+bool dataflashStreamIsActive(void);
+void dataflashStreamProcess(timeUs_t currentTimeUs);
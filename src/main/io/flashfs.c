@@ -24,8 +24,13 @@
  *
  * Note that bits can only be set to 0 when writing, not back to 1 from 0. You must erase sectors in order
  * to bring bits back to 1 again.
+ *
+ * The last sectors of the partition hold an index of the logs, so that a single log can be found and downloaded
+ * without reading the whole device. Each log gets one entry when it ends, which is written to the next erased slot
+ * of the index. A NAND page can't be programmed twice, so there each entry takes a page of its own.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -34,10 +39,17 @@
 
 #if defined(USE_FLASHFS)
 
+#include "common/crc.h"
+#include "common/maths.h"
+#include "common/time.h"
+
 #include "drivers/flash.h"
+#include "drivers/time.h"
 
 #include "io/flashfs.h"
 
+#define FLASHFS_NO_LOG  UINT32_MAX
+
 static flashPartition_t *flashPartition;
 
 static uint8_t flashWriteBuffer[FLASHFS_WRITE_BUFFER_SIZE];
@@ -54,6 +66,25 @@ static uint8_t bufferHead = 0, bufferTail = 0;
 // The position of the buffer's tail in the overall flash address space:
 static uint32_t tailAddress = 0;
 
+/*
+ * The log index, there is none when logIndexSize is 0. Its first slot holds a signature, so that the index isn't
+ * mistaken for the logs of firmware without one, which may have filled the chip up to the end.
+ */
+#define FLASHFS_LOG_INDEX_SIGNATURE     0x58444E49  // "INDX"
+
+static uint32_t logIndexSize;       // Bytes at the end of the partition which are not available for logs
+static uint32_t logIndexAddress;    // Of the first entry, after the signature
+static uint32_t logIndexStride;
+static uint16_t logIndexCapacity;
+static uint16_t logIndexCount;      // Used slots, including any which failed to write properly
+static uint32_t logIndexEnd;        // Where the first log that isn't indexed yet starts
+static bool logIndexSigned;
+
+// The log being written
+static uint32_t logStart = FLASHFS_NO_LOG;
+static uint32_t logStartTime;
+static timeMs_t logStartMs;
+
 static void flashfsClearBuffer(void)
 {
     bufferTail = bufferHead = 0;
@@ -69,11 +100,16 @@ static void flashfsSetTailAddress(uint32_t address)
     tailAddress = address;
 }
 
+static void flashfsPlaceLogIndex(void);
+
 void flashfsEraseCompletely(void)
 {
     flashPartitionErase(flashPartition);
     flashfsClearBuffer();
     flashfsSetTailAddress(0);
+
+    // The erase may still be running, there is nothing to read yet. The index is empty once it is done.
+    flashfsPlaceLogIndex();
 }
 
 void flashfsClose(void)
@@ -128,9 +164,12 @@ bool flashfsIsReady(void)
     return !!flashPartition;
 }
 
+/**
+ * Get the space available for logs, which doesn't include the log index.
+ */
 uint32_t flashfsGetSize(void)
 {
-    return flashPartitionSize(flashPartition);
+    return flashPartitionSize(flashPartition) - logIndexSize;
 }
 
 static uint32_t flashfsTransmitBufferUsed(void)
@@ -478,7 +517,11 @@ void flashfsWrite(const uint8_t *data, unsigned int len, bool sync)
  */
 int flashfsReadAbs(uint32_t address, uint8_t *buffer, unsigned int len)
 {
-    int bytesRead;
+    int bytesRead = 0;
+
+    if (address >= flashfsGetSize()) {
+        return 0;
+    }
 
     // Did caller try to read past the end of the volume?
     if (address + len > flashfsGetSize()) {
@@ -489,7 +532,15 @@ int flashfsReadAbs(uint32_t address, uint8_t *buffer, unsigned int len)
     // Since the read could overlap data in our dirty buffers, force a sync to clear those first
     flashfsFlushSync();
 
-    bytesRead = flashReadBytes(address, buffer, len);
+    // NAND devices stop reading at the end of a page, so carry on into the next one
+    while (bytesRead < (int)len) {
+        const int chunk = flashReadBytes(address + bytesRead, buffer + bytesRead, len - bytesRead);
+
+        if (chunk <= 0) {
+            break;
+        }
+        bytesRead += chunk;
+    }
 
     return bytesRead;
 }
@@ -571,6 +622,247 @@ bool flashfsIsEOF(void)
     return tailAddress >= flashfsGetSize();
 }
 
+/**
+ * Where the next log starts after a log which ends at the given address. Writes to NAND start on a page boundary
+ * after a close.
+ */
+static uint32_t flashfsNextLogStart(uint32_t end)
+{
+    const flashGeometry_t *geometry = flashGetGeometry();
+
+    if (geometry->flashType == FLASH_TYPE_NAND) {
+        return (end + geometry->pageSize - 1) & ~(geometry->pageSize - 1);
+    }
+    return end;
+}
+
+static bool flashfsReadLogIndexSlot(int slot, flashfsLogEntry_t *entry)
+{
+    return flashReadBytes(logIndexAddress + slot * logIndexStride, (uint8_t *)entry, sizeof(*entry)) == sizeof(*entry);
+}
+
+// Reads fail as not erased, so that nothing gets written over data we couldn't read
+static bool flashfsIsErasedAt(uint32_t address)
+{
+    uint8_t bytes[sizeof(flashfsLogEntry_t)];
+
+    if (flashReadBytes(address, bytes, sizeof(bytes)) != sizeof(bytes)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < sizeof(bytes); i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool flashfsLogEntryIsValid(const flashfsLogEntry_t *entry)
+{
+    return entry->crc == crc8_dvb_s2_update(0, entry, offsetof(flashfsLogEntry_t, crc))
+        && entry->start <= flashfsGetSize() && entry->length <= flashfsGetSize() - entry->start;
+}
+
+static void flashfsProgramLogIndexSlot(uint32_t address, flashfsLogEntry_t *entry)
+{
+    entry->crc = crc8_dvb_s2_update(0, entry, offsetof(flashfsLogEntry_t, crc));
+
+    // NAND devices must program the partly filled page of the log before they can start another
+    flashFlush();
+    flashPageProgram(address, (const uint8_t *)entry, sizeof(*entry));
+    flashFlush();
+}
+
+static void flashfsAppendLogIndex(flashfsLogEntry_t *entry)
+{
+    if (logIndexCount >= logIndexCapacity) {
+        // The index is full, the rest of the logs are reported as one unfinished log
+        return;
+    }
+
+    // The signature is only written with the first entry, an index nobody has used yet is left erased
+    if (!logIndexSigned) {
+        flashfsLogEntry_t signature = { .start = FLASHFS_LOG_INDEX_SIGNATURE };
+
+        flashfsProgramLogIndexSlot(logIndexAddress - logIndexStride, &signature);
+        logIndexSigned = true;
+    }
+
+    flashfsProgramLogIndexSlot(logIndexAddress + logIndexCount * logIndexStride, entry);
+
+    logIndexCount++;
+    logIndexEnd = flashfsNextLogStart(entry->start + entry->length);
+}
+
+/**
+ * Place an empty log index at the end of the partition, without looking at what is there.
+ */
+static void flashfsPlaceLogIndex(void)
+{
+    enum {
+        // Don't take more than this share of a small device for the index
+        LOG_INDEX_MAX_SHARE = 16,
+    };
+
+    const flashGeometry_t *geometry = flashGetGeometry();
+    const uint32_t stride = geometry->flashType == FLASH_TYPE_NAND ? geometry->pageSize : sizeof(flashfsLogEntry_t);
+    const uint32_t sectors = (FLASHFS_LOG_INDEX_MIN_ENTRIES * stride + geometry->sectorSize - 1) / geometry->sectorSize;
+
+    logIndexSize = 0;
+    logIndexCapacity = 0;
+    logIndexCount = 0;
+    logIndexEnd = 0;
+    logIndexSigned = false;
+    logStart = FLASHFS_NO_LOG;
+
+    if (sectors * LOG_INDEX_MAX_SHARE > (uint32_t)FLASH_PARTITION_SECTOR_COUNT(flashPartition)) {
+        return;
+    }
+
+    logIndexSize = sectors * geometry->sectorSize;
+    logIndexStride = stride;
+    logIndexAddress = (flashPartition->endSector + 1 - sectors) * geometry->sectorSize + stride;
+    logIndexCapacity = MIN(logIndexSize / stride - 1, (uint32_t)UINT16_MAX);
+}
+
+static bool flashfsLogIndexSignatureIsValid(void)
+{
+    flashfsLogEntry_t signature;
+
+    return flashReadBytes(logIndexAddress - logIndexStride, (uint8_t *)&signature, sizeof(signature)) == sizeof(signature)
+        && signature.start == FLASHFS_LOG_INDEX_SIGNATURE
+        && signature.crc == crc8_dvb_s2_update(0, &signature, offsetof(flashfsLogEntry_t, crc));
+}
+
+/**
+ * Place the log index at the end of the partition, and find how much of it is used. When the space holds neither an
+ * index nor erased flash, it is taken by the logs of firmware without the index. The index is left out then, until
+ * the chip is erased, so that these logs can still be read.
+ */
+static void flashfsInitLogIndex(void)
+{
+    flashfsPlaceLogIndex();
+
+    if (logIndexSize == 0) {
+        return;
+    }
+
+    // Logs are written from the start of the partition on, so older ones which reached the index also cover its start
+    if (flashfsLogIndexSignatureIsValid()) {
+        logIndexSigned = true;
+    } else if (!flashfsIsErasedAt(logIndexAddress - logIndexStride)) {
+        logIndexSize = 0;
+        logIndexCapacity = 0;
+        return;
+    }
+
+    // The slots are used in order, so look for the first erased one like flashfsIdentifyStartOfFreeSpace() does
+    int left = 0;
+    int right = logIndexCapacity;
+
+    while (left < right) {
+        const int mid = (left + right) / 2;
+
+        if (flashfsIsErasedAt(logIndexAddress + mid * logIndexStride)) {
+            right = mid;
+        } else {
+            left = mid + 1;
+        }
+    }
+    logIndexCount = left;
+
+    // The last entry may not have been written completely when the power went off
+    for (int slot = logIndexCount - 1; slot >= 0; slot--) {
+        flashfsLogEntry_t entry;
+
+        if (flashfsReadLogIndexSlot(slot, &entry) && flashfsLogEntryIsValid(&entry)) {
+            logIndexEnd = flashfsNextLogStart(entry.start + entry.length);
+            break;
+        }
+    }
+}
+
+/**
+ * Call when a log starts at the current offset.
+ */
+void flashfsBeginLog(void)
+{
+    const uint32_t start = flashfsGetOffset();
+
+    // Index what was written since the last log ended, e.g. a log cut short by a power loss, so it can still be found
+    if (start > logIndexEnd) {
+        flashfsLogEntry_t entry = {
+            .start = logIndexEnd,
+            .length = start - logIndexEnd,
+            .flags = FLASHFS_LOG_UNFINISHED,
+        };
+
+        flashfsAppendLogIndex(&entry);
+    }
+
+    rtcTime_t now;
+
+    logStart = start;
+    logStartTime = rtcGet(&now) ? rtcTimeGetSeconds(&now) : 0;
+    logStartMs = millis();
+}
+
+/**
+ * Call when the log has been written. Adds it to the index, and may be called again.
+ */
+void flashfsEndLog(void)
+{
+    if (logStart == FLASHFS_NO_LOG) {
+        return;
+    }
+
+    flashfsFlushSync();
+
+    flashfsLogEntry_t entry = {
+        .start = logStart,
+        .length = tailAddress - logStart,
+        .timestamp = logStartTime,
+        .duration = MIN((millis() - logStartMs) / 1000, (timeMs_t)UINT16_MAX),
+    };
+
+    flashfsAppendLogIndex(&entry);
+    logStart = FLASHFS_NO_LOG;
+}
+
+/**
+ * Returns the number of logs. Data after the last indexed log, like the log being written, counts as one more.
+ */
+int flashfsGetLogCount(void)
+{
+    return logIndexCount + (flashfsGetOffset() > logIndexEnd ? 1 : 0);
+}
+
+/**
+ * Returns false if the index entry couldn't be read, or was damaged.
+ */
+bool flashfsGetLog(int index, flashfsLogEntry_t *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+
+    if (index < 0 || index >= flashfsGetLogCount()) {
+        return false;
+    }
+
+    if (index == logIndexCount) {
+        entry->start = logIndexEnd;
+        entry->length = flashfsGetOffset() - logIndexEnd;
+        entry->flags = FLASHFS_LOG_UNFINISHED;
+        return true;
+    }
+
+    if (!flashfsReadLogIndexSlot(index, entry) || !flashfsLogEntryIsValid(entry)) {
+        memset(entry, 0, sizeof(*entry));
+        return false;
+    }
+    return true;
+}
+
 /**
  * Call after initializing the flash chip in order to set up the filesystem.
  */
@@ -579,8 +871,16 @@ void flashfsInit(void)
     flashPartition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS);
 
     if (flashPartition) {
+        flashfsInitLogIndex();
+
         // Start the file pointer off at the beginning of free space so caller can start writing immediately
-        flashfsSeekAbs(flashfsIdentifyStartOfFreeSpace());
+        uint32_t start = flashfsIdentifyStartOfFreeSpace();
+
+        // The search rounds up to a whole block, so carry on right after the last indexed log if nothing followed it
+        if (logIndexEnd < start && flashfsIsErasedAt(logIndexEnd)) {
+            start = logIndexEnd;
+        }
+        flashfsSeekAbs(start);
     }
 }
 
@@ -27,6 +27,22 @@
 // Automatically trigger a flush when this much data is in the buffer
 #define FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN 64
 
+// The log index gets at least this many slots, in sectors at the end of the partition. The first holds its signature.
+#define FLASHFS_LOG_INDEX_MIN_ENTRIES 256
+
+typedef enum {
+    FLASHFS_LOG_UNFINISHED = 1 << 0,    // The log didn't end properly, e.g. on a power loss. Time and duration are unknown
+} flashfsLogFlags_e;
+
+typedef struct flashfsLogEntry_s {
+    uint32_t start;
+    uint32_t length;
+    uint32_t timestamp;     // Seconds since 1970 when the log started, 0 if the time wasn't known
+    uint16_t duration;      // Seconds
+    uint8_t flags;
+    uint8_t crc;
+} flashfsLogEntry_t;
+
 void flashfsEraseCompletely(void);
 void flashfsEraseRange(uint32_t start, uint32_t end);
 
@@ -53,3 +69,8 @@ void flashfsInit(void);
 
 bool flashfsIsReady(void);
 bool flashfsIsEOF(void);
+
+void flashfsBeginLog(void);
+void flashfsEndLog(void);
+int flashfsGetLogCount(void);
+bool flashfsGetLog(int index, flashfsLogEntry_t *entry);
@@ -28,7 +28,10 @@
 #include "scheduler/scheduler.h"
 
 #if defined(SITL_BUILD)
+#include "drivers/serial_tcp.h"
+#include "target/SITL/io_reactor.h"
 #include "target/SITL/serial_proxy.h"
+#include "target/SITL/lockstep.h"
 #endif
 
 
@@ -75,5 +78,10 @@ int main(void)
 #endif
         scheduler();
         processLoopback();
+#if defined(SITL_BUILD)
+        tcpFlushAll();
+        lockstepIdle();
+        ioReactorIdle();
+#endif
     }
 }
@@ -89,6 +89,8 @@
 #define MSP2_INAV_LOGIC_CONDITIONS_SINGLE       0x203B
 
 #define MSP2_INAV_ESC_RPM                       0x2040
+#define MSP2_INAV_TASK_HISTOGRAM                0x2041
+#define MSP2_INAV_PROFILER                      0x2042
 
 #define MSP2_INAV_LED_STRIP_CONFIG_EX           0x2048
 #define MSP2_INAV_SET_LED_STRIP_CONFIG_EX       0x2049
@@ -111,5 +113,11 @@
 #define MSP2_INAV_CUSTOM_OSD_ELEMENTS           0x2100
 #define MSP2_INAV_SET_CUSTOM_OSD_ELEMENTS       0x2101
 
+#define MSP2_BLACKBOX_LOG_LIST                  0x2110
+#define MSP2_BLACKBOX_LOG_READ                  0x2111
+#define MSP2_BLACKBOX_STREAM_START              0x2112
+#define MSP2_BLACKBOX_STREAM_ACK                0x2113
+#define MSP2_BLACKBOX_STREAM_DATA               0x2114    // Sent by the FC, not a command
+
 #define MSP2_INAV_SERVO_CONFIG                  0x2200
 #define MSP2_INAV_SET_SERVO_CONFIG              0x2201
\ No newline at end of file
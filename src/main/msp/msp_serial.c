@@ -538,6 +538,17 @@ int mspSerialPushPort(uint16_t cmd, const uint8_t *data, int datalen, mspPort_t
     return mspSerialEncode(mspPort, &push, version);
 }
 
+/*
+ * Like mspSerialPushPort(), but sends a packet the caller has filled in already. This saves copying a large payload
+ * into another buffer on the stack.
+ *
+ * Returns the number of bytes written, 0 if the frame doesn't fit the transmit buffer now.
+ */
+int mspSerialPushPacket(mspPort_t *mspPort, mspPacket_t *packet, mspVersion_e version)
+{
+    return mspSerialEncode(mspPort, packet, version);
+}
+
 int mspSerialPushVersion(uint8_t cmd, const uint8_t *data, int datalen, mspVersion_e version)
 {
     int ret = 0;
@@ -24,6 +24,8 @@
 
 #include "build/debug.h"
 
+#include "blackbox/blackbox.h"
+
 #include "common/axis.h"
 #include "common/filter.h"
 #include "common/maths.h"
@@ -3372,6 +3374,9 @@ void updateLandingStatus(timeMs_t currentTimeMs)
         }
     } else if (isLandingDetected()) {
         ENABLE_STATE(LANDING_DETECTED);
+#ifdef USE_BLACKBOX
+        blackboxTrigger(BLACKBOX_TRIGGER_LANDING);
+#endif
     }
 }
 
@@ -24,6 +24,8 @@
 
 #include <stdbool.h>
 
+#include "blackbox/blackbox.h"
+
 #include "config/config_reset.h"
 #include "config/parameter_group.h"
 #include "config/parameter_group_ids.h"
@@ -293,6 +295,12 @@ static int logicConditionCompute(
             ENABLE_STATE(CALIBRATE_MAG);
             return true;
             break;
+#endif
+#ifdef USE_BLACKBOX
+        case LOGIC_CONDITION_BLACKBOX_TRIGGER:
+            blackboxTrigger(BLACKBOX_TRIGGER_LOGIC_CONDITION);
+            return true;
+            break;
 #endif
         case LOGIC_CONDITION_SET_VTX_POWER_LEVEL:
 #if defined(USE_VTX_CONTROL)
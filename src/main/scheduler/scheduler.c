@@ -33,6 +33,7 @@
 #include "drivers/time.h"
 
 STATIC_FASTRAM cfTask_t *currentTask = NULL;
+STATIC_FASTRAM schedulerMode_e schedulerMode = SCHEDULER_MODE_PRIORITY_SCAN;
 
 STATIC_FASTRAM uint32_t totalWaitingTasks;
 STATIC_FASTRAM uint32_t totalWaitingTasksSamples;
@@ -48,11 +49,123 @@ STATIC_FASTRAM_UNIT_TESTED cfTask_t* taskQueueArray[TASK_COUNT + 2]; // 1 extra
 #else
 STATIC_FASTRAM cfTask_t* taskQueueArray[TASK_COUNT + 1]; // extra item for NULL pointer at end of queue
 #endif
+
+/*
+ * Deadline queue: time-driven tasks are kept in a binary min-heap keyed on the time they are
+ * next due (lastExecutedAt + desiredPeriod). The scheduler only visits the part of the heap
+ * that is due, instead of walking every enabled task on every call. Event-driven tasks can't be
+ * ordered by time, they are kept in a short separate list and polled on every call. Rank is the
+ * position of the task in taskQueueArray and is used to break ties exactly as the priority scan does.
+ */
+#define TASK_INDEX(task)    ((task) - cfTasks)
+
+STATIC_FASTRAM cfTask_t *taskHeap[TASK_COUNT];
+STATIC_FASTRAM int taskHeapSize;
+STATIC_FASTRAM int8_t taskHeapPos[TASK_COUNT];
+STATIC_FASTRAM uint8_t taskQueueRank[TASK_COUNT];
+STATIC_FASTRAM cfTask_t *eventTaskArray[TASK_COUNT];
+STATIC_FASTRAM int eventTaskCount;
+
+static inline timeUs_t taskNextExecutionAt(const cfTask_t *task)
+{
+    return task->lastExecutedAt + task->desiredPeriod;
+}
+
+static inline bool taskHeapLess(int a, int b)
+{
+    return cmpTimeUs(taskNextExecutionAt(taskHeap[a]), taskNextExecutionAt(taskHeap[b])) < 0;
+}
+
+static void taskHeapSwap(int a, int b)
+{
+    cfTask_t *task = taskHeap[a];
+    taskHeap[a] = taskHeap[b];
+    taskHeap[b] = task;
+    taskHeapPos[TASK_INDEX(taskHeap[a])] = a;
+    taskHeapPos[TASK_INDEX(taskHeap[b])] = b;
+}
+
+static void taskHeapSiftUp(int pos)
+{
+    while (pos > 0) {
+        const int parent = (pos - 1) / 2;
+        if (!taskHeapLess(pos, parent)) {
+            break;
+        }
+        taskHeapSwap(pos, parent);
+        pos = parent;
+    }
+}
+
+static void taskHeapSiftDown(int pos)
+{
+    while (true) {
+        const int left = 2 * pos + 1;
+        const int right = left + 1;
+        int smallest = pos;
+
+        if (left < taskHeapSize && taskHeapLess(left, smallest)) {
+            smallest = left;
+        }
+        if (right < taskHeapSize && taskHeapLess(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            break;
+        }
+        taskHeapSwap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+// Restore heap order after the deadline of a task has changed
+static void taskHeapUpdate(cfTask_t *task)
+{
+    if (schedulerMode != SCHEDULER_MODE_DEADLINE_QUEUE) {
+        return;
+    }
+
+    const int pos = taskHeapPos[TASK_INDEX(task)];
+    if (pos >= 0) {
+        taskHeapSiftUp(pos);
+        taskHeapSiftDown(taskHeapPos[TASK_INDEX(task)]);
+    }
+}
+
+/*
+ * Tasks are only enabled/disabled at startup or on configuration changes,
+ * so it's cheaper to rebuild everything than to maintain the heap incrementally
+ */
+STATIC_UNIT_TESTED void deadlineQueueRebuild(void)
+{
+    taskHeapSize = 0;
+    eventTaskCount = 0;
+    memset(taskHeapPos, -1, sizeof(taskHeapPos));
+
+    for (int ii = 0; ii < taskQueueSize; ++ii) {
+        cfTask_t *task = taskQueueArray[ii];
+        taskQueueRank[TASK_INDEX(task)] = ii;
+        if (task->checkFunc) {
+            eventTaskArray[eventTaskCount++] = task;
+        } else {
+            taskHeapPos[TASK_INDEX(task)] = taskHeapSize;
+            taskHeap[taskHeapSize++] = task;
+        }
+    }
+
+    for (int ii = taskHeapSize / 2 - 1; ii >= 0; --ii) {
+        taskHeapSiftDown(ii);
+    }
+}
+
 STATIC_UNIT_TESTED void queueClear(void)
 {
     memset(taskQueueArray, 0, sizeof(taskQueueArray));
     taskQueuePos = 0;
     taskQueueSize = 0;
+    taskHeapSize = 0;
+    eventTaskCount = 0;
+    memset(taskHeapPos, -1, sizeof(taskHeapPos));
 }
 
 #ifdef UNIT_TEST
@@ -82,6 +195,7 @@ STATIC_UNIT_TESTED bool queueAdd(cfTask_t *task)
             memmove(&taskQueueArray[ii+1], &taskQueueArray[ii], sizeof(task) * (taskQueueSize - ii));
             taskQueueArray[ii] = task;
             ++taskQueueSize;
+            deadlineQueueRebuild();
             return true;
         }
     }
@@ -94,6 +208,7 @@ STATIC_UNIT_TESTED bool queueRemove(cfTask_t *task)
         if (taskQueueArray[ii] == task) {
             memmove(&taskQueueArray[ii], &taskQueueArray[ii+1], sizeof(task) * (taskQueueSize - ii));
             --taskQueueSize;
+            deadlineQueueRebuild();
             return true;
         }
     }
@@ -153,14 +268,57 @@ void getTaskInfo(cfTaskId_e taskId, cfTaskInfo_t * taskInfo)
     taskInfo->latestDeltaTime = cfTasks[taskId].taskLatestDeltaTime;
 }
 
+static inline int taskHistogramBucket(timeDelta_t valueUs)
+{
+    if (valueUs <= 0) {
+        return 0;
+    }
+    return MIN(32 - __builtin_clz((uint32_t)valueUs), TASK_HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+static void taskHistogramAdd(uint16_t *histogram, timeDelta_t valueUs)
+{
+    uint16_t *bucket = &histogram[taskHistogramBucket(valueUs)];
+    if (++(*bucket) == UINT16_MAX) {
+        // Halve all buckets to keep the shape of the distribution instead of saturating
+        for (int ii = 0; ii < TASK_HISTOGRAM_BUCKET_COUNT; ii++) {
+            histogram[ii] /= 2;
+        }
+    }
+}
+
+timeUs_t taskHistogramBucketUpperBound(int bucket)
+{
+    // Upper bound of the bucket, exclusive. Zero for the last, unbounded one
+    return (bucket < TASK_HISTOGRAM_BUCKET_COUNT - 1) ? (1 << bucket) : 0;
+}
+
+void getTaskHistogram(cfTaskId_e taskId, cfTaskHistogram_t *histogram)
+{
+    if (taskId < TASK_COUNT) {
+        memcpy(histogram, &cfTasks[taskId].histogram, sizeof(cfTaskHistogram_t));
+    } else {
+        memset(histogram, 0, sizeof(cfTaskHistogram_t));
+    }
+}
+
+void schedulerResetTaskHistograms(void)
+{
+    for (int ii = 0; ii < TASK_COUNT; ii++) {
+        memset(&cfTasks[ii].histogram, 0, sizeof(cfTaskHistogram_t));
+    }
+}
+
 void rescheduleTask(cfTaskId_e taskId, timeDelta_t newPeriodUs)
 {
     if (taskId == TASK_SELF) {
         cfTask_t *task = currentTask;
         task->desiredPeriod = MAX(SCHEDULER_DELAY_LIMIT, newPeriodUs);  // Limit delay to 100us (10 kHz) to prevent scheduler clogging
+        taskHeapUpdate(task);
     } else if (taskId < TASK_COUNT) {
         cfTask_t *task = &cfTasks[taskId];
         task->desiredPeriod = MAX(SCHEDULER_DELAY_LIMIT, newPeriodUs);  // Limit delay to 100us (10 kHz) to prevent scheduler clogging
+        taskHeapUpdate(task);
     }
 }
 
@@ -193,10 +351,55 @@ void schedulerResetTaskStatistics(cfTaskId_e taskId)
         currentTask->movingSumExecutionTime = 0;
         currentTask->totalExecutionTime = 0;
         currentTask->maxExecutionTime = 0;
+        memset(&currentTask->histogram, 0, sizeof(cfTaskHistogram_t));
     } else if (taskId < TASK_COUNT) {
         cfTasks[taskId].movingSumExecutionTime = 0;
         cfTasks[taskId].totalExecutionTime = 0;
+        memset(&cfTasks[taskId].histogram, 0, sizeof(cfTaskHistogram_t));
+    }
+}
+
+/*
+ * Earliest time at which a task is due, but no later than maxWaitUs from now. For running the scheduler on a
+ * virtual clock. Event-driven tasks only count once signalled. Their checkFunc is polled on every scheduler pass,
+ * so it runs along with the next time-driven task and doesn't need a pass of its own.
+ */
+timeUs_t schedulerGetNextDueTime(timeUs_t currentTimeUs, timeDelta_t maxWaitUs)
+{
+    timeDelta_t waitUs = maxWaitUs;
+
+    for (int ii = 0; taskQueueArray[ii] != NULL; ii++) {
+        const cfTask_t *task = taskQueueArray[ii];
+        timeDelta_t taskWaitUs;
+
+        if (task->checkFunc) {
+            if (task->dynamicPriority == 0) {
+                continue;
+            }
+            taskWaitUs = 0;
+        } else {
+            taskWaitUs = cmpTimeUs(task->lastExecutedAt + task->desiredPeriod, currentTimeUs);
+            // Realtime tasks only run once they are overdue
+            if (task->staticPriority == TASK_PRIORITY_REALTIME) {
+                taskWaitUs++;
+            }
+        }
+
+        waitUs = MIN(waitUs, MAX(taskWaitUs, 0));
     }
+
+    return currentTimeUs + waitUs;
+}
+
+void schedulerSetMode(schedulerMode_e mode)
+{
+    schedulerMode = mode;
+    deadlineQueueRebuild();
+}
+
+schedulerMode_e schedulerGetMode(void)
+{
+    return schedulerMode;
 }
 
 void schedulerInit(void)
@@ -205,48 +408,50 @@ void schedulerInit(void)
     queueAdd(&cfTasks[TASK_SYSTEM]);
 }
 
-void FAST_CODE NOINLINE scheduler(void)
+static bool FAST_CODE pollEventTask(cfTask_t *task, timeUs_t currentTimeUs)
 {
-    // Cache currentTime
-    const timeUs_t currentTimeUs = micros();
+    const timeUs_t currentTimeBeforeCheckFuncCallUs = micros();
+
+    // Increase priority for event driven tasks
+    if (task->dynamicPriority > 0) {
+        task->taskAgeCycles = 1 + ((timeDelta_t)(currentTimeUs - task->lastSignaledAt)) / task->desiredPeriod;
+        task->dynamicPriority = 1 + task->staticPriority * task->taskAgeCycles;
+        return true;
+    } else if (task->checkFunc(currentTimeBeforeCheckFuncCallUs, currentTimeBeforeCheckFuncCallUs - task->lastExecutedAt)) {
+        const timeUs_t checkFuncExecutionTime = micros() - currentTimeBeforeCheckFuncCallUs;
+        checkFuncMovingSumExecutionTime -= checkFuncMovingSumExecutionTime / TASK_MOVING_SUM_COUNT;
+        checkFuncMovingSumExecutionTime += checkFuncExecutionTime;
+        checkFuncTotalExecutionTime += checkFuncExecutionTime;   // time consumed by scheduler + task
+        checkFuncMaxExecutionTime = MAX(checkFuncMaxExecutionTime, checkFuncExecutionTime);
+        task->lastSignaledAt = currentTimeBeforeCheckFuncCallUs;
+        task->taskAgeCycles = 1;
+        task->dynamicPriority = 1 + task->staticPriority;
+        return true;
+    } else {
+        task->taskAgeCycles = 0;
+        return false;
+    }
+}
 
-    // The task to be invoked
+static cfTask_t * FAST_CODE selectTaskPriorityScan(timeUs_t currentTimeUs, uint16_t *waitingTasks, bool *forcedRealTimeTask)
+{
     cfTask_t *selectedTask = NULL;
     uint16_t selectedTaskDynamicPriority = 0;
-    bool forcedRealTimeTask = false;
 
     // Update task dynamic priorities
-    uint16_t waitingTasks = 0;
     for (cfTask_t *task = queueFirst(); task != NULL; task = queueNext()) {
         // Task has checkFunc - event driven
         if (task->checkFunc) {
-            const timeUs_t currentTimeBeforeCheckFuncCallUs = micros();
-
-            // Increase priority for event driven tasks
-            if (task->dynamicPriority > 0) {
-                task->taskAgeCycles = 1 + ((timeDelta_t)(currentTimeUs - task->lastSignaledAt)) / task->desiredPeriod;
-                task->dynamicPriority = 1 + task->staticPriority * task->taskAgeCycles;
-                waitingTasks++;
-            } else if (task->checkFunc(currentTimeBeforeCheckFuncCallUs, currentTimeBeforeCheckFuncCallUs - task->lastExecutedAt)) {
-                const timeUs_t checkFuncExecutionTime = micros() - currentTimeBeforeCheckFuncCallUs;
-                checkFuncMovingSumExecutionTime -= checkFuncMovingSumExecutionTime / TASK_MOVING_SUM_COUNT;
-                checkFuncMovingSumExecutionTime += checkFuncExecutionTime;
-                checkFuncTotalExecutionTime += checkFuncExecutionTime;   // time consumed by scheduler + task
-                checkFuncMaxExecutionTime = MAX(checkFuncMaxExecutionTime, checkFuncExecutionTime);
-                task->lastSignaledAt = currentTimeBeforeCheckFuncCallUs;
-                task->taskAgeCycles = 1;
-                task->dynamicPriority = 1 + task->staticPriority;
-                waitingTasks++;
-            } else {
-                task->taskAgeCycles = 0;
+            if (pollEventTask(task, currentTimeUs)) {
+                (*waitingTasks)++;
             }
         } else if (task->staticPriority == TASK_PRIORITY_REALTIME) {
             //realtime tasks take absolute priority. Any RT tasks that is overdue, should be execute immediately
             if (((timeDelta_t)(currentTimeUs - task->lastExecutedAt)) > task->desiredPeriod) {
                 selectedTaskDynamicPriority = task->dynamicPriority;
                 selectedTask = task;
-                waitingTasks++;
-                forcedRealTimeTask = true;
+                (*waitingTasks)++;
+                *forcedRealTimeTask = true;
             }
         } else {
             // Task is time-driven, dynamicPriority is last execution age (measured in desiredPeriods)
@@ -254,16 +459,109 @@ void FAST_CODE NOINLINE scheduler(void)
             task->taskAgeCycles = ((timeDelta_t)(currentTimeUs - task->lastExecutedAt)) / task->desiredPeriod;
             if (task->taskAgeCycles > 0) {
                 task->dynamicPriority = 1 + task->staticPriority * task->taskAgeCycles;
-                waitingTasks++;
+                (*waitingTasks)++;
             }
         }
 
-        if (!forcedRealTimeTask && task->dynamicPriority > selectedTaskDynamicPriority) {
+        if (!*forcedRealTimeTask && task->dynamicPriority > selectedTaskDynamicPriority) {
+            selectedTaskDynamicPriority = task->dynamicPriority;
+            selectedTask = task;
+        }
+    }
+
+    return selectedTask;
+}
+
+/*
+ * Selects the same task as selectTaskPriorityScan(), but only looks at event-driven tasks
+ * and at the time-driven tasks that are due. Ties are resolved by queue rank: the first task
+ * in the queue wins for dynamic priority, the last overdue one wins for realtime tasks.
+ */
+static cfTask_t * FAST_CODE selectTaskDeadline(timeUs_t currentTimeUs, uint16_t *waitingTasks, bool *forcedRealTimeTask)
+{
+    cfTask_t *selectedTask = NULL;
+    uint16_t selectedTaskDynamicPriority = 0;
+    cfTask_t *realTimeTask = NULL;
+    int8_t heapStack[TASK_COUNT];
+    int heapStackSize = 0;
+
+    for (int ii = 0; ii < eventTaskCount; ++ii) {
+        cfTask_t *task = eventTaskArray[ii];
+        if (pollEventTask(task, currentTimeUs)) {
+            (*waitingTasks)++;
+        }
+        if (task->dynamicPriority > selectedTaskDynamicPriority ||
+            (task->dynamicPriority > 0 && task->dynamicPriority == selectedTaskDynamicPriority && taskQueueRank[TASK_INDEX(task)] < taskQueueRank[TASK_INDEX(selectedTask)])) {
             selectedTaskDynamicPriority = task->dynamicPriority;
             selectedTask = task;
         }
     }
 
+    if (taskHeapSize > 0) {
+        heapStack[heapStackSize++] = 0;
+    }
+
+    while (heapStackSize > 0) {
+        const int pos = heapStack[--heapStackSize];
+        cfTask_t *task = taskHeap[pos];
+        const timeDelta_t taskAge = (timeDelta_t)(currentTimeUs - task->lastExecutedAt);
+
+        // Heap order guarantees that if a task is not due yet, none of its children is
+        if (taskAge < task->desiredPeriod) {
+            continue;
+        }
+
+        if (2 * pos + 1 < taskHeapSize) {
+            heapStack[heapStackSize++] = 2 * pos + 1;
+        }
+        if (2 * pos + 2 < taskHeapSize) {
+            heapStack[heapStackSize++] = 2 * pos + 2;
+        }
+
+        if (task->staticPriority == TASK_PRIORITY_REALTIME) {
+            if (taskAge > task->desiredPeriod) {
+                if (!realTimeTask || taskQueueRank[TASK_INDEX(task)] > taskQueueRank[TASK_INDEX(realTimeTask)]) {
+                    realTimeTask = task;
+                }
+                (*waitingTasks)++;
+            }
+        } else {
+            task->taskAgeCycles = taskAge / task->desiredPeriod;
+            task->dynamicPriority = 1 + task->staticPriority * task->taskAgeCycles;
+            (*waitingTasks)++;
+
+            if (task->dynamicPriority > selectedTaskDynamicPriority ||
+                (task->dynamicPriority == selectedTaskDynamicPriority && taskQueueRank[TASK_INDEX(task)] < taskQueueRank[TASK_INDEX(selectedTask)])) {
+                selectedTaskDynamicPriority = task->dynamicPriority;
+                selectedTask = task;
+            }
+        }
+    }
+
+    if (realTimeTask) {
+        *forcedRealTimeTask = true;
+        return realTimeTask;
+    }
+
+    return selectedTask;
+}
+
+void FAST_CODE NOINLINE scheduler(void)
+{
+    // Cache currentTime
+    const timeUs_t currentTimeUs = micros();
+
+    bool forcedRealTimeTask = false;
+    uint16_t waitingTasks = 0;
+
+    // The task to be invoked
+    cfTask_t *selectedTask;
+    if (schedulerMode == SCHEDULER_MODE_DEADLINE_QUEUE) {
+        selectedTask = selectTaskDeadline(currentTimeUs, &waitingTasks, &forcedRealTimeTask);
+    } else {
+        selectedTask = selectTaskPriorityScan(currentTimeUs, &waitingTasks, &forcedRealTimeTask);
+    }
+
     totalWaitingTasksSamples++;
     totalWaitingTasks += waitingTasks;
 
@@ -271,9 +569,12 @@ void FAST_CODE NOINLINE scheduler(void)
 
     if (selectedTask) {
         // Found a task that should be run
+        // Event driven tasks are due when signalled, time driven ones one period after the last execution
+        const timeUs_t taskDueAt = selectedTask->checkFunc ? selectedTask->lastSignaledAt : selectedTask->lastExecutedAt + selectedTask->desiredPeriod;
         selectedTask->taskLatestDeltaTime = (timeDelta_t)(currentTimeUs - selectedTask->lastExecutedAt);
         selectedTask->lastExecutedAt = currentTimeUs;
         selectedTask->dynamicPriority = 0;
+        taskHeapUpdate(selectedTask);
 
         // Execute task
         const timeUs_t currentTimeBeforeTaskCall = micros();
@@ -282,6 +583,8 @@ void FAST_CODE NOINLINE scheduler(void)
         selectedTask->movingSumExecutionTime += taskExecutionTime - selectedTask->movingSumExecutionTime / TASK_MOVING_SUM_COUNT;
         selectedTask->totalExecutionTime += taskExecutionTime;   // time consumed by scheduler + task
         selectedTask->maxExecutionTime = MAX(selectedTask->maxExecutionTime, taskExecutionTime);
+        taskHistogramAdd(selectedTask->histogram.startLatency, cmpTimeUs(currentTimeBeforeTaskCall, taskDueAt));
+        taskHistogramAdd(selectedTask->histogram.executionTime, taskExecutionTime);
     } 
     
     if (!selectedTask || forcedRealTimeTask) {
@@ -29,12 +29,25 @@ typedef enum {
     TASK_PRIORITY_MAX = 255
 } cfTaskPriority_e;
 
+typedef enum {
+    SCHEDULER_MODE_PRIORITY_SCAN = 0,   // Walk all enabled tasks on every call and pick the one with highest dynamic priority
+    SCHEDULER_MODE_DEADLINE_QUEUE,      // Keep time-driven tasks ordered by next due time, only look at the ones that are due
+} schedulerMode_e;
+
 typedef struct {
     timeUs_t     maxExecutionTime;
     timeUs_t     totalExecutionTime;
     timeUs_t     averageExecutionTime;
 } cfCheckFuncInfo_t;
 
+// Log2 buckets: bucket 0 counts 0us, bucket N counts [2^(N-1), 2^N) us, last bucket counts everything above
+#define TASK_HISTOGRAM_BUCKET_COUNT     16
+
+typedef struct {
+    uint16_t     startLatency[TASK_HISTOGRAM_BUCKET_COUNT];     // actual start vs. time the task was due
+    uint16_t     executionTime[TASK_HISTOGRAM_BUCKET_COUNT];
+} cfTaskHistogram_t;
+
 typedef struct {
     const char * taskName;
     bool         isEnabled;
@@ -137,6 +150,10 @@ typedef enum {
     TASK_TELEMETRY_SBUS2,
 #endif
 
+#ifdef USE_BLACKBOX
+    TASK_BLACKBOX,
+#endif
+
     /* Count of real tasks */
     TASK_COUNT,
 
@@ -164,6 +181,7 @@ typedef struct {
     timeUs_t movingSumExecutionTime;  // moving sum over 32 samples
     timeUs_t maxExecutionTime;
     timeUs_t totalExecutionTime;    // total time consumed by task since boot
+    cfTaskHistogram_t histogram;
 } cfTask_t;
 
 extern cfTask_t cfTasks[TASK_COUNT];
@@ -175,6 +193,13 @@ void rescheduleTask(cfTaskId_e taskId, timeDelta_t newPeriodUs);
 void setTaskEnabled(cfTaskId_e taskId, bool newEnabledState);
 timeDelta_t getTaskDeltaTime(cfTaskId_e taskId);
 void schedulerResetTaskStatistics(cfTaskId_e taskId);
+void getTaskHistogram(cfTaskId_e taskId, cfTaskHistogram_t *histogram);
+void schedulerResetTaskHistograms(void);
+timeUs_t taskHistogramBucketUpperBound(int bucket);
+
+timeUs_t schedulerGetNextDueTime(timeUs_t currentTimeUs, timeDelta_t maxWaitUs);
+void schedulerSetMode(schedulerMode_e mode);
+schedulerMode_e schedulerGetMode(void);
 
 void schedulerInit(void);
 void scheduler(void);
@@ -27,6 +27,7 @@
 
 #include "common/axis.h"
 #include "common/calibration.h"
+#include "common/decimator.h"
 #include "common/filter.h"
 #include "common/log.h"
 #include "common/maths.h"
@@ -63,13 +64,9 @@
 
 #include "sensors/boardalignment.h"
 #include "sensors/gyro.h"
+#include "sensors/gyro_filter_chain.h"
 #include "sensors/sensors.h"
 
-#include "flight/gyroanalyse.h"
-#include "flight/rpm_filter.h"
-#include "flight/kalman.h"
-#include "flight/adaptive_filter.h"
-
 #ifdef USE_HARDWARE_REVISION_DETECTION
 #include "hardware_revision.h"
 #endif
@@ -78,6 +75,8 @@ FASTRAM gyro_t gyro; // gyro sensor object
 
 #define MAX_GYRO_COUNT 1
 
+#define GYRO_DECIMATION_MIN_SAMPLE_INTERVAL_US  125     // 8kHz
+
 STATIC_UNIT_TESTED gyroDev_t gyroDev[MAX_GYRO_COUNT];  // Not in FASTRAM since it may hold DMA buffers
 STATIC_FASTRAM int16_t gyroTemperature[MAX_GYRO_COUNT];
 STATIC_FASTRAM_UNIT_TESTED zeroCalibrationVector_t gyroCalibration[MAX_GYRO_COUNT];
@@ -85,24 +84,15 @@ STATIC_FASTRAM_UNIT_TESTED zeroCalibrationVector_t gyroCalibration[MAX_GYRO_COUN
 STATIC_FASTRAM filterApplyFnPtr gyroLpfApplyFn;
 STATIC_FASTRAM filter_t gyroLpfState[XYZ_AXIS_COUNT];
 
-STATIC_FASTRAM filterApplyFnPtr gyroLpf2ApplyFn;
-STATIC_FASTRAM filter_t gyroLpf2State[XYZ_AXIS_COUNT];
-
-STATIC_FASTRAM filterApplyFnPtr gyroLuluApplyFn;
-STATIC_FASTRAM filter_t gyroLuluState[XYZ_AXIS_COUNT];
-
-#ifdef USE_DYNAMIC_FILTERS
-
-EXTENDED_FASTRAM gyroAnalyseState_t gyroAnalyseState;
-EXTENDED_FASTRAM dynamicGyroNotchState_t dynamicGyroNotchState;
-EXTENDED_FASTRAM secondaryDynamicGyroNotchState_t secondaryDynamicGyroNotchState;
-
-#endif
+STATIC_FASTRAM bool gyroDecimationEnabled;
+EXTENDED_FASTRAM decimatorVec3_t gyroDecimator;
 
-PG_REGISTER_WITH_RESET_TEMPLATE(gyroConfig_t, gyroConfig, PG_GYRO_CONFIG, 12);
+PG_REGISTER_WITH_RESET_TEMPLATE(gyroConfig_t, gyroConfig, PG_GYRO_CONFIG, 15);
 
 PG_RESET_TEMPLATE(gyroConfig_t, gyroConfig,
     .gyro_anti_aliasing_lpf_hz = SETTING_GYRO_ANTI_ALIASING_LPF_HZ_DEFAULT,
+    .gyroDecimationFactor = SETTING_GYRO_DECIMATION_FACTOR_DEFAULT,
+    .gyroDecimationFilter = SETTING_GYRO_DECIMATION_FILTER_DEFAULT,
     .looptime = SETTING_LOOPTIME_DEFAULT,
 #ifdef USE_DUAL_GYRO
     .gyro_to_use = SETTING_GYRO_TO_USE_DEFAULT,
@@ -117,6 +107,9 @@ PG_RESET_TEMPLATE(gyroConfig_t, gyroConfig,
     .dynamicGyroNotchEnabled = SETTING_DYNAMIC_GYRO_NOTCH_ENABLED_DEFAULT,
     .dynamicGyroNotchMode = SETTING_DYNAMIC_GYRO_NOTCH_MODE_DEFAULT,
     .dynamicGyroNotch3dQ = SETTING_DYNAMIC_GYRO_NOTCH_3D_Q_DEFAULT,
+    .dynamicGyroNotchFftSize = SETTING_DYNAMIC_GYRO_NOTCH_FFT_SIZE_DEFAULT,
+    .dynamicGyroNotchFftOverlap = SETTING_DYNAMIC_GYRO_NOTCH_FFT_OVERLAP_DEFAULT,
+    .dynamicGyroNotchAnalyser = SETTING_DYNAMIC_GYRO_NOTCH_ANALYSER_DEFAULT,
 #endif
 #ifdef USE_GYRO_KALMAN
     .kalman_q = SETTING_SETPOINT_KALMAN_Q_DEFAULT,
@@ -256,38 +249,56 @@ static void initGyroFilter(filterApplyFnPtr *applyFn, filter_t state[], uint16_t
     }
 }
 
-static void gyroInitFilters(void)
+/*
+ * With decimation the gyro is sampled gyroDecimationFactor times per PID loop,
+ * otherwise at the fixed gyro task rate
+ */
+static uint32_t gyroRequestedSampleIntervalUs(void)
 {
-    //First gyro LPF running at full gyro frequency 8kHz
-    initGyroFilter(&gyroLpfApplyFn, gyroLpfState, gyroConfig()->gyro_anti_aliasing_lpf_hz, getGyroLooptime());
+    if (gyroConfig()->gyroDecimationFactor > 1 && getLooptime() > 0) {
+        return MAX(getLooptime() / gyroConfig()->gyroDecimationFactor, (uint32_t)GYRO_DECIMATION_MIN_SAMPLE_INTERVAL_US);
+    }
 
-    if (gyroConfig()->gyroLuluEnabled && gyroConfig()->gyroLuluSampleCount > 0) {
-        gyroLuluApplyFn = (filterApplyFnPtr)luluFilterApply;
+    return TASK_GYRO_LOOPTIME;
+}
 
-        for (int axis = 0; axis < 3; axis++) {
-            luluFilterInit(&gyroLuluState[axis].lulu, gyroConfig()->gyroLuluSampleCount);
+static void gyroInitDecimation(void)
+{
+    gyroDecimationEnabled = false;
+
+    if (gyroConfig()->gyroDecimationFactor > 1 && getLooptime() > 0) {
+        // The gyro might not support the requested rate, the filter is designed for the rate it actually runs at
+        const uint32_t factor = (getLooptime() + getGyroLooptime() / 2) / getGyroLooptime();
+
+        if (factor > 1) {
+            decimatorVec3Init(&gyroDecimator, gyroConfig()->gyroDecimationFilter, MIN(factor, (uint32_t)DECIMATOR_MAX_FACTOR));
+            gyroDecimationEnabled = true;
         }
-    } else {
-        gyroLuluApplyFn = nullFilterApply;
     }
+}
 
-    if (gyroConfig()->gyroFilterMode != GYRO_FILTER_MODE_OFF) {
-        initGyroFilter(&gyroLpf2ApplyFn, gyroLpf2State, gyroConfig()->gyro_main_lpf_hz, getLooptime());
-    } else {
-        gyroLpf2ApplyFn = nullFilterApply;
+bool gyroGetDecimationInfo(gyroDecimationInfo_t *info)
+{
+    if (!gyroDecimationEnabled) {
+        return false;
     }
 
-#ifdef USE_ADAPTIVE_FILTER
-    if (gyroConfig()->gyroFilterMode == GYRO_FILTER_MODE_ADAPTIVE) {
-        adaptiveFilterSetDefaultFrequency(gyroConfig()->gyro_main_lpf_hz, gyroConfig()->adaptiveFilterMinHz, gyroConfig()->adaptiveFilterMaxHz);
-    }
-#endif
+    info->factor = gyroDecimator.factor;
+    info->filter = gyroConfig()->gyroDecimationFilter;
+    info->taps = gyroDecimator.taps;
+    info->groupDelayUs = lrintf(decimatorGroupDelaySamples(&gyroDecimator) * getGyroLooptime());
+    return true;
+}
 
-#ifdef USE_GYRO_KALMAN
-    if (gyroConfig()->kalmanEnabled) {
-        gyroKalmanInitialize(gyroConfig()->kalman_q);
-    }
-#endif
+static void gyroInitFilters(void)
+{
+    gyroInitDecimation();
+
+    //First gyro LPF running at full gyro frequency 8kHz, the decimation filter takes its place when enabled
+    initGyroFilter(&gyroLpfApplyFn, gyroLpfState, gyroDecimationEnabled ? 0 : gyroConfig()->gyro_anti_aliasing_lpf_hz, getGyroLooptime());
+
+    // Everything else runs at the PID loop rate
+    gyroFilterChainInit();
 }
 
 bool gyroInit(void)
@@ -316,8 +327,8 @@ bool gyroInit(void)
 
     // Driver initialisation
     gyroDev[0].lpf = GYRO_LPF_256HZ;
-    gyroDev[0].requestedSampleIntervalUs = TASK_GYRO_LOOPTIME;
-    gyroDev[0].sampleRateIntervalUs = TASK_GYRO_LOOPTIME;
+    gyroDev[0].requestedSampleIntervalUs = gyroRequestedSampleIntervalUs();
+    gyroDev[0].sampleRateIntervalUs = gyroDev[0].requestedSampleIntervalUs;
     gyroDev[0].initFn(&gyroDev[0]);
 
     // initFn will initialize sampleRateIntervalUs to actual gyro sampling rate (if driver supports it). Calculate target looptime using that value
@@ -325,18 +336,6 @@ bool gyroInit(void)
  
     gyroInitFilters();
 
-#ifdef USE_DYNAMIC_FILTERS
-    // Dynamic notch running at PID frequency
-    dynamicGyroNotchFiltersInit(&dynamicGyroNotchState);
-
-    secondaryDynamicGyroNotchFiltersInit(&secondaryDynamicGyroNotchState);
-
-    gyroDataAnalyseStateInit(
-        &gyroAnalyseState,
-        gyroConfig()->dynamicGyroNotchMinHz,
-        getLooptime()
-    );
-#endif
     return true;
 }
 
@@ -458,81 +457,28 @@ static bool FAST_CODE NOINLINE gyroUpdateAndCalibrate(gyroDev_t * gyroDev, zeroC
     }
 }
 
+/*
+ * Gyro filter chain, see gyro_filter_chain.c. Each stage runs over all three axes before the
+ * next one starts, biquad and PT1 stages keep the state of all axes side by side (see filter_vec3.h)
+ */
 void FAST_CODE NOINLINE gyroFilter(void)
 {
     if (!gyro.initialized) {
         return;
     }
 
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        float gyroADCf = gyro.gyroADCf[axis];
-
-#ifdef USE_RPM_FILTER
-        gyroADCf = rpmFilterGyroApply(axis, gyroADCf);
-#endif
-
-        // LULU gyro filter
-        DEBUG_SET(DEBUG_LULU, axis, gyroADCf); //Pre LULU debug
-        float preLulu = gyroADCf;
-        gyroADCf = gyroLuluApplyFn((filter_t *) &gyroLuluState[axis], gyroADCf);
-        DEBUG_SET(DEBUG_LULU, axis + 3, gyroADCf); //Post LULU debug
-
-        if (axis == ROLL) {
-            DEBUG_SET(DEBUG_LULU, 6, gyroADCf - preLulu); //LULU delta debug
-        }
-
-        // Gyro Main LPF
-        gyroADCf = gyroLpf2ApplyFn((filter_t *) &gyroLpf2State[axis], gyroADCf);
-
-#ifdef USE_ADAPTIVE_FILTER
-        adaptiveFilterPush(axis, gyroADCf);
-#endif
-
-#ifdef USE_DYNAMIC_FILTERS
-        if (dynamicGyroNotchState.enabled) {
-            gyroDataAnalysePush(&gyroAnalyseState, axis, gyroADCf);
-            gyroADCf = dynamicGyroNotchFiltersApply(&dynamicGyroNotchState, axis, gyroADCf);
-        }
-
-        /**
-         * Secondary dynamic notch filter. 
-         * In some cases, noise amplitude is high enough not to be filtered by the primary filter.
-         * This happens on the first frequency with the biggest aplitude
-         */
-        gyroADCf = secondaryDynamicGyroNotchFiltersApply(&secondaryDynamicGyroNotchState, axis, gyroADCf);
-
-#endif
+    float *gyroADCf = gyro.gyroADCf;
 
-#ifdef USE_GYRO_KALMAN
-        if (gyroConfig()->kalmanEnabled) {
-            gyroADCf = gyroKalmanUpdate(axis, gyroADCf);
-        }
+    // In HITL mode gyroADCf comes from the simulator and the decimator is not fed
+    if (gyroDecimationEnabled
+#ifdef USE_SIMULATOR
+        && !ARMING_FLAG(SIMULATOR_MODE_HITL)
 #endif
-
-        gyro.gyroADCf[axis] = gyroADCf;
+    ) {
+        decimatorVec3Apply(&gyroDecimator, gyroADCf);
     }
 
-#ifdef USE_DYNAMIC_FILTERS
-    if (dynamicGyroNotchState.enabled) {
-        gyroDataAnalyse(&gyroAnalyseState);
-
-        if (gyroAnalyseState.filterUpdateExecute) {
-            dynamicGyroNotchFiltersUpdate(
-                &dynamicGyroNotchState,
-                gyroAnalyseState.filterUpdateAxis,
-                gyroAnalyseState.centerFrequency[gyroAnalyseState.filterUpdateAxis]
-            );
-
-            secondaryDynamicGyroNotchFiltersUpdate(
-                &secondaryDynamicGyroNotchState, 
-                gyroAnalyseState.filterUpdateAxis,
-                gyroAnalyseState.centerFrequency[gyroAnalyseState.filterUpdateAxis]
-            );
-
-        }
-    }
-#endif
-
+    gyroFilterChainApply(gyroADCf);
 }
 
 void FAST_CODE NOINLINE gyroUpdate(void)
@@ -552,6 +498,18 @@ void FAST_CODE NOINLINE gyroUpdate(void)
         return;
     }
 
+    if (gyroDecimationEnabled) {
+        /*
+         * Samples are only stored at the full gyro rate, the decimation filter
+         * runs once per PID loop in gyroFilter()
+         */
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyro.gyroRaw[axis] = gyro.gyroADCf[axis];
+        }
+        decimatorVec3Push(&gyroDecimator, gyro.gyroADCf);
+        return;
+    }
+
     for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
         // At this point gyro.gyroADCf contains unfiltered gyro value [deg/s]
         float gyroADCf = gyro.gyroADCf[axis];
@@ -601,9 +559,7 @@ int16_t gyroRateDps(int axis)
 }
 
 void gyroUpdateDynamicLpf(float cutoffFreq) {
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        pt1FilterUpdateCutoff(&gyroLpf2State[axis].pt1, cutoffFreq);
-    }
+    gyroFilterChainUpdateMainLpf(cutoffFreq);
 }
 
 float averageAbsGyroRates(void)
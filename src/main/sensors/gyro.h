@@ -18,6 +18,7 @@
 #pragma once
 
 #include "common/axis.h"
+#include "common/decimator.h"
 #include "common/maths.h"
 #include "common/vector.h"
 #include "common/time.h"
@@ -52,6 +53,17 @@ typedef enum {
     DYNAMIC_NOTCH_MODE_3D
 } dynamicGyroNotchMode_e;
 
+typedef enum {
+    DYNAMIC_NOTCH_FFT_SIZE_64 = 0,
+    DYNAMIC_NOTCH_FFT_SIZE_128,
+    DYNAMIC_NOTCH_FFT_SIZE_256
+} dynamicGyroNotchFftSize_e;
+
+typedef enum {
+    DYNAMIC_NOTCH_ANALYSER_FFT = 0,
+    DYNAMIC_NOTCH_ANALYSER_SDFT
+} dynamicGyroNotchAnalyser_e;
+
 typedef enum {
     GYRO_FILTER_MODE_OFF = 0,
     GYRO_FILTER_MODE_STATIC = 1,
@@ -72,6 +84,8 @@ extern dynamicGyroNotchState_t dynamicGyroNotchState;
 typedef struct gyroConfig_s {
     uint16_t looptime;                      // imu loop time in us
     uint16_t  gyro_anti_aliasing_lpf_hz;
+    uint8_t gyroDecimationFactor;           // gyro samples per PID loop, 0 or 1 keeps the gyro at TASK_GYRO_LOOPTIME
+    uint8_t gyroDecimationFilter;
 #ifdef USE_DUAL_GYRO
     uint8_t  gyro_to_use;
 #endif
@@ -85,6 +99,9 @@ typedef struct gyroConfig_s {
     uint8_t dynamicGyroNotchEnabled;
     uint8_t dynamicGyroNotchMode;
     uint16_t dynamicGyroNotch3dQ;
+    uint8_t dynamicGyroNotchFftSize;
+    bool dynamicGyroNotchFftOverlap;
+    uint8_t dynamicGyroNotchAnalyser;
 #endif
 #ifdef USE_GYRO_KALMAN
     uint16_t kalman_q;
@@ -110,6 +127,13 @@ typedef struct gyroConfig_s {
 
 PG_DECLARE(gyroConfig_t, gyroConfig);
 
+typedef struct {
+    uint8_t factor;
+    uint8_t filter;
+    uint8_t taps;
+    uint32_t groupDelayUs;
+} gyroDecimationInfo_t;
+
 bool gyroInit(void);
 void gyroGetMeasuredRotationRate(fpVector3_t *imuMeasuredRotationBF);
 void gyroUpdate(void);
@@ -121,3 +145,4 @@ int16_t gyroGetTemperature(void);
 int16_t gyroRateDps(int axis);
 void gyroUpdateDynamicLpf(float cutoffFreq);
 float averageAbsGyroRates(void);
+bool gyroGetDecimationInfo(gyroDecimationInfo_t *info);
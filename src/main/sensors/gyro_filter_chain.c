@@ -0,0 +1,232 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+#include "build/build_config.h"
+#include "build/debug.h"
+
+#include "common/axis.h"
+#include "common/filter.h"
+#include "common/filter_vec3.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "fc/config.h"
+
+#include "flight/adaptive_filter.h"
+#include "flight/dynamic_gyro_notch.h"
+#include "flight/gyroanalyse.h"
+#include "flight/kalman.h"
+#include "flight/rpm_filter.h"
+#include "flight/secondary_dynamic_gyro_notch.h"
+
+#include "sensors/gyro.h"
+#include "sensors/gyro_filter_chain.h"
+
+STATIC_FASTRAM filterApplyFnPtr gyroLuluApplyFn;
+STATIC_FASTRAM filter_t gyroLuluState[XYZ_AXIS_COUNT];
+
+STATIC_FASTRAM bool gyroLpf2Enabled;
+STATIC_FASTRAM pt1FilterVec3_t gyroLpf2State;
+
+#ifdef USE_DYNAMIC_FILTERS
+
+EXTENDED_FASTRAM gyroAnalyseState_t gyroAnalyseState;
+EXTENDED_FASTRAM dynamicGyroNotchState_t dynamicGyroNotchState;
+EXTENDED_FASTRAM secondaryDynamicGyroNotchState_t secondaryDynamicGyroNotchState;
+
+#endif
+
+void gyroFilterChainInit(void)
+{
+    if (gyroConfig()->gyroLuluEnabled && gyroConfig()->gyroLuluSampleCount > 0) {
+        gyroLuluApplyFn = (filterApplyFnPtr)luluFilterApply;
+
+        for (int axis = 0; axis < 3; axis++) {
+            luluFilterInit(&gyroLuluState[axis].lulu, gyroConfig()->gyroLuluSampleCount);
+        }
+    } else {
+        gyroLuluApplyFn = nullFilterApply;
+    }
+
+    gyroLpf2Enabled = gyroConfig()->gyroFilterMode != GYRO_FILTER_MODE_OFF && gyroConfig()->gyro_main_lpf_hz > 0;
+    if (gyroLpf2Enabled) {
+        pt1FilterVec3Init(&gyroLpf2State, gyroConfig()->gyro_main_lpf_hz, US2S(getLooptime()));
+    }
+
+#ifdef USE_ADAPTIVE_FILTER
+    if (gyroConfig()->gyroFilterMode == GYRO_FILTER_MODE_ADAPTIVE) {
+        adaptiveFilterSetDefaultFrequency(gyroConfig()->gyro_main_lpf_hz, gyroConfig()->adaptiveFilterMinHz, gyroConfig()->adaptiveFilterMaxHz);
+    }
+#endif
+
+#ifdef USE_GYRO_KALMAN
+    if (gyroConfig()->kalmanEnabled) {
+        gyroKalmanInitialize(gyroConfig()->kalman_q);
+    }
+#endif
+
+#ifdef USE_DYNAMIC_FILTERS
+    // Dynamic notch running at PID frequency
+    dynamicGyroNotchFiltersInit(&dynamicGyroNotchState);
+
+    secondaryDynamicGyroNotchFiltersInit(&secondaryDynamicGyroNotchState);
+
+    gyroDataAnalyseStateInit(
+        &gyroAnalyseState,
+        gyroConfig()->dynamicGyroNotchMinHz,
+        getLooptime(),
+        64 << gyroConfig()->dynamicGyroNotchFftSize,
+        gyroConfig()->dynamicGyroNotchFftOverlap,
+        gyroConfig()->dynamicGyroNotchAnalyser
+    );
+#endif
+}
+
+static void FAST_CODE gyroFilterRpm(float *gyroADCf)
+{
+#ifdef USE_RPM_FILTER
+    rpmFilterGyroApply(gyroADCf);
+#else
+    UNUSED(gyroADCf);
+#endif
+}
+
+static void FAST_CODE gyroFilterLulu(float *gyroADCf)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        DEBUG_SET(DEBUG_LULU, axis, gyroADCf[axis]); //Pre LULU debug
+        const float preLulu = gyroADCf[axis];
+        gyroADCf[axis] = gyroLuluApplyFn((filter_t *) &gyroLuluState[axis], gyroADCf[axis]);
+        DEBUG_SET(DEBUG_LULU, axis + 3, gyroADCf[axis]); //Post LULU debug
+
+        if (axis == FD_ROLL) {
+            DEBUG_SET(DEBUG_LULU, 6, gyroADCf[axis] - preLulu); //LULU delta debug
+        }
+    }
+}
+
+static void FAST_CODE gyroFilterMainLpf(float *gyroADCf)
+{
+    if (gyroLpf2Enabled) {
+        pt1FilterVec3Apply(&gyroLpf2State, gyroADCf);
+    }
+
+#ifdef USE_ADAPTIVE_FILTER
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        adaptiveFilterPush(axis, gyroADCf[axis]);
+    }
+#endif
+}
+
+static void FAST_CODE gyroFilterDynamicNotch(float *gyroADCf)
+{
+#ifdef USE_DYNAMIC_FILTERS
+    if (dynamicGyroNotchState.enabled) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroDataAnalysePush(&gyroAnalyseState, axis, gyroADCf[axis]);
+        }
+        dynamicGyroNotchFiltersApply(&dynamicGyroNotchState, gyroADCf);
+    }
+
+    /**
+     * Secondary dynamic notch filter.
+     * In some cases, noise amplitude is high enough not to be filtered by the primary filter.
+     * This happens on the first frequency with the biggest aplitude
+     */
+    secondaryDynamicGyroNotchFiltersApply(&secondaryDynamicGyroNotchState, gyroADCf);
+#else
+    UNUSED(gyroADCf);
+#endif
+}
+
+static void FAST_CODE gyroFilterKalman(float *gyroADCf)
+{
+#ifdef USE_GYRO_KALMAN
+    if (gyroConfig()->kalmanEnabled) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroADCf[axis] = gyroKalmanUpdate(axis, gyroADCf[axis]);
+        }
+    }
+#else
+    UNUSED(gyroADCf);
+#endif
+}
+
+static void FAST_CODE gyroFilterSpectrum(float *gyroADCf)
+{
+    UNUSED(gyroADCf);
+
+#ifdef USE_DYNAMIC_FILTERS
+    if (dynamicGyroNotchState.enabled) {
+        gyroDataAnalyse(&gyroAnalyseState);
+
+        if (gyroAnalyseState.filterUpdateExecute) {
+            dynamicGyroNotchFiltersUpdate(
+                &dynamicGyroNotchState,
+                gyroAnalyseState.filterUpdateAxis,
+                gyroAnalyseState.centerFrequency[gyroAnalyseState.filterUpdateAxis]
+            );
+
+            secondaryDynamicGyroNotchFiltersUpdate(
+                &secondaryDynamicGyroNotchState,
+                gyroAnalyseState.filterUpdateAxis,
+                gyroAnalyseState.centerFrequency[gyroAnalyseState.filterUpdateAxis]
+            );
+
+        }
+    }
+#endif
+}
+
+// The order the stages run in, each one over all three axes
+static void (* const gyroFilterStages[GYRO_FILTER_STAGE_COUNT])(float *gyroADCf) = {
+    [GYRO_FILTER_STAGE_RPM]             = gyroFilterRpm,
+    [GYRO_FILTER_STAGE_LULU]            = gyroFilterLulu,
+    [GYRO_FILTER_STAGE_MAIN_LPF]        = gyroFilterMainLpf,
+    [GYRO_FILTER_STAGE_DYNAMIC_NOTCH]   = gyroFilterDynamicNotch,
+    [GYRO_FILTER_STAGE_KALMAN]          = gyroFilterKalman,
+    [GYRO_FILTER_STAGE_SPECTRUM]        = gyroFilterSpectrum,
+};
+
+void FAST_CODE gyroFilterChainApply(float *gyroADCf)
+{
+    for (int stage = 0; stage < GYRO_FILTER_STAGE_COUNT; stage++) {
+        gyroFilterStages[stage](gyroADCf);
+    }
+}
+
+void gyroFilterChainApplyStage(gyroFilterStage_e stage, float *gyroADCf)
+{
+    gyroFilterStages[stage](gyroADCf);
+}
+
+void gyroFilterChainUpdateMainLpf(float cutoffFreq)
+{
+    pt1FilterVec3UpdateCutoff(&gyroLpf2State, cutoffFreq);
+}
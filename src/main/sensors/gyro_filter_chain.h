@@ -0,0 +1,45 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+
+/*
+ * Gyro filters that run once per PID loop, after decimation and the anti-aliasing LPF.
+ * gyroFilter() runs all stages, the filter replay tool runs them one by one to time them.
+ */
+
+typedef enum {
+    GYRO_FILTER_STAGE_RPM = 0,
+    GYRO_FILTER_STAGE_LULU,
+    GYRO_FILTER_STAGE_MAIN_LPF,
+    GYRO_FILTER_STAGE_DYNAMIC_NOTCH,
+    GYRO_FILTER_STAGE_KALMAN,
+    GYRO_FILTER_STAGE_SPECTRUM,         // Noise analysis and dynamic notch frequency updates
+    GYRO_FILTER_STAGE_COUNT
+} gyroFilterStage_e;
+
+void gyroFilterChainInit(void);
+void gyroFilterChainApply(float *gyroADCf);
+void gyroFilterChainApplyStage(gyroFilterStage_e stage, float *gyroADCf);
+void gyroFilterChainUpdateMainLpf(float cutoffFreq);
@@ -0,0 +1,455 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // pthread_setname_np()
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "platform.h"
+
+#if defined(SITL_BUILD)
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sys/epoll.h>
+#define IO_REACTOR_EPOLL
+#endif
+
+#include "common/maths.h"
+#include "common/time.h"
+#include "common/utils.h"
+
+#include "drivers/time.h"
+
+#include "scheduler/scheduler.h"
+
+#include "target/SITL/io_reactor.h"
+#include "target/SITL/lockstep.h"
+
+#if defined(__APPLE__)
+#define IO_REACTOR_IDLE_CLOCK   CLOCK_REALTIME      // No pthread_condattr_setclock()
+#else
+#define IO_REACTOR_IDLE_CLOCK   CLOCK_MONOTONIC
+#endif
+
+typedef struct {
+    bool used;
+    bool paused;
+    int fd;
+    uint64_t resumeAtMs;
+    ioReactorHandler_fn handler;
+    void *arg;
+} ioReactorEntry_t;
+
+static struct {
+    pthread_once_t once;
+    bool failed;
+    pthread_t thread;
+
+    pthread_mutex_t lock;       // The entries, and the main loop's wakeup
+    ioReactorEntry_t entries[IO_REACTOR_MAX_FDS];
+#if defined(IO_REACTOR_EPOLL)
+    int epollFd;
+#else
+    int wakeFds[2];             // Makes poll() see added descriptors
+#endif
+
+    pthread_cond_t dataArrived;
+    bool newData;
+
+    uint32_t statsIntervalS;
+    uint64_t startMs;
+    uint64_t nextStatsMs;
+    uint64_t wakeups;
+    uint64_t events;
+    uint64_t mainSleeps;
+    uint64_t mainWoken;
+} reactor = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t hostMillis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+static bool watch(int fd, int slot)
+{
+#if defined(IO_REACTOR_EPOLL)
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.u64 = ((uint64_t)fd << 32) | (uint32_t)slot,
+    };
+    return epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+#else
+    UNUSED(fd);
+    UNUSED(slot);
+    // The reactor builds the set of descriptors again
+    const uint8_t wake = 0;
+    return write(reactor.wakeFds[1], &wake, 1) == 1 || errno == EAGAIN;
+#endif
+}
+
+static void unwatch(int fd)
+{
+#if defined(IO_REACTOR_EPOLL)
+    epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, fd, NULL);
+#else
+    UNUSED(fd);
+#endif
+}
+
+static void printThreadStats(void)
+{
+#if defined(__linux__)
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        return;
+    }
+
+    struct dirent *task;
+    while ((task = readdir(dir)) != NULL) {
+        if (task->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/status", task->d_name);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+
+        char line[128];
+        char name[32] = "";
+        long voluntary = 0;
+        long involuntary = 0;
+        while (fgets(line, sizeof(line), file)) {
+            sscanf(line, "Name: %31s", name);
+            sscanf(line, "voluntary_ctxt_switches: %ld", &voluntary);
+            sscanf(line, "nonvoluntary_ctxt_switches: %ld", &involuntary);
+        }
+        fclose(file);
+
+        fprintf(stderr, "[STATS]   thread %s %s: %ld voluntary, %ld involuntary context switches\n",
+            task->d_name, name, voluntary, involuntary);
+    }
+    closedir(dir);
+#endif
+}
+
+static void printStats(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(stderr, "[STATS] %.1f s: %ld voluntary, %ld involuntary context switches\n",
+        (double)(hostMillis() - reactor.startMs) / 1000, usage.ru_nvcsw, usage.ru_nivcsw);
+    printThreadStats();
+    fprintf(stderr, "[STATS]   reactor: %llu wakeups, %llu events. Main loop: %llu sleeps, %llu ended by new data\n",
+        (unsigned long long)reactor.wakeups, (unsigned long long)reactor.events,
+        (unsigned long long)reactor.mainSleeps, (unsigned long long)reactor.mainWoken);
+}
+
+static void printStatsAtExit(void)
+{
+    fprintf(stderr, "[STATS] At exit\n");
+    printStats();
+}
+
+static void dispatch(int fd, int slot, bool *delivered)
+{
+    pthread_mutex_lock(&reactor.lock);
+    const ioReactorEntry_t entry = reactor.entries[slot];
+    pthread_mutex_unlock(&reactor.lock);
+
+    // Removed, and maybe reused, by an earlier handler of this round
+    if (!entry.used || entry.paused || entry.fd != fd) {
+        return;
+    }
+
+    reactor.events++;
+    if (entry.handler(fd, entry.arg)) {
+        *delivered = true;
+        return;
+    }
+
+    unwatch(fd);
+    pthread_mutex_lock(&reactor.lock);
+    if (reactor.entries[slot].used && reactor.entries[slot].fd == fd) {
+        reactor.entries[slot].paused = true;
+        reactor.entries[slot].resumeAtMs = hostMillis() + IO_REACTOR_RETRY_MS;
+    }
+    pthread_mutex_unlock(&reactor.lock);
+}
+
+// Returns the time until the next paused descriptor is due, -1 if there is none
+static int resumePaused(void)
+{
+    const uint64_t nowMs = hostMillis();
+    int timeoutMs = -1;
+
+    pthread_mutex_lock(&reactor.lock);
+    for (int slot = 0; slot < IO_REACTOR_MAX_FDS; slot++) {
+        ioReactorEntry_t *entry = &reactor.entries[slot];
+        if (!entry->used || !entry->paused) {
+            continue;
+        }
+        if (entry->resumeAtMs <= nowMs) {
+            entry->paused = false;
+            watch(entry->fd, slot);
+        } else if (timeoutMs < 0 || (int)(entry->resumeAtMs - nowMs) < timeoutMs) {
+            timeoutMs = entry->resumeAtMs - nowMs;
+        }
+    }
+    pthread_mutex_unlock(&reactor.lock);
+
+    return timeoutMs;
+}
+
+static void *reactorThread(void *arg)
+{
+    UNUSED(arg);
+
+    while (true) {
+        int timeoutMs = resumePaused();
+
+        if (reactor.statsIntervalS) {
+            const uint64_t nowMs = hostMillis();
+            if (nowMs >= reactor.nextStatsMs) {
+                printStats();
+                reactor.nextStatsMs = nowMs + reactor.statsIntervalS * 1000;
+            }
+            const int statsTimeoutMs = reactor.nextStatsMs - nowMs;
+            timeoutMs = timeoutMs < 0 ? statsTimeoutMs : MIN(timeoutMs, statsTimeoutMs);
+        }
+
+        bool delivered = false;
+
+#if defined(IO_REACTOR_EPOLL)
+        struct epoll_event events[IO_REACTOR_MAX_FDS];
+        const int count = epoll_wait(reactor.epollFd, events, IO_REACTOR_MAX_FDS, timeoutMs);
+        if (count < 0 && errno != EINTR) {
+            fprintf(stderr, "[REACTOR] epoll_wait: %s\n", strerror(errno));
+            return NULL;
+        }
+        reactor.wakeups++;
+
+        for (int i = 0; i < count; i++) {
+            dispatch(events[i].data.u64 >> 32, events[i].data.u64 & 0xFFFFFFFF, &delivered);
+        }
+#else
+        struct pollfd fds[IO_REACTOR_MAX_FDS + 1];
+        int slots[IO_REACTOR_MAX_FDS];
+        int fdCount = 0;
+
+        fds[fdCount++] = (struct pollfd){ .fd = reactor.wakeFds[0], .events = POLLIN };
+        pthread_mutex_lock(&reactor.lock);
+        for (int slot = 0; slot < IO_REACTOR_MAX_FDS; slot++) {
+            if (reactor.entries[slot].used && !reactor.entries[slot].paused) {
+                slots[fdCount - 1] = slot;
+                fds[fdCount++] = (struct pollfd){ .fd = reactor.entries[slot].fd, .events = POLLIN };
+            }
+        }
+        pthread_mutex_unlock(&reactor.lock);
+
+        const int count = poll(fds, fdCount, timeoutMs);
+        if (count < 0 && errno != EINTR) {
+            fprintf(stderr, "[REACTOR] poll: %s\n", strerror(errno));
+            return NULL;
+        }
+        reactor.wakeups++;
+
+        if (count > 0 && fds[0].revents) {
+            uint8_t drain[64];
+            while (read(reactor.wakeFds[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+        for (int i = 1; count > 0 && i < fdCount; i++) {
+            if (fds[i].revents) {
+                dispatch(fds[i].fd, slots[i - 1], &delivered);
+            }
+        }
+#endif
+
+        if (delivered) {
+            pthread_mutex_lock(&reactor.lock);
+            reactor.newData = true;
+            pthread_cond_signal(&reactor.dataArrived);
+            pthread_mutex_unlock(&reactor.lock);
+        }
+    }
+
+    return NULL;
+}
+
+static void reactorStart(void)
+{
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+#if !defined(__APPLE__)
+    pthread_condattr_setclock(&condAttr, IO_REACTOR_IDLE_CLOCK);
+#endif
+    pthread_cond_init(&reactor.dataArrived, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+
+    reactor.startMs = hostMillis();
+    reactor.nextStatsMs = reactor.startMs + reactor.statsIntervalS * 1000;
+
+#if defined(IO_REACTOR_EPOLL)
+    reactor.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    reactor.failed = reactor.epollFd < 0;
+#else
+    reactor.failed = pipe(reactor.wakeFds) < 0;
+    if (!reactor.failed) {
+        fcntl(reactor.wakeFds[0], F_SETFL, fcntl(reactor.wakeFds[0], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(reactor.wakeFds[1], F_SETFL, fcntl(reactor.wakeFds[1], F_GETFL, 0) | O_NONBLOCK);
+    }
+#endif
+
+    if (!reactor.failed) {
+        reactor.failed = pthread_create(&reactor.thread, NULL, reactorThread, NULL) != 0;
+    }
+
+    if (reactor.failed) {
+        fprintf(stderr, "[REACTOR] Unable to start: %s\n", strerror(errno));
+        return;
+    }
+#if defined(__linux__)
+    pthread_setname_np(reactor.thread, "reactor");
+#endif
+}
+
+bool ioReactorAdd(int fd, ioReactorHandler_fn handler, void *arg)
+{
+    pthread_once(&reactor.once, reactorStart);
+    if (reactor.failed) {
+        return false;
+    }
+
+    pthread_mutex_lock(&reactor.lock);
+    int slot = 0;
+    while (slot < IO_REACTOR_MAX_FDS && reactor.entries[slot].used) {
+        slot++;
+    }
+    if (slot < IO_REACTOR_MAX_FDS) {
+        reactor.entries[slot] = (ioReactorEntry_t){ .used = true, .fd = fd, .handler = handler, .arg = arg };
+    }
+    pthread_mutex_unlock(&reactor.lock);
+
+    if (slot == IO_REACTOR_MAX_FDS) {
+        fprintf(stderr, "[REACTOR] Too many descriptors\n");
+        return false;
+    }
+
+    if (!watch(fd, slot)) {
+        fprintf(stderr, "[REACTOR] Unable to watch descriptor %d: %s\n", fd, strerror(errno));
+        pthread_mutex_lock(&reactor.lock);
+        reactor.entries[slot].used = false;
+        pthread_mutex_unlock(&reactor.lock);
+        return false;
+    }
+    return true;
+}
+
+void ioReactorRemove(int fd)
+{
+    pthread_mutex_lock(&reactor.lock);
+    for (int slot = 0; slot < IO_REACTOR_MAX_FDS; slot++) {
+        ioReactorEntry_t *entry = &reactor.entries[slot];
+        if (entry->used && entry->fd == fd) {
+            if (!entry->paused) {
+                unwatch(fd);
+            }
+            entry->used = false;
+        }
+    }
+    pthread_mutex_unlock(&reactor.lock);
+}
+
+/*
+ * Call from the main loop after each scheduler pass. Outside of lockstep mode, sleeps until the next task is due or
+ * the reactor has delivered new data.
+ */
+void ioReactorIdle(void)
+{
+    if (lockstepIsEnabled()) {
+        return;
+    }
+
+    pthread_once(&reactor.once, reactorStart);
+
+    const timeUs_t currentTimeUs = micros();
+    // The host wakes threads late, the last bit is spent in the scheduler instead
+    const timeDelta_t waitUs = cmpTimeUs(schedulerGetNextDueTime(currentTimeUs, IO_REACTOR_MAX_IDLE_US), currentTimeUs)
+        - IO_REACTOR_WAKE_MARGIN_US;
+    if (waitUs <= 0) {
+        return;
+    }
+
+    struct timespec deadline;
+    clock_gettime(IO_REACTOR_IDLE_CLOCK, &deadline);
+    deadline.tv_nsec += waitUs * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&reactor.lock);
+    if (!reactor.newData) {
+        reactor.mainSleeps++;
+        if (pthread_cond_timedwait(&reactor.dataArrived, &reactor.lock, &deadline) == 0 && reactor.newData) {
+            reactor.mainWoken++;
+        }
+    }
+    reactor.newData = false;
+    pthread_mutex_unlock(&reactor.lock);
+}
+
+/*
+ * Prints the context switches of all threads to stderr every intervalS seconds, and at exit.
+ */
+void ioReactorEnableStats(uint32_t intervalS)
+{
+    reactor.statsIntervalS = intervalS;
+    atexit(printStatsAtExit);
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * All host I/O of SITL is done by a single reactor thread: the TCP serial ports and the serial proxy. It waits on the
+ * descriptors with epoll, poll() where there is no epoll, and calls their handlers, which hand the data to the
+ * firmware through lock-free rings. Outside of lockstep mode the main loop sleeps until the next task is due, and
+ * the reactor wakes it when new data has arrived.
+ *
+ * The simulator interfaces keep their own threads, each of them waits for the simulator in step with the firmware.
+ */
+
+#define IO_REACTOR_MAX_FDS          32
+#define IO_REACTOR_RETRY_MS         1       // Paused descriptors are watched again after this
+#define IO_REACTOR_MAX_IDLE_US      1000    // Longest sleep of the main loop, for tasks which have to be polled
+#define IO_REACTOR_WAKE_MARGIN_US   100     // The main loop wakes this much before the next task is due
+#define IO_REACTOR_STATS_DEFAULT_S  10
+
+/*
+ * Called on the reactor thread when fd can be read. Returns false when the data can't be taken now, the descriptor is
+ * paused then and watched again after IO_REACTOR_RETRY_MS. Descriptors must be non-blocking.
+ */
+typedef bool (*ioReactorHandler_fn)(int fd, void *arg);
+
+// The reactor thread starts with the first descriptor. Thread safe.
+bool ioReactorAdd(int fd, ioReactorHandler_fn handler, void *arg);
+// Before the descriptor is closed
+void ioReactorRemove(int fd);
+
+void ioReactorIdle(void);
+
+void ioReactorEnableStats(uint32_t intervalS);
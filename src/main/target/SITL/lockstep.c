@@ -0,0 +1,170 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "platform.h"
+
+#if defined(SITL_BUILD)
+
+#include "common/time.h"
+
+#include "scheduler/scheduler.h"
+
+#include "target/SITL/lockstep.h"
+
+static struct {
+    bool enabled;
+    bool simulatorDriven;
+    uint32_t frameUs;
+
+    // Written by the main thread only, the simulator threads read it too
+    _Atomic uint64_t nowUs;
+    bool idlePassDone;          // The scheduler had a pass with nothing due since the clock last moved
+
+    // The main thread may run up to here, the simulator moves it on by a frame at a time
+    uint64_t limitUs;
+    bool waiting;               // The main thread is at the limit and waits for the next frame
+    pthread_mutex_t lock;
+    pthread_cond_t granted;
+    pthread_cond_t idle;
+} lockstep = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .granted = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Can be called again, e.g. when the simulator could not be started. The clock keeps its value.
+ */
+void lockstepInit(uint32_t frameUs, bool simulatorDriven)
+{
+    pthread_mutex_lock(&lockstep.lock);
+    lockstep.frameUs = frameUs;
+    lockstep.simulatorDriven = simulatorDriven;
+    lockstep.limitUs = atomic_load(&lockstep.nowUs);
+    lockstep.waiting = false;
+    lockstep.enabled = true;
+    pthread_cond_broadcast(&lockstep.granted);
+    pthread_mutex_unlock(&lockstep.lock);
+}
+
+bool lockstepIsEnabled(void)
+{
+    return lockstep.enabled;
+}
+
+uint64_t lockstepMicros(void)
+{
+    return atomic_load(&lockstep.nowUs);
+}
+
+/*
+ * Moves the clock on. With a simulator this waits for it whenever the step goes past the frames received so far.
+ */
+void lockstepAdvance(uint32_t us)
+{
+    const uint64_t target = atomic_load(&lockstep.nowUs) + us;
+
+    if (!lockstep.simulatorDriven) {
+        atomic_store(&lockstep.nowUs, target);
+        return;
+    }
+
+    pthread_mutex_lock(&lockstep.lock);
+
+    while (target > lockstep.limitUs && lockstep.simulatorDriven) {
+        atomic_store(&lockstep.nowUs, lockstep.limitUs);
+        lockstep.waiting = true;
+        pthread_cond_broadcast(&lockstep.idle);
+        pthread_cond_wait(&lockstep.granted, &lockstep.lock);
+    }
+    atomic_store(&lockstep.nowUs, target);
+
+    pthread_mutex_unlock(&lockstep.lock);
+}
+
+/*
+ * Call from the main loop after each scheduler pass. Jumps ahead to the next task when none is due, after one more
+ * scheduler pass that finds nothing to do.
+ */
+void lockstepIdle(void)
+{
+    if (!lockstep.enabled) {
+        return;
+    }
+
+    const timeUs_t currentTimeUs = lockstepMicros();
+    const timeDelta_t waitUs = cmpTimeUs(schedulerGetNextDueTime(currentTimeUs, LOCKSTEP_MAX_STEP_US), currentTimeUs);
+
+    if (waitUs <= 0) {
+        lockstep.idlePassDone = false;
+        return;
+    }
+
+    // A flight controller has idle scheduler passes between its tasks. Keep one before each jump, it runs the realtime
+    // callbacks and keeps the system load from reading as overloaded
+    if (!lockstep.idlePassDone) {
+        lockstep.idlePassDone = true;
+        return;
+    }
+
+    lockstep.idlePassDone = false;
+    lockstepAdvance(waitUs);
+}
+
+/*
+ * Simulator threads call this before they touch the firmware's state, and lockstepGrant() when they are done.
+ * Returns once the main thread has used up the previous frame and waits for the next one.
+ */
+void lockstepWaitForStep(void)
+{
+    if (!lockstep.enabled || !lockstep.simulatorDriven) {
+        return;
+    }
+
+    pthread_mutex_lock(&lockstep.lock);
+    while (!lockstep.waiting) {
+        pthread_cond_wait(&lockstep.idle, &lockstep.lock);
+    }
+    pthread_mutex_unlock(&lockstep.lock);
+}
+
+void lockstepGrant(void)
+{
+    if (!lockstep.enabled || !lockstep.simulatorDriven) {
+        return;
+    }
+
+    pthread_mutex_lock(&lockstep.lock);
+    lockstep.limitUs += lockstep.frameUs;
+    lockstep.waiting = false;
+    pthread_cond_signal(&lockstep.granted);
+    pthread_mutex_unlock(&lockstep.lock);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Lockstep mode replaces the host clock with a virtual one. It only moves when the firmware waits: in delay(), and
+ * in the main loop when no task is due, where it jumps ahead to the next task. Tasks take no time at all, so a run
+ * only depends on its inputs and goes as fast as the host allows.
+ *
+ * Without a simulator the clock runs freely. With one, every frame received from the simulator allows the firmware
+ * to run for a fixed step, and the simulator thread waits until the firmware has used up the previous step before
+ * it applies the next frame.
+ */
+
+#define LOCKSTEP_DEFAULT_FRAME_US   10000   // Virtual time per simulator frame
+#define LOCKSTEP_MAX_STEP_US        1000    // Longest jump of the clock in one go
+#define LOCKSTEP_RTC_EPOCH          1704067200  // 2024-01-01, start of the RTC in lockstep mode
+
+void lockstepInit(uint32_t frameUs, bool simulatorDriven);
+bool lockstepIsEnabled(void);
+
+uint64_t lockstepMicros(void);
+void lockstepAdvance(uint32_t us);
+void lockstepIdle(void);
+
+void lockstepWaitForStep(void);
+void lockstepGrant(void);
@@ -69,6 +69,7 @@
 #endif
 
 #include "drivers/serial_tcp.h"
+#include "target/SITL/io_reactor.h"
 
 #define SYM_BEGIN       '$'
 #define SYM_PROTO_V1    'M'
@@ -401,9 +402,39 @@ void serialProxyInit(void)
     }
 }
 
+#if !defined(__CYGWIN__)
+// Feeds the UART from the reactor thread. The FC proxy's replies are decoded in the main loop instead.
+static bool serialProxyReceive(int serialFd, void *arg)
+{
+    UNUSED(arg);
+
+    unsigned char buf[SERIAL_BUFFER_SIZE];
+    uint32_t avail = tcpRXBytesFree(serialUartIndex - 1);
+    if ( avail == 0 ) return false;
+    if (avail > SERIAL_BUFFER_SIZE) avail = SERIAL_BUFFER_SIZE;
+
+    ssize_t count = read(serialFd, buf, avail);
+    if (count > 0) {
+        tcpReceiveBytesEx( serialUartIndex - 1, buf, count);
+    } else if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+        // Readable without data, the device is gone
+        fprintf(stderr, "[SERIALPROXY] ERROR: Serial port closed\n");
+        ioReactorRemove(serialFd);
+    }
+    return true;
+}
+#endif
+
 void serialProxyStart(void)
 {
     started = true;
+
+#if !defined(__CYGWIN__)
+    if ( connected && !serialFCProxy && serialUartIndex != -1 ) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        ioReactorAdd(fd, serialProxyReceive, NULL);
+    }
+#endif
 }
 
 void serialProxyClose(void)
@@ -767,7 +798,8 @@ void serialProxyProcess(void)
         decodeProxyMessages(buf, count);
 
     } else {
-
+#if defined(__CYGWIN__)
+        // The reactor can't wait for a Windows handle
         if ( serialUartIndex == -1 )  return;
         unsigned char buf[SERIAL_BUFFER_SIZE];
         uint32_t avail = tcpRXBytesFree(serialUartIndex - 1);
@@ -778,6 +810,7 @@ void serialProxyProcess(void)
         if (count == 0) return;
 
         tcpReceiveBytesEx( serialUartIndex - 1, buf, count);
+#endif
     }
 
 }
@@ -0,0 +1,286 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "platform.h"
+
+#include "target.h"
+#include "target/SITL/sim/builtin.h"
+#include "target/SITL/sim/physics.h"
+#include "target/SITL/sim/scenario.h"
+#include "target/SITL/sim/simHelper.h"
+#include "fc/runtime_config.h"
+#include "drivers/time.h"
+#include "drivers/accgyro/accgyro_fake.h"
+#include "drivers/barometer/barometer_fake.h"
+#include "sensors/barometer.h"
+#include "sensors/battery_sensor_fake.h"
+#include "drivers/pitotmeter/pitotmeter_fake.h"
+#include "drivers/compass/compass_fake.h"
+#include "drivers/rangefinder/rangefinder_virtual.h"
+#include "io/rangefinder.h"
+#include "common/utils.h"
+#include "common/maths.h"
+#include "flight/mixer.h"
+#include "flight/servos.h"
+#include "flight/imu.h"
+#include "io/gps.h"
+#include "rx/msp.h"
+#include "scheduler/scheduler.h"
+#include "target/SITL/lockstep.h"
+
+#define GPS_PERIOD_US       100000  // 10Hz, like most GPS modules
+#define RC_PERIOD_US        20000   // 50Hz
+#define MAX_RANGEFINDER_TILT    DEGREES_TO_RADIANS(60)
+
+static simAirframe_t airframe;
+static simState_t state;
+static pthread_t simThread;
+static uint32_t frameUs;
+static bool useImu = false;
+static simScenario_t scenario;
+static const char *scenarioName = NULL;
+
+static void readOutputs(simInput_t *input)
+{
+    for (int i = 0; i < SIM_MAX_MOTORS; i++) {
+        input->throttle[i] = PWM_TO_FLOAT_0_1(motor[i]);
+    }
+    for (int i = 0; i < SIM_MAX_SERVOS; i++) {
+        input->servo[i] = PWM_TO_FLOAT_MINUS_1_1(servo[i]);
+    }
+}
+
+static void updateGps(void)
+{
+    // Literals are single precision in this build, the coordinates need double
+    const double metersToDegrees = (double)RADIANS_TO_DEGREES(1.0f) / ((double)EARTH_RADIUS * (double)1000);
+    const double lat = airframe.homeLat + state.position[0] * metersToDegrees;
+    const double lon = airframe.homeLon + state.position[1] * metersToDegrees / cos(airframe.homeLat * (double)RAD);
+    const float groundSpeed = sqrtf(sq(state.velocity.x) + sq(state.velocity.y));
+    float course = RADIANS_TO_DEGREES(atan2f(state.velocity.y, state.velocity.x));
+
+    if (course < 0) {
+        course += 360.0f;
+    }
+
+    // A receiver which lost its fix keeps sending
+    gpsFakeSet(
+        scenario.gpsFailed ? GPS_NO_FIX : GPS_FIX_3D,
+        scenario.gpsFailed ? 0 : 16,
+        (int32_t)round(lat * 10000000),
+        (int32_t)round(lon * 10000000),
+        (int32_t)roundf((airframe.homeAlt - (float)state.position[2]) * 100),
+        (int16_t)roundf(groundSpeed * 100),
+        (int16_t)roundf(course * 10),
+        constrainToInt16(state.velocity.x * 100),
+        constrainToInt16(state.velocity.y * 100),
+        constrainToInt16(state.velocity.z * 100),
+        0
+    );
+}
+
+static void updateSensors(void)
+{
+    float roll, pitch, yaw;
+    simPhysicsGetEuler(&state, &roll, &pitch, &yaw);
+
+    // INAV's body frame has y to the left and z up, and its pitch is positive nose down
+    const int16_t roll_inav = lrintf(RADIANS_TO_DEGREES(roll) * 10);
+    const int16_t pitch_inav = lrintf(-RADIANS_TO_DEGREES(pitch) * 10);
+    const int16_t yaw_inav = lrintf(RADIANS_TO_DEGREES(yaw) * 10) % 3600;
+
+    if (!useImu) {
+        imuSetAttitudeRPY(roll_inav, pitch_inav, yaw_inav);
+        imuUpdateAttitude(micros());
+    }
+
+    fakeAccSet(
+        constrainToInt16(state.specificForce.x * 1000.0f),
+        constrainToInt16(-state.specificForce.y * 1000.0f),
+        constrainToInt16(-state.specificForce.z * 1000.0f)
+    );
+
+    fakeGyroSet(
+        constrainToInt16(RADIANS_TO_DEGREES(state.rates.x) * 16.0f),
+        constrainToInt16(-RADIANS_TO_DEGREES(state.rates.y) * 16.0f),
+        constrainToInt16(-RADIANS_TO_DEGREES(state.rates.z) * 16.0f)
+    );
+
+    const float altitude = airframe.homeAlt - (float)state.position[2];
+    fakeBaroSet(lrintf(altitudeToPressure(altitude * 100)), DEGREES_TO_CENTIDEGREES(21));
+    fakePitotSetAirspeed(state.airspeed * 100.0f);
+
+    // Measured along the body z axis, flat ground
+    const float tilt = acosf(constrainf(cosf(roll) * cosf(pitch), -1.0f, 1.0f));
+    const int32_t distance = lrintf(-(float)state.position[2] / cosf(tilt) * 100);
+    if (tilt < MAX_RANGEFINDER_TILT && distance > 0 && distance <= RANGEFINDER_VIRTUAL_MAX_RANGE_CM) {
+        fakeRangefindersSetData(distance);
+    } else {
+        fakeRangefindersSetData(-1);
+    }
+
+    fakeBattSensorSetVbat(lrintf(state.voltage * 100));
+    fakeBattSensorSetAmperage(lrintf(state.current * 100));
+
+    fpQuaternion_t quat;
+    fpVector3_t north;
+    north.x = 1.0f;
+    north.y = 0.0f;
+    north.z = 0.0f;
+    computeQuaternionFromRPY(&quat, roll_inav, pitch_inav, yaw_inav);
+    transformVectorEarthToBody(&north, &quat);
+    fakeMagSet(
+        constrainToInt16(north.x * 1024.0f),
+        constrainToInt16(north.y * 1024.0f),
+        constrainToInt16(north.z * 1024.0f)
+    );
+}
+
+static void finishScenario(const struct timespec *startTime)
+{
+    struct rusage usage;
+    struct timespec now;
+
+    getrusage(RUSAGE_SELF, &usage);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    const float cpuTime = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6f;
+    const float wallTime = (now.tv_sec - startTime->tv_sec) + (now.tv_nsec - startTime->tv_nsec) * 1e-9f;
+
+    // Logs go to stderr, the report is all there is on stdout
+    simScenarioWriteReport(&scenario, stdout, scenarioName, cpuTime, wallTime);
+    fflush(stdout);
+    fprintf(stderr, "[SIM] Scenario finished after %.1fs\n", (double)scenario.metrics.duration);
+    exit(0);
+}
+
+static void* simWorker(void* arg)
+{
+    UNUSED(arg);
+
+    // In lockstep each frame covers frameUs of virtual time, otherwise the model keeps up with the host clock
+    const uint32_t stepCount = frameUs ? (frameUs + SIM_BUILTIN_STEP_US - 1) / SIM_BUILTIN_STEP_US : 1;
+    const float dt = (frameUs ? frameUs : SIM_BUILTIN_STEP_US) * 1e-6f / stepCount;
+    uint32_t gpsElapsedUs = GPS_PERIOD_US;
+    uint32_t rcElapsedUs = RC_PERIOD_US;
+    struct timespec deadline, startTime;
+    bool initalized = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    startTime = deadline;
+
+    while (true) {
+        if (lockstepIsEnabled()) {
+            lockstepWaitForStep();
+        } else {
+            deadline.tv_nsec += SIM_BUILTIN_STEP_US * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_nsec -= 1000000000;
+                deadline.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+
+        simInput_t input;
+        memset(&input, 0, sizeof(input));
+        readOutputs(&input);
+        if (scenarioName) {
+            simScenarioApplyInput(&scenario, &input);
+        }
+
+        for (uint32_t i = 0; i < stepCount; i++) {
+            simPhysicsStep(&state, &airframe, &input, dt);
+            if (scenarioName && !simScenarioStep(&scenario, &state, dt, ARMING_FLAG(ARMED), averageSystemLoadPercent)) {
+                finishScenario(&startTime);
+            }
+        }
+
+        const uint32_t elapsedUs = frameUs ? frameUs : SIM_BUILTIN_STEP_US;
+        gpsElapsedUs += elapsedUs;
+        if (gpsElapsedUs >= GPS_PERIOD_US) {
+            gpsElapsedUs -= GPS_PERIOD_US;
+            updateGps();
+        }
+
+        rcElapsedUs += elapsedUs;
+        if (scenarioName && rcElapsedUs >= RC_PERIOD_US) {
+            rcElapsedUs -= RC_PERIOD_US;
+            rxMspFrameReceive(scenario.rc, SIM_SCENARIO_RC_CHANNELS);
+        }
+
+        updateSensors();
+
+        if (!initalized) {
+            ENABLE_ARMING_FLAG(SIMULATOR_MODE_SITL);
+            ENABLE_STATE(ACCELEROMETER_CALIBRATED);
+            initalized = true;
+        }
+
+        unlockMainPID();
+        lockstepGrant();
+    }
+
+    return NULL;
+}
+
+bool simBuiltinInit(const char *airframePath, const char *scenarioPath, uint32_t lockstepFrameUs, bool imu)
+{
+    frameUs = lockstepFrameUs;
+    useImu = imu;
+
+    simPhysicsDefaultAirframe(&airframe);
+    if (airframePath && !simPhysicsLoadAirframe(&airframe, airframePath)) {
+        return false;
+    }
+    if (scenarioPath) {
+        if (!simScenarioLoad(&scenario, scenarioPath)) {
+            return false;
+        }
+        scenarioName = scenarioPath;
+    } else {
+        simScenarioInit(&scenario);
+    }
+    simPhysicsReset(&state, &airframe);
+
+    fprintf(stderr, "[SIM] Built-in %s with %d motors, %.2fkg\n",
+        airframe.type == SIM_AIRFRAME_AIRPLANE ? "airplane" : "multirotor", airframe.motorCount, (double)airframe.mass);
+
+    // pthread_create() returns the error number rather than setting errno
+    const int error = pthread_create(&simThread, NULL, simWorker, NULL);
+    if (error != 0) {
+        fprintf(stderr, "[SIM] Unable to start the simulation thread: %s\n", strerror(error));
+        return false;
+    }
+
+    return true;
+}
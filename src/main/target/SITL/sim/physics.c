@@ -0,0 +1,568 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "common/maths.h"
+#include "common/quaternion.h"
+#include "common/utils.h"
+#include "common/vector.h"
+
+#include "target/SITL/sim/physics.h"
+
+#define AIR_DENSITY_SEA_LEVEL       1.225f      // kg/m^3
+#define MIN_AERO_AIRSPEED           0.5f        // m/s, below this the coefficient model is meaningless
+#define STALL_BLEND                 50.0f       // How sharply lift goes over to that of a flat plate past the stall
+#define GROUND_MAX_PITCH            DEGREES_TO_RADIANS(15)  // Tail on the ground
+#define CELL_VOLTAGE_EMPTY          3.3f
+#define CELL_VOLTAGE_FULL           4.2f
+
+typedef enum {
+    PARAM_FLOAT,
+    PARAM_DOUBLE,
+    PARAM_VECTOR,
+    PARAM_UINT8,
+} paramType_e;
+
+typedef struct {
+    const char *name;
+    paramType_e type;
+    size_t offset;
+} airframeParam_t;
+
+static const airframeParam_t airframeParams[] = {
+    { "mass",               PARAM_FLOAT,    offsetof(simAirframe_t, mass) },
+    { "inertia",            PARAM_VECTOR,   offsetof(simAirframe_t, inertia) },
+    { "motor_thrust",       PARAM_FLOAT,    offsetof(simAirframe_t, motorThrust) },
+    { "motor_torque",       PARAM_FLOAT,    offsetof(simAirframe_t, motorTorque) },
+    { "motor_tau",          PARAM_FLOAT,    offsetof(simAirframe_t, motorTau) },
+    { "motor_current",      PARAM_FLOAT,    offsetof(simAirframe_t, motorCurrent) },
+    { "drag",               PARAM_VECTOR,   offsetof(simAirframe_t, drag) },
+    { "rate_damping",       PARAM_FLOAT,    offsetof(simAirframe_t, rateDamping) },
+    { "wing_area",          PARAM_FLOAT,    offsetof(simAirframe_t, wingArea) },
+    { "wing_span",          PARAM_FLOAT,    offsetof(simAirframe_t, wingSpan) },
+    { "chord",              PARAM_FLOAT,    offsetof(simAirframe_t, chord) },
+    { "cl0",                PARAM_FLOAT,    offsetof(simAirframe_t, cl0) },
+    { "cl_alpha",           PARAM_FLOAT,    offsetof(simAirframe_t, clAlpha) },
+    { "cl_max",             PARAM_FLOAT,    offsetof(simAirframe_t, clMax) },
+    { "cd0",                PARAM_FLOAT,    offsetof(simAirframe_t, cd0) },
+    { "cd_k",               PARAM_FLOAT,    offsetof(simAirframe_t, cdK) },
+    { "cy_beta",            PARAM_FLOAT,    offsetof(simAirframe_t, cyBeta) },
+    { "croll_beta",         PARAM_FLOAT,    offsetof(simAirframe_t, clBeta) },
+    { "croll_p",            PARAM_FLOAT,    offsetof(simAirframe_t, clP) },
+    { "croll_aileron",      PARAM_FLOAT,    offsetof(simAirframe_t, clAileron) },
+    { "cm0",                PARAM_FLOAT,    offsetof(simAirframe_t, cm0) },
+    { "cm_alpha",           PARAM_FLOAT,    offsetof(simAirframe_t, cmAlpha) },
+    { "cm_q",               PARAM_FLOAT,    offsetof(simAirframe_t, cmQ) },
+    { "cm_elevator",        PARAM_FLOAT,    offsetof(simAirframe_t, cmElevator) },
+    { "cn_beta",            PARAM_FLOAT,    offsetof(simAirframe_t, cnBeta) },
+    { "cn_r",               PARAM_FLOAT,    offsetof(simAirframe_t, cnR) },
+    { "cn_rudder",          PARAM_FLOAT,    offsetof(simAirframe_t, cnRudder) },
+    { "ground_friction",    PARAM_FLOAT,    offsetof(simAirframe_t, groundFriction) },
+    { "battery_cells",      PARAM_UINT8,    offsetof(simAirframe_t, batteryCells) },
+    { "battery_capacity",   PARAM_FLOAT,    offsetof(simAirframe_t, batteryCapacity) },
+    { "battery_resistance", PARAM_FLOAT,    offsetof(simAirframe_t, batteryResistance) },
+    { "home_lat",           PARAM_DOUBLE,   offsetof(simAirframe_t, homeLat) },
+    { "home_lon",           PARAM_DOUBLE,   offsetof(simAirframe_t, homeLon) },
+    { "home_alt",           PARAM_FLOAT,    offsetof(simAirframe_t, homeAlt) },
+    { "heading",            PARAM_FLOAT,    offsetof(simAirframe_t, heading) },
+};
+
+/*
+ * A 1kg quad X with 12N motors, laid out like motors 1 to 4 of the QUADX mixer. The aerodynamic coefficients are
+ * those of a 1.4m span trainer and only used once the type is set to airplane.
+ */
+void simPhysicsDefaultAirframe(simAirframe_t *airframe)
+{
+    static const simMotor_t quadX[] = {
+        { { .v = { -0.125f,  0.125f, 0.0f } },  1.0f },    // Rear right
+        { { .v = {  0.125f,  0.125f, 0.0f } }, -1.0f },    // Front right
+        { { .v = { -0.125f, -0.125f, 0.0f } }, -1.0f },    // Rear left
+        { { .v = {  0.125f, -0.125f, 0.0f } },  1.0f },    // Front left
+    };
+
+    memset(airframe, 0, sizeof(*airframe));
+
+    airframe->type = SIM_AIRFRAME_MULTIROTOR;
+    airframe->mass = 1.0f;
+    airframe->inertia = (fpVector3_t) { .v = { 0.01f, 0.01f, 0.018f } };
+
+    airframe->motorCount = ARRAYLEN(quadX);
+    memcpy(airframe->motors, quadX, sizeof(quadX));
+    airframe->motorThrust = 12.0f;
+    airframe->motorTorque = 0.016f;
+    airframe->motorTau = 0.03f;
+    airframe->motorCurrent = 15.0f;
+
+    airframe->drag = (fpVector3_t) { .v = { 0.05f, 0.05f, 0.1f } };
+    airframe->rateDamping = 0.002f;
+
+    airframe->wingArea = 0.3f;
+    airframe->wingSpan = 1.4f;
+    airframe->chord = 0.22f;
+    airframe->cl0 = 0.3f;
+    airframe->clAlpha = 5.0f;
+    airframe->clMax = 1.2f;
+    airframe->cd0 = 0.03f;
+    airframe->cdK = 0.06f;
+    airframe->cyBeta = -0.3f;
+    airframe->clBeta = -0.05f;
+    airframe->clP = -0.45f;
+    airframe->clAileron = 0.15f;
+    airframe->cm0 = 0.02f;
+    airframe->cmAlpha = -0.6f;
+    airframe->cmQ = -10.0f;
+    airframe->cmElevator = 0.3f;
+    airframe->cnBeta = 0.08f;
+    airframe->cnR = -0.1f;
+    airframe->cnRudder = 0.06f;
+    airframe->groundFriction = 0.05f;
+
+    airframe->batteryCells = 4;
+    airframe->batteryCapacity = 3000.0f;
+    airframe->batteryResistance = 0.02f;
+
+    airframe->homeLat = 47.2598;
+    airframe->homeLon = 11.3440;
+    airframe->homeAlt = 580.0f;
+    airframe->heading = 0.0f;
+}
+
+static bool parseFloats(const char *str, float *values, int count)
+{
+    char *end;
+
+    for (int i = 0; i < count; i++) {
+        values[i] = strtof(str, &end);
+        if (end == str) {
+            return false;
+        }
+        str = end;
+    }
+
+    while (*str == ' ' || *str == '\t') {
+        str++;
+    }
+    return *str == '\0';
+}
+
+static bool parseMotor(simAirframe_t *airframe, const char *args)
+{
+    int index;
+    float x, y;
+    char direction[4];
+
+    if (sscanf(args, "%d %f %f %3s", &index, &x, &y, direction) != 4 || index < 0 || index >= SIM_MAX_MOTORS) {
+        return false;
+    }
+
+    simMotor_t *motor = &airframe->motors[index];
+    if (strcasecmp(direction, "cw") == 0) {
+        motor->spin = 1.0f;
+    } else if (strcasecmp(direction, "ccw") == 0) {
+        motor->spin = -1.0f;
+    } else {
+        return false;
+    }
+
+    motor->position.x = x;
+    motor->position.y = y;
+    motor->position.z = 0.0f;
+    airframe->motorCount = MAX(airframe->motorCount, index + 1);
+    return true;
+}
+
+static bool parseServo(simAirframe_t *airframe, const char *args)
+{
+    char *end;
+    const long index = strtol(args, &end, 10);
+    float gains[3];
+
+    if (end == args || index < 0 || index >= SIM_MAX_SERVOS || !parseFloats(end, gains, 3)) {
+        return false;
+    }
+
+    airframe->servos[index].aileron = gains[0];
+    airframe->servos[index].elevator = gains[1];
+    airframe->servos[index].rudder = gains[2];
+    return true;
+}
+
+/*
+ * One "key value" line of an airframe file. Empty lines and comments starting with # are fine.
+ */
+bool simPhysicsParseLine(simAirframe_t *airframe, const char *line)
+{
+    char buf[128];
+
+    strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *comment = strchr(buf, '#');
+    if (comment) {
+        *comment = '\0';
+    }
+    buf[strcspn(buf, "\r\n")] = '\0';
+    for (int i = strlen(buf) - 1; i >= 0 && (buf[i] == ' ' || buf[i] == '\t'); i--) {
+        buf[i] = '\0';
+    }
+
+    char *key = buf + strspn(buf, " \t");
+    if (*key == '\0') {
+        return true;
+    }
+
+    char *args = key + strcspn(key, " \t");
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+    args += strspn(args, " \t");
+
+    if (strcmp(key, "type") == 0) {
+        if (strcmp(args, "multirotor") == 0) {
+            airframe->type = SIM_AIRFRAME_MULTIROTOR;
+        } else if (strcmp(args, "airplane") == 0) {
+            airframe->type = SIM_AIRFRAME_AIRPLANE;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(key, "motor") == 0) {
+        return parseMotor(airframe, args);
+    }
+    if (strcmp(key, "servo") == 0) {
+        return parseServo(airframe, args);
+    }
+
+    for (unsigned i = 0; i < ARRAYLEN(airframeParams); i++) {
+        const airframeParam_t *param = &airframeParams[i];
+        if (strcmp(key, param->name) != 0) {
+            continue;
+        }
+
+        void *ptr = (uint8_t *)airframe + param->offset;
+        float values[3];
+        char *end;
+
+        switch (param->type) {
+        case PARAM_FLOAT:
+            if (!parseFloats(args, values, 1)) {
+                return false;
+            }
+            *(float *)ptr = values[0];
+            return true;
+        case PARAM_VECTOR:
+            if (!parseFloats(args, values, 3)) {
+                return false;
+            }
+            memcpy(ptr, values, sizeof(values));
+            return true;
+        case PARAM_DOUBLE: {
+            const double value = strtod(args, &end);
+            if (end == args || *end != '\0') {
+                return false;
+            }
+            *(double *)ptr = value;
+            return true;
+        }
+        case PARAM_UINT8:
+            if (!parseFloats(args, values, 1) || values[0] < 0 || values[0] > 255) {
+                return false;
+            }
+            *(uint8_t *)ptr = values[0];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Settings missing from the file keep their defaults, except for the motors and servos, which the file describes
+ * completely.
+ */
+bool simPhysicsLoadAirframe(simAirframe_t *airframe, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "[SIM] Unable to open airframe file %s\n", path);
+        return false;
+    }
+
+    airframe->motorCount = 0;
+    memset(airframe->motors, 0, sizeof(airframe->motors));
+    memset(airframe->servos, 0, sizeof(airframe->servos));
+
+    char line[128];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        if (!simPhysicsParseLine(airframe, line)) {
+            fprintf(stderr, "[SIM] %s:%d: invalid line: %s", path, lineNumber, line);
+            ok = false;
+        }
+    }
+
+    fclose(file);
+
+    if (ok && airframe->mass <= 0.0f) {
+        fprintf(stderr, "[SIM] %s: mass must be positive\n", path);
+        ok = false;
+    }
+    return ok;
+}
+
+static void quaternionFromEuler(fpQuaternion_t *q, float roll, float pitch, float yaw)
+{
+    const float cr = cosf(roll / 2), sr = sinf(roll / 2);
+    const float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+    const float cy = cosf(yaw / 2), sy = sinf(yaw / 2);
+
+    q->q0 = cr * cp * cy + sr * sp * sy;
+    q->q1 = sr * cp * cy - cr * sp * sy;
+    q->q2 = cr * sp * cy + sr * cp * sy;
+    q->q3 = cr * cp * sy - sr * sp * cy;
+}
+
+void simPhysicsGetEuler(const simState_t *state, float *roll, float *pitch, float *yaw)
+{
+    const fpQuaternion_t *q = &state->attitude;
+
+    *roll = atan2f(2 * (q->q0 * q->q1 + q->q2 * q->q3), 1 - 2 * (sq(q->q1) + sq(q->q2)));
+    *pitch = asinf(constrainf(2 * (q->q0 * q->q2 - q->q3 * q->q1), -1.0f, 1.0f));
+    *yaw = atan2f(2 * (q->q0 * q->q3 + q->q1 * q->q2), 1 - 2 * (sq(q->q2) + sq(q->q3)));
+    if (*yaw < 0) {
+        *yaw += 2 * M_PIf;
+    }
+}
+
+void simPhysicsReset(simState_t *state, const simAirframe_t *airframe)
+{
+    memset(state, 0, sizeof(*state));
+
+    quaternionFromEuler(&state->attitude, 0, 0, DEGREES_TO_RADIANS(airframe->heading));
+    state->specificForce.z = -SIM_GRAVITY;
+    state->voltage = airframe->batteryCells * CELL_VOLTAGE_FULL;
+    state->onGround = true;
+}
+
+// ISA troposphere
+static float airDensity(float altitude)
+{
+    return AIR_DENSITY_SEA_LEVEL * powf(1.0f - 2.25577e-5f * altitude, 4.2559f);
+}
+
+/*
+ * Beard & McLain, Small Unmanned Aircraft, 4.2: the lift of the linear model blended into that of a flat plate past
+ * the stall angle.
+ */
+static float liftCoefficient(const simAirframe_t *airframe, float alpha)
+{
+    const float stallAlpha = (airframe->clMax - airframe->cl0) / airframe->clAlpha;
+    const float a = expf(-STALL_BLEND * (alpha - stallAlpha));
+    const float b = expf(STALL_BLEND * (alpha + stallAlpha));
+    const float sigma = (1 + a + b) / ((1 + a) * (1 + b));
+    const float plate = 2 * copysignf(sq(sinf(alpha)), alpha) * cosf(alpha);
+
+    return (1 - sigma) * (airframe->cl0 + airframe->clAlpha * alpha) + sigma * plate;
+}
+
+static void airplaneAero(const simAirframe_t *airframe, const simState_t *state, const simInput_t *input, const fpVector3_t *air, float altitude, fpVector3_t *force, fpVector3_t *torque)
+{
+    const float airspeed = state->airspeed;
+    if (airspeed < MIN_AERO_AIRSPEED) {
+        return;
+    }
+
+    float aileron = 0, elevator = 0, rudder = 0;
+    for (int i = 0; i < SIM_MAX_SERVOS; i++) {
+        const float deflection = constrainf(input->servo[i], -1.0f, 1.0f);
+        aileron += airframe->servos[i].aileron * deflection;
+        elevator += airframe->servos[i].elevator * deflection;
+        rudder += airframe->servos[i].rudder * deflection;
+    }
+
+    const float alpha = atan2f(air->z, air->x);
+    const float beta = asinf(constrainf(air->y / airspeed, -1.0f, 1.0f));
+    const float dynamicPressure = 0.5f * airDensity(altitude) * sq(airspeed) * airframe->wingArea;
+    const float halfSpanOverV = airframe->wingSpan / (2 * airspeed);
+    const float halfChordOverV = airframe->chord / (2 * airspeed);
+
+    const float cl = liftCoefficient(airframe, alpha);
+    const float cd = airframe->cd0 + airframe->cdK * sq(cl);
+    const float lift = dynamicPressure * cl;
+    const float drag = dynamicPressure * cd;
+
+    // Lift and drag are perpendicular and parallel to the airflow in the plane of symmetry
+    force->x += -drag * cosf(alpha) + lift * sinf(alpha);
+    force->y += dynamicPressure * airframe->cyBeta * beta;
+    force->z += -drag * sinf(alpha) - lift * cosf(alpha);
+
+    torque->x += dynamicPressure * airframe->wingSpan * (airframe->clBeta * beta + airframe->clP * state->rates.x * halfSpanOverV + airframe->clAileron * aileron);
+    torque->y += dynamicPressure * airframe->chord * (airframe->cm0 + airframe->cmAlpha * alpha + airframe->cmQ * state->rates.y * halfChordOverV + airframe->cmElevator * elevator);
+    torque->z += dynamicPressure * airframe->wingSpan * (airframe->cnBeta * beta + airframe->cnR * state->rates.z * halfSpanOverV + airframe->cnRudder * rudder);
+}
+
+static void multirotorAero(const simAirframe_t *airframe, const simState_t *state, const fpVector3_t *air, fpVector3_t *force, fpVector3_t *torque)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        force->v[axis] -= airframe->drag.v[axis] * air->v[axis] * fabsf(air->v[axis]);
+        torque->v[axis] -= airframe->rateDamping * state->rates.v[axis];
+    }
+}
+
+/*
+ * Holds the aircraft on the ground while it doesn't climb. A multirotor stands still on its legs, an airplane rolls
+ * along its heading and may only raise its nose.
+ */
+static void groundContact(simState_t *state, const simAirframe_t *airframe, float dt)
+{
+    float roll, pitch, yaw;
+    simPhysicsGetEuler(state, &roll, &pitch, &yaw);
+
+    state->position[2] = 0;
+    state->velocity.z = 0;
+    state->rates.x = 0;
+
+    if (airframe->type == SIM_AIRFRAME_MULTIROTOR) {
+        state->velocity.x = 0;
+        state->velocity.y = 0;
+        state->rates.y = 0;
+        state->rates.z = 0;
+        quaternionFromEuler(&state->attitude, 0, 0, yaw);
+        return;
+    }
+
+    // Wheels don't slide sideways and slow down by rolling friction
+    float speed = state->velocity.x * cosf(yaw) + state->velocity.y * sinf(yaw);
+    const float friction = airframe->groundFriction * SIM_GRAVITY * dt;
+    speed = fabsf(speed) > friction ? speed - copysignf(friction, speed) : 0;
+    state->velocity.x = speed * cosf(yaw);
+    state->velocity.y = speed * sinf(yaw);
+
+    if (pitch <= 0 && state->rates.y < 0) {
+        state->rates.y = 0;
+    } else if (pitch >= GROUND_MAX_PITCH && state->rates.y > 0) {
+        state->rates.y = 0;
+    }
+    quaternionFromEuler(&state->attitude, 0, constrainf(pitch, 0, GROUND_MAX_PITCH), yaw);
+}
+
+void simPhysicsStep(simState_t *state, const simAirframe_t *airframe, const simInput_t *input, float dt)
+{
+    fpVector3_t force = { .v = { 0, 0, 0 } };
+    fpVector3_t torque = { .v = { 0, 0, 0 } };
+    const bool airplane = airframe->type == SIM_AIRFRAME_AIRPLANE;
+    // Thrust and spin axis of the propellers
+    const fpVector3_t axis = airplane ? (fpVector3_t) { .v = { 1, 0, 0 } } : (fpVector3_t) { .v = { 0, 0, -1 } };
+    const float lag = dt / (airframe->motorTau + dt);
+
+    state->current = 0;
+    for (int i = 0; i < airframe->motorCount; i++) {
+        const simMotor_t *motor = &airframe->motors[i];
+
+        state->motorState[i] += (constrainf(input->throttle[i], 0.0f, 1.0f) - state->motorState[i]) * lag;
+        state->current += airframe->motorCurrent * state->motorState[i] * sq(state->motorState[i]);
+
+        const float thrust = airframe->motorThrust * sq(state->motorState[i]);
+        fpVector3_t motorForce, motorTorque;
+
+        vectorScale(&motorForce, &axis, thrust);
+        vectorAdd(&force, &force, &motorForce);
+        vectorCrossProduct(&motorTorque, &motor->position, &motorForce);
+        vectorAdd(&torque, &torque, &motorTorque);
+
+        // Seen from above a multirotor looks against the thrust axis, from behind an airplane looks along it
+        vectorScale(&motorTorque, &axis, (airplane ? -1 : 1) * motor->spin * airframe->motorTorque * thrust);
+        vectorAdd(&torque, &torque, &motorTorque);
+    }
+
+    const float altitude = airframe->homeAlt - (float)state->position[2];
+    fpVector3_t air, relativeWind;
+    relativeWind.x = state->velocity.x - input->wind.x;
+    relativeWind.y = state->velocity.y - input->wind.y;
+    relativeWind.z = state->velocity.z - input->wind.z;
+    quaternionRotateVector(&air, &relativeWind, &state->attitude);
+    state->airspeed = sqrtf(vectorNormSquared(&air));
+
+    if (airplane) {
+        airplaneAero(airframe, state, input, &air, altitude, &force, &torque);
+    } else {
+        multirotorAero(airframe, state, &air, &force, &torque);
+    }
+
+    // Translation, semi-implicit Euler
+    const fpVector3_t previousVelocity = state->velocity;
+    fpVector3_t acceleration;
+    quaternionRotateVectorInv(&acceleration, &force, &state->attitude);
+    vectorScale(&acceleration, &acceleration, 1.0f / airframe->mass);
+    acceleration.z += SIM_GRAVITY;
+
+    vectorScale(&acceleration, &acceleration, dt);
+    vectorAdd(&state->velocity, &state->velocity, &acceleration);
+    for (int axis = 0; axis < 3; axis++) {
+        state->position[axis] += (double)(state->velocity.v[axis] * dt);
+    }
+
+    // Rotation, Euler's equations for the principal axes
+    const fpVector3_t *inertia = &airframe->inertia;
+    fpVector3_t *rates = &state->rates;
+    rates->x += (torque.x - (inertia->z - inertia->y) * rates->y * rates->z) / inertia->x * dt;
+    rates->y += (torque.y - (inertia->x - inertia->z) * rates->z * rates->x) / inertia->y * dt;
+    rates->z += (torque.z - (inertia->y - inertia->x) * rates->x * rates->y) / inertia->z * dt;
+
+    const float angle = sqrtf(vectorNormSquared(rates)) * dt;
+    if (angle > 0) {
+        const float s = sinf(angle / 2) / (angle / dt);
+        const fpQuaternion_t delta = { .q0 = cosf(angle / 2), .q1 = rates->x * s, .q2 = rates->y * s, .q3 = rates->z * s };
+        quaternionMultiply(&state->attitude, &state->attitude, &delta);
+        quaternionNormalize(&state->attitude, &state->attitude);
+    }
+
+    state->onGround = state->position[2] >= 0 && state->velocity.z >= 0;
+    if (state->onGround) {
+        groundContact(state, airframe, dt);
+    }
+
+    // What the accelerometer feels is the change in velocity less gravity
+    fpVector3_t specificForce;
+    specificForce.x = (state->velocity.x - previousVelocity.x) / dt;
+    specificForce.y = (state->velocity.y - previousVelocity.y) / dt;
+    specificForce.z = (state->velocity.z - previousVelocity.z) / dt - SIM_GRAVITY;
+    quaternionRotateVector(&state->specificForce, &specificForce, &state->attitude);
+
+    state->consumedMah += state->current * dt / 3.6f;
+    const float charge = 1.0f - constrainf(state->consumedMah / airframe->batteryCapacity, 0.0f, 1.0f);
+    const float cellVoltage = CELL_VOLTAGE_EMPTY + (CELL_VOLTAGE_FULL - CELL_VOLTAGE_EMPTY) * charge;
+    state->voltage = MAX(airframe->batteryCells * cellVoltage - state->current * airframe->batteryResistance, 0.0f);
+}
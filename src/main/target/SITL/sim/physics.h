@@ -0,0 +1,128 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/quaternion.h"
+#include "common/vector.h"
+
+/*
+ * Rigid body model of a multirotor or an airplane for the built-in simulator. Positions and velocities are in the
+ * north-east-down frame relative to the home point, on flat ground at home altitude. The body frame is forward-right-down.
+ */
+
+#define SIM_MAX_MOTORS      8
+#define SIM_MAX_SERVOS      8
+
+#define SIM_GRAVITY         9.80665f
+
+typedef enum {
+    SIM_AIRFRAME_MULTIROTOR,
+    SIM_AIRFRAME_AIRPLANE,
+} simAirframeType_e;
+
+typedef struct simMotor_s {
+    fpVector3_t position;       // m, body frame
+    float spin;                 // 1 for clockwise seen from above (from behind on an airplane), -1 counter-clockwise
+} simMotor_t;
+
+// How much a servo output moves each control surface, per unit of travel
+typedef struct simServo_s {
+    float aileron;              // Positive rolls right
+    float elevator;             // Positive pitches up
+    float rudder;               // Positive yaws right
+} simServo_t;
+
+typedef struct simAirframe_s {
+    simAirframeType_e type;
+    float mass;                 // kg
+    fpVector3_t inertia;        // kg m^2, about the body axes
+
+    uint8_t motorCount;
+    simMotor_t motors[SIM_MAX_MOTORS];
+    float motorThrust;          // N per motor at full throttle
+    float motorTorque;          // Reaction torque per N of thrust, m
+    float motorTau;             // s, time constant of the motors
+    float motorCurrent;         // A per motor at full throttle
+
+    simServo_t servos[SIM_MAX_SERVOS];
+
+    fpVector3_t drag;           // N/(m/s)^2 along the body axes, multirotor only
+    float rateDamping;          // Nm/(rad/s), multirotor only
+
+    // Airplane only. Coefficients are per radian, control derivatives per unit of surface travel
+    float wingArea;             // m^2
+    float wingSpan;             // m
+    float chord;                // m
+    float cl0, clAlpha, clMax;
+    float cd0, cdK;             // CD = cd0 + cdK * CL^2
+    float cyBeta;
+    float clBeta, clP, clAileron;
+    float cm0, cmAlpha, cmQ, cmElevator;
+    float cnBeta, cnR, cnRudder;
+    float groundFriction;
+
+    uint8_t batteryCells;
+    float batteryCapacity;      // mAh
+    float batteryResistance;    // Ohm
+
+    double homeLat;             // deg
+    double homeLon;             // deg
+    float homeAlt;              // m above sea level
+    float heading;              // deg, at start
+} simAirframe_t;
+
+typedef struct simInput_s {
+    float throttle[SIM_MAX_MOTORS];     // 0..1
+    float servo[SIM_MAX_SERVOS];        // -1..1
+    fpVector3_t wind;                   // m/s, NED
+} simInput_t;
+
+typedef struct simState_s {
+    double position[3];         // m, NED
+    fpVector3_t velocity;       // m/s, NED
+    fpQuaternion_t attitude;    // Body to NED
+    fpVector3_t rates;          // rad/s, body
+    fpVector3_t specificForce;  // m/s^2, body, what an accelerometer measures
+
+    float motorState[SIM_MAX_MOTORS];
+    float airspeed;             // m/s
+    float current;              // A
+    float voltage;              // V
+    float consumedMah;
+    bool onGround;
+} simState_t;
+
+void simPhysicsDefaultAirframe(simAirframe_t *airframe);
+bool simPhysicsParseLine(simAirframe_t *airframe, const char *line);
+bool simPhysicsLoadAirframe(simAirframe_t *airframe, const char *path);
+
+void simPhysicsReset(simState_t *state, const simAirframe_t *airframe);
+void simPhysicsStep(simState_t *state, const simAirframe_t *airframe, const simInput_t *input, float dt);
+
+// Euler angles in radians: roll right, pitch up and heading in 0..2*pi
+void simPhysicsGetEuler(const simState_t *state, float *roll, float *pitch, float *yaw);
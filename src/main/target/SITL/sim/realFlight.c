@@ -55,6 +55,7 @@
 #include "flight/imu.h"
 #include "io/gps.h"
 #include "rx/sim.h"
+#include "target/SITL/lockstep.h"
 
 #define RF_PORT 18083
 #define RF_MAX_CHANNEL_COUNT 12
@@ -426,8 +427,10 @@ static void* soapWorker(void* arg)
             isInitalised = true;  
         }
 
+        lockstepWaitForStep();
         exchangeData();
         unlockMainPID();
+        lockstepGrant();
     }
 
     return NULL;
@@ -0,0 +1,432 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "target/SITL/sim/scenario.h"
+
+#define RC_MIN_US               750
+#define RC_MAX_US               2250
+#define DEFAULT_SETTLE_RADIUS   1.0f    // m
+
+void simScenarioInit(simScenario_t *scenario)
+{
+    memset(scenario, 0, sizeof(*scenario));
+
+    // AETR: sticks centered, throttle low and all switches off
+    for (int i = 0; i < SIM_SCENARIO_RC_CHANNELS; i++) {
+        scenario->rc[i] = (i < 4 && i != 2) ? 1500 : 1000;
+    }
+    for (int i = 0; i < SIM_MAX_MOTORS; i++) {
+        scenario->motorFactor[i] = 1.0f;
+    }
+    scenario->settleRadius = DEFAULT_SETTLE_RADIUS;
+    scenario->wasOnGround = true;
+    scenario->metrics.minVoltage = INFINITY;
+}
+
+static bool parseFloats(const char *str, float *values, int count)
+{
+    char *end;
+
+    for (int i = 0; i < count; i++) {
+        values[i] = strtof(str, &end);
+        if (end == str) {
+            return false;
+        }
+        str = end;
+    }
+
+    while (*str == ' ' || *str == '\t') {
+        str++;
+    }
+    return *str == '\0';
+}
+
+static simEvent_t *addEvent(simScenario_t *scenario, uint32_t timeMs, simEventType_e type)
+{
+    if (scenario->eventCount >= SIM_SCENARIO_MAX_EVENTS) {
+        return NULL;
+    }
+
+    simEvent_t *event = &scenario->events[scenario->eventCount++];
+    memset(event, 0, sizeof(*event));
+    event->timeMs = timeMs;
+    event->type = type;
+    return event;
+}
+
+// "<channel>=<us> ...", channels counted from 1. Adds nothing unless the whole list is valid.
+static bool parseRc(simScenario_t *scenario, uint32_t timeMs, const char *args)
+{
+    const unsigned firstEvent = scenario->eventCount;
+    const char *str = args;
+
+    while (*str != '\0') {
+        char *end;
+        const long channel = strtol(str, &end, 10);
+        if (end == str || *end != '=' || channel < 1 || channel > SIM_SCENARIO_RC_CHANNELS) {
+            break;
+        }
+
+        str = end + 1;
+        const long value = strtol(str, &end, 10);
+        if (end == str || (*end != '\0' && *end != ' ' && *end != '\t') || value < RC_MIN_US || value > RC_MAX_US) {
+            break;
+        }
+
+        simEvent_t *event = addEvent(scenario, timeMs, SIM_EVENT_RC);
+        if (!event) {
+            break;
+        }
+        event->rc.channel = channel - 1;
+        event->rc.value = value;
+
+        str = end + strspn(end, " \t");
+        if (*str == '\0') {
+            return true;
+        }
+    }
+
+    scenario->eventCount = firstEvent;
+    return false;
+}
+
+static bool parseCommand(simScenario_t *scenario, uint32_t timeMs, const char *command, const char *args)
+{
+    float values[3];
+    simEvent_t *event;
+
+    if (strcmp(command, "rc") == 0) {
+        return parseRc(scenario, timeMs, args);
+    }
+
+    if (strcmp(command, "wind") == 0) {
+        if (!parseFloats(args, values, 3) || !(event = addEvent(scenario, timeMs, SIM_EVENT_WIND))) {
+            return false;
+        }
+        event->wind.x = values[0];
+        event->wind.y = values[1];
+        event->wind.z = values[2];
+        return true;
+    }
+
+    if (strcmp(command, "motor") == 0) {
+        char *end;
+        const long index = strtol(args, &end, 10);
+        if (end == args || index < 0 || index >= SIM_MAX_MOTORS || !parseFloats(end, values, 1) || values[0] < 0) {
+            return false;
+        }
+        if (!(event = addEvent(scenario, timeMs, SIM_EVENT_MOTOR))) {
+            return false;
+        }
+        event->motor.index = index;
+        event->motor.factor = values[0];
+        return true;
+    }
+
+    if (strcmp(command, "gps") == 0) {
+        const bool failed = strcmp(args, "fail") == 0;
+        if ((!failed && strcmp(args, "ok") != 0) || !(event = addEvent(scenario, timeMs, SIM_EVENT_GPS))) {
+            return false;
+        }
+        event->gpsFailed = failed;
+        return true;
+    }
+
+    if (strcmp(command, "target") == 0) {
+        const bool off = strcmp(args, "off") == 0;
+        if ((!off && !parseFloats(args, values, 3)) || !(event = addEvent(scenario, timeMs, SIM_EVENT_TARGET))) {
+            return false;
+        }
+        event->target.enabled = !off;
+        if (!off) {
+            // North, east and altitude above home
+            event->target.position.x = values[0];
+            event->target.position.y = values[1];
+            event->target.position.z = -values[2];
+        }
+        return true;
+    }
+
+    if (strcmp(command, "settle") == 0) {
+        if (!parseFloats(args, values, 1) || values[0] <= 0 || !(event = addEvent(scenario, timeMs, SIM_EVENT_SETTLE))) {
+            return false;
+        }
+        event->settleRadius = values[0];
+        return true;
+    }
+
+    if (strcmp(command, "end") == 0) {
+        return *args == '\0' && addEvent(scenario, timeMs, SIM_EVENT_END);
+    }
+
+    return false;
+}
+
+/*
+ * One "<time> <command> <arguments>" line of a scenario file, time in seconds from the start. Times must not go
+ * backwards. Empty lines and comments starting with # are fine.
+ */
+bool simScenarioParseLine(simScenario_t *scenario, const char *line)
+{
+    char buf[256];
+
+    strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *comment = strchr(buf, '#');
+    if (comment) {
+        *comment = '\0';
+    }
+    buf[strcspn(buf, "\r\n")] = '\0';
+    for (int i = strlen(buf) - 1; i >= 0 && (buf[i] == ' ' || buf[i] == '\t'); i--) {
+        buf[i] = '\0';
+    }
+
+    char *str = buf + strspn(buf, " \t");
+    if (*str == '\0') {
+        return true;
+    }
+
+    char *end;
+    const float time = strtof(str, &end);
+    if (end == str || (*end != ' ' && *end != '\t') || !(time >= 0 && time < 4e6f)) {
+        return false;
+    }
+    const uint32_t timeMs = lrintf(time * 1000);
+    if (scenario->eventCount > 0 && timeMs < scenario->events[scenario->eventCount - 1].timeMs) {
+        return false;
+    }
+
+    char *command = end + strspn(end, " \t");
+    char *args = command + strcspn(command, " \t");
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+    args += strspn(args, " \t");
+
+    return parseCommand(scenario, timeMs, command, args);
+}
+
+bool simScenarioLoad(simScenario_t *scenario, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "[SIM] Unable to open scenario file %s\n", path);
+        return false;
+    }
+
+    simScenarioInit(scenario);
+
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        if (!simScenarioParseLine(scenario, line)) {
+            fprintf(stderr, "[SIM] %s:%d: invalid line: %s", path, lineNumber, line);
+            ok = false;
+        }
+    }
+
+    fclose(file);
+
+    if (ok && (scenario->eventCount == 0 || scenario->events[scenario->eventCount - 1].type != SIM_EVENT_END)) {
+        fprintf(stderr, "[SIM] %s: must finish with an end line\n", path);
+        ok = false;
+    }
+    return ok;
+}
+
+// Called whenever a target is left, for another one or at the end
+static void finishTarget(simScenario_t *scenario)
+{
+    simMetrics_t *metrics = &scenario->metrics;
+
+    if (!scenario->targetEnabled || metrics->lastTrackedAt == metrics->targetSetAt) {
+        return;
+    }
+
+    if (metrics->lastOutsideAt >= metrics->lastTrackedAt) {
+        metrics->settleFailed = true;
+    } else {
+        metrics->settleTime = MAX(metrics->settleTime, metrics->lastOutsideAt - metrics->targetSetAt);
+    }
+    metrics->anyTarget = true;
+}
+
+static void applyEvent(simScenario_t *scenario, const simEvent_t *event, float now)
+{
+    switch (event->type) {
+    case SIM_EVENT_RC:
+        scenario->rc[event->rc.channel] = event->rc.value;
+        break;
+    case SIM_EVENT_WIND:
+        scenario->wind = event->wind;
+        break;
+    case SIM_EVENT_MOTOR:
+        scenario->motorFactor[event->motor.index] = event->motor.factor;
+        break;
+    case SIM_EVENT_GPS:
+        scenario->gpsFailed = event->gpsFailed;
+        break;
+    case SIM_EVENT_TARGET:
+        finishTarget(scenario);
+        scenario->targetEnabled = event->target.enabled;
+        scenario->target = event->target.position;
+        scenario->metrics.targetSetAt = now;
+        scenario->metrics.lastOutsideAt = now;
+        scenario->metrics.lastTrackedAt = now;
+        break;
+    case SIM_EVENT_SETTLE:
+        scenario->settleRadius = event->settleRadius;
+        break;
+    case SIM_EVENT_END:
+        finishTarget(scenario);
+        scenario->ended = true;
+        break;
+    }
+}
+
+static void updateTracking(simScenario_t *scenario, const simState_t *state, float now)
+{
+    simMetrics_t *metrics = &scenario->metrics;
+
+    const float distance = sqrtf(
+        sq((float)state->position[0] - scenario->target.x) +
+        sq((float)state->position[1] - scenario->target.y) +
+        sq((float)state->position[2] - scenario->target.z)
+    );
+
+    metrics->trackingSamples++;
+    metrics->trackingSquareSum += (double)sq(distance);
+    metrics->trackingMax = MAX(metrics->trackingMax, distance);
+    metrics->lastTrackedAt = now;
+
+    if (distance > scenario->settleRadius) {
+        metrics->lastOutsideAt = now;
+    }
+}
+
+bool simScenarioStep(simScenario_t *scenario, const simState_t *state, float dt, bool armed, uint16_t cpuLoad)
+{
+    if (scenario->ended) {
+        return false;
+    }
+
+    scenario->timeUs += lrintf(dt * 1e6f);
+    const uint32_t nowMs = scenario->timeUs / 1000;
+    const float now = scenario->timeUs * 1e-6f;
+
+    while (scenario->nextEvent < scenario->eventCount && scenario->events[scenario->nextEvent].timeMs <= nowMs) {
+        applyEvent(scenario, &scenario->events[scenario->nextEvent++], now);
+    }
+
+    simMetrics_t *metrics = &scenario->metrics;
+    metrics->duration = now;
+    if (armed) {
+        metrics->armedTime += dt;
+    }
+    metrics->maxAltitude = MAX(metrics->maxAltitude, -(float)state->position[2]);
+    metrics->minVoltage = MIN(metrics->minVoltage, state->voltage);
+    metrics->consumedMah = state->consumedMah;
+    metrics->cpuLoadSum += cpuLoad;
+    metrics->cpuLoadSamples++;
+
+    if (state->onGround && !scenario->wasOnGround) {
+        metrics->maxImpactSpeed = MAX(metrics->maxImpactSpeed, scenario->lastVerticalSpeed);
+        if (scenario->lastVerticalSpeed > SIM_SCENARIO_CRASH_SPEED) {
+            metrics->crashed = true;
+        }
+    }
+    scenario->wasOnGround = state->onGround;
+    scenario->lastVerticalSpeed = state->velocity.z;
+
+    if (scenario->targetEnabled) {
+        updateTracking(scenario, state, now);
+    }
+
+    return !scenario->ended;
+}
+
+void simScenarioApplyInput(const simScenario_t *scenario, simInput_t *input)
+{
+    input->wind = scenario->wind;
+    for (int i = 0; i < SIM_MAX_MOTORS; i++) {
+        input->throttle[i] *= scenario->motorFactor[i];
+    }
+}
+
+static void writeOptional(FILE *file, const char *name, bool valid, float value)
+{
+    if (valid) {
+        fprintf(file, "\"%s\":%.3f,", name, (double)value);
+    } else {
+        fprintf(file, "\"%s\":null,", name);
+    }
+}
+
+/*
+ * One line of JSON. Values without a meaning for this flight are null, e.g. the tracking error without a target, or
+ * the settle time when the aircraft was off a target when it was left.
+ */
+void simScenarioWriteReport(const simScenario_t *scenario, FILE *file, const char *name, float hostCpuTime, float wallTime)
+{
+    const simMetrics_t *metrics = &scenario->metrics;
+
+    fprintf(file, "{\"scenario\":\"");
+    for (const char *c = name; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+    fprintf(file, "\",");
+
+    fprintf(file, "\"duration_s\":%.3f,", (double)metrics->duration);
+    fprintf(file, "\"armed_time_s\":%.3f,", (double)metrics->armedTime);
+    fprintf(file, "\"max_altitude_m\":%.3f,", (double)metrics->maxAltitude);
+    writeOptional(file, "tracking_rms_m", metrics->trackingSamples > 0,
+        metrics->trackingSamples ? (float)sqrt(metrics->trackingSquareSum / metrics->trackingSamples) : 0);
+    writeOptional(file, "tracking_max_m", metrics->trackingSamples > 0, metrics->trackingMax);
+    writeOptional(file, "settle_time_s", metrics->anyTarget && !metrics->settleFailed, metrics->settleTime);
+    fprintf(file, "\"battery_used_mah\":%.3f,", (double)metrics->consumedMah);
+    writeOptional(file, "min_voltage_v", metrics->duration > 0, metrics->minVoltage);
+    fprintf(file, "\"max_impact_speed_ms\":%.3f,", (double)metrics->maxImpactSpeed);
+    fprintf(file, "\"crashed\":%s,", metrics->crashed ? "true" : "false");
+    writeOptional(file, "cpu_load_pct", metrics->cpuLoadSamples > 0,
+        metrics->cpuLoadSamples ? (float)(metrics->cpuLoadSum / metrics->cpuLoadSamples) : 0);
+    fprintf(file, "\"host_cpu_s\":%.3f,", (double)hostCpuTime);
+    writeOptional(file, "realtime_factor", wallTime > 0, wallTime > 0 ? metrics->duration / wallTime : 0);
+    fprintf(file, "\"events\":%u}\n", scenario->nextEvent);
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of INAV Project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Alternatively, the contents of this file may be used under the terms
+ * of the GNU General Public License Version 3, as described below:
+ *
+ * This file is free software: you may copy, redistribute and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common/vector.h"
+
+#include "target/SITL/sim/physics.h"
+
+/*
+ * A scenario drives a flight of the built-in simulator: RC inputs, wind and failures at given times, and the
+ * position the aircraft should hold. It ends at a fixed time, with a summary of the flight.
+ */
+
+#define SIM_SCENARIO_MAX_EVENTS     256
+#define SIM_SCENARIO_RC_CHANNELS    16
+#define SIM_SCENARIO_CRASH_SPEED    3.0f    // m/s, hitting the ground faster than this is a crash
+
+typedef enum {
+    SIM_EVENT_RC,
+    SIM_EVENT_WIND,
+    SIM_EVENT_MOTOR,
+    SIM_EVENT_GPS,
+    SIM_EVENT_TARGET,
+    SIM_EVENT_SETTLE,
+    SIM_EVENT_END,
+} simEventType_e;
+
+typedef struct simEvent_s {
+    uint32_t timeMs;
+    simEventType_e type;
+    union {
+        struct {
+            uint8_t channel;
+            uint16_t value;
+        } rc;
+        fpVector3_t wind;           // m/s, NED
+        struct {
+            uint8_t index;
+            float factor;
+        } motor;
+        bool gpsFailed;
+        struct {
+            bool enabled;
+            fpVector3_t position;   // m, NED from home
+        } target;
+        float settleRadius;         // m
+    };
+} simEvent_t;
+
+typedef struct simMetrics_s {
+    float duration;                 // s
+    float armedTime;                // s
+    float maxAltitude;              // m above home
+    float minVoltage;
+    float consumedMah;
+    float maxImpactSpeed;           // m/s
+    bool crashed;
+
+    // Distance to the target while there is one
+    uint32_t trackingSamples;
+    double trackingSquareSum;
+    float trackingMax;
+
+    // The longest it took to get within the settle radius of a target for good, i.e. until the next target
+    float settleTime;
+    bool settleFailed;          // Outside the radius when a target was left
+    bool anyTarget;
+    float targetSetAt;
+    float lastOutsideAt;
+    float lastTrackedAt;
+
+    double cpuLoadSum;
+    uint32_t cpuLoadSamples;
+} simMetrics_t;
+
+typedef struct simScenario_s {
+    simEvent_t events[SIM_SCENARIO_MAX_EVENTS];
+    unsigned eventCount;
+    unsigned nextEvent;
+    uint32_t timeUs;
+    bool ended;
+
+    uint16_t rc[SIM_SCENARIO_RC_CHANNELS];  // us
+    fpVector3_t wind;
+    float motorFactor[SIM_MAX_MOTORS];
+    bool gpsFailed;
+    bool targetEnabled;
+    fpVector3_t target;
+    float settleRadius;
+
+    bool wasOnGround;
+    float lastVerticalSpeed;
+    simMetrics_t metrics;
+} simScenario_t;
+
+void simScenarioInit(simScenario_t *scenario);
+bool simScenarioParseLine(simScenario_t *scenario, const char *line);
+bool simScenarioLoad(simScenario_t *scenario, const char *path);
+
+// Moves the scenario on by dt after a step of the simulation. Returns false once it has ended.
+bool simScenarioStep(simScenario_t *scenario, const simState_t *state, float dt, bool armed, uint16_t cpuLoad);
+void simScenarioApplyInput(const simScenario_t *scenario, simInput_t *input);
+
+void simScenarioWriteReport(const simScenario_t *scenario, FILE *file, const char *name, float hostCpuTime, float wallTime);
@@ -58,6 +58,7 @@
 #include "flight/imu.h"
 #include "io/gps.h"
 #include "rx/sim.h"
+#include "target/SITL/lockstep.h"
 
 #define XP_PORT 49000
 #define XPLANE_JOYSTICK_AXIS_COUNT 8
@@ -217,6 +218,8 @@ static void* listenWorker(void* arg)
             continue;
         }
 
+        lockstepWaitForStep();
+
         for (int i = 5; i < recvLen; i += 8) {
             dref_t dref = (dref_t)xint2uint32(&buf[i]);
             float value = xflt2float(&(buf[i + 4]));
@@ -434,6 +437,7 @@ static void* listenWorker(void* arg)
         }
 
         unlockMainPID();
+        lockstepGrant();
     }
 
     return NULL;
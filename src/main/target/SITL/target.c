@@ -50,13 +50,18 @@
 #include "drivers/pwm_mapping.h"
 #include "drivers/timer.h"
 #include "drivers/serial.h"
+#include "drivers/serial_tcp.h"
+#include "drivers/flash_file.h"
 #include "config/config_streamer.h"
 #include "build/version.h"
 
+#include "target/SITL/sim/builtin.h"
 #include "target/SITL/sim/realFlight.h"
 #include "target/SITL/sim/xplane.h"
 
+#include "target/SITL/io_reactor.h"
 #include "target/SITL/serial_proxy.h"
+#include "target/SITL/lockstep.h"
 
 // More dummys
 const int timerHardwareCount = 0;
@@ -73,6 +78,10 @@ static uint8_t mappingCount = 0;
 static bool useImu = false;
 static char *simIp = NULL;
 static int simPort = 0;
+static char *airframePath = NULL;
+static char *scenarioPath = NULL;
+static bool lockstep = false;
+static uint32_t lockstepFrameUs = 0;     // 0 picks the default of the simulator
 
 static char **c_argv;
 
@@ -85,6 +94,14 @@ void systemInit(void) {
     clock_gettime(CLOCK_MONOTONIC, &start_time);
     fprintf(stderr, "[SYSTEM] Init...\n");
 
+    if (lockstep) {
+        if (lockstepFrameUs == 0) {
+            lockstepFrameUs = sitlSim == SITL_SIM_BUILTIN ? SIM_BUILTIN_STEP_US : LOCKSTEP_DEFAULT_FRAME_US;
+        }
+        lockstepInit(lockstepFrameUs, sitlSim != SITL_SIM_NONE);
+        fprintf(stderr, "[SYSTEM] Lockstep mode, %s\n", sitlSim != SITL_SIM_NONE ? "driven by the simulator" : "running freely");
+    }
+
 #if !defined(__FreeBSD__)  && !defined(__APPLE__)
     pthread_attr_t thAttr;
     int policy = 0;
@@ -100,10 +117,12 @@ void systemInit(void) {
         exit(1);
     }
 
-    if (sitlSim != SITL_SIM_NONE) {
+    if (sitlSim != SITL_SIM_NONE && sitlSim != SITL_SIM_BUILTIN) {
         fprintf(stderr, "[SIM] Waiting for connection...\n");
     }
 
+    const bool simRequested = sitlSim != SITL_SIM_NONE;
+
     switch (sitlSim) {
         case SITL_SIM_REALFLIGHT:
             if (mappingCount > RF_MAX_PWM_OUTS) {
@@ -115,6 +134,7 @@ void systemInit(void) {
                 fprintf(stderr, "[SIM] Connection with RealFlight successfully established.\n");
             } else {
                 fprintf(stderr, "[SIM] Connection with RealFlight NOT established.\n");
+                sitlSim = SITL_SIM_NONE;
             }
             break;
         case SITL_SIM_XPLANE:
@@ -127,6 +147,17 @@ void systemInit(void) {
                 fprintf(stderr, "[SIM] Connection with X-Plane successfully established.\n");
             } else {
                 fprintf(stderr, "[SIM] Connection with X-PLane NOT established.\n");
+                sitlSim = SITL_SIM_NONE;
+            }
+            break;
+        case SITL_SIM_BUILTIN:
+            if (!simBuiltinInit(airframePath, scenarioPath, lockstep ? lockstepFrameUs : 0, useImu)) {
+                fprintf(stderr, "[SIM] Built-in simulator NOT started.\n");
+                if (scenarioPath) {
+                    // Nothing would ever end the run
+                    exit(1);
+                }
+                sitlSim = SITL_SIM_NONE;
             }
             break;
         default:
@@ -134,6 +165,12 @@ void systemInit(void) {
           break;
     }
 
+    if (lockstep && simRequested && sitlSim == SITL_SIM_NONE) {
+        // The simulator didn't start, nothing would move the clock on
+        lockstepInit(lockstepFrameUs, false);
+        fprintf(stderr, "[SYSTEM] Lockstep mode, running freely\n");
+    }
+
     rescheduleTask(TASK_SERIAL, SITL_SERIAL_TASK_US);
 }
 
@@ -199,9 +236,15 @@ void printCmdLineOptions(void)
     printVersion();
     fprintf(stderr, "Avaiable options:\n");
     fprintf(stderr, "--path=[path]                  Path and filename of eeprom.bin. If not specified 'eeprom.bin' in program directory is used.\n");
-    fprintf(stderr, "--sim=[rf|xp]                  Simulator interface: rf = RealFligt, xp = XPlane. Example: --sim=rf\n");
+    fprintf(stderr, "--flash=[path]                 Path and filename of flash.bin, the dataflash for blackbox_device = SPIFLASH. Only created with that device. If not specified 'flash.bin' in program directory is used.\n");
+    fprintf(stderr, "--sim=[rf|xp|builtin]          Simulator interface: rf = RealFligt, xp = XPlane, builtin = physics model in SITL itself. Example: --sim=rf\n");
+    fprintf(stderr, "--airframe=[path]              Airframe file for the built-in simulator. If not specified a 1kg quad X is simulated.\n");
+    fprintf(stderr, "--scenario=[path]              Scenario for the built-in simulator: RC inputs, wind and failures over time. SITL exits at its end and prints a summary.\n");
     fprintf(stderr, "--simip=[ip]                   IP-Address oft the simulator host. If not specified localhost (127.0.0.1) is used.\n");
     fprintf(stderr, "--simport=[port]               Port oft the simulator host.\n");
+    fprintf(stderr, "--lockstep[=us]                Run on a virtual clock, as fast as the host allows. With a simulator each of its frames advances the clock by us (default: %d, %d with the built-in one).\n", LOCKSTEP_DEFAULT_FRAME_US, SIM_BUILTIN_STEP_US);
+    fprintf(stderr, "--baseport=[port]              TCP port of UART1, the other UARTs follow it (default: %d).\n", BASE_IP_ADDRESS);
+    fprintf(stderr, "--stats[=s]                    Print the context switches of all threads every s seconds (default: %d) and at exit.\n", IO_REACTOR_STATS_DEFAULT_S);
     fprintf(stderr, "--useimu                       Use IMU sensor data from the simulator instead of using attitude data from the simulator directly (experimental, not recommended).\n");
     fprintf(stderr, "--serialuart=[uart]            UART number on which serial receiver is configured in SITL, f.e. 3 for UART3\n");
     fprintf(stderr, "--serialport=[serialport]      Host's serial port to which serial receiver/proxy FC is connected, f.e. COM3, /dev/ttyACM3\n");
@@ -239,6 +282,12 @@ void parseArguments(int argc, char *argv[])
             {"stopbits", required_argument, 0, '3'},
             {"parity", required_argument, 0, '4'},
             {"fcproxy", no_argument, 0, '5'},
+            {"flash", required_argument, 0, 'f'},
+            {"lockstep", optional_argument, 0, 'l'},
+            {"airframe", required_argument, 0, 'a'},
+            {"scenario", required_argument, 0, 'n'},
+            {"baseport", required_argument, 0, 'b'},
+            {"stats", optional_argument, 0, 't'},
             {NULL, 0, NULL, 0}
         };
 
@@ -252,6 +301,8 @@ void parseArguments(int argc, char *argv[])
                     sitlSim = SITL_SIM_REALFLIGHT;
                 } else if (strcmp(optarg, "xp") == 0){
                     sitlSim = SITL_SIM_XPLANE;
+                } else if (strcmp(optarg, "builtin") == 0){
+                    sitlSim = SITL_SIM_BUILTIN;
                 } else {
                     fprintf(stderr, "[SIM] Unsupported simulator %s.\n", optarg);
                 }
@@ -275,7 +326,7 @@ void parseArguments(int argc, char *argv[])
                 break;
             case 'e':
                 if (!configFileSetPath(optarg)){
-                    fprintf(stderr, "[EEPROM] Invalid path, using eeprom file in program directory\n.");
+                    fprintf(stderr, "[EEPROM] Invalid path, using eeprom file in program directory.\n");
                 }
                 break;
             case 'v':
@@ -284,13 +335,13 @@ void parseArguments(int argc, char *argv[])
             case '0':
                 serialUartIndex = atoi(optarg);
                 if ( (serialUartIndex<1) || (serialUartIndex>8) ) {
-                    fprintf(stderr, "[serialuart] Invalid argument\n.");
+                    fprintf(stderr, "[serialuart] Invalid argument.\n");
                     exit(0);
                 }
                 break;
             case '1':
                 if ( (strlen(optarg)<1) || (strlen(optarg)>63) ) {
-                    fprintf(stderr, "[serialport] Invalid argument\n.");
+                    fprintf(stderr, "[serialport] Invalid argument.\n");
                     exit(0);
                 } else {
                     strcpy( serialPort, optarg );
@@ -300,7 +351,7 @@ void parseArguments(int argc, char *argv[])
                 serialBaudRate = atoi(optarg);
                 if ( serialBaudRate < 1200 )
                 {
-                    fprintf(stderr, "[baudrate] Invalid argument\n.");
+                    fprintf(stderr, "[baudrate] Invalid argument.\n");
                     exit(0);
                 }
                 break;
@@ -308,7 +359,7 @@ void parseArguments(int argc, char *argv[])
                 serialStopBits = parseStopBits(optarg);
                 if ( serialStopBits == OPT_SERIAL_STOP_BITS_INVALID )
                 {
-                    fprintf(stderr, "[stopbits] Invalid argument\n.");
+                    fprintf(stderr, "[stopbits] Invalid argument.\n");
                     exit(0);
                 }
                 break;
@@ -317,13 +368,50 @@ void parseArguments(int argc, char *argv[])
                 serialParity = parseParity(optarg);
                 if ( serialParity== OPT_SERIAL_PARITY_INVALID )
                 {
-                    fprintf(stderr, "[parity] Invalid argument\n.");
+                    fprintf(stderr, "[parity] Invalid argument.\n");
                     exit(0);
                 }
                 break;
             case '5':
                 serialFCProxy = true;
                 break;
+            case 'f':
+                if (!flashFileSetPath(optarg)) {
+                    fprintf(stderr, "[FLASH] Invalid path, using flash file in program directory.\n");
+                }
+                break;
+            case 'l':
+                lockstep = true;
+                lockstepFrameUs = optarg ? atoi(optarg) : 0;
+                if (optarg && (lockstepFrameUs < 1 || lockstepFrameUs > 1000000)) {
+                    fprintf(stderr, "[lockstep] Invalid argument.\n");
+                    exit(1);
+                }
+                break;
+            case 'a':
+                airframePath = optarg;
+                break;
+            case 'n':
+                scenarioPath = optarg;
+                break;
+            case 'b': {
+                const int port = atoi(optarg);
+                if (port < 1 || port > UINT16_MAX - SERIAL_PORT_COUNT) {
+                    fprintf(stderr, "[baseport] Invalid argument.\n");
+                    exit(1);
+                }
+                tcpSetBasePort(port);
+                break;
+            }
+            case 't': {
+                const int interval = optarg ? atoi(optarg) : IO_REACTOR_STATS_DEFAULT_S;
+                if (interval < 1) {
+                    fprintf(stderr, "[stats] Invalid argument.\n");
+                    exit(1);
+                }
+                ioReactorEnableStats(interval);
+                break;
+            }
 
             default:
                 printCmdLineOptions();
@@ -331,6 +419,11 @@ void parseArguments(int argc, char *argv[])
         }
     }
 
+    if (scenarioPath && sitlSim != SITL_SIM_BUILTIN) {
+        fprintf(stderr, "[SIM] A scenario needs --sim=builtin.\n");
+        exit(1);
+    }
+
     if (simIp == NULL) {
         simIp = malloc(10);
         strcpy(simIp, "127.0.0.1");
@@ -349,6 +442,10 @@ void unlockMainPID(void)
 
 // Replacements for system functions
 timeUs_t micros(void) {
+    if (lockstepIsEnabled()) {
+        return lockstepMicros();
+    }
+
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
 
@@ -364,9 +461,28 @@ uint32_t millis(void) {
     return (uint32_t)(micros() / 1000);
 }
 
+// No cycle counter on the host, ticks are nanoseconds
+uint32_t usTicks = 1000;
+
+uint32_t ticks(void)
+{
+    if (lockstepIsEnabled()) {
+        return (uint32_t)(lockstepMicros() * 1000);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t)(now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
 void delayMicroseconds(timeUs_t us)
 {
-    usleep(us);
+    if (lockstepIsEnabled()) {
+        lockstepAdvance(us);
+    } else {
+        usleep(us);
+    }
 }
 
 void delay(timeMs_t ms)
@@ -396,6 +512,10 @@ void systemResetToBootloader(void)
 
 void failureMode(failureMode_e mode) {
     fprintf(stderr, "[SYSTEM] Failure mode %d\n", mode);
+    if (lockstepIsEnabled()) {
+        // Nothing would ever end the run
+        exit(1);
+    }
     while (true) {
         delay(1000);
     };
@@ -41,9 +41,23 @@
 #define CONFIG_IN_FILE
 #define EEPROM_SIZE     32768
 
+// file backed dataflash for blackbox
+#define FLASH_FILENAME  "flash.bin"
+#define USE_FLASHFS
+#define USE_FLASH_FILE
+
 #undef SCHEDULER_DELAY_LIMIT
 #define SCHEDULER_DELAY_LIMIT           1
 
+#define DYN_NOTCH_FFT_MAX_WINDOW_SIZE 256
+
+#define USE_PROFILER
+#define PROFILER_RING_SIZE              8192
+
+#define USE_BLACKBOX_PRETRIGGER
+#define BLACKBOX_PRETRIGGER_BUFFER_SIZE (256 * 1024)
+#define USE_BLACKBOX_GYRO_RATE
+
 #define USE_UART1
 #define USE_UART2
 #define USE_UART3
@@ -192,6 +206,7 @@ typedef enum
     SITL_SIM_NONE,
     SITL_SIM_REALFLIGHT,
     SITL_SIM_XPLANE,
+    SITL_SIM_BUILTIN,
 } SitlSim_e;
 
 
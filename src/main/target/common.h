@@ -21,6 +21,10 @@
 #define USE_ITCM_RAM
 #endif
 
+#if defined(STM32H7)
+#define DYN_NOTCH_FFT_MAX_WINDOW_SIZE 256
+#endif
+
 #ifdef USE_ITCM_RAM
 #define FAST_CODE                   __attribute__((section(".tcm_code")))
 #define NOINLINE                    __attribute__((noinline))
@@ -43,6 +47,7 @@
 #define USE_SERIALRX_FPORT2
 
 //#define USE_DEV_TOOLS           // tools for dev use only. Undefine for release builds.
+//#define USE_PROFILER            // hot path probes, see build/profiler.h. Costs RAM and a few cycles per probe.
 
 #define COMMON_DEFAULT_FEATURES (FEATURE_TX_PROF_SEL)
 
@@ -209,6 +214,8 @@
 #define USE_34CHANNELS
 #define MAX_MIXER_PROFILE_COUNT 2
 #define USE_SMARTPORT_MASTER
+#define USE_BLACKBOX_PRETRIGGER
+#define USE_BLACKBOX_GYRO_RATE
 #elif !defined(STM32F7)
 #define MAX_MIXER_PROFILE_COUNT 1
 #endif
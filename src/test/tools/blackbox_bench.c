@@ -0,0 +1,445 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Blackbox P frame compression benchmark. The fields of a decoded blackbox log which the
+ * firmware writes with the average predictor are encoded again with the firmware's own
+ * encoder, once as signed VB and once Rice coded, and the sizes and encoder times are
+ * compared. See docs/development/Blackbox bench.md
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+#include "platform.h"
+
+#include "blackbox/blackbox_encoding.h"
+#include "blackbox/blackbox_io.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#define BENCH_MAX_LINE              8192
+#define BENCH_MAX_COLUMNS           512
+#define BENCH_MAX_FIELDS            64
+#define BENCH_DEFAULT_I_INTERVAL    32
+#define BENCH_DEFAULT_PASSES        20
+
+typedef enum {
+    CODING_SIGNED_VB = 0,
+    CODING_RICE,
+    CODING_COUNT
+} benchCoding_e;
+
+static const char * const codingNames[CODING_COUNT] = {
+    [CODING_SIGNED_VB]  = "signed VB",
+    [CODING_RICE]       = "Rice",
+};
+
+typedef struct {
+    uint32_t frameCount;
+    int fieldCount;
+    char *fieldNames[BENCH_MAX_FIELDS];
+    int32_t *values;                    // frameCount rows of fieldCount values
+} benchLog_t;
+
+typedef struct {
+    uint64_t bytes;
+    double ticksPerFrame;
+} benchResult_t;
+
+// Fields the firmware writes with the average predictor, as named in the decoded CSV
+static const char * const averagedFieldNames[] = {
+    "gyroADC", "gyroRaw", "gyroPeakRoll", "gyroPeakPitch", "gyroPeakYaw", "accSmooth", "accVib",
+    "attitude", "debug", "motor", "servo", "navVel", "navTgtVel", "navAcc",
+};
+
+// Owned by blackbox_io.c, only used for the header
+int32_t blackboxHeaderBudget;
+
+static benchLog_t benchLog;
+static uint64_t bytesWritten;
+static uint32_t writeChecksum;
+
+void blackboxWrite(uint8_t value)
+{
+    bytesWritten++;
+    writeChecksum = writeChecksum * 31 + value;
+}
+
+int blackboxPrint(const char *s)
+{
+    UNUSED(s);
+    return 0;
+}
+
+int tfp_format(void *putp, void (*putf) (void *, char), const char *fmt, va_list va)
+{
+    UNUSED(putp);
+    UNUSED(putf);
+    UNUSED(fmt);
+    UNUSED(va);
+    return 0;
+}
+
+/*
+ * Logs
+ */
+
+static int splitCsvLine(char *line, char **fields)
+{
+    int count = 0;
+    char *field = line;
+
+    while (count < BENCH_MAX_COLUMNS) {
+        char *end = strchr(field, ',');
+        if (end) {
+            *end = '\0';
+        }
+
+        // Trim spaces, quotes and the line end
+        while (*field == ' ' || *field == '"') {
+            field++;
+        }
+        for (char *tail = field + strlen(field); tail > field && strchr(" \"\r\n", tail[-1]); tail--) {
+            tail[-1] = '\0';
+        }
+        fields[count++] = field;
+
+        if (!end) {
+            break;
+        }
+        field = end + 1;
+    }
+
+    return count;
+}
+
+static bool isAveragedField(const char *name)
+{
+    for (unsigned i = 0; i < ARRAYLEN(averagedFieldNames); i++) {
+        const size_t length = strlen(averagedFieldNames[i]);
+        if (strncmp(name, averagedFieldNames[i], length) == 0 && (name[length] == '\0' || name[length] == '[')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Reads a CSV made by blackbox_decode. Every column of a field which is written with the
+ * average predictor is used, the rest of the log is ignored.
+ */
+static bool loadCsvLog(benchLog_t *log, const char *fileName)
+{
+    FILE *file = fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", fileName);
+        return false;
+    }
+
+    static char line[BENCH_MAX_LINE];
+    static char *header[BENCH_MAX_COLUMNS];
+    static char *fields[BENCH_MAX_COLUMNS];
+    int fieldColumn[BENCH_MAX_FIELDS];
+
+    if (!fgets(line, sizeof(line), file)) {
+        fprintf(stderr, "%s is empty\n", fileName);
+        fclose(file);
+        return false;
+    }
+    const int columnCount = splitCsvLine(line, header);
+
+    log->fieldCount = 0;
+    for (int i = 0; i < columnCount && log->fieldCount < BENCH_MAX_FIELDS; i++) {
+        if (isAveragedField(header[i])) {
+            fieldColumn[log->fieldCount] = i;
+            log->fieldNames[log->fieldCount++] = strdup(header[i]);
+        }
+    }
+    if (log->fieldCount == 0) {
+        fprintf(stderr, "%s has no fields written with the average predictor\n", fileName);
+        fclose(file);
+        return false;
+    }
+
+    uint32_t capacity = 1 << 16;
+    log->values = malloc((size_t)capacity * log->fieldCount * sizeof(int32_t));
+    log->frameCount = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        const int count = splitCsvLine(line, fields);
+        if (count < columnCount) {
+            continue;
+        }
+
+        if (log->frameCount == capacity) {
+            capacity *= 2;
+            log->values = realloc(log->values, (size_t)capacity * log->fieldCount * sizeof(int32_t));
+        }
+
+        int32_t *row = &log->values[(size_t)log->frameCount++ * log->fieldCount];
+        for (int field = 0; field < log->fieldCount; field++) {
+            row[field] = strtol(fields[fieldColumn[field]], NULL, 10);
+        }
+    }
+    fclose(file);
+
+    if (log->frameCount < 3) {
+        fprintf(stderr, "%s has too few frames\n", fileName);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * A quad logged at 1kHz: gyro, acc and attitude follow the sticks with some motor noise,
+ * the motors follow the gyro.
+ */
+static void generateLog(benchLog_t *log, float seconds)
+{
+    static const char * const names[] = {
+        "gyroADC[0]", "gyroADC[1]", "gyroADC[2]", "accSmooth[0]", "accSmooth[1]", "accSmooth[2]",
+        "attitude[0]", "attitude[1]", "attitude[2]", "motor[0]", "motor[1]", "motor[2]", "motor[3]",
+    };
+    const float dT = 0.001f;
+
+    log->frameCount = lrintf(seconds / dT);
+    log->fieldCount = ARRAYLEN(names);
+    for (int field = 0; field < log->fieldCount; field++) {
+        log->fieldNames[field] = (char *)names[field];
+    }
+    log->values = malloc((size_t)log->frameCount * log->fieldCount * sizeof(int32_t));
+    srand(1);
+
+    for (uint32_t frame = 0; frame < log->frameCount; frame++) {
+        const float t = frame * dT;
+        int32_t *row = &log->values[(size_t)frame * log->fieldCount];
+        float rate[XYZ_AXIS_COUNT];
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const float motion = 150.0f * sinf(2 * M_PIf * (1.3f + axis) * t) + 60.0f * sinf(2 * M_PIf * (4.1f + axis) * t + axis);
+            const float noise = 4.0f * sinf(2 * M_PIf * 185.0f * t + axis) + 3.0f * (rand() / (float)RAND_MAX - 0.5f);
+
+            rate[axis] = motion + noise;
+            row[axis] = lrintf(rate[axis]);
+            row[3 + axis] = lrintf((axis == FD_YAW ? 4096 : 0) + 300.0f * sinf(2 * M_PIf * 0.8f * t + axis) + 20.0f * (rand() / (float)RAND_MAX - 0.5f));
+            row[6 + axis] = lrintf(450.0f * sinf(2 * M_PIf * (0.3f + 0.1f * axis) * t));
+        }
+
+        for (int motor = 0; motor < 4; motor++) {
+            const float mix = ((motor & 1) ? 1 : -1) * rate[FD_ROLL] + ((motor & 2) ? 1 : -1) * rate[FD_PITCH] + ((motor == 0 || motor == 3) ? 1 : -1) * rate[FD_YAW];
+            row[9 + motor] = lrintf(1450.0f + 200.0f * sinf(2 * M_PIf * 0.5f * t) + 0.8f * mix);
+        }
+    }
+}
+
+/*
+ * Encoding
+ */
+
+// CPU cycles where the TSC is available, nanoseconds otherwise
+static uint64_t readTicks(void)
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// The residuals of every P frame, as the firmware computes them. Frames which are I frames are left out.
+static int32_t *computeResiduals(const benchLog_t *log, uint32_t iInterval, uint32_t *pFrameCount)
+{
+    int32_t *residuals = malloc((size_t)log->frameCount * log->fieldCount * sizeof(int32_t));
+    const int32_t *prev1 = NULL;
+    const int32_t *prev2 = NULL;
+    uint32_t count = 0;
+
+    for (uint32_t frame = 0; frame < log->frameCount; frame++) {
+        const int32_t *curr = &log->values[(size_t)frame * log->fieldCount];
+
+        if (frame % iInterval == 0) {
+            // Both history states are the I frame after it is written
+            prev1 = prev2 = curr;
+            continue;
+        }
+
+        int32_t *out = &residuals[(size_t)count++ * log->fieldCount];
+        for (int field = 0; field < log->fieldCount; field++) {
+            const int32_t predictor = ((int64_t)prev1[field] + (int64_t)prev2[field]) / 2;
+            out[field] = curr[field] - predictor;
+        }
+
+        prev2 = prev1;
+        prev1 = curr;
+    }
+
+    *pFrameCount = count;
+    return residuals;
+}
+
+static void encodeFrames(const int32_t *residuals, uint32_t frameCount, int fieldCount, uint32_t iInterval, benchCoding_e coding)
+{
+    const uint32_t pFramesPerInterval = iInterval - 1;
+
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        const int32_t *row = &residuals[(size_t)frame * fieldCount];
+
+        if (coding == CODING_RICE) {
+            if (frame % pFramesPerInterval == 0) {
+                blackboxRiceReset();
+            }
+            blackboxRiceBeginFrame();
+            for (int field = 0; field < fieldCount; field++) {
+                blackboxWriteRice(row[field]);
+            }
+            blackboxRiceFlush();
+        } else {
+            for (int field = 0; field < fieldCount; field++) {
+                blackboxWriteSignedVB(row[field]);
+            }
+        }
+    }
+}
+
+static void benchCoding(const int32_t *residuals, uint32_t frameCount, int fieldCount, uint32_t iInterval, int passes, benchCoding_e coding, benchResult_t *result)
+{
+    uint64_t bestTicks = UINT64_MAX;
+
+    for (int pass = 0; pass < passes; pass++) {
+        bytesWritten = 0;
+
+        const uint64_t start = readTicks();
+        encodeFrames(residuals, frameCount, fieldCount, iInterval, coding);
+        const uint64_t ticks = readTicks() - start;
+
+        bestTicks = MIN(bestTicks, ticks);
+    }
+
+    result->bytes = bytesWritten;
+    result->ticksPerFrame = (double)bestTicks / frameCount;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <log.csv | --synthetic seconds>\n"
+        "\n"
+        "Encodes the P frame fields of a blackbox_decode CSV which are written with the average\n"
+        "predictor as signed VB and Rice coded, and compares the sizes and encoder times.\n"
+        "\n"
+        "Options:\n"
+        "  --i-interval <frames>  frames from one I frame to the next (default %d)\n"
+        "  --passes <count>       encoder passes, the fastest is reported (default %d)\n"
+        "  --fields               list the fields used\n",
+        name, BENCH_DEFAULT_I_INTERVAL, BENCH_DEFAULT_PASSES);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *logFileName = NULL;
+    float syntheticSeconds = 0;
+    uint32_t iInterval = BENCH_DEFAULT_I_INTERVAL;
+    int passes = BENCH_DEFAULT_PASSES;
+    bool listFields = false;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--i-interval") == 0 && hasValue) {
+            iInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--passes") == 0 && hasValue) {
+            passes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--synthetic") == 0 && hasValue) {
+            syntheticSeconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--fields") == 0) {
+            listFields = true;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (!logFileName) {
+            logFileName = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((!logFileName && syntheticSeconds <= 0) || iInterval < 2 || passes < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (syntheticSeconds > 0) {
+        generateLog(&benchLog, syntheticSeconds);
+    } else if (!loadCsvLog(&benchLog, logFileName)) {
+        return EXIT_FAILURE;
+    }
+
+    uint32_t pFrameCount;
+    const int32_t *residuals = computeResiduals(&benchLog, iInterval, &pFrameCount);
+    if (pFrameCount == 0) {
+        fprintf(stderr, "No P frames with an I interval of %u\n", iInterval);
+        return EXIT_FAILURE;
+    }
+
+    printf("%u frames, %u P frames, %d fields\n", benchLog.frameCount, pFrameCount, benchLog.fieldCount);
+    if (listFields) {
+        for (int field = 0; field < benchLog.fieldCount; field++) {
+            printf("  %s\n", benchLog.fieldNames[field]);
+        }
+    }
+
+    benchResult_t results[CODING_COUNT];
+    for (int coding = 0; coding < CODING_COUNT; coding++) {
+        benchCoding(residuals, pFrameCount, benchLog.fieldCount, iInterval, passes, coding, &results[coding]);
+    }
+
+#ifdef BENCH_HAVE_TSC
+    const char *tickUnit = "cycles/frame";
+#else
+    const char *tickUnit = "ns/frame";
+#endif
+
+    printf("%-10s %12s %12s %10s %14s\n", "coding", "bytes", "bytes/frame", "bits/value", tickUnit);
+    for (int coding = 0; coding < CODING_COUNT; coding++) {
+        const benchResult_t *result = &results[coding];
+        printf("%-10s %12llu %12.2f %10.2f %14.1f\n", codingNames[coding], (unsigned long long)result->bytes,
+            (double)result->bytes / pFrameCount, 8.0 * result->bytes / ((double)pFrameCount * benchLog.fieldCount), result->ticksPerFrame);
+    }
+
+    printf("Rice coded size is %.1f%% of signed VB, ratio %.2f:1\n",
+        100.0 * results[CODING_RICE].bytes / results[CODING_SIGNED_VB].bytes,
+        (double)results[CODING_SIGNED_VB].bytes / results[CODING_RICE].bytes);
+
+    // Keeps the encoder output from being optimised away
+    return writeChecksum == 0xFFFFFFFF ? EXIT_FAILURE : EXIT_SUCCESS;
+}
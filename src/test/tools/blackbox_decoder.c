@@ -0,0 +1,926 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reference blackbox log decoder, see blackbox_decoder.h. The frame layouts and predictors
+ * follow the log viewers, so that a log which decodes here decodes there as well.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "blackbox/blackbox_fielddefs.h"
+
+#include "common/maths.h"
+
+#include "blackbox_decoder.h"
+
+#define DECODER_MAX_HEADER_LINE     8192
+
+// Must match the encoder, see blackbox_encoding.c
+#define RICE_MAX_K                  20
+#define RICE_ESCAPE                 20
+#define RICE_MAX_SAMPLE             (1 << 24)
+#define RICE_HALVE_COUNT            32
+#define RICE_INITIAL_SUM            4
+
+static void decoderError(blackboxDecoder_t *decoder, const char *format, ...)
+{
+    va_list va;
+
+    va_start(va, format);
+    vsnprintf(decoder->error, sizeof(decoder->error), format, va);
+    va_end(va);
+}
+
+/*
+ * Streams
+ */
+
+static uint8_t readByte(blackboxDecoder_t *decoder)
+{
+    if (decoder->pos >= decoder->size) {
+        decoder->overrun = true;
+        return 0;
+    }
+
+    return decoder->data[decoder->pos++];
+}
+
+static uint32_t readUnsignedVB(blackboxDecoder_t *decoder)
+{
+    uint32_t value = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        const uint8_t c = readByte(decoder);
+
+        value |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return value;
+        }
+    }
+
+    // More than 5 bytes, the stream is corrupt
+    decoder->overrun = true;
+    return 0;
+}
+
+static int32_t zigzagDecode(uint32_t value)
+{
+    return (value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t readSignedVB(blackboxDecoder_t *decoder)
+{
+    return zigzagDecode(readUnsignedVB(decoder));
+}
+
+static int32_t signExtend(uint32_t value, int bits)
+{
+    const uint32_t sign = 1u << (bits - 1);
+
+    value &= (sign << 1) - 1;
+    return (int32_t)(value ^ sign) - (int32_t)sign;
+}
+
+static void readTag2_3S32(blackboxDecoder_t *decoder, int32_t *values)
+{
+    const uint8_t lead = readByte(decoder);
+
+    switch (lead >> 6) {
+    case 0:
+        values[0] = signExtend(lead >> 4, 2);
+        values[1] = signExtend(lead >> 2, 2);
+        values[2] = signExtend(lead, 2);
+        break;
+    case 1: {
+        values[0] = signExtend(lead, 4);
+        const uint8_t c = readByte(decoder);
+        values[1] = signExtend(c >> 4, 4);
+        values[2] = signExtend(c, 4);
+        break;
+    }
+    case 2:
+        values[0] = signExtend(lead, 6);
+        values[1] = signExtend(readByte(decoder), 6);
+        values[2] = signExtend(readByte(decoder), 6);
+        break;
+    default: {
+        // The byte count of each field, the first one in the low bits
+        uint8_t selector = lead;
+
+        for (int i = 0; i < 3; i++, selector >>= 2) {
+            const int bytes = (selector & 0x03) + 1;
+            uint32_t value = 0;
+
+            for (int b = 0; b < bytes; b++) {
+                value |= (uint32_t)readByte(decoder) << (8 * b);
+            }
+            values[i] = signExtend(value, 8 * bytes);
+        }
+        break;
+    }
+    }
+}
+
+static void readTag8_4S16(blackboxDecoder_t *decoder, int32_t *values)
+{
+    uint8_t selector = readByte(decoder);
+    bool halfByte = false;
+    uint8_t buffer = 0;
+
+    // The nibbles are packed high bits first, a field may start in the middle of a byte
+    for (int i = 0; i < 4; i++, selector >>= 2) {
+        switch (selector & 0x03) {
+        case 0:
+            values[i] = 0;
+            break;
+        case 1:
+            if (!halfByte) {
+                buffer = readByte(decoder);
+                values[i] = signExtend(buffer >> 4, 4);
+            } else {
+                values[i] = signExtend(buffer, 4);
+            }
+            halfByte = !halfByte;
+            break;
+        case 2:
+            if (!halfByte) {
+                values[i] = signExtend(readByte(decoder), 8);
+            } else {
+                const uint8_t high = buffer << 4;
+                buffer = readByte(decoder);
+                values[i] = signExtend(high | (buffer >> 4), 8);
+            }
+            break;
+        default:
+            if (!halfByte) {
+                const uint8_t high = readByte(decoder);
+                values[i] = signExtend((high << 8) | readByte(decoder), 16);
+            } else {
+                const uint8_t middle = readByte(decoder);
+                const uint8_t low = readByte(decoder);
+                values[i] = signExtend(((buffer & 0x0F) << 12) | (middle << 4) | (low >> 4), 16);
+                buffer = low;
+            }
+            break;
+        }
+    }
+}
+
+static void readTag8_8SVB(blackboxDecoder_t *decoder, int32_t *values, int count)
+{
+    if (count == 1) {
+        values[0] = readSignedVB(decoder);
+        return;
+    }
+
+    const uint8_t header = readByte(decoder);
+
+    for (int i = 0; i < count; i++) {
+        values[i] = (header & (1 << i)) ? readSignedVB(decoder) : 0;
+    }
+}
+
+// Bits are read LSB first, a run of values ends on a whole byte
+typedef struct bitReader_s {
+    blackboxDecoder_t *decoder;
+    uint32_t bits;
+    int bitCount;
+} bitReader_t;
+
+static uint32_t readBits(bitReader_t *reader, int count)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (reader->bitCount == 0) {
+            reader->bits = readByte(reader->decoder);
+            reader->bitCount = 8;
+        }
+
+        value |= (reader->bits & 1) << i;
+        reader->bits >>= 1;
+        reader->bitCount--;
+    }
+
+    return value;
+}
+
+static void resetRice(blackboxDecoder_t *decoder)
+{
+    for (int i = 0; i < BLACKBOX_DECODER_RICE_CONTEXTS; i++) {
+        decoder->rice[i].sum = RICE_INITIAL_SUM;
+        decoder->rice[i].count = 1;
+    }
+    decoder->riceIndex = 0;
+}
+
+static int32_t readRice(bitReader_t *reader)
+{
+    blackboxDecoder_t *decoder = reader->decoder;
+    blackboxRiceState_t *context = &decoder->rice[decoder->riceIndex];
+
+    if (decoder->riceIndex < BLACKBOX_DECODER_RICE_CONTEXTS - 1) {
+        decoder->riceIndex++;
+    }
+
+    int k = 0;
+    while (k < RICE_MAX_K && (context->count << k) < context->sum) {
+        k++;
+    }
+
+    uint32_t quotient = 0;
+    while (quotient < RICE_ESCAPE && readBits(reader, 1)) {
+        quotient++;
+    }
+
+    uint32_t u;
+    if (quotient == RICE_ESCAPE) {
+        u = readBits(reader, 16);
+        u |= readBits(reader, 16) << 16;
+    } else {
+        u = (quotient << k) | readBits(reader, k);
+    }
+
+    context->sum += u < RICE_MAX_SAMPLE ? u : RICE_MAX_SAMPLE;
+    context->count++;
+    if (context->count >= RICE_HALVE_COUNT) {
+        context->sum >>= 1;
+        context->count >>= 1;
+    }
+
+    return zigzagDecode(u);
+}
+
+/*
+ * Read the values of count fields with the given encodings. The grouped encodings take
+ * the fields which follow as well.
+ */
+static bool readFields(blackboxDecoder_t *decoder, const uint8_t *encodings, int count, int32_t *values)
+{
+    for (int i = 0; i < count; i++) {
+        int run = 1;
+
+        switch (encodings[i]) {
+        case FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB:
+            values[i] = readSignedVB(decoder);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB:
+            values[i] = readUnsignedVB(decoder);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_NEG_14BIT:
+            values[i] = -signExtend(readUnsignedVB(decoder), 14);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_NULL:
+            values[i] = 0;
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
+            if (i + 3 > count) {
+                decoderError(decoder, "TAG2_3S32 needs 3 fields from field %d", i);
+                return false;
+            }
+            readTag2_3S32(decoder, &values[i]);
+            run = 3;
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
+            if (i + 4 > count) {
+                decoderError(decoder, "TAG8_4S16 needs 4 fields from field %d", i);
+                return false;
+            }
+            readTag8_4S16(decoder, &values[i]);
+            run = 4;
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
+            // Up to 8 consecutive fields share the header byte
+            while (run < 8 && i + run < count && encodings[i + run] == FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB) {
+                run++;
+            }
+            readTag8_8SVB(decoder, &values[i], run);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_RICE: {
+            bitReader_t reader = { .decoder = decoder };
+
+            while (i + run < count && encodings[i + run] == FLIGHT_LOG_FIELD_ENCODING_RICE) {
+                run++;
+            }
+            for (int j = 0; j < run; j++) {
+                values[i + j] = readRice(&reader);
+            }
+            break;
+        }
+        default:
+            decoderError(decoder, "Unknown encoding %d", encodings[i]);
+            return false;
+        }
+
+        i += run - 1;
+    }
+
+    return true;
+}
+
+/*
+ * Header
+ */
+
+static blackboxFrameDef_t *frameDefFor(blackboxDecoder_t *decoder, char frameType, bool *delta)
+{
+    *delta = frameType == 'P' || frameType == 'd';
+
+    switch (frameType) {
+    case 'I':
+    case 'P':
+        return &decoder->main;
+    case 'S':
+        return &decoder->slow;
+    case 'G':
+        return &decoder->gpsG;
+    case 'H':
+        return &decoder->gpsH;
+    case 'D':
+    case 'd':
+        return &decoder->group;
+    default:
+        return NULL;
+    }
+}
+
+// Parse a comma separated list of integers, returns the count
+static int parseIntList(const char *value, int *out, int max)
+{
+    int count = 0;
+
+    while (*value && count < max) {
+        char *end;
+        const long number = strtol(value, &end, 10);
+
+        if (end == value) {
+            break;
+        }
+
+        out[count++] = number;
+        value = *end == ',' ? end + 1 : end;
+    }
+
+    return count;
+}
+
+static bool parseFieldLine(blackboxDecoder_t *decoder, char frameType, const char *property, const char *value)
+{
+    bool delta;
+    blackboxFrameDef_t *def = frameDefFor(decoder, frameType, &delta);
+    int numbers[BLACKBOX_DECODER_MAX_FIELDS];
+
+    if (!def) {
+        // Frame types this decoder doesn't know about are skipped
+        return true;
+    }
+
+    if (!strcmp(property, "name")) {
+        int count = 0;
+
+        while (*value) {
+            const char *comma = strchr(value, ',');
+            const size_t length = comma ? (size_t)(comma - value) : strlen(value);
+
+            if (count >= BLACKBOX_DECODER_MAX_FIELDS || length >= BLACKBOX_DECODER_MAX_NAME) {
+                decoderError(decoder, "Too many or too long field names for frame %c", frameType);
+                return false;
+            }
+
+            memcpy(def->names[count], value, length);
+            def->names[count][length] = '\0';
+            count++;
+
+            value += length + (comma ? 1 : 0);
+        }
+
+        def->fieldCount = count;
+        return true;
+    }
+
+    const int count = parseIntList(value, numbers, BLACKBOX_DECODER_MAX_FIELDS);
+    uint8_t *target = NULL;
+
+    if (!strcmp(property, "signed")) {
+        target = def->isSigned;
+    } else if (!strcmp(property, "predictor")) {
+        target = delta ? def->deltaPredictor : def->predictor;
+    } else if (!strcmp(property, "encoding")) {
+        target = delta ? def->deltaEncoding : def->encoding;
+    } else if (!strcmp(property, "group") && frameType == 'D') {
+        target = decoder->fieldGroup;
+    } else {
+        return true;
+    }
+
+    for (int i = 0; i < count; i++) {
+        target[i] = numbers[i];
+    }
+
+    return true;
+}
+
+static bool parseHeaderLine(blackboxDecoder_t *decoder, char *line)
+{
+    char *colon = strchr(line, ':');
+
+    if (!colon) {
+        decoderError(decoder, "Header line without a colon: %.40s", line);
+        return false;
+    }
+
+    *colon = '\0';
+    const char *name = line;
+    const char *value = colon + 1;
+
+    if (!strncmp(name, "Field ", 6) && name[6] && name[7] == ' ') {
+        return parseFieldLine(decoder, name[6], name + 8, value);
+    }
+
+    if (!strcmp(name, "I interval")) {
+        decoder->iInterval = MAX(atoi(value), 1);
+    } else if (!strcmp(name, "P interval")) {
+        unsigned num, denom;
+
+        if (sscanf(value, "%u/%u", &num, &denom) == 2 && num > 0 && denom > 0) {
+            decoder->pIntervalNum = num;
+            decoder->pIntervalDenom = denom;
+        }
+    } else if (!strcmp(name, "P compression")) {
+        decoder->compression = atoi(value);
+    } else if (!strcmp(name, "minthrottle")) {
+        decoder->minthrottle = atoi(value);
+    } else if (!strcmp(name, "vbatref")) {
+        decoder->vbatref = atoi(value);
+    } else if (!strcmp(name, "D interval")) {
+        parseIntList(value, decoder->groupDivider, BLACKBOX_DECODER_GROUP_COUNT);
+    } else if (!strcmp(name, "gyro_rate")) {
+        int numbers[3] = { 0 };
+
+        if (parseIntList(value, numbers, 3) == 3) {
+            decoder->gyroRateSamples = numbers[0];
+            decoder->gyroRateMotors = numbers[2];
+        }
+    }
+
+    return true;
+}
+
+int blackboxDecoderFieldIndex(const blackboxFrameDef_t *def, const char *name)
+{
+    for (int i = 0; i < def->fieldCount; i++) {
+        if (!strcmp(def->names[i], name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool blackboxDecoderOpen(blackboxDecoder_t *decoder, const uint8_t *data, size_t size)
+{
+    static char line[DECODER_MAX_HEADER_LINE];
+
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->data = data;
+    decoder->size = size;
+    decoder->iInterval = 32;
+    decoder->pIntervalNum = 1;
+    decoder->pIntervalDenom = 1;
+
+    // The header is the "H " lines at the start of the log
+    while (decoder->pos + 2 < size && data[decoder->pos] == 'H' && data[decoder->pos + 1] == ' ') {
+        const uint8_t *start = data + decoder->pos + 2;
+        const uint8_t *end = memchr(start, '\n', size - decoder->pos - 2);
+
+        if (!end) {
+            break;
+        }
+
+        const size_t length = end - start;
+        bool printable = length < sizeof(line);
+        for (size_t i = 0; printable && i < length; i++) {
+            printable = start[i] >= ' ' && start[i] < 0x7F;
+        }
+        if (!printable) {
+            // A GPS home frame right after the header
+            break;
+        }
+
+        memcpy(line, start, length);
+        line[length] = '\0';
+
+        if (!parseHeaderLine(decoder, line)) {
+            return false;
+        }
+
+        decoder->pos = end - data + 1;
+    }
+
+    decoder->headerSize = decoder->pos;
+
+    if (decoder->main.fieldCount == 0) {
+        decoderError(decoder, "No main field definitions in the header");
+        return false;
+    }
+
+    decoder->iterationField = blackboxDecoderFieldIndex(&decoder->main, "loopIteration");
+    decoder->timeField = blackboxDecoderFieldIndex(&decoder->main, "time");
+    decoder->motor0Field = blackboxDecoderFieldIndex(&decoder->main, "motor[0]");
+
+    if (decoder->iterationField < 0 || decoder->timeField < 0) {
+        decoderError(decoder, "No loopIteration or time field");
+        return false;
+    }
+
+    if (decoder->gyroRateSamples > BLACKBOX_DECODER_MAX_R_SAMPLES || 3 + decoder->gyroRateMotors > BLACKBOX_DECODER_MAX_R_CHANNELS) {
+        decoderError(decoder, "Gyro rate blocks of %d samples and %d motors are too large", decoder->gyroRateSamples, decoder->gyroRateMotors);
+        return false;
+    }
+
+    resetRice(decoder);
+
+    return true;
+}
+
+long blackboxDecoderFindLog(const uint8_t *data, size_t size, int logNumber)
+{
+    static const char marker[] = "H Product:";
+    const size_t markerLength = strlen(marker);
+
+    for (size_t pos = 0; pos + markerLength <= size; pos++) {
+        if (!memcmp(data + pos, marker, markerLength) && logNumber-- == 0) {
+            return pos;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Frames
+ */
+
+// Like the encoder, see blackboxShouldLogPFrame()
+static bool isLoggedIteration(const blackboxDecoder_t *decoder, uint32_t iteration)
+{
+    const uint32_t pFrameIndex = iteration % decoder->iInterval;
+
+    return pFrameIndex == 0 || (pFrameIndex + decoder->pIntervalNum - 1) % decoder->pIntervalDenom < decoder->pIntervalNum;
+}
+
+static bool decodeMainFrame(blackboxDecoder_t *decoder, bool intraframe, blackboxDecodedFrame_t *frame)
+{
+    const blackboxFrameDef_t *def = &decoder->main;
+    const uint8_t *predictors = intraframe ? def->predictor : def->deltaPredictor;
+    const uint8_t *encodings = intraframe ? def->encoding : def->deltaEncoding;
+    const int32_t *previous = decoder->mainHistory[0];
+    const int32_t *previous2 = decoder->mainHistory[1];
+    int32_t *values = decoder->mainValues;
+
+    if (!intraframe && !decoder->mainValid) {
+        decoderError(decoder, "P frame at %zu without an I frame before it", frame->offset);
+        return false;
+    }
+
+    if (intraframe) {
+        // The Rice coder starts from scratch at every I frame
+        resetRice(decoder);
+    }
+    decoder->riceIndex = 0;
+
+    if (!readFields(decoder, encodings, def->fieldCount, values)) {
+        return false;
+    }
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        const bool isSigned = def->isSigned[i];
+        uint32_t value = values[i];
+
+        switch (predictors[i]) {
+        case FLIGHT_LOG_FIELD_PREDICTOR_0:
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS:
+            value += previous[i];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE:
+            value += 2 * (uint32_t)previous[i] - (uint32_t)previous2[i];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2:
+            if (isSigned) {
+                value += (int32_t)(((int64_t)previous[i] + previous2[i]) / 2);
+            } else {
+                value += (uint32_t)(((uint64_t)(uint32_t)previous[i] + (uint32_t)previous2[i]) / 2);
+            }
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_MINTHROTTLE:
+            value += decoder->minthrottle;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0:
+            if (decoder->motor0Field < 0 || decoder->motor0Field >= i) {
+                decoderError(decoder, "Field %s is predicted from a missing motor[0]", def->names[i]);
+                return false;
+            }
+            value += values[decoder->motor0Field];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_INC: {
+            uint32_t iteration = decoder->lastIteration + 1;
+
+            while (!isLoggedIteration(decoder, iteration)) {
+                iteration++;
+            }
+            value += iteration;
+            break;
+        }
+        case FLIGHT_LOG_FIELD_PREDICTOR_1500:
+            value += 1500;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_VBATREF:
+            value += decoder->vbatref;
+            break;
+        default:
+            decoderError(decoder, "Unknown predictor %d for main field %s", predictors[i], def->names[i]);
+            return false;
+        }
+
+        values[i] = value;
+    }
+
+    memcpy(decoder->mainHistory[1], intraframe ? values : decoder->mainHistory[0], sizeof(decoder->mainHistory[1]));
+    memcpy(decoder->mainHistory[0], values, sizeof(decoder->mainHistory[0]));
+    decoder->mainValid = true;
+    decoder->lastIteration = values[decoder->iterationField];
+    decoder->lastTime = values[decoder->timeField];
+
+    frame->values = values;
+    frame->valueCount = def->fieldCount;
+    frame->iteration = decoder->lastIteration;
+
+    return true;
+}
+
+/*
+ * Slow and GPS frames have no previous frame to predict from, so like in the log viewers
+ * the previous predictor does nothing for them.
+ */
+static bool decodeSimpleFrame(blackboxDecoder_t *decoder, const blackboxFrameDef_t *def, int32_t *values, blackboxDecodedFrame_t *frame)
+{
+    int homeCoord = 0;
+
+    if (def->fieldCount == 0) {
+        decoderError(decoder, "Frame %c at %zu has no field definitions", frame->type, frame->offset);
+        return false;
+    }
+
+    if (!readFields(decoder, def->encoding, def->fieldCount, values)) {
+        return false;
+    }
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        switch (def->predictor[i]) {
+        case FLIGHT_LOG_FIELD_PREDICTOR_0:
+        case FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS:
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD:
+            values[i] += decoder->gpsHValues[MIN(homeCoord, 1)];
+            homeCoord++;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_LAST_MAIN_FRAME_TIME:
+            values[i] += decoder->lastTime;
+            break;
+        default:
+            decoderError(decoder, "Unknown predictor %d for %c field %s", def->predictor[i], frame->type, def->names[i]);
+            return false;
+        }
+    }
+
+    frame->values = values;
+    frame->valueCount = def->fieldCount;
+
+    return true;
+}
+
+// A "D" frame holds the absolute values of one group's fields, a "d" frame their changes
+static bool decodeGroupFrame(blackboxDecoder_t *decoder, bool intraframe, blackboxDecodedFrame_t *frame)
+{
+    const blackboxFrameDef_t *def = &decoder->group;
+    uint8_t encodings[BLACKBOX_DECODER_MAX_FIELDS];
+    int32_t raw[BLACKBOX_DECODER_MAX_FIELDS];
+    int fields[BLACKBOX_DECODER_MAX_FIELDS];
+    int count = 0;
+
+    const int group = readUnsignedVB(decoder);
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        if (decoder->fieldGroup[i] == group) {
+            encodings[count] = intraframe ? def->encoding[i] : def->deltaEncoding[i];
+            fields[count++] = i;
+        }
+    }
+
+    if (count == 0) {
+        decoderError(decoder, "Group frame at %zu for group %d, which has no fields", frame->offset, group);
+        return false;
+    }
+
+    if (!readFields(decoder, encodings, count, raw)) {
+        return false;
+    }
+
+    for (int j = 0; j < count; j++) {
+        const int i = fields[j];
+        const uint8_t predictor = intraframe ? def->predictor[i] : def->deltaPredictor[i];
+
+        switch (predictor) {
+        case FLIGHT_LOG_FIELD_PREDICTOR_0:
+            decoder->groupValues[i] = raw[j];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS:
+            decoder->groupValues[i] += raw[j];
+            break;
+        default:
+            decoderError(decoder, "Unknown predictor %d for group field %s", predictor, def->names[i]);
+            return false;
+        }
+    }
+
+    frame->group = group;
+    frame->values = decoder->groupValues;
+    frame->valueCount = def->fieldCount;
+
+    return true;
+}
+
+static bool decodeEventFrame(blackboxDecoder_t *decoder, blackboxDecodedFrame_t *frame)
+{
+    frame->event = readByte(decoder);
+
+    switch (frame->event) {
+    case FLIGHT_LOG_EVENT_SYNC_BEEP:
+    case FLIGHT_LOG_EVENT_IMU_FAILURE:
+        frame->eventData[0] = readUnsignedVB(decoder);
+        break;
+    case FLIGHT_LOG_EVENT_FLIGHTMODE:
+        frame->eventData[0] = readUnsignedVB(decoder);
+        frame->eventData[1] = readUnsignedVB(decoder);
+        break;
+    case FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT:
+        frame->eventData[0] = readByte(decoder);
+        if (frame->eventData[0] & FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT_FUNCTION_FLOAT_VALUE_FLAG) {
+            for (int b = 0; b < 4; b++) {
+                frame->eventData[1] |= (uint32_t)readByte(decoder) << (8 * b);
+            }
+        } else {
+            frame->eventData[1] = readSignedVB(decoder);
+        }
+        break;
+    case FLIGHT_LOG_EVENT_LOGGING_RESUME:
+        // The iterations and time skipped while paused
+        frame->eventData[0] = readUnsignedVB(decoder);
+        frame->eventData[1] = readUnsignedVB(decoder);
+        decoder->lastIteration = frame->eventData[0];
+        decoder->lastTime = frame->eventData[1];
+        break;
+    case FLIGHT_LOG_EVENT_LOG_END:
+        // A message, then a zero byte
+        while (readByte(decoder) != 0 && !decoder->overrun) {
+        }
+        decoder->ended = true;
+        break;
+    default:
+        decoderError(decoder, "Unknown event %d at %zu", frame->event, frame->offset);
+        return false;
+    }
+
+    return true;
+}
+
+// An "R" frame holds a block of gyro rate samples, see writeGyroRateFrame()
+static bool decodeGyroRateFrame(blackboxDecoder_t *decoder, blackboxDecodedFrame_t *frame)
+{
+    const int channels = 3 + decoder->gyroRateMotors;
+
+    if (decoder->gyroRateSamples == 0) {
+        decoderError(decoder, "R frame at %zu without a gyro_rate header", frame->offset);
+        return false;
+    }
+
+    frame->rStartTime = readUnsignedVB(decoder);
+    frame->rEndTime = frame->rStartTime + readUnsignedVB(decoder);
+    frame->rSampleCount = readUnsignedVB(decoder);
+
+    if (frame->rSampleCount < 1 || frame->rSampleCount > BLACKBOX_DECODER_MAX_R_SAMPLES) {
+        decoderError(decoder, "R frame at %zu with %d samples", frame->offset, frame->rSampleCount);
+        return false;
+    }
+
+    for (int channel = 0; channel < channels; channel++) {
+        frame->rSamples[0][channel] = readSignedVB(decoder);
+
+        if (frame->rSampleCount == 1) {
+            continue;
+        }
+
+        const int32_t minDelta = readSignedVB(decoder);
+        const int width = readByte(decoder);
+        bitReader_t reader = { .decoder = decoder };
+
+        if (width > 32) {
+            decoderError(decoder, "R frame at %zu with %d bit deltas", frame->offset, width);
+            return false;
+        }
+
+        for (int i = 1; i < frame->rSampleCount; i++) {
+            const uint32_t delta = width ? readBits(&reader, width) : 0;
+            frame->rSamples[i][channel] = frame->rSamples[i - 1][channel] + minDelta + (int32_t)delta;
+        }
+    }
+
+    return true;
+}
+
+static bool isFrameType(uint8_t c)
+{
+    return c && strchr("IPSGHDdER", c);
+}
+
+int blackboxDecoderNext(blackboxDecoder_t *decoder, blackboxDecodedFrame_t *frame)
+{
+    if (decoder->ended || decoder->pos >= decoder->size) {
+        return 0;
+    }
+
+    memset(frame, 0, offsetof(blackboxDecodedFrame_t, rSamples));
+    frame->offset = decoder->pos;
+    frame->type = readByte(decoder);
+    frame->iteration = decoder->lastIteration;
+
+    bool ok;
+    switch (frame->type) {
+    case 'I':
+    case 'P':
+        ok = decodeMainFrame(decoder, frame->type == 'I', frame);
+        break;
+    case 'S':
+        ok = decodeSimpleFrame(decoder, &decoder->slow, decoder->slowValues, frame);
+        break;
+    case 'H':
+        ok = decodeSimpleFrame(decoder, &decoder->gpsH, decoder->gpsHValues, frame);
+        break;
+    case 'G':
+        ok = decodeSimpleFrame(decoder, &decoder->gpsG, decoder->gpsGValues, frame);
+        break;
+    case 'D':
+    case 'd':
+        ok = decodeGroupFrame(decoder, frame->type == 'D', frame);
+        break;
+    case 'E':
+        ok = decodeEventFrame(decoder, frame);
+        break;
+    case 'R':
+        ok = decodeGyroRateFrame(decoder, frame);
+        break;
+    default:
+        decoderError(decoder, "Unknown frame type 0x%02x at %zu", frame->type, frame->offset);
+        return -1;
+    }
+
+    if (!ok) {
+        return -1;
+    }
+
+    if (decoder->overrun) {
+        decoderError(decoder, "Frame %c at %zu runs past the end of the log", frame->type, frame->offset);
+        return -1;
+    }
+
+    frame->size = decoder->pos - frame->offset;
+
+    // A frame of the wrong size leaves the stream somewhere in the middle of the next one
+    if (!decoder->ended && decoder->pos < decoder->size && !isFrameType(decoder->data[decoder->pos])) {
+        decoderError(decoder, "Frame %c at %zu is followed by 0x%02x, not a frame", frame->type, frame->offset, decoder->data[decoder->pos]);
+        return -1;
+    }
+
+    return 1;
+}
@@ -0,0 +1,145 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reference decoder for the blackbox logs written by blackbox.c. It reads one log from
+ * memory, the header first and then one frame at a time, and keeps the predictor state
+ * the way a log viewer would. It is written from the log format, not from the encoder,
+ * so that the two can be checked against each other.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLACKBOX_DECODER_MAX_FIELDS         192
+#define BLACKBOX_DECODER_MAX_NAME           32
+#define BLACKBOX_DECODER_MAX_R_SAMPLES      64
+#define BLACKBOX_DECODER_MAX_R_CHANNELS     16
+#define BLACKBOX_DECODER_GROUP_COUNT        8
+#define BLACKBOX_DECODER_RICE_CONTEXTS      128
+
+// The fields of one frame type, as defined by the "H Field X ..." header lines
+typedef struct blackboxFrameDef_s {
+    int fieldCount;
+    char names[BLACKBOX_DECODER_MAX_FIELDS][BLACKBOX_DECODER_MAX_NAME];
+    uint8_t isSigned[BLACKBOX_DECODER_MAX_FIELDS];
+    uint8_t predictor[BLACKBOX_DECODER_MAX_FIELDS];
+    uint8_t encoding[BLACKBOX_DECODER_MAX_FIELDS];
+    // The second predictor and encoding lines: "P" for the "I" fields and "d" for the "D" fields
+    uint8_t deltaPredictor[BLACKBOX_DECODER_MAX_FIELDS];
+    uint8_t deltaEncoding[BLACKBOX_DECODER_MAX_FIELDS];
+} blackboxFrameDef_t;
+
+typedef struct blackboxDecodedFrame_s {
+    char type;                      // 'I', 'P', 'S', 'G', 'H', 'D', 'd', 'E' or 'R'
+    size_t offset;                  // Of the frame in the log
+    size_t size;                    // In bytes
+
+    /*
+     * The decoded values, in the order of the fields of the frame type. "D" and "d" frames
+     * give every group field, only those of the frame's group are new.
+     */
+    const int32_t *values;
+    int valueCount;
+
+    uint32_t iteration;             // Of the main frame this frame follows, or of an "I" or "P" frame itself
+    int group;                      // Of a "D" or "d" frame
+
+    uint8_t event;                  // Of an "E" frame
+    uint32_t eventData[2];
+
+    // Of an "R" frame: the start time, the end time and samples[sample][channel]
+    uint32_t rStartTime;
+    uint32_t rEndTime;
+    int rSampleCount;
+    int16_t rSamples[BLACKBOX_DECODER_MAX_R_SAMPLES][BLACKBOX_DECODER_MAX_R_CHANNELS];
+} blackboxDecodedFrame_t;
+
+typedef struct blackboxRiceState_s {
+    uint32_t sum;
+    uint32_t count;
+} blackboxRiceState_t;
+
+typedef struct blackboxDecoder_s {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    size_t headerSize;
+    bool overrun;                   // Read past the end of the data
+    char error[128];
+
+    blackboxFrameDef_t main;        // "I" fields, with the "P" predictors and encodings as the delta ones
+    blackboxFrameDef_t slow;
+    blackboxFrameDef_t gpsG;
+    blackboxFrameDef_t gpsH;
+    blackboxFrameDef_t group;       // "D" fields, with the "d" predictors and encodings as the delta ones
+    uint8_t fieldGroup[BLACKBOX_DECODER_MAX_FIELDS];
+    int groupDivider[BLACKBOX_DECODER_GROUP_COUNT];
+
+    uint32_t iInterval;
+    uint32_t pIntervalNum;
+    uint32_t pIntervalDenom;
+    int32_t minthrottle;
+    int32_t vbatref;
+    int compression;
+    int gyroRateSamples;            // From "H gyro_rate", 0 when there are no "R" frames
+    int gyroRateMotors;
+
+    // Indexes of the main fields some predictors need
+    int iterationField;
+    int timeField;
+    int motor0Field;
+
+    // Predictor state
+    int32_t mainHistory[2][BLACKBOX_DECODER_MAX_FIELDS];
+    bool mainValid;
+    uint32_t lastIteration;
+    uint32_t lastTime;
+    int32_t mainValues[BLACKBOX_DECODER_MAX_FIELDS];
+    int32_t slowValues[BLACKBOX_DECODER_MAX_FIELDS];
+    int32_t gpsGValues[BLACKBOX_DECODER_MAX_FIELDS];
+    int32_t gpsHValues[BLACKBOX_DECODER_MAX_FIELDS];
+    int32_t groupValues[BLACKBOX_DECODER_MAX_FIELDS];
+    blackboxRiceState_t rice[BLACKBOX_DECODER_RICE_CONTEXTS];
+    int riceIndex;
+    bool ended;
+} blackboxDecoder_t;
+
+/*
+ * Reads the header of the log at the start of data. Returns false with the reason in
+ * decoder->error if it is not a log this decoder understands.
+ */
+bool blackboxDecoderOpen(blackboxDecoder_t *decoder, const uint8_t *data, size_t size);
+
+/*
+ * Decodes the next frame. Returns 1 for a frame, 0 at the end of the log and -1 when the
+ * log is corrupt, with the reason in decoder->error. The frame's values stay valid until
+ * the next call.
+ */
+int blackboxDecoderNext(blackboxDecoder_t *decoder, blackboxDecodedFrame_t *frame);
+
+// The index of the named field, like "gyroADC[0]", or -1
+int blackboxDecoderFieldIndex(const blackboxFrameDef_t *def, const char *name);
+
+/*
+ * Finds the start of the logNumber'th log (from 0) of a file which may hold several, or
+ * returns -1 when there are fewer logs.
+ */
+long blackboxDecoderFindLog(const uint8_t *data, size_t size, int logNumber);
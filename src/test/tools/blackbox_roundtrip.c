@@ -0,0 +1,1733 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Blackbox encoder round trip test. The firmware's blackbox.c logs a sequence of flight
+ * controller states, generated or taken from a recorded log, into memory. The log is read
+ * back with the reference decoder in blackbox_decoder.c and every decoded value is checked
+ * against the state it was logged from. The encoded size and the encoder time per frame
+ * are reported as well. See docs/development/Blackbox round trip.md
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ROUNDTRIP_HAVE_TSC
+#endif
+
+#include "platform.h"
+
+#include "blackbox/blackbox.h"
+#include "blackbox/blackbox_fielddefs.h"
+#include "blackbox/blackbox_io.h"
+
+#include "build/debug.h"
+#include "build/version.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/printf.h"
+#include "common/time.h"
+#include "common/utils.h"
+
+#include "config/feature.h"
+
+#include "drivers/pwm_output.h"
+
+#include "fc/config.h"
+#include "fc/controlrate_profile.h"
+#include "fc/fc_core.h"
+#include "fc/rc_controls.h"
+#include "fc/rc_modes.h"
+#include "fc/rc_smoothing.h"
+#include "fc/runtime_config.h"
+#include "fc/settings.h"
+
+#include "flight/failsafe.h"
+#include "flight/imu.h"
+#include "flight/mixer.h"
+#include "flight/pid.h"
+#include "flight/servos.h"
+
+#include "io/beeper.h"
+#include "io/gps.h"
+
+#include "navigation/navigation.h"
+
+#include "rx/rx.h"
+
+#include "sensors/acceleration.h"
+#include "sensors/barometer.h"
+#include "sensors/battery.h"
+#include "sensors/compass.h"
+#include "sensors/diagnostics.h"
+#include "sensors/gyro.h"
+#include "sensors/pitotmeter.h"
+#include "sensors/rangefinder.h"
+#include "sensors/sensors.h"
+#include "sensors/temperature.h"
+
+#include "blackbox_decoder.h"
+
+#define ROUNDTRIP_DEFAULT_LOOPTIME      1000
+#define ROUNDTRIP_DEFAULT_MOTORS        4
+#define ROUNDTRIP_DEFAULT_SERVOS        0
+#define ROUNDTRIP_START_TIME_US         1000000     // The header is written before this
+#define ROUNDTRIP_ACC_1G                4096
+#define ROUNDTRIP_MAX_CONFIG            512
+#define ROUNDTRIP_MAX_REPORTED          10
+
+typedef enum {
+    SOURCE_INT16 = 0,
+    SOURCE_UINT16,
+    SOURCE_INT32,                   // Or uint32_t, compared as the same bits
+    SOURCE_UINT8,
+    SOURCE_FLOAT,                   // Logged with lrintf()
+    SOURCE_FLOAT_DECI,              // Logged as lrintf(value / 10)
+    SOURCE_FLOAT_ACC,               // In g, logged as lrintf(value * acc_1G)
+    SOURCE_GPS_ALTITUDE,            // In cm, logged in m
+    SOURCE_NONE,                    // Not in the FC state of this build, always 0
+} roundtripSource_e;
+
+/*
+ * A field of the log and the FC state it is logged from. Generated values move between min and max, and only
+ * change every hold iterations like a sensor which is read slower than the loop.
+ */
+typedef struct {
+    const char *name;
+    roundtripSource_e source;
+    void *variable;
+    int32_t min;
+    int32_t max;
+    uint16_t hold;
+} roundtripField_t;
+
+typedef struct {
+    uint32_t stepCount;
+    uint32_t *time;
+    int32_t *values;                // stepCount rows, one value for each of roundtripFields
+} roundtripInput_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t bytes;
+} roundtripFrameStats_t;
+
+typedef struct {
+    const char *name;
+    void *field;
+    uint8_t size;
+    int32_t min;
+    int32_t max;
+    const char * const *values;         // names of table values, NULL for numeric settings
+} roundtripSetting_t;
+
+/*
+ * Firmware state normally owned by the sensors, the PID controllers, the mixer, the RX and navigation
+ */
+gyro_t gyro;
+acc_t acc;
+mag_t mag;
+baro_t baro;
+attitudeEulerAngles_t attitude;
+
+int32_t axisPID_P[FLIGHT_DYNAMICS_INDEX_COUNT];
+int32_t axisPID_I[FLIGHT_DYNAMICS_INDEX_COUNT];
+int32_t axisPID_D[FLIGHT_DYNAMICS_INDEX_COUNT];
+int32_t axisPID_F[FLIGHT_DYNAMICS_INDEX_COUNT];
+int32_t axisPID_Setpoint[FLIGHT_DYNAMICS_INDEX_COUNT];
+
+int16_t motor[MAX_SUPPORTED_MOTORS];
+int16_t servo[MAX_SUPPORTED_SERVOS];
+int16_t rcCommand[4];
+
+int32_t debug[DEBUG32_VALUE_COUNT];
+uint8_t debugMode;
+
+uint32_t armingFlags;
+uint32_t flightModeFlags;
+uint32_t stateFlags;
+boxBitmask_t rcModeActivationMask;
+
+gpsLocation_t GPS_home;
+gpsSolutionData_t gpsSol;
+
+int16_t navCurrentState;
+int16_t navActualVelocity[3];
+int16_t navDesiredVelocity[3];
+int32_t navTargetPosition[3];
+int32_t navLatestActualPosition[3];
+uint16_t navDesiredHeading;
+int16_t navActualSurface;
+uint16_t navFlags;
+uint16_t navEPH;
+uint16_t navEPV;
+int16_t navAccNEU[3];
+
+static controlRateConfig_t controlRateProfile;
+const controlRateConfig_t *currentControlRateProfile = &controlRateProfile;
+static batteryProfile_t batteryProfile;
+const batteryProfile_t *currentBatteryProfile = &batteryProfile;
+static pidProfile_t pidProfileStorage;
+pidProfile_t *pidProfile_ProfileCurrent = &pidProfileStorage;
+
+accelerometerConfig_t accelerometerConfig_System;
+barometerConfig_t barometerConfig_System;
+batteryMetersConfig_t batteryMetersConfig_System;
+compassConfig_t compassConfig_System;
+featureConfig_t featureConfig_System;
+gyroConfig_t gyroConfig_System;
+motorConfig_t motorConfig_System;
+rcControlsConfig_t rcControlsConfig_System;
+rxConfig_t rxConfig_System;
+systemConfig_t systemConfig_System;
+
+extern const blackboxConfig_t pgResetTemplate_blackboxConfig;
+
+const char * const targetName = "ROUNDTRIP";
+const char * const shortGitRevision = "0000000";
+const char * const buildDate = "Jan  1 2000";
+const char * const buildTime = "00:00:00";
+
+// Owned by blackbox_io.c
+int32_t blackboxHeaderBudget;
+
+// FC state which is only reached through functions
+static navigationPIDControllers_t navPids;
+static int16_t rcChannels[4];
+static uint16_t batteryRawVoltage;
+static int16_t amperage;
+static float airSpeed;
+static int32_t surfaceRaw;
+static uint16_t rssi;
+static float accVibration;
+static uint8_t activeWpNumber;
+static int32_t failsafePhaseValue;
+static uint8_t rxSignalReceived;
+static uint8_t rxFlightChannelsValid;
+static uint16_t rxUpdateRate;
+static int32_t hwHealthStatus;
+static uint16_t powerSupplyImpedance;
+static uint16_t sagCompensatedVBat;
+static int16_t imuTemperature;
+static int16_t baroTemperature;
+
+STATIC_ASSERT(sizeof(gpsSol.fixType) == sizeof(int32_t), gps_fix_type_is_not_32_bits);
+
+static const roundtripField_t roundtripFields[] = {
+    // Main fields
+    { "axisRate[0]",        SOURCE_INT32,       &axisPID_Setpoint[0],           -600,   600,    1 },
+    { "axisRate[1]",        SOURCE_INT32,       &axisPID_Setpoint[1],           -600,   600,    1 },
+    { "axisRate[2]",        SOURCE_INT32,       &axisPID_Setpoint[2],           -400,   400,    1 },
+    { "axisP[0]",           SOURCE_INT32,       &axisPID_P[0],                  -500,   500,    1 },
+    { "axisP[1]",           SOURCE_INT32,       &axisPID_P[1],                  -500,   500,    1 },
+    { "axisP[2]",           SOURCE_INT32,       &axisPID_P[2],                  -500,   500,    1 },
+    { "axisI[0]",           SOURCE_INT32,       &axisPID_I[0],                  -200,   200,    1 },
+    { "axisI[1]",           SOURCE_INT32,       &axisPID_I[1],                  -200,   200,    1 },
+    { "axisI[2]",           SOURCE_INT32,       &axisPID_I[2],                  -200,   200,    1 },
+    { "axisD[0]",           SOURCE_INT32,       &axisPID_D[0],                  -300,   300,    1 },
+    { "axisD[1]",           SOURCE_INT32,       &axisPID_D[1],                  -300,   300,    1 },
+    { "axisD[2]",           SOURCE_INT32,       &axisPID_D[2],                  -300,   300,    1 },
+    { "axisF[0]",           SOURCE_INT32,       &axisPID_F[0],                  -300,   300,    1 },
+    { "axisF[1]",           SOURCE_INT32,       &axisPID_F[1],                  -300,   300,    1 },
+    { "axisF[2]",           SOURCE_INT32,       &axisPID_F[2],                  -300,   300,    1 },
+
+    { "fwAltP",             SOURCE_FLOAT,       &navPids.fw_alt.proportional,   -450,   450,    10 },
+    { "fwAltI",             SOURCE_FLOAT,       &navPids.fw_alt.integral,       -450,   450,    10 },
+    { "fwAltD",             SOURCE_FLOAT,       &navPids.fw_alt.derivative,     -450,   450,    10 },
+    { "fwAltOut",           SOURCE_FLOAT,       &navPids.fw_alt.output_constrained, -450, 450,  10 },
+    { "fwPosP",             SOURCE_FLOAT_DECI,  &navPids.fw_nav.proportional,   -450,   450,    10 },
+    { "fwPosI",             SOURCE_FLOAT_DECI,  &navPids.fw_nav.integral,       -450,   450,    10 },
+    { "fwPosD",             SOURCE_FLOAT_DECI,  &navPids.fw_nav.derivative,     -450,   450,    10 },
+    { "fwPosOut",           SOURCE_FLOAT_DECI,  &navPids.fw_nav.output_constrained, -450, 450,  10 },
+
+    { "mcPosAxisP[0]",      SOURCE_FLOAT,       &navPids.pos[0].output_constrained, -500, 500,  10 },
+    { "mcPosAxisP[1]",      SOURCE_FLOAT,       &navPids.pos[1].output_constrained, -500, 500,  10 },
+    { "mcPosAxisP[2]",      SOURCE_FLOAT,       &navPids.pos[2].output_constrained, -500, 500,  10 },
+    { "mcVelAxisP[0]",      SOURCE_FLOAT,       &navPids.vel[0].proportional,   -1000,  1000,   10 },
+    { "mcVelAxisP[1]",      SOURCE_FLOAT,       &navPids.vel[1].proportional,   -1000,  1000,   10 },
+    { "mcVelAxisP[2]",      SOURCE_FLOAT,       &navPids.vel[2].proportional,   -1000,  1000,   10 },
+    { "mcVelAxisI[0]",      SOURCE_FLOAT,       &navPids.vel[0].integral,       -1000,  1000,   10 },
+    { "mcVelAxisI[1]",      SOURCE_FLOAT,       &navPids.vel[1].integral,       -1000,  1000,   10 },
+    { "mcVelAxisI[2]",      SOURCE_FLOAT,       &navPids.vel[2].integral,       -1000,  1000,   10 },
+    { "mcVelAxisD[0]",      SOURCE_FLOAT,       &navPids.vel[0].derivative,     -1000,  1000,   10 },
+    { "mcVelAxisD[1]",      SOURCE_FLOAT,       &navPids.vel[1].derivative,     -1000,  1000,   10 },
+    { "mcVelAxisD[2]",      SOURCE_FLOAT,       &navPids.vel[2].derivative,     -1000,  1000,   10 },
+    { "mcVelAxisFF[0]",     SOURCE_FLOAT,       &navPids.vel[0].feedForward,    -1000,  1000,   10 },
+    { "mcVelAxisFF[1]",     SOURCE_FLOAT,       &navPids.vel[1].feedForward,    -1000,  1000,   10 },
+    { "mcVelAxisFF[2]",     SOURCE_FLOAT,       &navPids.vel[2].feedForward,    -1000,  1000,   10 },
+    { "mcVelAxisOut[0]",    SOURCE_FLOAT,       &navPids.vel[0].output_constrained, -1000, 1000, 10 },
+    { "mcVelAxisOut[1]",    SOURCE_FLOAT,       &navPids.vel[1].output_constrained, -1000, 1000, 10 },
+    { "mcVelAxisOut[2]",    SOURCE_FLOAT,       &navPids.vel[2].output_constrained, -1000, 1000, 10 },
+    { "mcSurfaceP",         SOURCE_FLOAT_DECI,  &navPids.surface.proportional,  -500,   500,    10 },
+    { "mcSurfaceI",         SOURCE_FLOAT_DECI,  &navPids.surface.integral,      -500,   500,    10 },
+    { "mcSurfaceD",         SOURCE_FLOAT_DECI,  &navPids.surface.derivative,    -500,   500,    10 },
+    { "mcSurfaceOut",       SOURCE_FLOAT_DECI,  &navPids.surface.output_constrained, -500, 500, 10 },
+
+    { "rcData[0]",          SOURCE_INT16,       &rcChannels[0],                 1000,   2000,   20 },
+    { "rcData[1]",          SOURCE_INT16,       &rcChannels[1],                 1000,   2000,   20 },
+    { "rcData[2]",          SOURCE_INT16,       &rcChannels[2],                 1000,   2000,   20 },
+    { "rcData[3]",          SOURCE_INT16,       &rcChannels[3],                 1000,   2000,   20 },
+    { "rcCommand[0]",       SOURCE_INT16,       &rcCommand[0],                  -500,   500,    1 },
+    { "rcCommand[1]",       SOURCE_INT16,       &rcCommand[1],                  -500,   500,    1 },
+    { "rcCommand[2]",       SOURCE_INT16,       &rcCommand[2],                  -500,   500,    1 },
+    { "rcCommand[3]",       SOURCE_INT16,       &rcCommand[3],                  1000,   2000,   1 },
+
+    { "vbat",               SOURCE_UINT16,      &batteryRawVoltage,             1400,   1700,   10 },
+    { "amperage",           SOURCE_INT16,       &amperage,                      0,      3000,   10 },
+    { "magADC[0]",          SOURCE_FLOAT,       &mag.magADC[0],                 -2000,  2000,   13 },
+    { "magADC[1]",          SOURCE_FLOAT,       &mag.magADC[1],                 -2000,  2000,   13 },
+    { "magADC[2]",          SOURCE_FLOAT,       &mag.magADC[2],                 -2000,  2000,   13 },
+    { "BaroAlt",            SOURCE_INT32,       &baro.BaroAlt,                  -1000,  50000,  20 },
+    { "AirSpeed",           SOURCE_FLOAT,       &airSpeed,                      0,      4000,   10 },
+    { "surfaceRaw",         SOURCE_INT32,       &surfaceRaw,                    -1,     400,    25 },
+    { "rssi",               SOURCE_UINT16,      &rssi,                          0,      1023,   50 },
+
+    { "gyroADC[0]",         SOURCE_FLOAT,       &gyro.gyroADCf[0],              -2000,  2000,   1 },
+    { "gyroADC[1]",         SOURCE_FLOAT,       &gyro.gyroADCf[1],              -2000,  2000,   1 },
+    { "gyroADC[2]",         SOURCE_FLOAT,       &gyro.gyroADCf[2],              -1000,  1000,   1 },
+    { "gyroRaw[0]",         SOURCE_FLOAT,       &gyro.gyroRaw[0],               -2000,  2000,   1 },
+    { "gyroRaw[1]",         SOURCE_FLOAT,       &gyro.gyroRaw[1],               -2000,  2000,   1 },
+    { "gyroRaw[2]",         SOURCE_FLOAT,       &gyro.gyroRaw[2],               -1000,  1000,   1 },
+    { "gyroPeakRoll[0]",    SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakRoll[1]",    SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakRoll[2]",    SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakPitch[0]",   SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakPitch[1]",   SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakPitch[2]",   SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakYaw[0]",     SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakYaw[1]",     SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "gyroPeakYaw[2]",     SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "accSmooth[0]",       SOURCE_FLOAT_ACC,   &acc.accADCf[0],                -16000, 16000,  1 },
+    { "accSmooth[1]",       SOURCE_FLOAT_ACC,   &acc.accADCf[1],                -16000, 16000,  1 },
+    { "accSmooth[2]",       SOURCE_FLOAT_ACC,   &acc.accADCf[2],                -16000, 16000,  1 },
+    { "accVib",             SOURCE_FLOAT_ACC,   &accVibration,                  0,      8000,   1 },
+    { "attitude[0]",        SOURCE_INT16,       &attitude.raw[0],               -1800,  1800,   1 },
+    { "attitude[1]",        SOURCE_INT16,       &attitude.raw[1],               -900,   900,    1 },
+    { "attitude[2]",        SOURCE_INT16,       &attitude.raw[2],               0,      3599,   1 },
+
+    { "debug[0]",           SOURCE_INT32,       &debug[0],                      -1000,  1000,   1 },
+    { "debug[1]",           SOURCE_INT32,       &debug[1],                      -1000,  1000,   1 },
+    { "debug[2]",           SOURCE_INT32,       &debug[2],                      0,      100000, 1 },
+    { "debug[3]",           SOURCE_INT32,       &debug[3],                      0,      100000, 1 },
+    { "debug[4]",           SOURCE_INT32,       &debug[4],                      -2000000000, 2000000000, 1 },
+    { "debug[5]",           SOURCE_INT32,       &debug[5],                      -2000000000, 2000000000, 1 },
+    { "debug[6]",           SOURCE_INT32,       &debug[6],                      INT32_MIN, INT32_MAX, 1 },
+    { "debug[7]",           SOURCE_INT32,       &debug[7],                      INT32_MIN, INT32_MAX, 7 },
+
+    { "motor[0]",           SOURCE_INT16,       &motor[0],                      1000,   2000,   1 },
+    { "motor[1]",           SOURCE_INT16,       &motor[1],                      1000,   2000,   1 },
+    { "motor[2]",           SOURCE_INT16,       &motor[2],                      1000,   2000,   1 },
+    { "motor[3]",           SOURCE_INT16,       &motor[3],                      1000,   2000,   1 },
+    { "motor[4]",           SOURCE_INT16,       &motor[4],                      1000,   2000,   1 },
+    { "motor[5]",           SOURCE_INT16,       &motor[5],                      1000,   2000,   1 },
+    { "motor[6]",           SOURCE_INT16,       &motor[6],                      1000,   2000,   1 },
+    { "motor[7]",           SOURCE_INT16,       &motor[7],                      1000,   2000,   1 },
+    { "motor[8]",           SOURCE_INT16,       &motor[8],                      1000,   2000,   1 },
+    { "motor[9]",           SOURCE_INT16,       &motor[9],                      1000,   2000,   1 },
+    { "motor[10]",          SOURCE_INT16,       &motor[10],                     1000,   2000,   1 },
+    { "motor[11]",          SOURCE_INT16,       &motor[11],                     1000,   2000,   1 },
+
+    { "servo[0]",           SOURCE_INT16,       &servo[0],                      1000,   2000,   1 },
+    { "servo[1]",           SOURCE_INT16,       &servo[1],                      1000,   2000,   1 },
+    { "servo[2]",           SOURCE_INT16,       &servo[2],                      1000,   2000,   1 },
+    { "servo[3]",           SOURCE_INT16,       &servo[3],                      1000,   2000,   1 },
+    { "servo[4]",           SOURCE_INT16,       &servo[4],                      1000,   2000,   1 },
+    { "servo[5]",           SOURCE_INT16,       &servo[5],                      1000,   2000,   1 },
+    { "servo[6]",           SOURCE_INT16,       &servo[6],                      1000,   2000,   1 },
+    { "servo[7]",           SOURCE_INT16,       &servo[7],                      1000,   2000,   1 },
+    { "servo[8]",           SOURCE_INT16,       &servo[8],                      1000,   2000,   1 },
+    { "servo[9]",           SOURCE_INT16,       &servo[9],                      1000,   2000,   1 },
+    { "servo[10]",          SOURCE_INT16,       &servo[10],                     1000,   2000,   1 },
+    { "servo[11]",          SOURCE_INT16,       &servo[11],                     1000,   2000,   1 },
+    { "servo[12]",          SOURCE_INT16,       &servo[12],                     1000,   2000,   1 },
+    { "servo[13]",          SOURCE_INT16,       &servo[13],                     1000,   2000,   1 },
+    { "servo[14]",          SOURCE_INT16,       &servo[14],                     1000,   2000,   1 },
+    { "servo[15]",          SOURCE_INT16,       &servo[15],                     1000,   2000,   1 },
+    { "servo[16]",          SOURCE_INT16,       &servo[16],                     1000,   2000,   1 },
+    { "servo[17]",          SOURCE_INT16,       &servo[17],                     1000,   2000,   1 },
+
+    { "navState",           SOURCE_INT16,       &navCurrentState,               0,      40,     500 },
+    { "navFlags",           SOURCE_UINT16,      &navFlags,                      0,      0xFFFF, 300 },
+    { "navEPH",             SOURCE_UINT16,      &navEPH,                        0,      5000,   100 },
+    { "navEPV",             SOURCE_UINT16,      &navEPV,                        0,      5000,   100 },
+    { "navPos[0]",          SOURCE_INT32,       &navLatestActualPosition[0],    -100000, 100000, 1 },
+    { "navPos[1]",          SOURCE_INT32,       &navLatestActualPosition[1],    -100000, 100000, 1 },
+    { "navPos[2]",          SOURCE_INT32,       &navLatestActualPosition[2],    -1000,  50000,  1 },
+    { "navVel[0]",          SOURCE_INT16,       &navActualVelocity[0],          -3000,  3000,   1 },
+    { "navVel[1]",          SOURCE_INT16,       &navActualVelocity[1],          -3000,  3000,   1 },
+    { "navVel[2]",          SOURCE_INT16,       &navActualVelocity[2],          -1000,  1000,   1 },
+    { "navTgtVel[0]",       SOURCE_INT16,       &navDesiredVelocity[0],         -3000,  3000,   1 },
+    { "navTgtVel[1]",       SOURCE_INT16,       &navDesiredVelocity[1],         -3000,  3000,   1 },
+    { "navTgtVel[2]",       SOURCE_INT16,       &navDesiredVelocity[2],         -1000,  1000,   1 },
+    { "navTgtPos[0]",       SOURCE_INT32,       &navTargetPosition[0],          -100000, 100000, 200 },
+    { "navTgtPos[1]",       SOURCE_INT32,       &navTargetPosition[1],          -100000, 100000, 200 },
+    { "navTgtPos[2]",       SOURCE_INT32,       &navTargetPosition[2],          -1000,  50000,  200 },
+    { "navTgtHdg",          SOURCE_UINT16,      &navDesiredHeading,             0,      36000,  50 },
+    { "navSurf",            SOURCE_INT16,       &navActualSurface,              -1,     400,    25 },
+    { "navAcc[0]",          SOURCE_INT16,       &navAccNEU[0],                  -2000,  2000,   1 },
+    { "navAcc[1]",          SOURCE_INT16,       &navAccNEU[1],                  -2000,  2000,   1 },
+    { "navAcc[2]",          SOURCE_INT16,       &navAccNEU[2],                  -2000,  2000,   1 },
+
+    // Slow fields
+    { "activeWpNumber",     SOURCE_UINT8,       &activeWpNumber,                0,      30,     2000 },
+    { "flightModeFlags",    SOURCE_INT32,       &rcModeActivationMask.bits[0],  0,      0x3FFFFFFF, 700 },
+    { "flightModeFlags2",   SOURCE_INT32,       &rcModeActivationMask.bits[1],  0,      0xFFFF, 1500 },
+    { "activeFlightModeFlags", SOURCE_INT32,    &flightModeFlags,               0,      0xFFFF, 900 },
+    { "stateFlags",         SOURCE_INT32,       &stateFlags,                    0,      0,      0 },
+    { "failsafePhase",      SOURCE_INT32,       &failsafePhaseValue,            0,      6,      1100 },
+    { "rxSignalReceived",   SOURCE_UINT8,       &rxSignalReceived,              0,      1,      1300 },
+    { "rxFlightChannelsValid", SOURCE_UINT8,    &rxFlightChannelsValid,         0,      1,      1700 },
+    { "rxUpdateRate",       SOURCE_UINT16,      &rxUpdateRate,                  50,     500,    800 },
+    { "hwHealthStatus",     SOURCE_INT32,       &hwHealthStatus,                0,      0x3FFF, 1900 },
+    { "powerSupplyImpedance", SOURCE_UINT16,    &powerSupplyImpedance,          0,      200,    600 },
+    { "sagCompensatedVBat", SOURCE_UINT16,      &sagCompensatedVBat,            1400,   1700,   300 },
+    { "wind[0]",            SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "wind[1]",            SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "wind[2]",            SOURCE_NONE,        NULL,                           0,      0,      0 },
+    { "IMUTemperature",     SOURCE_INT16,       &imuTemperature,                -100,   800,    1000 },
+    { "baroTemperature",    SOURCE_INT16,       &baroTemperature,               -100,   800,    1200 },
+
+    // GPS fields, the G frames only follow changes of the fix, the satellites or the position
+    { "GPS_fixType",        SOURCE_INT32,       &gpsSol.fixType,                0,      3,      3000 },
+    { "GPS_numSat",         SOURCE_UINT8,       &gpsSol.numSat,                 4,      30,     1000 },
+    { "GPS_coord[0]",       SOURCE_INT32,       &gpsSol.llh.lat,                473000000, 473100000, 100 },
+    { "GPS_coord[1]",       SOURCE_INT32,       &gpsSol.llh.lon,                85000000, 85100000, 100 },
+    { "GPS_altitude",       SOURCE_GPS_ALTITUDE, &gpsSol.llh.alt,               -100,   3000,   100 },
+    { "GPS_speed",          SOURCE_INT16,       &gpsSol.groundSpeed,            0,      3000,   100 },
+    { "GPS_ground_course",  SOURCE_INT16,       &gpsSol.groundCourse,           0,      3599,   100 },
+    { "GPS_hdop",           SOURCE_UINT16,      &gpsSol.hdop,                   50,     500,    100 },
+    { "GPS_eph",            SOURCE_UINT16,      &gpsSol.eph,                    100,    5000,   100 },
+    { "GPS_epv",            SOURCE_UINT16,      &gpsSol.epv,                    100,    5000,   100 },
+    { "GPS_velned[0]",      SOURCE_INT16,       &gpsSol.velNED[0],              -3000,  3000,   100 },
+    { "GPS_velned[1]",      SOURCE_INT16,       &gpsSol.velNED[1],              -3000,  3000,   100 },
+    { "GPS_velned[2]",      SOURCE_INT16,       &gpsSol.velNED[2],              -1000,  1000,   100 },
+    { "GPS_home[0]",        SOURCE_INT32,       &GPS_home.lat,                  473000000, 473100000, 3000 },
+    { "GPS_home[1]",        SOURCE_INT32,       &GPS_home.lon,                  85000000, 85100000, 3000 },
+};
+
+#define ROUNDTRIP_FIELD_COUNT   ARRAYLEN(roundtripFields)
+
+// The CLI names of the include flags, in bit order
+static const char * const includeFlagNames[] = {
+    "NAV_ACC", "NAV_POS", "NAV_PID", "MAG", "ACC", "ATTI", "RC_DATA", "RC_COMMAND",
+    "MOTORS", "GYRO_RAW", "PEAKS_R", "PEAKS_P", "PEAKS_Y", "SERVOS", "GYRO_RATE", "GYRO_RATE_MOTORS",
+};
+
+// A field of each include flag, to tell which flags a recorded log was written with
+static const char * const includeFlagFields[] = {
+    "navAcc[0]", "navPos[0]", NULL, "magADC[0]", "accSmooth[0]", "attitude[0]", "rcData[0]", "rcCommand[0]",
+    "motor[0]", "gyroRaw[0]", "gyroPeakRoll[0]", "gyroPeakPitch[0]", "gyroPeakYaw[0]", "servo[0]", NULL, NULL,
+};
+
+static const char * const compressionValues[] = { "NONE", "RICE", NULL };
+
+#define SETTING_NUMBER(_name, _config, _field, _min, _max) \
+    { _name, &_config._field, sizeof(_config._field), _min, _max, NULL }
+#define SETTING_TABLE(_name, _config, _field, _values) \
+    { _name, &_config._field, sizeof(_config._field), 0, ARRAYLEN(_values) - 2, _values }
+
+static const roundtripSetting_t roundtripSettings[] = {
+    SETTING_NUMBER("blackbox_rate_num", blackboxConfig_System, rate_num, SETTING_BLACKBOX_RATE_NUM_MIN, SETTING_BLACKBOX_RATE_NUM_MAX),
+    SETTING_NUMBER("blackbox_rate_denom", blackboxConfig_System, rate_denom, SETTING_BLACKBOX_RATE_DENOM_MIN, SETTING_BLACKBOX_RATE_DENOM_MAX),
+    SETTING_NUMBER("blackbox_rc_divider", blackboxConfig_System, groupDivider[BLACKBOX_GROUP_RC], SETTING_BLACKBOX_RC_DIVIDER_MIN, SETTING_BLACKBOX_RC_DIVIDER_MAX),
+    SETTING_NUMBER("blackbox_attitude_divider", blackboxConfig_System, groupDivider[BLACKBOX_GROUP_ATTITUDE], SETTING_BLACKBOX_ATTITUDE_DIVIDER_MIN, SETTING_BLACKBOX_ATTITUDE_DIVIDER_MAX),
+    SETTING_NUMBER("blackbox_nav_divider", blackboxConfig_System, groupDivider[BLACKBOX_GROUP_NAV], SETTING_BLACKBOX_NAV_DIVIDER_MIN, SETTING_BLACKBOX_NAV_DIVIDER_MAX),
+    SETTING_NUMBER("blackbox_sensors_divider", blackboxConfig_System, groupDivider[BLACKBOX_GROUP_SENSORS], SETTING_BLACKBOX_SENSORS_DIVIDER_MIN, SETTING_BLACKBOX_SENSORS_DIVIDER_MAX),
+    SETTING_TABLE("blackbox_compression", blackboxConfig_System, compression, compressionValues),
+};
+
+static roundtripInput_t roundtripInput;
+static uint32_t randomState = 1;
+
+// Options
+static uint32_t looptimeUs = ROUNDTRIP_DEFAULT_LOOPTIME;
+static int motorCount = ROUNDTRIP_DEFAULT_MOTORS;
+static int servoCount = ROUNDTRIP_DEFAULT_SERVOS;
+static bool fixedWing;
+static uint32_t enabledSensors;
+static uint32_t armingBeepTimeUs;
+
+// The in-memory blackbox device
+static uint8_t *logData;
+static size_t logSize;
+static size_t logCapacity;
+static bool headerWritten;
+static size_t headerSize;
+static bool deviceOpen;
+
+/*
+ * The blackbox device
+ */
+
+void blackboxWrite(uint8_t value)
+{
+    if (logSize == logCapacity) {
+        logCapacity = logCapacity ? logCapacity * 2 : 1 << 20;
+        logData = realloc(logData, logCapacity);
+    }
+    logData[logSize++] = value;
+}
+
+int blackboxPrint(const char *s)
+{
+    int length = 0;
+
+    for (; *s; s++, length++) {
+        blackboxWrite(*s);
+    }
+    return length;
+}
+
+int tfp_format(void *putp, void (*putf) (void *, char), const char *fmt, va_list va)
+{
+    char buffer[256];
+    const int length = MIN(vsnprintf(buffer, sizeof(buffer), fmt, va), (int)sizeof(buffer) - 1);
+
+    for (int i = 0; i < length; i++) {
+        putf(putp, buffer[i]);
+    }
+    return length;
+}
+
+bool blackboxDeviceOpen(void)
+{
+    deviceOpen = true;
+    return true;
+}
+
+void blackboxDeviceClose(void)
+{
+    deviceOpen = false;
+}
+
+bool blackboxDeviceBeginLog(void)
+{
+    return true;
+}
+
+bool blackboxDeviceEndLog(bool retainLog)
+{
+    UNUSED(retainLog);
+    return true;
+}
+
+void blackboxDeviceFlush(void)
+{
+}
+
+// Called when the header is complete, and while shutting down
+bool blackboxDeviceFlushForce(void)
+{
+    if (!headerWritten) {
+        headerWritten = true;
+        headerSize = logSize;
+    }
+    return true;
+}
+
+bool isBlackboxDeviceFull(void)
+{
+    return false;
+}
+
+void blackboxReplenishHeaderBudget(void)
+{
+    blackboxHeaderBudget = 1024;
+}
+
+blackboxBufferReserveStatus_e blackboxDeviceReserveBufferSpace(int32_t bytes)
+{
+    UNUSED(bytes);
+    return BLACKBOX_RESERVE_SUCCESS;
+}
+
+/*
+ * The rest of the firmware, as far as blackbox.c can see it
+ */
+
+static timeUs_t currentTimeUs;
+
+timeMs_t millis(void)
+{
+    return currentTimeUs / 1000;
+}
+
+bool feature(uint32_t mask)
+{
+    return (FEATURE_BLACKBOX | FEATURE_GPS | FEATURE_VBAT | FEATURE_CURRENT_METER) & mask;
+}
+
+bool sensors(uint32_t mask)
+{
+    return enabledSensors & mask;
+}
+
+uint8_t getMotorCount(void)
+{
+    return motorCount;
+}
+
+int getServoCount(void)
+{
+    return servoCount;
+}
+
+bool isMixerUsingServos(void)
+{
+    return servoCount > 0;
+}
+
+int getThrottleIdleValue(void)
+{
+    return 1150;
+}
+
+uint16_t getMaxThrottle(void)
+{
+    return 1850;
+}
+
+uint32_t getLooptime(void)
+{
+    return looptimeUs;
+}
+
+uint32_t getGyroLooptime(void)
+{
+    return looptimeUs;
+}
+
+uint32_t getEscUpdateFrequency(void)
+{
+    return 400;
+}
+
+const pidBank_t *pidBank(void)
+{
+    return &pidProfileStorage.bank_mc;
+}
+
+const navigationPIDControllers_t *getNavigationPIDControllers(void)
+{
+    return &navPids;
+}
+
+int16_t rxGetChannelValue(unsigned channelNumber)
+{
+    return rcChannels[channelNumber];
+}
+
+rssiSource_e getRSSISource(void)
+{
+    return RSSI_SOURCE_ADC;
+}
+
+uint16_t getRSSI(void)
+{
+    return rssi;
+}
+
+bool rxIsReceivingSignal(void)
+{
+    return rxSignalReceived;
+}
+
+bool rxAreFlightChannelsValid(void)
+{
+    return rxFlightChannelsValid;
+}
+
+uint16_t getRcUpdateFrequency(void)
+{
+    return rxUpdateRate;
+}
+
+failsafePhase_e failsafePhase(void)
+{
+    return failsafePhaseValue;
+}
+
+uint16_t getBatteryRawVoltage(void)
+{
+    return batteryRawVoltage;
+}
+
+uint16_t getBatterySagCompensatedVoltage(void)
+{
+    return sagCompensatedVBat;
+}
+
+uint16_t getPowerSupplyImpedance(void)
+{
+    return powerSupplyImpedance;
+}
+
+int16_t getAmperage(void)
+{
+    return amperage;
+}
+
+float getAirspeedEstimate(void)
+{
+    return airSpeed;
+}
+
+int32_t rangefinderGetLatestRawAltitude(void)
+{
+    return surfaceRaw;
+}
+
+float accGetVibrationLevel(void)
+{
+    return accVibration;
+}
+
+bool getIMUTemperature(int16_t *temperature)
+{
+    *temperature = imuTemperature;
+    return true;
+}
+
+bool getBaroTemperature(int16_t *temperature)
+{
+    *temperature = baroTemperature;
+    return true;
+}
+
+hardwareSensorStatus_e getHwGyroStatus(void)
+{
+    return (hwHealthStatus >> 2 * 0) & 3;
+}
+
+hardwareSensorStatus_e getHwAccelerometerStatus(void)
+{
+    return (hwHealthStatus >> 2 * 1) & 3;
+}
+
+hardwareSensorStatus_e getHwCompassStatus(void)
+{
+    return (hwHealthStatus >> 2 * 2) & 3;
+}
+
+hardwareSensorStatus_e getHwBarometerStatus(void)
+{
+    return (hwHealthStatus >> 2 * 3) & 3;
+}
+
+hardwareSensorStatus_e getHwGPSStatus(void)
+{
+    return (hwHealthStatus >> 2 * 4) & 3;
+}
+
+hardwareSensorStatus_e getHwRangefinderStatus(void)
+{
+    return (hwHealthStatus >> 2 * 5) & 3;
+}
+
+hardwareSensorStatus_e getHwPitotmeterStatus(void)
+{
+    return (hwHealthStatus >> 2 * 6) & 3;
+}
+
+uint8_t getActiveWpNumber(void)
+{
+    return activeWpNumber;
+}
+
+int8_t navigationGetHeadingControlState(void)
+{
+    return NAV_HEADING_CONTROL_NONE;
+}
+
+int getWaypointCount(void)
+{
+    return 0;
+}
+
+bool isWaypointListValid(void)
+{
+    return false;
+}
+
+uint32_t getArmingBeepTimeMicros(void)
+{
+    return armingBeepTimeUs;
+}
+
+disarmReason_t getDisarmReason(void)
+{
+    return DISARM_SWITCH;
+}
+
+bool isModeActivationConditionPresent(boxId_e modeId)
+{
+    UNUSED(modeId);
+    return false;
+}
+
+bool IS_RC_MODE_ACTIVE(boxId_e boxId)
+{
+    UNUSED(boxId);
+    return false;
+}
+
+bool rtcGetDateTime(dateTime_t *dt)
+{
+    memset(dt, 0, sizeof(*dt));
+    return false;
+}
+
+bool dateTimeFormatLocal(char *buf, dateTime_t *dt)
+{
+    UNUSED(dt);
+    strcpy(buf, "0000-01-01T00:00:00.000+00:00");
+    return true;
+}
+
+/*
+ * Settings
+ */
+
+static void resetSettings(void)
+{
+    blackboxConfig_System = pgResetTemplate_blackboxConfig;
+    blackboxConfig_System.device = BLACKBOX_DEVICE_SERIAL;
+    blackboxConfig_System.includeFlags = BLACKBOX_FEATURE_NAV_ACC | BLACKBOX_FEATURE_NAV_POS | BLACKBOX_FEATURE_NAV_PID
+        | BLACKBOX_FEATURE_MAG | BLACKBOX_FEATURE_ACC | BLACKBOX_FEATURE_ATTITUDE | BLACKBOX_FEATURE_RC_DATA
+        | BLACKBOX_FEATURE_RC_COMMAND | BLACKBOX_FEATURE_MOTORS | BLACKBOX_FEATURE_GYRO_RAW | BLACKBOX_FEATURE_SERVOS;
+}
+
+static bool parseSettingValue(const roundtripSetting_t *setting, const char *text, int32_t *value)
+{
+    if (setting->values) {
+        for (int i = 0; setting->values[i]; i++) {
+            if (strcasecmp(setting->values[i], text) == 0) {
+                *value = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    char *end;
+    *value = strtol(text, &end, 10);
+    return end != text && *end == '\0' && *value >= setting->min && *value <= setting->max;
+}
+
+/*
+ * Applies "name=value,name=value" on top of the defaults
+ */
+static bool applyConfig(const char *config)
+{
+    char buffer[ROUNDTRIP_MAX_CONFIG];
+    strncpy(buffer, config, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    for (char *item = strtok(buffer, ", \t"); item; item = strtok(NULL, ", \t")) {
+        char *value = strchr(item, '=');
+        if (!value) {
+            fprintf(stderr, "Expected name=value, got '%s'\n", item);
+            return false;
+        }
+        *value++ = '\0';
+
+        const roundtripSetting_t *setting = NULL;
+        for (unsigned i = 0; i < ARRAYLEN(roundtripSettings); i++) {
+            if (strcmp(roundtripSettings[i].name, item) == 0) {
+                setting = &roundtripSettings[i];
+                break;
+            }
+        }
+
+        int32_t parsed;
+        if (!setting) {
+            fprintf(stderr, "Unknown setting '%s'\n", item);
+            return false;
+        }
+        if (!parseSettingValue(setting, value, &parsed)) {
+            fprintf(stderr, "Invalid value '%s' for %s\n", value, item);
+            return false;
+        }
+
+        switch (setting->size) {
+            case 1:
+                *(uint8_t *)setting->field = parsed;
+                break;
+            case 2:
+                *(uint16_t *)setting->field = parsed;
+                break;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Applies "NAME,-NAME" to the include flags, like the CLI's "blackbox" command
+ */
+static bool applyIncludeFlags(const char *flags)
+{
+    char buffer[ROUNDTRIP_MAX_CONFIG];
+    strncpy(buffer, flags, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    for (char *item = strtok(buffer, ", \t"); item; item = strtok(NULL, ", \t")) {
+        const bool clear = item[0] == '-';
+        const char *name = clear ? item + 1 : item;
+        unsigned flag;
+
+        for (flag = 0; flag < ARRAYLEN(includeFlagNames); flag++) {
+            if (strcasecmp(includeFlagNames[flag], name) == 0) {
+                break;
+            }
+        }
+        if (flag == ARRAYLEN(includeFlagNames)) {
+            fprintf(stderr, "Unknown blackbox field group '%s'\n", name);
+            return false;
+        }
+
+        if (clear) {
+            blackboxConfig_System.includeFlags &= ~(1U << flag);
+        } else {
+            blackboxConfig_System.includeFlags |= 1U << flag;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Inputs
+ */
+
+static int findField(const char *name)
+{
+    for (unsigned i = 0; i < ROUNDTRIP_FIELD_COUNT; i++) {
+        if (strcmp(roundtripFields[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void allocInput(roundtripInput_t *input, uint32_t stepCount)
+{
+    input->time = realloc(input->time, (size_t)stepCount * sizeof(uint32_t));
+    input->values = realloc(input->values, (size_t)stepCount * ROUNDTRIP_FIELD_COUNT * sizeof(int32_t));
+}
+
+static int32_t *inputRow(const roundtripInput_t *input, uint32_t step)
+{
+    return &input->values[(size_t)step * ROUNDTRIP_FIELD_COUNT];
+}
+
+// The same sequence on every host, unlike rand()
+static uint32_t randomNext(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static double randomUniform(void)
+{
+    return randomNext() / (double)UINT32_MAX;
+}
+
+/*
+ * Each field follows a slow sine with some noise, and jumps to a random value now and then so that the wide
+ * encodings are used too.
+ */
+static int32_t generateValue(const roundtripField_t *field, int index, uint32_t step, int32_t previous)
+{
+    if (field->hold == 0) {
+        return field->variable == &stateFlags && fixedWing ? FIXED_WING_LEGACY : field->min;
+    }
+
+    if (step > 0 && (step + index) % field->hold != 0) {
+        return previous;
+    }
+
+    const double t = (double)step * looptimeUs * 1e-6;
+    const double mid = ((double)field->min + field->max) / 2;
+    const double half = ((double)field->max - field->min) / 2;
+    double value;
+
+    if (randomNext() % 1000 == 0) {
+        value = field->min + randomUniform() * 2 * half;
+    } else {
+        const double hz = 0.2 + 0.37 * (index % 7);
+        value = mid + half * (0.8 * sin(2 * M_PI * hz * t + index) + 0.04 * (randomUniform() - 0.5));
+    }
+
+    return constrainf(value, field->min, field->max);
+}
+
+static void generateInput(roundtripInput_t *input, float seconds)
+{
+    input->stepCount = lrintf(seconds * 1e6f / looptimeUs);
+    allocInput(input, input->stepCount);
+
+    for (uint32_t step = 0; step < input->stepCount; step++) {
+        int32_t *row = inputRow(input, step);
+        const int32_t *previous = step > 0 ? inputRow(input, step - 1) : row;
+
+        input->time[step] = ROUNDTRIP_START_TIME_US + step * looptimeUs;
+        for (unsigned i = 0; i < ROUNDTRIP_FIELD_COUNT; i++) {
+            row[i] = generateValue(&roundtripFields[i], i, step, previous[i]);
+        }
+    }
+}
+
+static bool readFile(const char *fileName, uint8_t **data, size_t *size)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", fileName);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    *data = malloc(*size + 1);
+    const bool ok = fread(*data, 1, *size, file) == *size;
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "Cannot read %s\n", fileName);
+    }
+    return ok;
+}
+
+static bool writeFile(const char *fileName, const uint8_t *data, size_t size)
+{
+    FILE *file = fopen(fileName, "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot create %s\n", fileName);
+        return false;
+    }
+
+    const bool ok = fwrite(data, 1, size, file) == size;
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Cannot write %s\n", fileName);
+        return false;
+    }
+    return true;
+}
+
+static bool hasField(const blackboxDecoder_t *decoder, const char *name)
+{
+    return blackboxDecoderFieldIndex(&decoder->main, name) >= 0 || blackboxDecoderFieldIndex(&decoder->group, name) >= 0;
+}
+
+static int countFields(const blackboxDecoder_t *decoder, const char *name, int max)
+{
+    char fieldName[BLACKBOX_DECODER_MAX_NAME];
+    int count = 0;
+
+    while (count < max) {
+        snprintf(fieldName, sizeof(fieldName), "%s[%d]", name, count);
+        if (!hasField(decoder, fieldName)) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Copies the values of one kind of frame into the input fields of the same name
+static void copyFrameValues(const blackboxFrameDef_t *def, const int32_t *values, int32_t *row)
+{
+    for (int i = 0; i < def->fieldCount; i++) {
+        const int field = findField(def->names[i]);
+        if (field >= 0) {
+            row[field] = values[i];
+        }
+    }
+}
+
+/*
+ * Takes every main frame of a log as one loop iteration. The encoder is set up like the flight controller which
+ * wrote the log, except for the settings given on the command line. Fields the log doesn't have are logged as 0.
+ */
+static bool loadRecordedInput(roundtripInput_t *input, const char *fileName, int logNumber, bool keepFlags, bool keepMotors, bool keepServos)
+{
+    uint8_t *data;
+    size_t size;
+
+    if (!readFile(fileName, &data, &size)) {
+        return false;
+    }
+
+    const long start = blackboxDecoderFindLog(data, size, logNumber);
+    if (start < 0) {
+        fprintf(stderr, "%s has no log %d\n", fileName, logNumber);
+        return false;
+    }
+
+    static blackboxDecoder_t decoder;
+    static blackboxDecodedFrame_t frame;
+
+    if (!blackboxDecoderOpen(&decoder, data + start, size - start)) {
+        fprintf(stderr, "%s: %s\n", fileName, decoder.error);
+        return false;
+    }
+
+    fixedWing = hasField(&decoder, "fwAltP");
+    if (!keepMotors) {
+        motorCount = countFields(&decoder, "motor", MAX_SUPPORTED_MOTORS);
+    }
+    if (!keepServos) {
+        servoCount = countFields(&decoder, "servo", MAX_SUPPORTED_SERVOS);
+    }
+    if (!keepFlags) {
+        for (unsigned flag = 0; flag < ARRAYLEN(includeFlagFields); flag++) {
+            if (includeFlagFields[flag] && !hasField(&decoder, includeFlagFields[flag])) {
+                blackboxConfig_System.includeFlags &= ~(1U << flag);
+            }
+        }
+        if (!hasField(&decoder, "mcPosAxisP[0]") && !fixedWing) {
+            blackboxConfig_System.includeFlags &= ~BLACKBOX_FEATURE_NAV_PID;
+        }
+    }
+    if (decoder.compression == BLACKBOX_COMPRESSION_RICE) {
+        blackboxConfig_System.compression = BLACKBOX_COMPRESSION_RICE;
+    }
+
+    uint32_t capacity = 1 << 16;
+    uint32_t lastTime = 0;
+    int result;
+
+    input->stepCount = 0;
+    allocInput(input, capacity);
+
+    while ((result = blackboxDecoderNext(&decoder, &frame)) > 0) {
+        if (frame.type != 'I' && frame.type != 'P') {
+            continue;
+        }
+
+        const uint32_t time = frame.values[decoder.timeField];
+        if (input->stepCount > 0 && time <= lastTime) {
+            continue;
+        }
+
+        // The groups and GPS frames after the previous main frame belong to it
+        if (input->stepCount > 0) {
+            int32_t *previous = inputRow(input, input->stepCount - 1);
+            copyFrameValues(&decoder.group, decoder.groupValues, previous);
+            copyFrameValues(&decoder.gpsG, decoder.gpsGValues, previous);
+            copyFrameValues(&decoder.gpsH, decoder.gpsHValues, previous);
+        }
+
+        if (input->stepCount == capacity) {
+            capacity *= 2;
+            allocInput(input, capacity);
+        }
+
+        int32_t *row = inputRow(input, input->stepCount);
+        if (input->stepCount > 0) {
+            memcpy(row, inputRow(input, input->stepCount - 1), ROUNDTRIP_FIELD_COUNT * sizeof(int32_t));
+        } else {
+            memset(row, 0, ROUNDTRIP_FIELD_COUNT * sizeof(int32_t));
+        }
+        copyFrameValues(&decoder.main, frame.values, row);
+        copyFrameValues(&decoder.slow, decoder.slowValues, row);
+
+        input->time[input->stepCount] = time;
+        lastTime = time;
+        input->stepCount++;
+    }
+
+    if (result < 0) {
+        fprintf(stderr, "%s: %s, using the %u frames before it\n", fileName, decoder.error, input->stepCount);
+    }
+    if (input->stepCount < 3) {
+        fprintf(stderr, "%s has too few frames\n", fileName);
+        return false;
+    }
+
+    int32_t *last = inputRow(input, input->stepCount - 1);
+    copyFrameValues(&decoder.group, decoder.groupValues, last);
+    copyFrameValues(&decoder.gpsG, decoder.gpsGValues, last);
+    copyFrameValues(&decoder.gpsH, decoder.gpsHValues, last);
+
+    // Times from the start of the log, the state flags only as far as the encoder uses them
+    const uint32_t firstTime = input->time[0];
+    const int stateFlagsField = findField("stateFlags");
+    for (uint32_t step = 0; step < input->stepCount; step++) {
+        input->time[step] = ROUNDTRIP_START_TIME_US + input->time[step] - firstTime;
+        inputRow(input, step)[stateFlagsField] = fixedWing ? FIXED_WING_LEGACY : 0;
+    }
+
+    free(data);
+    return true;
+}
+
+/*
+ * Encoding
+ */
+
+static uint64_t readTicks(void)
+{
+#ifdef ROUNDTRIP_HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void applyStep(const roundtripInput_t *input, uint32_t step)
+{
+    const int32_t *row = inputRow(input, step);
+
+    for (unsigned i = 0; i < ROUNDTRIP_FIELD_COUNT; i++) {
+        const roundtripField_t *field = &roundtripFields[i];
+        const int32_t value = row[i];
+
+        switch (field->source) {
+        case SOURCE_INT16:
+            *(int16_t *)field->variable = value;
+            break;
+        case SOURCE_UINT16:
+            *(uint16_t *)field->variable = value;
+            break;
+        case SOURCE_INT32:
+            *(int32_t *)field->variable = value;
+            break;
+        case SOURCE_UINT8:
+            *(uint8_t *)field->variable = value;
+            break;
+        case SOURCE_FLOAT:
+            *(float *)field->variable = value;
+            break;
+        case SOURCE_FLOAT_DECI:
+            *(float *)field->variable = value * 10.0f;
+            break;
+        case SOURCE_FLOAT_ACC:
+            *(float *)field->variable = value / (float)ROUNDTRIP_ACC_1G;
+            break;
+        case SOURCE_GPS_ALTITUDE:
+            *(int32_t *)field->variable = value * 100;
+            break;
+        case SOURCE_NONE:
+            break;
+        }
+    }
+}
+
+/*
+ * Runs the firmware's logger over the input the way the scheduler would: the gyro sample, the PID loop's
+ * blackboxUpdate() and the blackbox task every iteration. Returns the encoder time of all iterations.
+ */
+static uint64_t encodeInput(const roundtripInput_t *input, bool gyroRate)
+{
+    logSize = 0;
+    headerWritten = false;
+
+    applyStep(input, 0);
+
+    blackboxInit();
+    blackboxStart();
+
+    // The header is written from 100ms after the start, in chunks
+    for (currentTimeUs = 0; !headerWritten && currentTimeUs < input->time[0]; currentTimeUs += 1000) {
+        blackboxUpdate(currentTimeUs);
+        blackboxEncodeTask(currentTimeUs);
+    }
+
+    uint64_t ticks = 0;
+    for (uint32_t step = 0; step < input->stepCount; step++) {
+        applyStep(input, step);
+        currentTimeUs = input->time[step];
+
+        // Also checks that a sync beep event is logged
+        if (step == input->stepCount / 3) {
+            armingBeepTimeUs = currentTimeUs;
+        }
+
+        const uint64_t start = readTicks();
+        if (gyroRate) {
+            blackboxLogGyroSample(currentTimeUs);
+        }
+        blackboxUpdate(currentTimeUs);
+        blackboxEncodeTask(currentTimeUs);
+        ticks += readTicks() - start;
+    }
+
+    blackboxFinish();
+    for (int i = 0; i < 1000 && deviceOpen; i++) {
+        currentTimeUs += looptimeUs;
+        blackboxUpdate(currentTimeUs);
+    }
+
+    return ticks;
+}
+
+/*
+ * Checking
+ */
+
+typedef enum {
+    MAP_ITERATION = -2,
+    MAP_TIME = -3,
+} roundtripFieldMap_e;
+
+typedef struct {
+    const roundtripInput_t *input;
+    uint64_t checkedValues;
+    uint32_t mismatches;
+    roundtripFrameStats_t frameStats[128];
+} roundtripCheck_t;
+
+static bool mapFields(const blackboxFrameDef_t *def, char frameType, int *map)
+{
+    bool ok = true;
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        if (strcmp(def->names[i], "loopIteration") == 0) {
+            map[i] = MAP_ITERATION;
+        } else if (strcmp(def->names[i], "time") == 0) {
+            map[i] = MAP_TIME;
+        } else {
+            map[i] = findField(def->names[i]);
+            if (map[i] < 0) {
+                fprintf(stderr, "No source for the %c field %s\n", frameType, def->names[i]);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static void reportMismatch(roundtripCheck_t *check, const blackboxDecodedFrame_t *frame, const char *name, int64_t expected, int64_t decoded)
+{
+    if (check->mismatches++ < ROUNDTRIP_MAX_REPORTED) {
+        fprintf(stderr, "%c frame at %zu after iteration %u: %s is %lld, expected %lld\n",
+            frame->type, frame->offset, frame->iteration, name, (long long)decoded, (long long)expected);
+    }
+}
+
+static void checkFields(roundtripCheck_t *check, const blackboxFrameDef_t *def, const int *map, const blackboxDecodedFrame_t *frame, uint32_t step)
+{
+    const int32_t *row = inputRow(check->input, step);
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        int32_t expected;
+
+        switch (map[i]) {
+        case MAP_ITERATION:
+            expected = step;
+            break;
+        case MAP_TIME:
+            expected = check->input->time[step];
+            break;
+        default:
+            expected = row[map[i]];
+            break;
+        }
+
+        check->checkedValues++;
+        if (frame->values[i] != expected) {
+            reportMismatch(check, frame, def->names[i], expected, frame->values[i]);
+        }
+    }
+}
+
+// Only the fields of the frame's own group are new
+static void checkGroupFields(roundtripCheck_t *check, const blackboxDecoder_t *decoder, const int *map, const blackboxDecodedFrame_t *frame, uint32_t step)
+{
+    const int32_t *row = inputRow(check->input, step);
+
+    for (int i = 0; i < decoder->group.fieldCount; i++) {
+        if (decoder->fieldGroup[i] != frame->group) {
+            continue;
+        }
+
+        check->checkedValues++;
+        if (frame->values[i] != row[map[i]]) {
+            reportMismatch(check, frame, decoder->group.names[i], row[map[i]], frame->values[i]);
+        }
+    }
+}
+
+static void checkGyroRateFrame(roundtripCheck_t *check, const blackboxDecoder_t *decoder, const blackboxDecodedFrame_t *frame, uint32_t block)
+{
+    const uint32_t firstStep = block * frame->rSampleCount;
+    const uint32_t lastStep = firstStep + frame->rSampleCount - 1;
+    char name[BLACKBOX_DECODER_MAX_NAME];
+
+    if (lastStep >= check->input->stepCount || frame->rStartTime != check->input->time[firstStep] || frame->rEndTime != check->input->time[lastStep]) {
+        reportMismatch(check, frame, "start time", firstStep < check->input->stepCount ? check->input->time[firstStep] : 0, frame->rStartTime);
+        return;
+    }
+
+    for (int channel = 0; channel < XYZ_AXIS_COUNT + decoder->gyroRateMotors; channel++) {
+        if (channel < XYZ_AXIS_COUNT) {
+            snprintf(name, sizeof(name), "gyroRaw[%d]", channel);
+        } else {
+            snprintf(name, sizeof(name), "motor[%d]", channel - XYZ_AXIS_COUNT);
+        }
+        const int field = findField(name);
+
+        for (int sample = 0; sample < frame->rSampleCount; sample++) {
+            const int32_t expected = inputRow(check->input, firstStep + sample)[field];
+
+            check->checkedValues++;
+            if (frame->rSamples[sample][channel] != expected) {
+                reportMismatch(check, frame, name, expected, frame->rSamples[sample][channel]);
+            }
+        }
+    }
+}
+
+static bool isLoggedIteration(uint32_t iteration, uint32_t iInterval)
+{
+    const uint32_t pFrameIndex = iteration % iInterval;
+    return pFrameIndex == 0 || (pFrameIndex + blackboxConfig()->rate_num - 1) % blackboxConfig()->rate_denom < blackboxConfig()->rate_num;
+}
+
+/*
+ * Decodes the log and checks every frame against the input it was written from. Slow frames and flight mode
+ * events come before the main frame of their iteration, the group and GPS frames after it.
+ */
+static bool checkLog(roundtripCheck_t *check, const roundtripInput_t *input)
+{
+    static blackboxDecoder_t decoder;
+    static blackboxDecodedFrame_t frame;
+    static int mainMap[BLACKBOX_DECODER_MAX_FIELDS];
+    static int slowMap[BLACKBOX_DECODER_MAX_FIELDS];
+    static int gpsGMap[BLACKBOX_DECODER_MAX_FIELDS];
+    static int gpsHMap[BLACKBOX_DECODER_MAX_FIELDS];
+    static int groupMap[BLACKBOX_DECODER_MAX_FIELDS];
+    static int32_t pendingSlow[BLACKBOX_DECODER_MAX_FIELDS];
+    static blackboxDecodedFrame_t pendingSlowFrame;
+
+    check->input = input;
+
+    if (!blackboxDecoderOpen(&decoder, logData, logSize)) {
+        fprintf(stderr, "Cannot read the log: %s\n", decoder.error);
+        return false;
+    }
+
+    if (!mapFields(&decoder.main, 'I', mainMap) || !mapFields(&decoder.slow, 'S', slowMap) || !mapFields(&decoder.gpsG, 'G', gpsGMap)
+            || !mapFields(&decoder.gpsH, 'H', gpsHMap) || !mapFields(&decoder.group, 'D', groupMap)) {
+        return false;
+    }
+
+    if (decoder.pIntervalNum != blackboxConfig()->rate_num || decoder.pIntervalDenom != blackboxConfig()->rate_denom) {
+        fprintf(stderr, "The header has a P interval of %u/%u, expected %u/%u\n", decoder.pIntervalNum, decoder.pIntervalDenom,
+            blackboxConfig()->rate_num, blackboxConfig()->rate_denom);
+        return false;
+    }
+
+    bool slowPending = false;
+    const int flightModeField = findField("flightModeFlags");
+    bool flightModePending = false;
+    uint32_t flightModeFlags = inputRow(input, 0)[flightModeField];
+    int64_t lastIteration = -1;
+    uint32_t mainFrames = 0;
+    uint32_t gyroRateBlocks = 0;
+    uint32_t syncBeeps = 0;
+    bool ended = false;
+    int result;
+
+    while ((result = blackboxDecoderNext(&decoder, &frame)) > 0) {
+        roundtripFrameStats_t *stats = &check->frameStats[frame.type & 0x7F];
+        stats->count++;
+        stats->bytes += frame.size;
+
+        switch (frame.type) {
+        case 'I':
+        case 'P': {
+            const uint32_t step = frame.iteration;
+
+            if (step >= input->stepCount || (int64_t)step <= lastIteration) {
+                fprintf(stderr, "%c frame at %zu has iteration %u after %lld\n", frame.type, frame.offset, step, (long long)lastIteration);
+                return false;
+            }
+            if (!isLoggedIteration(step, decoder.iInterval)) {
+                fprintf(stderr, "%c frame at %zu has iteration %u, which is not logged with this P interval\n", frame.type, frame.offset, step);
+                return false;
+            }
+            checkFields(check, &decoder.main, mainMap, &frame, step);
+
+            if (slowPending) {
+                const int32_t *row = inputRow(input, step);
+                for (int i = 0; i < decoder.slow.fieldCount; i++) {
+                    check->checkedValues++;
+                    if (pendingSlow[i] != row[slowMap[i]]) {
+                        reportMismatch(check, &pendingSlowFrame, decoder.slow.names[i], row[slowMap[i]], pendingSlow[i]);
+                    }
+                }
+                slowPending = false;
+            }
+            if (flightModePending) {
+                const uint32_t expected = inputRow(input, step)[flightModeField];
+
+                check->checkedValues++;
+                if (flightModeFlags != expected) {
+                    reportMismatch(check, &frame, "flight mode event", expected, flightModeFlags);
+                }
+                flightModePending = false;
+            }
+
+            lastIteration = step;
+            mainFrames++;
+            break;
+        }
+        case 'S':
+            memcpy(pendingSlow, frame.values, decoder.slow.fieldCount * sizeof(int32_t));
+            pendingSlowFrame = frame;
+            slowPending = true;
+            break;
+        case 'G':
+        case 'H':
+            if (lastIteration < 0) {
+                fprintf(stderr, "%c frame at %zu before the first main frame\n", frame.type, frame.offset);
+                return false;
+            }
+            checkFields(check, frame.type == 'G' ? &decoder.gpsG : &decoder.gpsH, frame.type == 'G' ? gpsGMap : gpsHMap, &frame, lastIteration);
+            break;
+        case 'D':
+        case 'd':
+            if (lastIteration < 0) {
+                fprintf(stderr, "%c frame at %zu before the first main frame\n", frame.type, frame.offset);
+                return false;
+            }
+            checkGroupFields(check, &decoder, groupMap, &frame, lastIteration);
+            break;
+        case 'R':
+            checkGyroRateFrame(check, &decoder, &frame, gyroRateBlocks++);
+            break;
+        case 'E':
+            switch (frame.event) {
+            case FLIGHT_LOG_EVENT_FLIGHTMODE:
+                // The previous flags are those of the last event, or the ones the log started with
+                check->checkedValues++;
+                if (frame.eventData[1] != flightModeFlags) {
+                    reportMismatch(check, &frame, "previous flight mode", flightModeFlags, frame.eventData[1]);
+                }
+                flightModeFlags = frame.eventData[0];
+                flightModePending = true;
+                break;
+            case FLIGHT_LOG_EVENT_SYNC_BEEP:
+                check->checkedValues++;
+                if (frame.eventData[0] != armingBeepTimeUs) {
+                    reportMismatch(check, &frame, "sync beep time", armingBeepTimeUs, frame.eventData[0]);
+                }
+                syncBeeps++;
+                break;
+            case FLIGHT_LOG_EVENT_LOG_END:
+                ended = true;
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+    }
+
+    if (result < 0) {
+        fprintf(stderr, "Cannot decode the log: %s\n", decoder.error);
+        return false;
+    }
+    if (!ended) {
+        fprintf(stderr, "The log has no end event\n");
+        return false;
+    }
+    if (slowPending) {
+        fprintf(stderr, "The last S frame has no main frame after it\n");
+        return false;
+    }
+
+    uint32_t expectedFrames = 0;
+    for (uint32_t step = 0; step < input->stepCount; step++) {
+        expectedFrames += isLoggedIteration(step, decoder.iInterval);
+    }
+    if (mainFrames != expectedFrames) {
+        fprintf(stderr, "The log has %u main frames, expected %u\n", mainFrames, expectedFrames);
+        return false;
+    }
+
+    if (syncBeeps != 1) {
+        fprintf(stderr, "The log has %u sync beep events, expected 1\n", syncBeeps);
+        return false;
+    }
+
+    if (decoder.gyroRateSamples > 0 && gyroRateBlocks != input->stepCount / decoder.gyroRateSamples) {
+        fprintf(stderr, "The log has %u R frames, expected %u\n", gyroRateBlocks, input->stepCount / decoder.gyroRateSamples);
+        return false;
+    }
+
+    return check->mismatches == 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <log.bbl | --synthetic seconds> [settings]\n"
+        "\n"
+        "Logs a generated or recorded flight with the firmware's blackbox encoder, decodes the log\n"
+        "and checks every value. settings are \"name=value,...\" of the blackbox settings.\n"
+        "\n"
+        "Options:\n"
+        "  --log <number>         log of a file holding several, from 0 (default 0)\n"
+        "  --looptime <us>        loop time of generated flights (default %d)\n"
+        "  --motors <count>       motors (default %d, or as in the recorded log)\n"
+        "  --servos <count>       servos (default %d, or as in the recorded log)\n"
+        "  --fixed-wing           log the fixed wing navigation fields\n"
+        "  --flags <NAME,-NAME>   include flags, like the CLI \"blackbox\" command\n"
+        "  --output <file>        save the encoded log\n",
+        name, ROUNDTRIP_DEFAULT_LOOPTIME, ROUNDTRIP_DEFAULT_MOTORS, ROUNDTRIP_DEFAULT_SERVOS);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *logFileName = NULL;
+    const char *config = "";
+    const char *flags = NULL;
+    const char *outputFileName = NULL;
+    float syntheticSeconds = 0;
+    int logNumber = 0;
+    bool motorsGiven = false;
+    bool servosGiven = false;
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--synthetic") == 0 && hasValue) {
+            syntheticSeconds = atof(argv[++i]);
+            positional++;
+        } else if (strcmp(argv[i], "--log") == 0 && hasValue) {
+            logNumber = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--looptime") == 0 && hasValue) {
+            looptimeUs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--motors") == 0 && hasValue) {
+            motorCount = atoi(argv[++i]);
+            motorsGiven = true;
+        } else if (strcmp(argv[i], "--servos") == 0 && hasValue) {
+            servoCount = atoi(argv[++i]);
+            servosGiven = true;
+        } else if (strcmp(argv[i], "--fixed-wing") == 0) {
+            fixedWing = true;
+        } else if (strcmp(argv[i], "--flags") == 0 && hasValue) {
+            flags = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            outputFileName = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (positional == 0) {
+            logFileName = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            config = argv[i];
+            positional++;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((!logFileName && syntheticSeconds <= 0) || looptimeUs < 125 || motorCount < 0 || motorCount > MAX_SUPPORTED_MOTORS
+            || servoCount < 0 || servoCount > MAX_SUPPORTED_SERVOS) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    resetSettings();
+    if (!applyConfig(config) || (flags && !applyIncludeFlags(flags))) {
+        return EXIT_FAILURE;
+    }
+
+    if (syntheticSeconds > 0) {
+        generateInput(&roundtripInput, syntheticSeconds);
+    } else if (!loadRecordedInput(&roundtripInput, logFileName, logNumber, flags != NULL, motorsGiven, servosGiven)) {
+        return EXIT_FAILURE;
+    }
+
+    // The FC configuration the encoder sees
+    gyroConfig_System.looptime = looptimeUs;
+    acc.dev.acc_1G = ROUNDTRIP_ACC_1G;
+    debugMode = DEBUG_NONE + 1;
+    enabledSensors = SENSOR_ACC | SENSOR_MAG | SENSOR_BARO | SENSOR_PITOT | SENSOR_RANGEFINDER;
+    batteryMetersConfig_System.current.type = CURRENT_SENSOR_ADC;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        pidProfileStorage.bank_mc.pid[axis].D = 20;
+    }
+
+    const bool gyroRate = blackboxConfig()->includeFlags & BLACKBOX_FEATURE_GYRO_RATE;
+    const uint64_t ticks = encodeInput(&roundtripInput, gyroRate);
+
+    if (outputFileName && !writeFile(outputFileName, logData, logSize)) {
+        return EXIT_FAILURE;
+    }
+
+    static roundtripCheck_t check;
+    const bool ok = checkLog(&check, &roundtripInput);
+
+    const uint32_t mainFrames = check.frameStats['I'].count + check.frameStats['P'].count;
+
+    printf("%u iterations of %uus, %d motors, %d servos, %s, P interval %u/%u, %s coding\n", roundtripInput.stepCount, looptimeUs,
+        motorCount, servoCount, fixedWing ? "fixed wing" : "multirotor", blackboxConfig()->rate_num, blackboxConfig()->rate_denom,
+        compressionValues[blackboxConfig()->compression]);
+
+    printf("%-8s %10s %12s %12s\n", "frame", "count", "bytes", "bytes/frame");
+    printf("%-8s %10s %12zu\n", "header", "", headerSize);
+    for (const char *type = "IPSGHDdRE"; *type; type++) {
+        const roundtripFrameStats_t *stats = &check.frameStats[(int)*type];
+        if (stats->count > 0) {
+            printf("%-8c %10u %12llu %12.2f\n", *type, stats->count, (unsigned long long)stats->bytes, (double)stats->bytes / stats->count);
+        }
+    }
+    printf("%-8s %10s %12zu\n", "total", "", logSize);
+
+#ifdef ROUNDTRIP_HAVE_TSC
+    const char *tickUnit = "cycles";
+#else
+    const char *tickUnit = "ns";
+#endif
+
+    if (mainFrames > 0) {
+        printf("Encoder time %.1f %s per main frame, %.1f %s per iteration\n", (double)ticks / mainFrames, tickUnit,
+            (double)ticks / roundtripInput.stepCount, tickUnit);
+    }
+
+    if (check.mismatches > 0) {
+        printf("%u of %llu decoded values differ from the input\n", check.mismatches, (unsigned long long)check.checkedValues);
+    } else if (ok) {
+        printf("All %llu decoded values match the input\n", (unsigned long long)check.checkedValues);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,539 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Downloads the dataflash of a SITL instance over its MSP TCP port and reports the sustained transfer rate, either
+ * with the MSP2_BLACKBOX_STREAM_* commands or with one MSP_DATAFLASH_READ request per chunk as the configurator
+ * does. SITL keeps its dataflash in flash.bin, which --make-image fills with test data before SITL is started.
+ * See the dataflash streaming section of docs/Blackbox.md
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "platform.h"
+
+#include "common/crc.h"
+
+#include "io/dataflash_stream.h"
+
+#include "msp/msp.h"
+#include "msp/msp_protocol.h"
+#include "msp/msp_protocol_v2_inav.h"
+
+#define DOWNLOAD_DEFAULT_PORT       5760        // UART1 of SITL
+#define DOWNLOAD_DEFAULT_CHUNK      2048
+#define DOWNLOAD_DEFAULT_WINDOW     16
+#define DOWNLOAD_LEGACY_MAX_CHUNK   4096        // What fits the reply buffer of the FC
+#define DOWNLOAD_REPLY_TIMEOUT_MS   1000
+#define DOWNLOAD_STREAM_IDLE_MS     100         // Acknowledge again after this long without data
+#define DOWNLOAD_MAX_PAYLOAD        8192
+#define DOWNLOAD_RX_BUFFER_SIZE     65536
+
+typedef struct {
+    uint16_t cmd;
+    uint16_t size;
+    uint8_t flags;
+    bool error;                                 // The FC replied with '!'
+    uint8_t payload[DOWNLOAD_MAX_PAYLOAD];
+} mspFrame_t;
+
+typedef struct {
+    int fd;
+    uint8_t buffer[DOWNLOAD_RX_BUFFER_SIZE];
+    size_t head;
+    size_t tail;
+    uint32_t crcErrors;
+} mspLink_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t erasedFrames;
+    uint32_t outOfOrderFrames;
+    uint32_t resendRequests;
+    uint32_t acks;
+    uint32_t requests;
+} downloadStats_t;
+
+static uint64_t nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t readU16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint8_t *writeU32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+static uint8_t *writeU16(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static bool mspConnect(mspLink_t *link, const char *host, int port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address %s\n", host);
+        return false;
+    }
+
+    link->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (link->fd < 0 || connect(link->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Can't connect to %s:%d: %s\n", host, port, strerror(errno));
+        return false;
+    }
+
+    const int one = 1;
+    setsockopt(link->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    link->head = link->tail = 0;
+    return true;
+}
+
+static bool mspSend(mspLink_t *link, uint16_t cmd, uint8_t flags, const uint8_t *payload, uint16_t size)
+{
+    uint8_t frame[8 + 64 + 1] = { '$', 'X', '<', flags };
+
+    writeU16(writeU16(frame + 4, cmd), size);
+    if (size > 0) {
+        memcpy(frame + 8, payload, size);
+    }
+    frame[8 + size] = crc8_dvb_s2_update(0, frame + 3, 5 + size);
+
+    return send(link->fd, frame, 9 + size, 0) == 9 + size;
+}
+
+/*
+ * Waits up to timeoutMs for the next MSPv2 frame. Frames with a bad CRC are counted and skipped, as the FC would.
+ */
+static bool mspReceive(mspLink_t *link, mspFrame_t *frame, int timeoutMs)
+{
+    const uint64_t deadline = nowUs() + (uint64_t)timeoutMs * 1000;
+
+    while (true) {
+        // Look for a complete frame in what was received so far
+        while (link->tail - link->head >= 9) {
+            const uint8_t *p = link->buffer + link->head;
+
+            if (p[0] != '$' || p[1] != 'X' || (p[2] != '>' && p[2] != '!')) {
+                link->head++;
+                continue;
+            }
+
+            const uint16_t size = readU16(p + 6);
+            if (size > DOWNLOAD_MAX_PAYLOAD) {
+                link->head++;
+                continue;
+            }
+            if (link->tail - link->head < 9u + size) {
+                break;
+            }
+
+            if (crc8_dvb_s2_update(0, p + 3, 5 + size) != p[8 + size]) {
+                link->crcErrors++;
+                link->head++;
+                continue;
+            }
+
+            frame->error = p[2] == '!';
+            frame->flags = p[3];
+            frame->cmd = readU16(p + 4);
+            frame->size = size;
+            memcpy(frame->payload, p + 8, size);
+            link->head += 9 + size;
+            return true;
+        }
+
+        if (link->head > 0) {
+            memmove(link->buffer, link->buffer + link->head, link->tail - link->head);
+            link->tail -= link->head;
+            link->head = 0;
+        }
+
+        const int64_t remainingUs = (int64_t)(deadline - nowUs());
+        struct pollfd pfd = { .fd = link->fd, .events = POLLIN };
+
+        if (remainingUs <= 0 || poll(&pfd, 1, (remainingUs + 999) / 1000) <= 0) {
+            return false;
+        }
+
+        const ssize_t length = recv(link->fd, link->buffer + link->tail, sizeof(link->buffer) - link->tail, 0);
+        if (length <= 0) {
+            return false;
+        }
+        link->tail += length;
+    }
+}
+
+static bool mspRequest(mspLink_t *link, uint16_t cmd, const uint8_t *payload, uint16_t size, mspFrame_t *reply)
+{
+    if (!mspSend(link, cmd, 0, payload, size)) {
+        return false;
+    }
+
+    // Skip stream frames still arriving from an earlier stream
+    while (mspReceive(link, reply, DOWNLOAD_REPLY_TIMEOUT_MS)) {
+        if (reply->cmd == cmd) {
+            return !reply->error;
+        }
+    }
+    return false;
+}
+
+static bool downloadLegacy(mspLink_t *link, uint8_t *data, uint32_t address, uint32_t length, uint16_t chunkSize, downloadStats_t *stats)
+{
+    static mspFrame_t reply;
+    const uint32_t end = address + length;
+
+    while (address < end) {
+        uint8_t request[6];
+        const uint16_t size = (end - address < chunkSize) ? end - address : chunkSize;
+
+        writeU16(writeU32(request, address), size);
+        stats->requests++;
+
+        if (!mspRequest(link, MSP_DATAFLASH_READ, request, sizeof(request), &reply) || reply.size < 4) {
+            fprintf(stderr, "No reply to the read of 0x%08x\n", address);
+            return false;
+        }
+
+        // A lost or damaged reply is asked for again
+        const uint32_t replyAddress = readU32(reply.payload);
+        const uint32_t replyLength = reply.size - 4;
+        if (replyAddress != address || replyLength == 0) {
+            continue;
+        }
+
+        memcpy(data + (address - (end - length)), reply.payload + 4, replyLength);
+        address += replyLength;
+    }
+    return true;
+}
+
+static bool sendAck(mspLink_t *link, uint32_t address, uint8_t flags, downloadStats_t *stats)
+{
+    uint8_t ack[5];
+
+    writeU32(ack, address);
+    ack[4] = flags;
+    stats->acks++;
+
+    return mspSend(link, MSP2_BLACKBOX_STREAM_ACK, MSP_FLAG_DONT_REPLY, ack, sizeof(ack));
+}
+
+static bool downloadStream(mspLink_t *link, uint8_t *data, uint32_t address, uint32_t length, uint16_t chunkSize, uint8_t window, downloadStats_t *stats)
+{
+    static mspFrame_t frame;
+    uint8_t request[12];
+
+    uint8_t *p = writeU16(writeU32(writeU32(request, address), length), chunkSize);
+    p[0] = window;
+    p[1] = DATAFLASH_STREAM_SKIP_ERASED;
+
+    if (!mspRequest(link, MSP2_BLACKBOX_STREAM_START, request, sizeof(request), &frame) || frame.size < 12) {
+        fprintf(stderr, "The FC refused the stream\n");
+        return false;
+    }
+
+    // The FC clips the chunk size and window to what it supports
+    const uint32_t start = address;
+    const uint32_t end = address + readU32(frame.payload + 4);
+    chunkSize = readU16(frame.payload + 8);
+    window = frame.payload[10];
+
+    const uint32_t ackEvery = (window > 1 ? window / 2 : 1) * (uint32_t)chunkSize;
+    uint32_t expected = start;
+    uint32_t acked = start;
+    bool resendRequested = false;
+    uint64_t lastDataUs = nowUs();
+
+    while (expected < end) {
+        if (!mspReceive(link, &frame, DOWNLOAD_STREAM_IDLE_MS)) {
+            // The FC gives up when nothing was acknowledged for a while, so should we
+            if (nowUs() - lastDataUs > DATAFLASH_STREAM_TIMEOUT_MS * 1000) {
+                fprintf(stderr, "The stream stopped at 0x%08x\n", expected);
+                return false;
+            }
+            // The last ack may have been lost
+            sendAck(link, expected, DATAFLASH_STREAM_ACK_RESEND, stats);
+            continue;
+        }
+
+        if (frame.cmd != MSP2_BLACKBOX_STREAM_DATA || frame.size < DATAFLASH_STREAM_DATA_HEADER_SIZE) {
+            continue;
+        }
+
+        const uint32_t frameAddress = readU32(frame.payload);
+        const uint16_t frameLength = readU16(frame.payload + 4);
+        const bool erased = frame.payload[6] & DATAFLASH_STREAM_CHUNK_ERASED;
+
+        stats->frames++;
+
+        if (frameAddress != expected || frameAddress + frameLength > end
+                || (!erased && frame.size != DATAFLASH_STREAM_DATA_HEADER_SIZE + frameLength)) {
+            stats->outOfOrderFrames++;
+            if (frameAddress > expected && !resendRequested) {
+                // Something before this frame was lost. Ask once for everything from there on
+                resendRequested = sendAck(link, expected, DATAFLASH_STREAM_ACK_RESEND, stats);
+                stats->resendRequests++;
+            } else if (frameAddress < expected) {
+                // Sent again after a lost ack
+                sendAck(link, expected, 0, stats);
+            }
+            continue;
+        }
+
+        if (erased) {
+            memset(data + (frameAddress - start), 0xFF, frameLength);
+            stats->erasedFrames++;
+        } else {
+            memcpy(data + (frameAddress - start), frame.payload + DATAFLASH_STREAM_DATA_HEADER_SIZE, frameLength);
+        }
+        expected += frameLength;
+        resendRequested = false;
+        lastDataUs = nowUs();
+
+        if (expected - acked >= ackEvery || expected >= end) {
+            sendAck(link, expected, 0, stats);
+            acked = expected;
+        }
+    }
+    return true;
+}
+
+/*
+ * Fills the first size bytes of a flash image with data which doesn't compress and leaves the rest erased, the
+ * way flashfs finds a flash with one long log on it.
+ */
+static bool makeImage(const char *fileName, uint32_t size, uint32_t totalSize)
+{
+    FILE *file = fopen(fileName, "wb");
+    if (!file) {
+        fprintf(stderr, "Can't create %s: %s\n", fileName, strerror(errno));
+        return false;
+    }
+
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < totalSize; i++) {
+        seed = seed * 1664525 + 1013904223;
+        // Programmed flash is never all 0xFF for long, flashfs would take it for free space
+        fputc(i < size ? (seed >> 24) & 0x7F : 0xFF, file);
+    }
+
+    return fclose(file) == 0;
+}
+
+static bool verifyImage(const char *fileName, const uint8_t *data, uint32_t address, uint32_t length)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (!file) {
+        fprintf(stderr, "Can't open %s: %s\n", fileName, strerror(errno));
+        return false;
+    }
+
+    uint8_t *image = malloc(length);
+    const bool readOk = fseek(file, address, SEEK_SET) == 0 && fread(image, 1, length, file) == length;
+    fclose(file);
+
+    uint32_t mismatch = length;
+    for (uint32_t i = 0; readOk && i < length; i++) {
+        if (image[i] != data[i]) {
+            mismatch = i;
+            break;
+        }
+    }
+    free(image);
+
+    if (!readOk) {
+        fprintf(stderr, "%s is shorter than the download\n", fileName);
+        return false;
+    }
+    if (mismatch < length) {
+        fprintf(stderr, "The download differs from %s at 0x%08x\n", fileName, address + mismatch);
+        return false;
+    }
+    return true;
+}
+
+static void printUsage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  --host=[ip]            Address of SITL (default: 127.0.0.1)\n");
+    fprintf(stderr, "  --port=[port]          MSP TCP port of SITL (default: %d)\n", DOWNLOAD_DEFAULT_PORT);
+    fprintf(stderr, "  --legacy               Use one MSP_DATAFLASH_READ request per chunk instead of the stream\n");
+    fprintf(stderr, "  --chunk=[bytes]        Flash bytes per frame (default: %d)\n", DOWNLOAD_DEFAULT_CHUNK);
+    fprintf(stderr, "  --window=[frames]      Frames the FC sends ahead of the acks (default: %d)\n", DOWNLOAD_DEFAULT_WINDOW);
+    fprintf(stderr, "  --address=[bytes]      Flash address to start at (default: 0)\n");
+    fprintf(stderr, "  --length=[bytes]       Bytes to download (default: the used part of the flash)\n");
+    fprintf(stderr, "  --output=[file]        Write the download to a file\n");
+    fprintf(stderr, "  --verify=[image]       Compare the download with a flash image, f.e. the flash.bin of SITL\n");
+    fprintf(stderr, "  --make-image=[image]   Write a flash image for SITL with --length bytes used, then exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "127.0.0.1";
+    const char *outputFileName = NULL;
+    const char *verifyFileName = NULL;
+    const char *imageFileName = NULL;
+    int port = DOWNLOAD_DEFAULT_PORT;
+    bool legacy = false;
+    int chunkSize = DOWNLOAD_DEFAULT_CHUNK;
+    int window = DOWNLOAD_DEFAULT_WINDOW;
+    uint32_t address = 0;
+    uint32_t length = 0;
+
+    static const struct option longOpt[] = {
+        { "host", required_argument, NULL, 'h' },
+        { "port", required_argument, NULL, 'p' },
+        { "legacy", no_argument, NULL, 'l' },
+        { "chunk", required_argument, NULL, 'c' },
+        { "window", required_argument, NULL, 'w' },
+        { "address", required_argument, NULL, 'a' },
+        { "length", required_argument, NULL, 'n' },
+        { "output", required_argument, NULL, 'o' },
+        { "verify", required_argument, NULL, 'v' },
+        { "make-image", required_argument, NULL, 'm' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOpt, NULL)) != -1) {
+        switch (c) {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'l': legacy = true; break;
+        case 'c': chunkSize = atoi(optarg); break;
+        case 'w': window = atoi(optarg); break;
+        case 'a': address = strtoul(optarg, NULL, 0); break;
+        case 'n': length = strtoul(optarg, NULL, 0); break;
+        case 'o': outputFileName = optarg; break;
+        case 'v': verifyFileName = optarg; break;
+        case 'm': imageFileName = optarg; break;
+        default:
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (chunkSize <= 0 || chunkSize > (legacy ? DOWNLOAD_LEGACY_MAX_CHUNK : DATAFLASH_STREAM_MAX_CHUNK) || window <= 0 || window > 255) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (imageFileName) {
+        // The size of the flash SITL emulates, see drivers/flash_file.h
+        return makeImage(imageFileName, length ? length : 8 * 1024 * 1024, 16 * 1024 * 1024) ? 0 : 1;
+    }
+
+    static mspLink_t link;
+    static mspFrame_t reply;
+
+    if (!mspConnect(&link, host, port)) {
+        return 1;
+    }
+
+    if (!mspRequest(&link, MSP_DATAFLASH_SUMMARY, NULL, 0, &reply) || reply.size < 13 || !reply.payload[0]) {
+        fprintf(stderr, "The FC has no dataflash. Set blackbox_device = SPIFLASH and save\n");
+        return 1;
+    }
+
+    const uint32_t usedSize = readU32(reply.payload + 9);
+    if (length == 0) {
+        length = usedSize > address ? usedSize - address : 0;
+    }
+    if (length == 0) {
+        fprintf(stderr, "Nothing to download\n");
+        return 1;
+    }
+
+    uint8_t *data = malloc(length);
+    downloadStats_t stats = { 0 };
+
+    const uint64_t startUs = nowUs();
+    const bool downloaded = legacy
+        ? downloadLegacy(&link, data, address, length, chunkSize, &stats)
+        : downloadStream(&link, data, address, length, chunkSize, window, &stats);
+    const double seconds = (nowUs() - startUs) / 1e6;
+
+    close(link.fd);
+
+    if (!downloaded) {
+        free(data);
+        return 1;
+    }
+
+    printf("%s: %u bytes in %.3f s, %.3f MB/s\n", legacy ? "request/response" : "stream", length, seconds, length / seconds / 1e6);
+    if (legacy) {
+        printf("  %u requests\n", stats.requests);
+    } else {
+        printf("  %u frames (%u erased, %u out of order), %u acks, %u resend requests\n",
+            stats.frames, stats.erasedFrames, stats.outOfOrderFrames, stats.acks, stats.resendRequests);
+    }
+    if (link.crcErrors) {
+        printf("  %u frames with a bad CRC\n", link.crcErrors);
+    }
+
+    bool ok = true;
+    if (outputFileName) {
+        FILE *file = fopen(outputFileName, "wb");
+        ok = file && fwrite(data, 1, length, file) == length;
+        if (file) {
+            fclose(file);
+        }
+    }
+    if (verifyFileName) {
+        ok = verifyImage(verifyFileName, data, address, length) && ok;
+        if (ok) {
+            printf("  matches %s\n", verifyFileName);
+        }
+    }
+
+    free(data);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,876 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Offline gyro filter chain replay. Raw gyro and motor RPM from a decoded blackbox log
+ * are run through the anti-aliasing LPF and the filter chain gyroFilter() runs, once for
+ * every configuration given on the command line. See docs/development/Filter replay.md
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "platform.h"
+
+#include "build/debug.h"
+
+#include "common/axis.h"
+#include "common/filter.h"
+#include "common/maths.h"
+#include "common/time.h"
+#include "common/utils.h"
+
+#include "fc/config.h"
+#include "fc/settings.h"
+
+#include "flight/kalman.h"
+#include "flight/mixer.h"
+#include "flight/rpm_filter.h"
+
+#include "sensors/esc_sensor.h"
+#include "sensors/gyro.h"
+#include "sensors/gyro_filter_chain.h"
+
+#define REPLAY_MAX_LINE             4096
+#define REPLAY_MAX_COLUMNS          512
+#define REPLAY_WARMUP_US            500000      // filters settling, not included in the results
+#define REPLAY_DEFAULT_SIGNAL_HZ    60
+#define REPLAY_DEFAULT_MAX_DELAY_MS 20
+
+// The anti-aliasing LPF runs at the gyro rate in gyroUpdate(), the chain stages follow it
+typedef enum {
+    STAGE_ANTI_ALIASING_LPF = 0,
+    STAGE_CHAIN,
+    STAGE_COUNT = STAGE_CHAIN + GYRO_FILTER_STAGE_COUNT
+} replayStage_e;
+
+static const char * const stageNames[STAGE_COUNT] = {
+    [STAGE_ANTI_ALIASING_LPF]                       = "aa_lpf",
+    [STAGE_CHAIN + GYRO_FILTER_STAGE_RPM]           = "rpm",
+    [STAGE_CHAIN + GYRO_FILTER_STAGE_LULU]          = "lulu",
+    [STAGE_CHAIN + GYRO_FILTER_STAGE_MAIN_LPF]      = "main_lpf",
+    [STAGE_CHAIN + GYRO_FILTER_STAGE_DYNAMIC_NOTCH] = "dyn_notch",
+    [STAGE_CHAIN + GYRO_FILTER_STAGE_KALMAN]        = "kalman",
+    [STAGE_CHAIN + GYRO_FILTER_STAGE_SPECTRUM]      = "spectrum",
+};
+
+typedef struct {
+    uint32_t sampleCount;
+    uint32_t looptimeUs;
+    uint8_t motorCount;
+    float *gyroRaw[XYZ_AXIS_COUNT];
+    float *setpoint[XYZ_AXIS_COUNT];    // NULL when axisRate is not logged
+    float *rpm[MAX_SUPPORTED_MOTORS];
+} replayLog_t;
+
+typedef struct {
+    float delayMs;
+    float noiseIn;
+    float noiseOut;
+    double stageNs[STAGE_COUNT];
+} replayResult_t;
+
+typedef struct {
+    const char *name;
+    void *field;
+    uint8_t size;
+    int32_t min;
+    int32_t max;
+    const char * const *values;         // names of table values, NULL for numeric settings
+} replaySetting_t;
+
+// Firmware state normally owned by sensors/gyro.c and the mixer
+gyroConfig_t gyroConfig_System;
+static escSensorData_t escSensorData[MAX_SUPPORTED_MOTORS];
+
+int32_t debug[DEBUG32_VALUE_COUNT];
+uint8_t debugMode;
+
+extern const rpmFilterConfig_t pgResetTemplate_rpmFilterConfig;
+
+static replayLog_t replayLog;
+
+uint32_t getLooptime(void)
+{
+    return replayLog.looptimeUs;
+}
+
+uint8_t getMotorCount(void)
+{
+    return replayLog.motorCount;
+}
+
+escSensorData_t *getEscTelemetry(uint8_t esc)
+{
+    return &escSensorData[esc];
+}
+
+static const char * const offOnValues[] = { "OFF", "ON", NULL };
+static const char * const filterModeValues[] = { "OFF", "STATIC", "DYNAMIC", "ADAPTIVE", NULL };
+static const char * const notchModeValues[] = { "2D", "3D", NULL };
+static const char * const fftSizeValues[] = { "64", "128", "256", NULL };
+static const char * const analyserValues[] = { "FFT", "SDFT", NULL };
+
+#define SETTING_NUMBER(_name, _config, _field, _min, _max) \
+    { _name, &_config._field, sizeof(_config._field), _min, _max, NULL }
+#define SETTING_TABLE(_name, _config, _field, _values) \
+    { _name, &_config._field, sizeof(_config._field), 0, ARRAYLEN(_values) - 2, _values }
+
+static const replaySetting_t replaySettings[] = {
+    SETTING_NUMBER("gyro_anti_aliasing_lpf_hz", gyroConfig_System, gyro_anti_aliasing_lpf_hz, 0, SETTING_GYRO_ANTI_ALIASING_LPF_HZ_MAX),
+    SETTING_TABLE("gyro_lulu_enabled", gyroConfig_System, gyroLuluEnabled, offOnValues),
+    SETTING_NUMBER("gyro_lulu_sample_count", gyroConfig_System, gyroLuluSampleCount, SETTING_GYRO_LULU_SAMPLE_COUNT_MIN, SETTING_GYRO_LULU_SAMPLE_COUNT_MAX),
+    SETTING_NUMBER("gyro_main_lpf_hz", gyroConfig_System, gyro_main_lpf_hz, SETTING_GYRO_MAIN_LPF_HZ_MIN, SETTING_GYRO_MAIN_LPF_HZ_MAX),
+    SETTING_TABLE("gyro_filter_mode", gyroConfig_System, gyroFilterMode, filterModeValues),
+    SETTING_TABLE("dynamic_gyro_notch_enabled", gyroConfig_System, dynamicGyroNotchEnabled, offOnValues),
+    SETTING_NUMBER("dynamic_gyro_notch_q", gyroConfig_System, dynamicGyroNotchQ, SETTING_DYNAMIC_GYRO_NOTCH_Q_MIN, SETTING_DYNAMIC_GYRO_NOTCH_Q_MAX),
+    SETTING_NUMBER("dynamic_gyro_notch_min_hz", gyroConfig_System, dynamicGyroNotchMinHz, SETTING_DYNAMIC_GYRO_NOTCH_MIN_HZ_MIN, SETTING_DYNAMIC_GYRO_NOTCH_MIN_HZ_MAX),
+    SETTING_TABLE("dynamic_gyro_notch_mode", gyroConfig_System, dynamicGyroNotchMode, notchModeValues),
+    SETTING_NUMBER("dynamic_gyro_notch_3d_q", gyroConfig_System, dynamicGyroNotch3dQ, SETTING_DYNAMIC_GYRO_NOTCH_3D_Q_MIN, SETTING_DYNAMIC_GYRO_NOTCH_3D_Q_MAX),
+    SETTING_TABLE("dynamic_gyro_notch_fft_size", gyroConfig_System, dynamicGyroNotchFftSize, fftSizeValues),
+    SETTING_TABLE("dynamic_gyro_notch_fft_overlap", gyroConfig_System, dynamicGyroNotchFftOverlap, offOnValues),
+    SETTING_TABLE("dynamic_gyro_notch_analyser", gyroConfig_System, dynamicGyroNotchAnalyser, analyserValues),
+    SETTING_TABLE("setpoint_kalman_enabled", gyroConfig_System, kalmanEnabled, offOnValues),
+    SETTING_NUMBER("setpoint_kalman_q", gyroConfig_System, kalman_q, SETTING_SETPOINT_KALMAN_Q_MIN, SETTING_SETPOINT_KALMAN_Q_MAX),
+    SETTING_TABLE("rpm_gyro_filter_enabled", rpmFilterConfig_System, gyro_filter_enabled, offOnValues),
+    SETTING_NUMBER("rpm_gyro_harmonics", rpmFilterConfig_System, gyro_harmonics, SETTING_RPM_GYRO_HARMONICS_MIN, SETTING_RPM_GYRO_HARMONICS_MAX),
+    SETTING_NUMBER("rpm_gyro_min_hz", rpmFilterConfig_System, gyro_min_hz, SETTING_RPM_GYRO_MIN_HZ_MIN, SETTING_RPM_GYRO_MIN_HZ_MAX),
+    SETTING_NUMBER("rpm_gyro_q", rpmFilterConfig_System, gyro_q, SETTING_RPM_GYRO_Q_MIN, SETTING_RPM_GYRO_Q_MAX),
+};
+
+static void resetSettings(void)
+{
+    memset(&gyroConfig_System, 0, sizeof(gyroConfig_System));
+    gyroConfig_System.gyro_anti_aliasing_lpf_hz = SETTING_GYRO_ANTI_ALIASING_LPF_HZ_DEFAULT;
+    gyroConfig_System.gyroLuluEnabled = SETTING_GYRO_LULU_ENABLED_DEFAULT;
+    gyroConfig_System.gyroLuluSampleCount = SETTING_GYRO_LULU_SAMPLE_COUNT_DEFAULT;
+    gyroConfig_System.gyro_main_lpf_hz = SETTING_GYRO_MAIN_LPF_HZ_DEFAULT;
+    gyroConfig_System.gyroFilterMode = SETTING_GYRO_FILTER_MODE_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchEnabled = SETTING_DYNAMIC_GYRO_NOTCH_ENABLED_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchQ = SETTING_DYNAMIC_GYRO_NOTCH_Q_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchMinHz = SETTING_DYNAMIC_GYRO_NOTCH_MIN_HZ_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchMode = SETTING_DYNAMIC_GYRO_NOTCH_MODE_DEFAULT;
+    gyroConfig_System.dynamicGyroNotch3dQ = SETTING_DYNAMIC_GYRO_NOTCH_3D_Q_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchFftSize = SETTING_DYNAMIC_GYRO_NOTCH_FFT_SIZE_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchFftOverlap = SETTING_DYNAMIC_GYRO_NOTCH_FFT_OVERLAP_DEFAULT;
+    gyroConfig_System.dynamicGyroNotchAnalyser = SETTING_DYNAMIC_GYRO_NOTCH_ANALYSER_DEFAULT;
+    gyroConfig_System.kalmanEnabled = SETTING_SETPOINT_KALMAN_ENABLED_DEFAULT;
+    gyroConfig_System.kalman_q = SETTING_SETPOINT_KALMAN_Q_DEFAULT;
+
+    rpmFilterConfig_System = pgResetTemplate_rpmFilterConfig;
+}
+
+static bool parseSettingValue(const replaySetting_t *setting, const char *text, int32_t *value)
+{
+    if (setting->values) {
+        for (int i = 0; setting->values[i]; i++) {
+            if (strcasecmp(setting->values[i], text) == 0) {
+                *value = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    char *end;
+    *value = strtol(text, &end, 10);
+    return end != text && *end == '\0' && *value >= setting->min && *value <= setting->max;
+}
+
+/*
+ * Applies "name=value,name=value" on top of the defaults
+ */
+static bool applyConfig(const char *config)
+{
+    char buffer[REPLAY_MAX_LINE];
+    strncpy(buffer, config, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    resetSettings();
+
+    for (char *item = strtok(buffer, ", \t"); item; item = strtok(NULL, ", \t")) {
+        char *value = strchr(item, '=');
+        if (!value) {
+            fprintf(stderr, "Expected name=value, got '%s'\n", item);
+            return false;
+        }
+        *value++ = '\0';
+
+        const replaySetting_t *setting = NULL;
+        for (unsigned i = 0; i < ARRAYLEN(replaySettings); i++) {
+            if (strcmp(replaySettings[i].name, item) == 0) {
+                setting = &replaySettings[i];
+                break;
+            }
+        }
+
+        int32_t parsed;
+        if (!setting) {
+            fprintf(stderr, "Unknown setting '%s'\n", item);
+            return false;
+        }
+        if (!parseSettingValue(setting, value, &parsed)) {
+            fprintf(stderr, "Invalid value '%s' for %s\n", value, item);
+            return false;
+        }
+
+        switch (setting->size) {
+            case 1:
+                *(uint8_t *)setting->field = parsed;
+                break;
+            case 2:
+                *(uint16_t *)setting->field = parsed;
+                break;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Log loading
+ */
+
+static float *allocSamples(uint32_t count)
+{
+    float *samples = calloc(count, sizeof(float));
+    if (!samples) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return samples;
+}
+
+static void allocLog(replayLog_t *log, uint32_t capacity, bool withSetpoint)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        log->gyroRaw[axis] = allocSamples(capacity);
+        log->setpoint[axis] = withSetpoint ? allocSamples(capacity) : NULL;
+    }
+    for (int motor = 0; motor < log->motorCount; motor++) {
+        log->rpm[motor] = allocSamples(capacity);
+    }
+}
+
+static void growLog(replayLog_t *log, uint32_t capacity)
+{
+    float **arrays[] = { log->gyroRaw, log->setpoint, log->rpm };
+    const int counts[] = { XYZ_AXIS_COUNT, XYZ_AXIS_COUNT, log->motorCount };
+
+    for (unsigned i = 0; i < ARRAYLEN(arrays); i++) {
+        for (int j = 0; j < counts[i]; j++) {
+            if (arrays[i][j]) {
+                arrays[i][j] = realloc(arrays[i][j], capacity * sizeof(float));
+                if (!arrays[i][j]) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    }
+}
+
+static int splitCsvLine(char *line, char **fields)
+{
+    int count = 0;
+    char *field = line;
+
+    while (count < REPLAY_MAX_COLUMNS) {
+        char *end = strchr(field, ',');
+        if (end) {
+            *end = '\0';
+        }
+
+        // Trim spaces, quotes and the line end
+        while (*field == ' ' || *field == '"') {
+            field++;
+        }
+        for (char *tail = field + strlen(field); tail > field && strchr(" \"\r\n", tail[-1]); tail--) {
+            tail[-1] = '\0';
+        }
+        fields[count++] = field;
+
+        if (!end) {
+            break;
+        }
+        field = end + 1;
+    }
+
+    return count;
+}
+
+static int findColumn(char **header, int columnCount, const char *name)
+{
+    for (int i = 0; i < columnCount; i++) {
+        if (strcmp(header[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Reads a CSV made by blackbox_decode. gyroRaw[0..2] are required, RPM is taken from
+ * escRPM[n] per motor or from the single escRPM column INAV logs in the slow frames.
+ */
+static bool loadCsvLog(replayLog_t *log, const char *fileName, uint32_t looptimeUs)
+{
+    FILE *file = fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", fileName);
+        return false;
+    }
+
+    static char line[REPLAY_MAX_LINE];
+    static char *header[REPLAY_MAX_COLUMNS];
+    static char *fields[REPLAY_MAX_COLUMNS];
+
+    if (!fgets(line, sizeof(line), file)) {
+        fprintf(stderr, "%s is empty\n", fileName);
+        fclose(file);
+        return false;
+    }
+    char *headerLine = strdup(line);
+    const int columnCount = splitCsvLine(headerLine, header);
+
+    int gyroColumn[XYZ_AXIS_COUNT];
+    int setpointColumn[XYZ_AXIS_COUNT];
+    int rpmColumn[MAX_SUPPORTED_MOTORS];
+    bool withSetpoint = true;
+    char name[32];
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        snprintf(name, sizeof(name), "gyroRaw[%d]", axis);
+        gyroColumn[axis] = findColumn(header, columnCount, name);
+        if (gyroColumn[axis] < 0) {
+            fprintf(stderr, "%s has no %s column, the log has to be recorded with the GYRO_RAW blackbox field\n", fileName, name);
+            fclose(file);
+            free(headerLine);
+            return false;
+        }
+
+        snprintf(name, sizeof(name), "axisRate[%d]", axis);
+        setpointColumn[axis] = findColumn(header, columnCount, name);
+        withSetpoint = withSetpoint && setpointColumn[axis] >= 0;
+    }
+
+    log->motorCount = 0;
+    for (int motor = 0; motor < MAX_SUPPORTED_MOTORS; motor++) {
+        snprintf(name, sizeof(name), "escRPM[%d]", motor);
+        rpmColumn[motor] = findColumn(header, columnCount, name);
+        if (rpmColumn[motor] < 0) {
+            break;
+        }
+        log->motorCount++;
+    }
+    if (log->motorCount == 0) {
+        // Single ESC telemetry value, used for all motors
+        rpmColumn[0] = findColumn(header, columnCount, "escRPM");
+        log->motorCount = rpmColumn[0] >= 0 ? 4 : 0;
+        for (int motor = 1; motor < log->motorCount; motor++) {
+            rpmColumn[motor] = rpmColumn[0];
+        }
+    }
+
+    const int timeColumn = findColumn(header, columnCount, "time (us)") >= 0 ? findColumn(header, columnCount, "time (us)") : findColumn(header, columnCount, "time");
+
+    uint32_t capacity = 1 << 16;
+    double firstTime = 0;
+    double lastTime = 0;
+    allocLog(log, capacity, withSetpoint);
+    log->sampleCount = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        const int count = splitCsvLine(line, fields);
+        if (count < columnCount) {
+            continue;
+        }
+
+        if (log->sampleCount == capacity) {
+            capacity *= 2;
+            growLog(log, capacity);
+        }
+
+        const uint32_t sample = log->sampleCount++;
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            log->gyroRaw[axis][sample] = strtof(fields[gyroColumn[axis]], NULL);
+            if (withSetpoint) {
+                log->setpoint[axis][sample] = strtof(fields[setpointColumn[axis]], NULL);
+            }
+        }
+        for (int motor = 0; motor < log->motorCount; motor++) {
+            log->rpm[motor][sample] = strtof(fields[rpmColumn[motor]], NULL);
+        }
+
+        if (timeColumn >= 0) {
+            lastTime = strtod(fields[timeColumn], NULL);
+            if (sample == 0) {
+                firstTime = lastTime;
+            }
+        }
+    }
+
+    fclose(file);
+    free(headerLine);
+
+    if (log->sampleCount < 2) {
+        fprintf(stderr, "%s has no samples\n", fileName);
+        return false;
+    }
+
+    log->looptimeUs = looptimeUs;
+    if (!log->looptimeUs) {
+        if (timeColumn < 0) {
+            fprintf(stderr, "%s has no time column, use --looptime\n", fileName);
+            return false;
+        }
+        log->looptimeUs = lrint((lastTime - firstTime) / (log->sampleCount - 1));
+    }
+
+    return log->looptimeUs > 0;
+}
+
+/*
+ * Synthetic flight: stick motion below 10Hz, motor noise following the RPM of
+ * 4 motors on their own throttle curves, a frame resonance and broadband noise
+ */
+static void generateLog(replayLog_t *log, float seconds, uint32_t looptimeUs)
+{
+    log->looptimeUs = looptimeUs ? looptimeUs : 250;
+    log->sampleCount = seconds * 1e6f / log->looptimeUs;
+    log->motorCount = 4;
+    allocLog(log, log->sampleCount, true);
+
+    float motorPhase[4] = { 0 };
+    srand(1);
+
+    for (uint32_t sample = 0; sample < log->sampleCount; sample++) {
+        const float t = sample * log->looptimeUs * 1e-6f;
+        const float dT = log->looptimeUs * 1e-6f;
+        float motorNoise = 0.0f;
+
+        for (int motor = 0; motor < log->motorCount; motor++) {
+            const float rpm = 16000 + 7000 * sinf(2 * M_PIf * (0.2f + 0.07f * motor) * t + motor);
+            log->rpm[motor][sample] = rpm;
+            motorPhase[motor] += 2 * M_PIf * rpm / 60.0f * dT;
+            motorNoise += 15.0f * sinf(motorPhase[motor]) + 6.0f * sinf(2 * motorPhase[motor]);
+        }
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const float motion = 150.0f * sinf(2 * M_PIf * (1.3f + axis) * t) + 60.0f * sinf(2 * M_PIf * (4.1f + axis) * t + axis);
+            const float resonance = 10.0f * sinf(2 * M_PIf * 185.0f * t + axis);
+            const float whiteNoise = 6.0f * (rand() / (float)RAND_MAX - 0.5f);
+
+            log->setpoint[axis][sample] = motion;
+            log->gyroRaw[axis][sample] = motion + motorNoise * (axis == FD_YAW ? 0.5f : 1.0f) + resonance + whiteNoise;
+        }
+    }
+}
+
+/*
+ * Replay
+ */
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Cost of reading the clock, subtracted from every stage measurement
+static double timerOverheadNs(void)
+{
+    const int count = 100000;
+    const double start = nowNs();
+    for (int i = 0; i < count; i++) {
+        nowNs();
+    }
+    return (nowNs() - start) / count;
+}
+
+static void replayConfig(const replayLog_t *log, float *output[XYZ_AXIS_COUNT], replayResult_t *result, double clockNs)
+{
+    const gyroConfig_t *config = gyroConfig();
+    pt1Filter_t antiAliasingLpf[XYZ_AXIS_COUNT];
+
+    const bool antiAliasingEnabled = config->gyro_anti_aliasing_lpf_hz > 0;
+    const bool rpmEnabled = rpmFilterConfig()->gyro_filter_enabled && log->motorCount > 0;
+    const uint32_t rpmUpdateSamples = MAX(1, lrintf(RPM_FILTER_UPDATE_RATE_US / log->looptimeUs));
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        pt1FilterInit(&antiAliasingLpf[axis], config->gyro_anti_aliasing_lpf_hz, US2S(log->looptimeUs));
+    }
+
+    rpmFiltersInit();
+    if (!rpmEnabled) {
+        disableRpmFilters();
+    }
+    memset(escSensorData, 0, sizeof(escSensorData));
+
+    gyroFilterChainInit();
+
+    memset(result->stageNs, 0, sizeof(result->stageNs));
+
+    for (uint32_t sample = 0; sample < log->sampleCount; sample++) {
+        float gyroADCf[XYZ_AXIS_COUNT];
+        double start;
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroADCf[axis] = log->gyroRaw[axis][sample];
+        }
+
+        if (antiAliasingEnabled) {
+            start = nowNs();
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                gyroADCf[axis] = pt1FilterApply(&antiAliasingLpf[axis], gyroADCf[axis]);
+            }
+            result->stageNs[STAGE_ANTI_ALIASING_LPF] += nowNs() - start - clockNs;
+        }
+
+        // Inputs the RPM filter task and the PID controller provide in the firmware
+        if (rpmEnabled && sample % rpmUpdateSamples == 0) {
+            start = nowNs();
+            for (int motor = 0; motor < log->motorCount; motor++) {
+                escSensorData[motor].rpm = log->rpm[motor][sample];
+            }
+            rpmFilterUpdateTask(0);
+            result->stageNs[STAGE_CHAIN + GYRO_FILTER_STAGE_RPM] += nowNs() - start - clockNs;
+        }
+        if (config->kalmanEnabled) {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                if (log->setpoint[axis]) {
+                    gyroKalmanUpdateSetpoint(axis, log->setpoint[axis][sample]);
+                }
+            }
+        }
+
+        for (int stage = 0; stage < GYRO_FILTER_STAGE_COUNT; stage++) {
+            start = nowNs();
+            gyroFilterChainApplyStage(stage, gyroADCf);
+            result->stageNs[STAGE_CHAIN + stage] += nowNs() - start - clockNs;
+        }
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            output[axis][sample] = gyroADCf[axis];
+        }
+    }
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        result->stageNs[stage] = MAX(0.0, result->stageNs[stage] / log->sampleCount);
+    }
+}
+
+/*
+ * Analysis
+ */
+
+// Zero phase low pass, separates flight motion from noise without shifting it in time
+static void zeroPhaseLowPass(const float *input, float *output, uint32_t count, float cutoffHz, uint32_t looptimeUs)
+{
+    biquadFilter_t filter;
+
+    biquadFilterInitLPF(&filter, cutoffHz, looptimeUs);
+    biquadFilterReset(&filter, input[0]);
+    for (uint32_t i = 0; i < count; i++) {
+        output[i] = biquadFilterApply(&filter, input[i]);
+    }
+
+    biquadFilterReset(&filter, output[count - 1]);
+    for (uint32_t i = count; i-- > 0;) {
+        output[i] = biquadFilterApply(&filter, output[i]);
+    }
+}
+
+static float noiseRms(const float *samples, const float *motion, uint32_t first, uint32_t count)
+{
+    double sum = 0;
+    for (uint32_t i = first; i < count; i++) {
+        sum += sq((double)samples[i] - motion[i]);
+    }
+    return sqrt(sum / (count - first));
+}
+
+/*
+ * Delay of the filtered signal behind the flight motion, from the peak of their cross
+ * correlation refined with a parabola through the neighbour lags. Returns -1 if the
+ * axis has too little motion to tell.
+ */
+static float delaySamples(const float *motion, const float *filtered, uint32_t first, uint32_t count, int maxLag)
+{
+    double motionMean = 0;
+    double filteredMean = 0;
+    for (uint32_t i = first; i < count; i++) {
+        motionMean += motion[i];
+        filteredMean += filtered[i];
+    }
+    motionMean /= count - first;
+    filteredMean /= count - first;
+
+    double correlation[maxLag + 1];
+    for (int lag = 0; lag <= maxLag; lag++) {
+        double sum = 0;
+        for (uint32_t i = first; i + lag < count; i++) {
+            sum += (motion[i] - motionMean) * (filtered[i + lag] - filteredMean);
+        }
+        correlation[lag] = sum;
+    }
+
+    int best = 0;
+    for (int lag = 1; lag <= maxLag; lag++) {
+        if (correlation[lag] > correlation[best]) {
+            best = lag;
+        }
+    }
+    if (correlation[best] <= 0) {
+        return -1;
+    }
+
+    float delay = best;
+    if (best > 0 && best < maxLag) {
+        const double denom = correlation[best - 1] - 2 * correlation[best] + correlation[best + 1];
+        if (denom != 0) {
+            delay += constrainf(0.5 * (correlation[best - 1] - correlation[best + 1]) / denom, -0.5f, 0.5f);
+        }
+    }
+
+    return delay;
+}
+
+static void analyseResult(const replayLog_t *log, float *motion[XYZ_AXIS_COUNT], float *output[XYZ_AXIS_COUNT], float signalHz, float maxDelayMs, replayResult_t *result)
+{
+    const uint32_t first = MIN(REPLAY_WARMUP_US / log->looptimeUs, log->sampleCount / 2);
+    const int maxLag = MAX(1, lrintf(maxDelayMs * 1000 / log->looptimeUs));
+    float *outputMotion = allocSamples(log->sampleCount);
+    double noiseIn = 0;
+    double noiseOut = 0;
+    double delay = 0;
+    int delayAxes = 0;
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        zeroPhaseLowPass(output[axis], outputMotion, log->sampleCount, signalHz, log->looptimeUs);
+
+        noiseIn += sq(noiseRms(log->gyroRaw[axis], motion[axis], first, log->sampleCount));
+        noiseOut += sq(noiseRms(output[axis], outputMotion, first, log->sampleCount));
+
+        const float axisDelay = delaySamples(motion[axis], output[axis], first, log->sampleCount, maxLag);
+        if (axisDelay >= 0) {
+            delay += axisDelay;
+            delayAxes++;
+        }
+    }
+    free(outputMotion);
+
+    result->noiseIn = sqrt(noiseIn / XYZ_AXIS_COUNT);
+    result->noiseOut = sqrt(noiseOut / XYZ_AXIS_COUNT);
+    result->delayMs = delayAxes ? delay / delayAxes * log->looptimeUs / 1000.0f : NAN;
+}
+
+/*
+ * Command line
+ */
+
+static void printResult(const char *config, const replayResult_t *result, bool csv)
+{
+    double totalNs = 0;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        totalNs += result->stageNs[stage];
+    }
+    const float attenuationDb = 20 * log10f(result->noiseOut / result->noiseIn);
+
+    if (csv) {
+        printf("\"%s\",%.3f,%.3f,%.3f,%.2f,%.1f", config, result->delayMs, result->noiseIn, result->noiseOut, attenuationDb, totalNs);
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            printf(",%.1f", result->stageNs[stage]);
+        }
+        printf("\n");
+        return;
+    }
+
+    printf("%s\n", config[0] ? config : "(defaults)");
+    printf("    delay %.2f ms, noise %.2f -> %.2f deg/s rms (%.1f dB), %.1f ns/sample:", result->delayMs, result->noiseIn, result->noiseOut, attenuationDb, totalNs);
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        if (result->stageNs[stage] > 0) {
+            printf(" %s %.1f", stageNames[stage], result->stageNs[stage]);
+        }
+    }
+    printf("\n");
+}
+
+static bool writeOutput(const char *fileName, const replayLog_t *log, float *output[XYZ_AXIS_COUNT])
+{
+    FILE *file = fopen(fileName, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot create %s\n", fileName);
+        return false;
+    }
+
+    fprintf(file, "time (us),gyroRaw[0],gyroRaw[1],gyroRaw[2],gyroADC[0],gyroADC[1],gyroADC[2]\n");
+    for (uint32_t sample = 0; sample < log->sampleCount; sample++) {
+        fprintf(file, "%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", sample * log->looptimeUs,
+            log->gyroRaw[FD_ROLL][sample], log->gyroRaw[FD_PITCH][sample], log->gyroRaw[FD_YAW][sample],
+            output[FD_ROLL][sample], output[FD_PITCH][sample], output[FD_YAW][sample]);
+    }
+
+    return fclose(file) == 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <log.csv | --synthetic seconds> [config ...]\n"
+        "\n"
+        "Replays gyroRaw of a blackbox_decode CSV through the gyro filter chain once per config.\n"
+        "A config is a comma separated list of setting=value, applied on top of the defaults.\n"
+        "Without configs the defaults are replayed.\n"
+        "\n"
+        "Options:\n"
+        "  --configs <file>       read configs from a file, one per line\n"
+        "  --looptime <us>        sample interval, taken from the time column by default\n"
+        "  --signal-hz <hz>       content below is flight motion, above is noise (default %d)\n"
+        "  --max-delay-ms <ms>    longest delay searched for (default %d)\n"
+        "  --output <file>        write the filtered gyro of the last config as CSV\n"
+        "  --csv                  one CSV line per config\n"
+        "\n"
+        "Settings:\n",
+        name, REPLAY_DEFAULT_SIGNAL_HZ, REPLAY_DEFAULT_MAX_DELAY_MS);
+
+    for (unsigned i = 0; i < ARRAYLEN(replaySettings); i++) {
+        fprintf(stderr, "  %s\n", replaySettings[i].name);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *logFileName = NULL;
+    const char *configsFileName = NULL;
+    const char *outputFileName = NULL;
+    float syntheticSeconds = 0;
+    uint32_t looptimeUs = 0;
+    float signalHz = REPLAY_DEFAULT_SIGNAL_HZ;
+    float maxDelayMs = REPLAY_DEFAULT_MAX_DELAY_MS;
+    bool csv = false;
+    const char **configs = calloc(argc + 1, sizeof(char *));
+    int configCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--configs") == 0 && hasValue) {
+            configsFileName = argv[++i];
+        } else if (strcmp(argv[i], "--looptime") == 0 && hasValue) {
+            looptimeUs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--signal-hz") == 0 && hasValue) {
+            signalHz = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-delay-ms") == 0 && hasValue) {
+            maxDelayMs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            outputFileName = argv[++i];
+        } else if (strcmp(argv[i], "--synthetic") == 0 && hasValue) {
+            syntheticSeconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (!logFileName && syntheticSeconds == 0) {
+            logFileName = argv[i];
+        } else {
+            configs[configCount++] = argv[i];
+        }
+    }
+
+    if (!logFileName && syntheticSeconds <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (configsFileName) {
+        FILE *file = fopen(configsFileName, "r");
+        if (!file) {
+            fprintf(stderr, "Cannot open %s\n", configsFileName);
+            return EXIT_FAILURE;
+        }
+
+        char line[REPLAY_MAX_LINE];
+        while (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '#') {
+                continue;
+            }
+            configs = realloc(configs, (configCount + 2) * sizeof(char *));
+            configs[configCount++] = strdup(line);
+        }
+        fclose(file);
+    }
+
+    if (configCount == 0) {
+        configs[configCount++] = "";
+    }
+
+    if (syntheticSeconds > 0) {
+        generateLog(&replayLog, syntheticSeconds, looptimeUs);
+    } else if (!loadCsvLog(&replayLog, logFileName, looptimeUs)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!csv) {
+        printf("%u samples, %u us looptime, %d motors with RPM%s\n", replayLog.sampleCount, replayLog.looptimeUs, replayLog.motorCount,
+            replayLog.setpoint[0] ? ", setpoint logged" : "");
+    } else {
+        printf("config,delay_ms,noise_in,noise_out,attenuation_db,total_ns");
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            printf(",%s_ns", stageNames[stage]);
+        }
+        printf("\n");
+    }
+
+    float *motion[XYZ_AXIS_COUNT];
+    float *output[XYZ_AXIS_COUNT];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        motion[axis] = allocSamples(replayLog.sampleCount);
+        output[axis] = allocSamples(replayLog.sampleCount);
+        zeroPhaseLowPass(replayLog.gyroRaw[axis], motion[axis], replayLog.sampleCount, signalHz, replayLog.looptimeUs);
+    }
+
+    const double clockNs = timerOverheadNs();
+    int failures = 0;
+
+    for (int i = 0; i < configCount; i++) {
+        replayResult_t result;
+
+        if (!applyConfig(configs[i])) {
+            failures++;
+            continue;
+        }
+
+        replayConfig(&replayLog, output, &result, clockNs);
+        analyseResult(&replayLog, motion, output, signalHz, maxDelayMs, &result);
+        printResult(configs[i], &result, csv);
+    }
+
+    if (outputFileName && !writeOutput(outputFileName, &replayLog, output)) {
+        failures++;
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,391 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SITL TCP serial port throughput benchmark. Data is moved over a loopback TCP connection the way the SITL serial
+ * driver does it, once per byte with a mutex and a send() for every byte as the driver did before, and once with the
+ * lock-free ring, batched receive and transmit buffered for a scheduler pass. See docs/development/Serial TCP bench.md
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "common/maths.h"
+#include "common/spsc_ring.h"
+
+#define BENCH_RX_BUFFER_SIZE    8192
+#define BENCH_TX_BUFFER_SIZE    16384
+#define BENCH_DEFAULT_SIZE_KB   4096
+#define BENCH_DEFAULT_CHUNK     64      // A typical MSP frame
+
+typedef enum {
+    METHOD_PER_BYTE = 0,
+    METHOD_RING,
+    METHOD_COUNT
+} benchMethod_e;
+
+static const char * const methodNames[METHOD_COUNT] = {
+    [METHOD_PER_BYTE]   = "per byte",
+    [METHOD_RING]       = "ring",
+};
+
+typedef struct {
+    int fd;
+    uint32_t size;
+    uint32_t chunk;
+    benchMethod_e method;
+
+    // Per byte, as the driver had it
+    pthread_mutex_t mutex;
+    uint8_t buffer[BENCH_RX_BUFFER_SIZE];
+    uint32_t bufferHead;
+    uint32_t bufferTail;
+
+    spscRing_t ring;
+    uint8_t ringBuffer[BENCH_RX_BUFFER_SIZE];
+
+    uint64_t syscalls;
+    bool ok;
+} benchChannel_t;
+
+typedef struct {
+    double seconds;
+    uint64_t syscalls;
+    bool ok;
+} benchResult_t;
+
+static uint8_t pattern(uint32_t index)
+{
+    return index * 13 + (index >> 8);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool connectLoopback(int fds[2])
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t addressLength = sizeof(address);
+    const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 1) < 0 ||
+        getsockname(listenFd, (struct sockaddr *)&address, &addressLength) < 0) {
+        perror("listen");
+        return false;
+    }
+
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (fds[0] < 0 || connect(fds[0], (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("connect");
+        return false;
+    }
+    fds[1] = accept(listenFd, NULL, NULL);
+    close(listenFd);
+
+    const int one = 1;
+    setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fds[1] >= 0;
+}
+
+static void sendAll(int fd, const uint8_t *data, uint32_t length, uint64_t *syscalls)
+{
+    while (length > 0) {
+        const ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        (*syscalls)++;
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("send");
+            exit(EXIT_FAILURE);
+        }
+        data += sent;
+        length -= sent;
+    }
+}
+
+// The client writes to the flight controller in chunks
+static void *rxClientThread(void *arg)
+{
+    benchChannel_t *channel = arg;
+    uint8_t chunk[BENCH_TX_BUFFER_SIZE];
+    uint64_t syscalls = 0;
+
+    for (uint32_t sent = 0; sent < channel->size; ) {
+        const uint32_t length = MIN(channel->chunk, channel->size - sent);
+        for (uint32_t i = 0; i < length; i++) {
+            chunk[i] = pattern(sent + i);
+        }
+        sendAll(channel->fd, chunk, length, &syscalls);
+        sent += length;
+    }
+    return NULL;
+}
+
+static uint32_t rxWaiting(benchChannel_t *channel)
+{
+    if (channel->method == METHOD_RING) {
+        return spscRingWaiting(&channel->ring);
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    const uint32_t count = (channel->bufferHead + BENCH_RX_BUFFER_SIZE - channel->bufferTail) % BENCH_RX_BUFFER_SIZE;
+    pthread_mutex_unlock(&channel->mutex);
+    return count;
+}
+
+// The SITL receive thread
+static void *rxReceiveThread(void *arg)
+{
+    benchChannel_t *channel = arg;
+    uint8_t buffer[BENCH_RX_BUFFER_SIZE];
+
+    for (uint32_t received = 0; received < channel->size; ) {
+        // The old driver overran its buffer instead, which would lose data here
+        const size_t length = BENCH_RX_BUFFER_SIZE - 1 - rxWaiting(channel);
+        if (length == 0) {
+            poll(NULL, 0, 1);
+            continue;
+        }
+
+        const ssize_t recvSize = recv(channel->fd, buffer, length, 0);
+        __atomic_fetch_add(&channel->syscalls, 1, __ATOMIC_RELAXED);
+        if (recvSize <= 0) {
+            break;
+        }
+
+        if (channel->method == METHOD_RING) {
+            spscRingWrite(&channel->ring, buffer, recvSize);
+        } else {
+            for (ssize_t i = 0; i < recvSize; i++) {
+                pthread_mutex_lock(&channel->mutex);
+                channel->buffer[channel->bufferHead] = buffer[i];
+                channel->bufferHead = (channel->bufferHead + 1) % BENCH_RX_BUFFER_SIZE;
+                pthread_mutex_unlock(&channel->mutex);
+            }
+        }
+        received += recvSize;
+    }
+    return NULL;
+}
+
+static uint8_t rxRead(benchChannel_t *channel)
+{
+    uint8_t ch = 0;
+    if (channel->method == METHOD_RING) {
+        spscRingReadByte(&channel->ring, &ch);
+        return ch;
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    ch = channel->buffer[channel->bufferTail];
+    channel->bufferTail = (channel->bufferTail + 1) % BENCH_RX_BUFFER_SIZE;
+    pthread_mutex_unlock(&channel->mutex);
+    return ch;
+}
+
+// The firmware reads byte by byte, as the MSP and CLI parsers do
+static void benchReceive(benchMethod_e method, uint32_t size, uint32_t chunk, benchResult_t *result)
+{
+    static benchChannel_t server;
+    static benchChannel_t client;
+    int fds[2];
+
+    if (!connectLoopback(fds)) {
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.mutex, NULL);
+    spscRingInit(&server.ring, server.ringBuffer, sizeof(server.ringBuffer));
+    server.fd = fds[1];
+    server.size = size;
+    server.method = method;
+    client = server;
+    client.fd = fds[0];
+    client.chunk = chunk;
+
+    const double start = now();
+    pthread_t clientThread, receiveThread;
+    pthread_create(&receiveThread, NULL, rxReceiveThread, &server);
+    pthread_create(&clientThread, NULL, rxClientThread, &client);
+
+    result->ok = true;
+    for (uint32_t read = 0; read < size; ) {
+        if (rxWaiting(&server) == 0) {
+            sched_yield();
+            continue;
+        }
+        result->ok &= rxRead(&server) == pattern(read);
+        read++;
+    }
+    result->seconds = now() - start;
+
+    pthread_join(clientThread, NULL);
+    pthread_join(receiveThread, NULL);
+    result->syscalls = server.syscalls;
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// The client reads what the flight controller writes
+static void *txClientThread(void *arg)
+{
+    benchChannel_t *channel = arg;
+    uint8_t buffer[BENCH_TX_BUFFER_SIZE];
+    bool ok = true;
+
+    for (uint32_t received = 0; received < channel->size; ) {
+        const ssize_t recvSize = recv(channel->fd, buffer, sizeof(buffer), 0);
+        if (recvSize <= 0) {
+            ok = false;
+            break;
+        }
+        for (ssize_t i = 0; i < recvSize; i++) {
+            ok &= buffer[i] == pattern(received + i);
+        }
+        received += recvSize;
+    }
+    channel->ok = ok;
+    return NULL;
+}
+
+// The firmware writes byte by byte, a chunk per scheduler pass
+static void benchTransmit(benchMethod_e method, uint32_t size, uint32_t chunk, benchResult_t *result)
+{
+    static benchChannel_t client;
+    static uint8_t txBuffer[BENCH_TX_BUFFER_SIZE];
+    int fds[2];
+
+    if (!connectLoopback(fds)) {
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&client, 0, sizeof(client));
+    client.fd = fds[0];
+    client.size = size;
+
+    const double start = now();
+    pthread_t clientThread;
+    pthread_create(&clientThread, NULL, txClientThread, &client);
+
+    uint64_t syscalls = 0;
+    uint32_t txHead = 0;
+    for (uint32_t written = 0; written < size; ) {
+        const uint32_t length = MIN(chunk, size - written);
+        for (uint32_t i = 0; i < length; i++) {
+            const uint8_t ch = pattern(written + i);
+            if (method == METHOD_PER_BYTE) {
+                sendAll(fds[1], &ch, 1, &syscalls);
+            } else {
+                if (txHead == sizeof(txBuffer)) {
+                    sendAll(fds[1], txBuffer, txHead, &syscalls);
+                    txHead = 0;
+                }
+                txBuffer[txHead++] = ch;
+            }
+        }
+        written += length;
+
+        // End of the scheduler pass
+        if (txHead > 0) {
+            sendAll(fds[1], txBuffer, txHead, &syscalls);
+            txHead = 0;
+        }
+    }
+
+    pthread_join(clientThread, NULL);
+    result->seconds = now() - start;
+    result->syscalls = syscalls;
+    result->ok = client.ok;
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--size <KiB>] [--chunk <bytes>]\n", name);
+    fprintf(stderr, "  --size   data moved in each direction, default %d KiB\n", BENCH_DEFAULT_SIZE_KB);
+    fprintf(stderr, "  --chunk  bytes the client sends at once and the firmware writes per scheduler pass, default %d\n",
+        BENCH_DEFAULT_CHUNK);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t size = BENCH_DEFAULT_SIZE_KB * 1024;
+    uint32_t chunk = BENCH_DEFAULT_CHUNK;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--size") == 0 && hasValue) {
+            size = atoi(argv[++i]) * 1024;
+        } else if (strcmp(argv[i], "--chunk") == 0 && hasValue) {
+            chunk = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (size == 0 || chunk == 0 || chunk > BENCH_TX_BUFFER_SIZE) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%u KiB each way, %u byte chunks\n", size / 1024, chunk);
+    printf("direction  method          MB/s     syscalls\n");
+
+    bool ok = true;
+    for (int direction = 0; direction < 2; direction++) {
+        for (int method = 0; method < METHOD_COUNT; method++) {
+            benchResult_t result;
+            if (direction == 0) {
+                benchReceive(method, size, chunk, &result);
+            } else {
+                benchTransmit(method, size, chunk, &result);
+            }
+            printf("%-10s %-10s %9.2f %12llu%s\n", direction == 0 ? "receive" : "transmit", methodNames[method],
+                (double)size / result.seconds / 1e6, (unsigned long long)result.syscalls, result.ok ? "" : "  CORRUPTED");
+            ok &= result.ok;
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
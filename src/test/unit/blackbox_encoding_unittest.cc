@@ -0,0 +1,484 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "blackbox/blackbox_encoding.h"
+    #include "blackbox/blackbox_io.h"
+
+    #include "common/maths.h"
+
+    int32_t blackboxHeaderBudget;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define BLOCK_SAMPLES   32
+
+static std::vector<uint8_t> written;
+
+/*
+ * Reference decoder for the blackbox stream, reading back what the encoder wrote
+ */
+class BlackboxReader {
+public:
+    BlackboxReader(const std::vector<uint8_t> &bytes) : bytes(bytes), position(0), bits(0), bitCount(0)
+    {
+        resetRice();
+    }
+
+    bool eof(void) const { return position >= bytes.size(); }
+
+    uint8_t readByte(void)
+    {
+        EXPECT_LT(position, bytes.size());
+        return position < bytes.size() ? bytes[position++] : 0;
+    }
+
+    uint32_t readUnsignedVB(void)
+    {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            const uint8_t byte = readByte();
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        return value;
+    }
+
+    int32_t readSignedVB(void)
+    {
+        const uint32_t value = readUnsignedVB();
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    // The counterpart of blackboxWriteDeltaPackedBlock()
+    std::vector<int16_t> readDeltaPackedBlock(int count)
+    {
+        std::vector<int16_t> samples;
+
+        samples.push_back(readSignedVB());
+        if (count == 1) {
+            return samples;
+        }
+
+        const int32_t minDelta = readSignedVB();
+        const int width = readByte();
+        EXPECT_LE(width, 17);
+
+        uint32_t bits = 0;
+        int bitCount = 0;
+        for (int i = 1; i < count; i++) {
+            while (bitCount < width) {
+                bits |= (uint32_t)readByte() << bitCount;
+                bitCount += 8;
+            }
+
+            const uint32_t value = width ? bits & ((1u << width) - 1) : 0;
+            bits >>= width;
+            bitCount -= width;
+
+            samples.push_back(samples.back() + minDelta + (int32_t)value);
+        }
+        return samples;
+    }
+
+    // The counterpart of blackboxWriteRice(), for a run of values that ends with blackboxRiceFlush()
+    std::vector<int32_t> readRiceRun(int count)
+    {
+        std::vector<int32_t> values;
+        bitCount = 0;
+
+        for (int i = 0; i < count; i++) {
+            RiceContext &context = riceContexts[std::min(riceContextIndex++, RICE_CONTEXTS - 1)];
+
+            const uint32_t mean = (context.sum + context.count - 1) / context.count;
+            int k = 0;
+            while (k < RICE_MAX_K && (1u << k) < mean) {
+                k++;
+            }
+
+            uint32_t quotient = 0;
+            while (quotient < RICE_ESCAPE && readBit()) {
+                quotient++;
+            }
+
+            uint32_t u;
+            if (quotient < RICE_ESCAPE) {
+                u = (quotient << k) | readBits(k);
+            } else {
+                u = readBits(32);
+            }
+
+            context.sum += std::min(u, (uint32_t)RICE_MAX_SAMPLE);
+            context.count++;
+            if (context.count >= RICE_HALVE_COUNT) {
+                context.sum >>= 1;
+                context.count >>= 1;
+            }
+
+            values.push_back((int32_t)(u >> 1) ^ -(int32_t)(u & 1));
+        }
+        return values;
+    }
+
+    void resetRice(void)
+    {
+        for (int i = 0; i < RICE_CONTEXTS; i++) {
+            riceContexts[i] = { RICE_INITIAL_SUM, 1 };
+        }
+        riceContextIndex = 0;
+    }
+
+    void beginRiceFrame(void) { riceContextIndex = 0; }
+
+private:
+    static const int RICE_CONTEXTS = 128;
+    static const int RICE_MAX_K = 20;
+    static const uint32_t RICE_ESCAPE = 20;
+    static const uint32_t RICE_MAX_SAMPLE = 1 << 24;
+    static const uint32_t RICE_HALVE_COUNT = 32;
+    static const uint32_t RICE_INITIAL_SUM = 4;
+
+    struct RiceContext {
+        uint32_t sum;
+        uint32_t count;
+    };
+
+    int readBit(void)
+    {
+        if (bitCount == 0) {
+            bits = readByte();
+            bitCount = 8;
+        }
+        const int bit = bits & 1;
+        bits >>= 1;
+        bitCount--;
+        return bit;
+    }
+
+    uint32_t readBits(int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++) {
+            value |= (uint32_t)readBit() << i;
+        }
+        return value;
+    }
+
+    const std::vector<uint8_t> &bytes;
+    size_t position;
+
+    uint32_t bits;
+    int bitCount;
+    RiceContext riceContexts[RICE_CONTEXTS];
+    int riceContextIndex;
+};
+
+// Something like a hovering quad's raw gyro at 8kHz: a slow rate change, motor noise and sensor noise
+static std::vector<int16_t> gyroLike(int count, int axis)
+{
+    std::vector<int16_t> samples(count);
+    uint32_t seed = 12345 + axis;
+
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        const float t = i / 8000.0f;
+        const float noise = (int)((seed >> 16) % 7) - 3;
+        samples[i] = lrintf(40 * sinf(2 * M_PIf * 2 * t + axis) + 6 * sinf(2 * M_PIf * 230 * t) + noise);
+    }
+    return samples;
+}
+
+TEST(BlackboxEncodingTest, TestDeltaPackedBlockRoundTrip)
+{
+    const std::vector<int16_t> samples = gyroLike(BLOCK_SAMPLES, 0);
+
+    written.clear();
+    blackboxWriteDeltaPackedBlock(samples.data(), BLOCK_SAMPLES, 1);
+
+    BlackboxReader reader(written);
+    EXPECT_EQ(samples, reader.readDeltaPackedBlock(BLOCK_SAMPLES));
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(BlackboxEncodingTest, TestDeltaPackedBlockConstant)
+{
+    const std::vector<int16_t> samples(BLOCK_SAMPLES, 1500);
+
+    written.clear();
+    blackboxWriteDeltaPackedBlock(samples.data(), BLOCK_SAMPLES, 1);
+
+    // The first sample, a zero difference and a zero bit width
+    EXPECT_EQ(4u, written.size());
+
+    BlackboxReader reader(written);
+    EXPECT_EQ(samples, reader.readDeltaPackedBlock(BLOCK_SAMPLES));
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(BlackboxEncodingTest, TestDeltaPackedBlockExtremes)
+{
+    std::vector<int16_t> samples;
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        samples.push_back(i % 3 == 0 ? INT16_MIN : (i % 3 == 1 ? INT16_MAX : 0));
+    }
+
+    written.clear();
+    blackboxWriteDeltaPackedBlock(samples.data(), BLOCK_SAMPLES, 1);
+
+    BlackboxReader reader(written);
+    EXPECT_EQ(samples, reader.readDeltaPackedBlock(BLOCK_SAMPLES));
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(BlackboxEncodingTest, TestDeltaPackedBlockShortBlocks)
+{
+    const std::vector<int16_t> samples = gyroLike(3, 1);
+
+    for (int count = 1; count <= 3; count++) {
+        written.clear();
+        blackboxWriteDeltaPackedBlock(samples.data(), count, 1);
+
+        BlackboxReader reader(written);
+        EXPECT_EQ(std::vector<int16_t>(samples.begin(), samples.begin() + count), reader.readDeltaPackedBlock(count));
+        EXPECT_TRUE(reader.eof());
+    }
+}
+
+/*
+ * A gyro rate block stores the samples interleaved, one channel after the other is written out with a stride.
+ * Decode a whole stream of blocks like the "R" frames, and compare the size with plain signed VB.
+ */
+TEST(BlackboxEncodingTest, TestDeltaPackedBlockInterleavedStream)
+{
+    const int channels = 7;     // Three gyro axes and four motors
+    const int blocks = 250;     // One second at 8kHz
+    const int count = blocks * BLOCK_SAMPLES;
+
+    std::vector<std::vector<int16_t>> signal;
+    for (int channel = 0; channel < channels; channel++) {
+        if (channel < 3) {
+            signal.push_back(gyroLike(count, channel));
+        } else {
+            // Motors only change once per PID loop, every 8 gyro samples
+            std::vector<int16_t> motor(count);
+            for (int i = 0; i < count; i++) {
+                motor[i] = 1400 + channel * 10 + (i / 8) % 23;
+            }
+            signal.push_back(motor);
+        }
+    }
+
+    written.clear();
+    for (int block = 0; block < blocks; block++) {
+        int16_t interleaved[BLOCK_SAMPLES][channels];
+        for (int i = 0; i < BLOCK_SAMPLES; i++) {
+            for (int channel = 0; channel < channels; channel++) {
+                interleaved[i][channel] = signal[channel][block * BLOCK_SAMPLES + i];
+            }
+        }
+        for (int channel = 0; channel < channels; channel++) {
+            blackboxWriteDeltaPackedBlock(&interleaved[0][channel], BLOCK_SAMPLES, channels);
+        }
+    }
+    const size_t packedBytes = written.size();
+
+    BlackboxReader reader(written);
+    for (int block = 0; block < blocks; block++) {
+        for (int channel = 0; channel < channels; channel++) {
+            const std::vector<int16_t> decoded = reader.readDeltaPackedBlock(BLOCK_SAMPLES);
+            const std::vector<int16_t> expected(signal[channel].begin() + block * BLOCK_SAMPLES, signal[channel].begin() + (block + 1) * BLOCK_SAMPLES);
+            ASSERT_EQ(expected, decoded) << "block " << block << " channel " << channel;
+        }
+    }
+    EXPECT_TRUE(reader.eof());
+
+    // The same samples as signed VB differences from the previous sample
+    written.clear();
+    for (int channel = 0; channel < channels; channel++) {
+        for (int i = 0; i < count; i++) {
+            blackboxWriteSignedVB(signal[channel][i] - (i ? signal[channel][i - 1] : 0));
+        }
+    }
+    const size_t vbBytes = written.size();
+
+    printf("[          ] %d samples of %d channels: %u bytes packed (%.2f bits per value), %u bytes signed VB\n",
+        count, channels, (unsigned)packedBytes, packedBytes * 8.0 / (count * channels), (unsigned)vbBytes);
+
+    EXPECT_LT(packedBytes * 2, vbBytes);
+}
+
+TEST(BlackboxEncodingTest, TestRiceRoundTrip)
+{
+    const std::vector<int16_t> gyro = gyroLike(64, 0);
+    std::vector<int32_t> values(gyro.begin(), gyro.end());
+
+    written.clear();
+    blackboxRiceReset();
+    for (int32_t value : values) {
+        blackboxWriteRice(value);
+    }
+    blackboxRiceFlush();
+
+    BlackboxReader reader(written);
+    EXPECT_EQ(values, reader.readRiceRun(values.size()));
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(BlackboxEncodingTest, TestRiceEscapes)
+{
+    const std::vector<int32_t> values = { 0, INT32_MAX, INT32_MIN, -1, 1, 0, 1 << 24, -(1 << 24), 3, 0, 0, 0 };
+
+    written.clear();
+    blackboxRiceReset();
+    for (int32_t value : values) {
+        blackboxWriteRice(value);
+    }
+    blackboxRiceFlush();
+
+    BlackboxReader reader(written);
+    EXPECT_EQ(values, reader.readRiceRun(values.size()));
+    EXPECT_TRUE(reader.eof());
+}
+
+// A run ends on a whole byte, so the bytes written after it can be read as usual
+TEST(BlackboxEncodingTest, TestRiceRunsBetweenBytes)
+{
+    written.clear();
+    blackboxRiceReset();
+    blackboxRiceBeginFrame();
+    blackboxWriteRice(5);
+    blackboxRiceFlush();
+    blackboxWriteSignedVB(-300);
+    blackboxWriteRice(-2);
+    blackboxWriteRice(7);
+    blackboxRiceFlush();
+    blackboxWrite('X');
+
+    BlackboxReader reader(written);
+    reader.beginRiceFrame();
+    EXPECT_EQ(std::vector<int32_t>({ 5 }), reader.readRiceRun(1));
+    EXPECT_EQ(-300, reader.readSignedVB());
+    EXPECT_EQ(std::vector<int32_t>({ -2, 7 }), reader.readRiceRun(2));
+    EXPECT_EQ('X', reader.readByte());
+    EXPECT_TRUE(reader.eof());
+}
+
+/*
+ * Frames of interleaved fields, each field with its own context and magnitude: three gyro axes, small after the
+ * average predictor, and four motors which only change now and then. The coder is reset every 32 frames like on
+ * an I frame. Compare the size with signed VB, which the P frames use otherwise.
+ */
+TEST(BlackboxEncodingTest, TestRiceFramesSmallerThanSignedVB)
+{
+    const int frames = 2000;
+    const int fields = 7;
+
+    std::vector<std::vector<int16_t>> signal;
+    for (int axis = 0; axis < 3; axis++) {
+        signal.push_back(gyroLike(frames + 2, axis));
+    }
+    for (int motor = 0; motor < 4; motor++) {
+        std::vector<int16_t> output(frames + 2);
+        for (int i = 0; i < frames + 2; i++) {
+            output[i] = 1400 + motor * 10 + ((i * (motor + 3)) / 7) % 31;
+        }
+        signal.push_back(output);
+    }
+
+    std::vector<std::vector<int32_t>> residuals(frames, std::vector<int32_t>(fields));
+    for (int i = 0; i < frames; i++) {
+        for (int field = 0; field < fields; field++) {
+            residuals[i][field] = signal[field][i + 2] - (signal[field][i + 1] + signal[field][i]) / 2;
+        }
+    }
+
+    written.clear();
+    for (int i = 0; i < frames; i++) {
+        if (i % 32 == 0) {
+            blackboxRiceReset();
+        }
+        blackboxRiceBeginFrame();
+        for (int field = 0; field < fields; field++) {
+            blackboxWriteRice(residuals[i][field]);
+        }
+        blackboxRiceFlush();
+    }
+    const size_t riceBytes = written.size();
+
+    BlackboxReader reader(written);
+    for (int i = 0; i < frames; i++) {
+        if (i % 32 == 0) {
+            reader.resetRice();
+        }
+        reader.beginRiceFrame();
+        ASSERT_EQ(residuals[i], reader.readRiceRun(fields)) << "frame " << i;
+    }
+    EXPECT_TRUE(reader.eof());
+
+    written.clear();
+    for (int i = 0; i < frames; i++) {
+        for (int field = 0; field < fields; field++) {
+            blackboxWriteSignedVB(residuals[i][field]);
+        }
+    }
+    const size_t vbBytes = written.size();
+
+    printf("[          ] %d frames of %d fields: %u bytes Rice, %u bytes signed VB\n",
+        frames, fields, (unsigned)riceBytes, (unsigned)vbBytes);
+
+    EXPECT_LT(riceBytes, vbBytes);
+}
+
+// STUBS
+
+extern "C" {
+
+void blackboxWrite(uint8_t value)
+{
+    written.push_back(value);
+}
+
+int blackboxPrint(const char *s)
+{
+    UNUSED(s);
+    return 0;
+}
+
+int tfp_format(void *putp, void (*putf) (void *, char), const char *fmt, va_list va)
+{
+    UNUSED(putp);
+    UNUSED(putf);
+    UNUSED(fmt);
+    UNUSED(va);
+    return 0;
+}
+
+}
@@ -0,0 +1,478 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "blackbox/blackbox.h"
+    #include "blackbox/blackbox_encoding.h"
+    #include "blackbox/blackbox_io.h"
+
+    #include "common/maths.h"
+    #include "common/utils.h"
+
+    #include "drivers/file_sink.h"
+    #include "drivers/sdcard/sdcard.h"
+    #include "drivers/serial.h"
+
+    #include "io/asyncfatfs/asyncfatfs.h"
+    #include "io/flashfs.h"
+
+    blackboxConfig_t blackboxConfig_System;
+
+    extern serialPort_t *blackboxPort;
+    extern fileSink_t blackboxFileSink;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define SINK_SIZE               (1 << 20)
+#define STREAM_FRAMES           8192
+#define BENCHMARK_BYTES         (16 << 20)
+#define FILE_BUFFER_SIZE        (4 << 20)
+
+/*
+ * The device stubs below copy into a RAM sink, doing the same per-call bookkeeping as the real driver
+ * (UART Tx ring and interrupt enable, flashfs auto-flush check, afatfs sector cursor). The benchmark
+ * measures the cost of getting the bytes to the device, not the device itself.
+ */
+static std::vector<uint8_t> sink(SINK_SIZE);
+static uint32_t sinkLength;
+static uint32_t sinkCalls;
+
+static void sinkBuf(const uint8_t *data, uint32_t length)
+{
+    while (length > 0) {
+        const uint32_t offset = sinkLength & (SINK_SIZE - 1);
+        const uint32_t chunk = MIN(length, SINK_SIZE - offset);
+        memcpy(&sink[offset], data, chunk);
+        sinkLength += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void sinkByte(uint8_t value)
+{
+    sink[sinkLength++ & (SINK_SIZE - 1)] = value;
+}
+
+static void sinkReset(void)
+{
+    sinkLength = 0;
+    sinkCalls = 0;
+}
+
+/*
+ * Frames sized like a typical log: an I-frame every 32 frames, P-frames in between
+ */
+typedef struct {
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> frameEnds;
+} frameStream_t;
+
+static frameStream_t makeFrameStream(void)
+{
+    frameStream_t stream;
+    uint32_t seed = 12345;
+
+    for (int frame = 0; frame < STREAM_FRAMES; frame++) {
+        seed = seed * 1664525 + 1013904223;
+        const int length = (frame % 32 == 0) ? 180 : 40 + (seed >> 24) % 50;
+
+        stream.bytes.push_back(frame % 32 == 0 ? 'I' : 'P');
+        for (int i = 1; i < length; i++) {
+            seed = seed * 1664525 + 1013904223;
+            stream.bytes.push_back(seed >> 24);
+        }
+        stream.frameEnds.push_back(stream.bytes.size());
+    }
+
+    return stream;
+}
+
+static FILE *legacyFile;
+
+// The per-byte device dispatch blackboxWrite() did before frames were staged
+static void legacyBlackboxWrite(uint8_t value)
+{
+    switch (blackboxConfig()->device) {
+    case BLACKBOX_DEVICE_FLASH:
+        flashfsWriteByte(value);
+        break;
+    case BLACKBOX_DEVICE_SDCARD:
+        afatfs_fputc(NULL, value);
+        break;
+    case BLACKBOX_DEVICE_FILE:
+        fputc(value, legacyFile);
+        break;
+    case BLACKBOX_DEVICE_SERIAL:
+    default:
+        serialWrite(blackboxPort, value);
+        break;
+    }
+}
+
+static void writeFrameStream(const frameStream_t &stream, bool legacy)
+{
+    uint32_t frameStart = 0;
+    for (uint32_t frameEnd : stream.frameEnds) {
+        for (uint32_t i = frameStart; i < frameEnd; i++) {
+            if (legacy) {
+                legacyBlackboxWrite(stream.bytes[i]);
+            } else {
+                blackboxWrite(stream.bytes[i]);
+            }
+        }
+        blackboxDeviceFlush();
+        frameStart = frameEnd;
+    }
+}
+
+static NOINLINE void uartWriteModel(serialPort_t *instance, uint8_t ch);
+static NOINLINE void uartWriteBufModel(serialPort_t *instance, const void *data, int count);
+
+static const struct serialPortVTable testSerialVTable = {
+    .serialWrite = uartWriteModel,
+    .serialTotalRxWaiting = NULL,
+    .serialTotalTxFree = NULL,
+    .serialRead = NULL,
+    .serialSetBaudRate = NULL,
+    .isSerialTransmitBufferEmpty = NULL,
+    .setMode = NULL,
+    .setOptions = NULL,
+    .writeBuf = uartWriteBufModel,
+    .isConnected = NULL,
+    .isIdle = NULL,
+    .beginWrite = NULL,
+    .endWrite = NULL,
+};
+
+static serialPort_t testSerialPort = {
+    .vTable = &testSerialVTable,
+    .identifier = 0,
+    .mode = MODE_TX,
+    .options = SERIAL_NOT_INVERTED,
+    .baudRate = 115200,
+    .rxBufferSize = 0,
+    .txBufferSize = 1024,
+    .rxBuffer = NULL,
+    .txBuffer = NULL,
+    .rxBufferHead = 0,
+    .rxBufferTail = 0,
+    .txBufferHead = 0,
+    .txBufferTail = 0,
+    .rxCallback = NULL,
+    .rxCallbackData = NULL,
+};
+
+static void selectDevice(BlackboxDevice device)
+{
+    blackboxConfigMutable()->device = device;
+    blackboxPort = &testSerialPort;
+    sinkReset();
+}
+
+static std::vector<uint8_t> readFile(const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    EXPECT_NE((FILE *)NULL, file);
+    fseek(file, 0, SEEK_END);
+    std::vector<uint8_t> contents(ftell(file));
+    rewind(file);
+    EXPECT_EQ(contents.size(), fread(contents.data(), 1, contents.size(), file));
+    fclose(file);
+    return contents;
+}
+
+static const BlackboxDevice sinkDevices[] = { BLACKBOX_DEVICE_SERIAL, BLACKBOX_DEVICE_FLASH, BLACKBOX_DEVICE_SDCARD };
+static const char * const deviceNames[] = { "SERIAL", "FLASH", "SDCARD", "FILE" };
+
+TEST(BlackboxIoUnittest, TestFramesReachDeviceUnchanged)
+{
+    const frameStream_t stream = makeFrameStream();
+    ASSERT_LE(stream.bytes.size(), (size_t)SINK_SIZE);
+
+    for (BlackboxDevice device : sinkDevices) {
+        selectDevice(device);
+        writeFrameStream(stream, false);
+
+        EXPECT_EQ(stream.bytes.size(), sinkLength);
+        EXPECT_EQ(0, memcmp(stream.bytes.data(), sink.data(), sinkLength));
+
+        // Frames are shorter than the staging buffer, so every frame is a single device call
+        EXPECT_EQ(stream.frameEnds.size(), sinkCalls);
+    }
+
+    char fileName[] = "/tmp/blackbox_io_XXXXXX";
+    close(mkstemp(fileName));
+    selectDevice(BLACKBOX_DEVICE_FILE);
+    ASSERT_TRUE(fileSinkOpen(&blackboxFileSink, fileName, FILE_BUFFER_SIZE));
+    writeFrameStream(stream, false);
+
+    // The writer thread empties the buffers after a forced flush, while the file stays open
+    for (int i = 0; i < 1000 && !blackboxDeviceFlushForce(); i++) {
+        usleep(1000);
+    }
+    EXPECT_TRUE(blackboxDeviceFlushForce());
+    EXPECT_TRUE(readFile(fileName) == stream.bytes);
+
+    fileSinkClose(&blackboxFileSink);
+
+    fileSinkStats_t stats;
+    fileSinkGetStats(&blackboxFileSink, &stats);
+    EXPECT_EQ(0u, stats.bytesDropped);
+    EXPECT_EQ(stream.bytes.size(), stats.bytesWritten);
+    unlink(fileName);
+}
+
+TEST(BlackboxIoUnittest, TestLongWritesAreSplit)
+{
+    selectDevice(BLACKBOX_DEVICE_FLASH);
+
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i * 7;
+    }
+
+    blackboxWrite('H');
+    blackboxWriteBuf(data.data(), data.size());
+    EXPECT_EQ(3 * 256, (int)sinkLength);    // Full staging buffers are committed right away
+
+    EXPECT_EQ(10, blackboxPrint("H Product:"));
+    blackboxDeviceFlush();
+
+    ASSERT_EQ(1 + 1000 + 10, (int)sinkLength);
+    EXPECT_EQ('H', sink[0]);
+    EXPECT_EQ(0, memcmp(data.data(), &sink[1], data.size()));
+    EXPECT_EQ(0, memcmp("H Product:", &sink[1001], 10));
+}
+
+TEST(BlackboxIoUnittest, TestStagedBytesCommittedBeforeDeviceQueries)
+{
+    selectDevice(BLACKBOX_DEVICE_SERIAL);
+
+    blackboxPrint("H Field I name:");
+    EXPECT_EQ(0u, sinkLength);
+
+    blackboxReplenishHeaderBudget();
+    EXPECT_EQ(15u, sinkLength);
+
+    blackboxPrint("loopIteration");
+    blackboxDeviceReserveBufferSpace(64);
+    EXPECT_EQ(28u, sinkLength);
+
+    blackboxWrite('E');
+    EXPECT_TRUE(blackboxDeviceFlushForce());
+    EXPECT_EQ(29u, sinkLength);
+}
+
+/*
+ * Bytes per microsecond from the encoder's blackboxWrite() to the device API, per-byte dispatch against
+ * staged frames. FILE goes to /dev/null, through host stdio before and the file sink's writer thread now,
+ * the other devices into the stub sinks.
+ */
+TEST(BlackboxIoUnittest, BenchmarkDeviceThroughput)
+{
+    const frameStream_t stream = makeFrameStream();
+    const int repeats = BENCHMARK_BYTES / stream.bytes.size() + 1;
+
+    for (int device = 0; device < 4; device++) {
+        double bytesPerUs[2];
+
+        for (int legacy = 1; legacy >= 0; legacy--) {
+            const bool isFile = device == BLACKBOX_DEVICE_FILE;
+            selectDevice((BlackboxDevice)device);
+            if (isFile && legacy) {
+                legacyFile = fopen("/dev/null", "wb");
+            } else if (isFile) {
+                ASSERT_TRUE(fileSinkOpen(&blackboxFileSink, "/dev/null", FILE_BUFFER_SIZE));
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeats; i++) {
+                writeFrameStream(stream, legacy);
+            }
+            if (isFile && legacy) {
+                fclose(legacyFile);
+            } else if (isFile) {
+                fileSinkClose(&blackboxFileSink);
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            const double us = std::chrono::duration<double, std::micro>(end - start).count();
+            bytesPerUs[legacy] = (double)stream.bytes.size() * repeats / us;
+
+            if (!isFile) {
+                EXPECT_EQ(stream.bytes.size() * repeats, sinkLength);
+            }
+        }
+
+        printf("[ BLACKBOX IO ] %-6s per-byte %7.1f B/us, staged frames %7.1f B/us (x%.1f)\n",
+            deviceNames[device], bytesPerUs[1], bytesPerUs[0], bytesPerUs[0] / bytesPerUs[1]);
+    }
+}
+
+// STUBS
+
+static volatile uint32_t txInterruptEnable;     // Stands for USART_ITConfig()
+
+static void uartWriteModel(serialPort_t *instance, uint8_t ch)
+{
+    sinkByte(ch);
+    if (instance->txBufferHead + 1 >= instance->txBufferSize) {
+        instance->txBufferHead = 0;
+    } else {
+        instance->txBufferHead++;
+    }
+    txInterruptEnable = 1;
+    sinkCalls++;
+}
+
+static void uartWriteBufModel(serialPort_t *instance, const void *data, int count)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (count > 0) {
+        const uint32_t chunk = MIN((uint32_t)count, instance->txBufferSize - instance->txBufferHead);
+        sinkBuf(p, chunk);
+        instance->txBufferHead = (instance->txBufferHead + chunk) % instance->txBufferSize;
+        p += chunk;
+        count -= chunk;
+        txInterruptEnable = 1;
+    }
+    sinkCalls++;
+}
+
+#define FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN 64
+static uint32_t flashBufferTail;
+
+static NOINLINE bool flashFlushModel(void)
+{
+    flashBufferTail = sinkLength;
+    return true;
+}
+
+#define AFATFS_SECTOR_SIZE 512
+static uint32_t fileCursorOffset;
+static int fileWriteLockedCacheIndex = 0;
+
+extern "C" {
+
+NOINLINE void serialWrite(serialPort_t *instance, uint8_t ch)
+{
+    instance->vTable->serialWrite(instance, ch);
+}
+
+NOINLINE void serialWriteBuf(serialPort_t *instance, const uint8_t *data, int count)
+{
+    instance->vTable->writeBuf(instance, data, count);
+}
+
+uint32_t serialTxBytesFree(const serialPort_t *instance)
+{
+    UNUSED(instance);
+    return 1023;
+}
+
+bool isSerialTransmitBufferEmpty(const serialPort_t *instance)
+{
+    UNUSED(instance);
+    return true;
+}
+
+NOINLINE void flashfsWriteByte(uint8_t byte)
+{
+    sinkByte(byte);
+    if (sinkLength - flashBufferTail >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN) {
+        flashFlushModel();
+    }
+    sinkCalls++;
+}
+
+NOINLINE void flashfsWrite(const uint8_t *data, unsigned int len, bool sync)
+{
+    UNUSED(sync);
+    sinkBuf(data, len);
+    if (sinkLength - flashBufferTail >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN) {
+        flashFlushModel();
+    }
+    sinkCalls++;
+}
+
+bool flashfsFlushAsync(void) { return flashFlushModel(); }
+bool flashfsIsReady(void) { return true; }
+bool flashfsIsEOF(void) { return false; }
+uint32_t flashfsGetWriteBufferSize(void) { return 512; }
+uint32_t flashfsGetWriteBufferFreeSpace(void) { return 512; }
+void flashfsBeginLog(void) {}
+void flashfsEndLog(void) {}
+
+NOINLINE uint32_t afatfs_fwrite(afatfsFilePtr_t file, const uint8_t *buffer, uint32_t len)
+{
+    UNUSED(file);
+    uint32_t written = 0;
+    while (written < len) {
+        const uint32_t cursorOffsetInSector = fileCursorOffset % AFATFS_SECTOR_SIZE;
+        const uint32_t chunk = MIN(AFATFS_SECTOR_SIZE - cursorOffsetInSector, len - written);
+        sinkBuf(buffer + written, chunk);
+        fileCursorOffset += chunk;
+        written += chunk;
+    }
+    sinkCalls++;
+    return len;
+}
+
+NOINLINE void afatfs_fputc(afatfsFilePtr_t file, uint8_t c)
+{
+    const uint32_t cursorOffsetInSector = fileCursorOffset % AFATFS_SECTOR_SIZE;
+
+    if (fileWriteLockedCacheIndex != -1 && cursorOffsetInSector != AFATFS_SECTOR_SIZE - 1) {
+        sinkByte(c);
+        fileCursorOffset++;
+        sinkCalls++;
+    } else {
+        afatfs_fwrite(file, &c, sizeof(c));
+    }
+}
+
+afatfsFilesystemState_e afatfs_getFilesystemState(void) { return AFATFS_FILESYSTEM_STATE_READY; }
+bool afatfs_fopen(const char *, const char *, afatfsFileCallback_t) { return true; }
+bool afatfs_fclose(afatfsFilePtr_t, afatfsCallback_t) { return true; }
+bool afatfs_funlink(afatfsFilePtr_t, afatfsCallback_t) { return true; }
+bool afatfs_mkdir(const char *, afatfsFileCallback_t) { return true; }
+bool afatfs_chdir(afatfsFilePtr_t) { return true; }
+void afatfs_findFirst(afatfsFilePtr_t, afatfsFinder_t *) {}
+afatfsOperationStatus_e afatfs_findNext(afatfsFilePtr_t, afatfsFinder_t *, fatDirectoryEntry_t **) { return AFATFS_OPERATION_FAILURE; }
+void afatfs_findLast(afatfsFilePtr_t) {}
+bool afatfs_flush(void) { return true; }
+uint32_t afatfs_getFreeBufferSpace(void) { return 512; }
+bool afatfs_isFull(void) { return false; }
+bool fat_isDirectoryEntryTerminator(fatDirectoryEntry_t *) { return true; }
+bool sdcard_isInserted(void) { return true; }
+bool sdcard_isFunctional(void) { return true; }
+
+}
@@ -0,0 +1,225 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "blackbox/blackbox_pretrigger.h"
+
+    #include "common/maths.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// The test build uses a 1kB ring, see CMakeLists.txt
+#define RING_SIZE   1024
+
+/*
+ * A keyframe interval as the encoder would write it: the keyframe's own iteration first, then filler which
+ * depends on the iteration, so that every byte can be checked.
+ */
+static std::vector<uint8_t> interval(uint32_t iteration, int length)
+{
+    std::vector<uint8_t> bytes(length);
+    for (int i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)(iteration * 31 + i);
+    }
+    memcpy(bytes.data(), &iteration, MIN(length, (int)sizeof(iteration)));
+    return bytes;
+}
+
+static void writeInterval(uint32_t iteration, uint32_t time, uint32_t window, int length)
+{
+    const std::vector<uint8_t> bytes = interval(iteration, length);
+
+    blackboxPretriggerMarkKeyframe(iteration, time, window);
+    // Written in a few pieces, like the encoder's frame commits
+    for (int offset = 0; offset < length; offset += 40) {
+        blackboxPretriggerWrite(bytes.data() + offset, MIN(40, length - offset));
+    }
+}
+
+static std::vector<uint8_t> readAll(void)
+{
+    std::vector<uint8_t> bytes;
+    const uint8_t *data;
+    int length;
+
+    while ((length = blackboxPretriggerPeek(&data)) > 0) {
+        bytes.insert(bytes.end(), data, data + length);
+        blackboxPretriggerConsume(length);
+    }
+    return bytes;
+}
+
+// Check that the stream is made of whole intervals, starting with the given iteration
+static void expectWholeIntervals(const std::vector<uint8_t> &stream, uint32_t firstIteration, int length)
+{
+    ASSERT_EQ(0u, stream.size() % length);
+    for (size_t offset = 0; offset < stream.size(); offset += length) {
+        const std::vector<uint8_t> expected = interval(firstIteration + offset / length, length);
+        EXPECT_EQ(0, memcmp(expected.data(), stream.data() + offset, length)) << "interval at " << offset;
+    }
+}
+
+TEST(BlackboxPretriggerTest, TestNothingKeptBeforeFirstKeyframe)
+{
+    blackboxPretriggerReset();
+
+    const uint8_t bytes[16] = { 0 };
+    blackboxPretriggerWrite(bytes, sizeof(bytes));
+    EXPECT_EQ(0u, blackboxPretriggerPendingBytes());
+
+    writeInterval(1, 1000, 0, 100);
+    EXPECT_EQ(100u, blackboxPretriggerPendingBytes());
+
+    blackboxPretriggerKeyframe_t keyframe;
+    ASSERT_TRUE(blackboxPretriggerOldestKeyframe(&keyframe));
+    EXPECT_EQ(1u, keyframe.iteration);
+    EXPECT_EQ(1000u, keyframe.time);
+}
+
+TEST(BlackboxPretriggerTest, TestWindowDropsWholeKeyframes)
+{
+    blackboxPretriggerReset();
+
+    // 10ms intervals with a 35ms window, the ring has room for more
+    for (uint32_t i = 0; i < 20; i++) {
+        writeInterval(i, i * 10000, 35000, 20);
+    }
+
+    blackboxPretriggerKeyframe_t keyframe;
+    ASSERT_TRUE(blackboxPretriggerOldestKeyframe(&keyframe));
+    // The oldest keyframe that still covers the window
+    EXPECT_EQ(15u, keyframe.iteration);
+
+    expectWholeIntervals(readAll(), 15, 20);
+}
+
+TEST(BlackboxPretriggerTest, TestFullRingDropsWholeKeyframes)
+{
+    blackboxPretriggerReset();
+
+    for (uint32_t i = 0; i < 50; i++) {
+        writeInterval(i, i * 10000, 0, 300);
+        EXPECT_LE(blackboxPretriggerPendingBytes(), (uint32_t)RING_SIZE);
+    }
+
+    // Three intervals fit in the ring
+    blackboxPretriggerKeyframe_t keyframe;
+    ASSERT_TRUE(blackboxPretriggerOldestKeyframe(&keyframe));
+    EXPECT_EQ(47u, keyframe.iteration);
+
+    expectWholeIntervals(readAll(), 47, 300);
+}
+
+TEST(BlackboxPretriggerTest, TestCapacityFollowsDataRate)
+{
+    blackboxPretriggerReset();
+
+    blackboxPretriggerInfo_t info;
+    writeInterval(1, 0, 0, 128);
+    blackboxPretriggerGetInfo(&info);
+    EXPECT_EQ(0u, info.capacity);
+
+    // 128 bytes per 10ms, 8 intervals fit
+    for (uint32_t i = 2; i < 20; i++) {
+        writeInterval(i, (i - 1) * 10000, 0, 128);
+    }
+    blackboxPretriggerGetInfo(&info);
+    EXPECT_EQ(80000u, info.capacity);
+    EXPECT_LT(info.span, info.capacity);
+}
+
+TEST(BlackboxPretriggerTest, TestOversizedIntervalResyncs)
+{
+    blackboxPretriggerReset();
+
+    blackboxPretriggerInfo_t before;
+    blackboxPretriggerGetInfo(&before);
+
+    writeInterval(1, 0, 0, 100);
+    writeInterval(2, 10000, 0, RING_SIZE + 100);
+
+    blackboxPretriggerInfo_t after;
+    blackboxPretriggerGetInfo(&after);
+    EXPECT_EQ(before.overflows + 1, after.overflows);
+
+    // The rest of the oversized interval is dropped too, the ring picks up at the next keyframe
+    EXPECT_EQ(0u, blackboxPretriggerPendingBytes());
+    writeInterval(3, 20000, 0, 100);
+
+    expectWholeIntervals(readAll(), 3, 100);
+}
+
+/*
+ * While a triggered log is written out the ring is read and written at the same time, with no window. As long as
+ * the reader keeps up, the stream comes out unchanged.
+ */
+TEST(BlackboxPretriggerTest, TestReadWhileWriting)
+{
+    blackboxPretriggerReset();
+
+    std::vector<uint8_t> stream;
+    const uint8_t *data;
+
+    for (uint32_t i = 0; i < 100; i++) {
+        writeInterval(i, i * 10000, 0, 170);
+
+        // Read a bit less than written, so the reader catches up over the wrap point a few times
+        int budget = 165;
+        int length;
+        while (budget > 0 && (length = MIN(blackboxPretriggerPeek(&data), budget)) > 0) {
+            stream.insert(stream.end(), data, data + length);
+            blackboxPretriggerConsume(length);
+            budget -= length;
+        }
+    }
+
+    const std::vector<uint8_t> rest = readAll();
+    stream.insert(stream.end(), rest.begin(), rest.end());
+
+    expectWholeIntervals(stream, 0, 170);
+    EXPECT_EQ(0u, blackboxPretriggerPendingBytes());
+}
+
+// When the reader falls behind, data is dropped up to the next keyframe and the stream resyncs there
+TEST(BlackboxPretriggerTest, TestSlowReaderResyncsAtKeyframe)
+{
+    blackboxPretriggerReset();
+
+    writeInterval(0, 0, 0, 200);
+
+    // Read half of the first interval, then let the writer overrun the reader
+    const uint8_t *data;
+    ASSERT_GE(blackboxPretriggerPeek(&data), 100);
+    blackboxPretriggerConsume(100);
+
+    for (uint32_t i = 1; i < 10; i++) {
+        writeInterval(i, i * 10000, 0, 200);
+    }
+
+    blackboxPretriggerKeyframe_t keyframe;
+    ASSERT_TRUE(blackboxPretriggerOldestKeyframe(&keyframe));
+    expectWholeIntervals(readAll(), keyframe.iteration, 200);
+}
@@ -0,0 +1,428 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <set>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/streambuf.h"
+    #include "common/time.h"
+    #include "common/utils.h"
+
+    #include "drivers/serial.h"
+
+    #include "fc/runtime_config.h"
+
+    #include "io/dataflash_stream.h"
+
+    #include "msp/msp.h"
+    #include "msp/msp_protocol_v2_inav.h"
+    #include "msp/msp_serial.h"
+
+    #include "scheduler/scheduler.h"
+
+    uint32_t armingFlags;
+    cfTask_t cfTasks[TASK_COUNT] = {};
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define FLASH_SIZE          (1024 * 1024)
+#define FLASH_USED          (600 * 1024)
+#define SERIAL_PERIOD_US    10000
+#define FRAME_OVERHEAD      9
+
+typedef struct {
+    uint32_t address;
+    uint16_t length;
+    uint8_t flags;
+    std::vector<uint8_t> data;
+} streamFrame_t;
+
+static std::vector<uint8_t> flashMemory;
+static serialPort_t fakePort;
+static mspPort_t fakeMspPort;
+
+static std::vector<streamFrame_t> sentFrames;
+static std::set<int> framesToLose;      // Counted over all frames pushed
+static int pushedFrameCount;
+static uint32_t txBytesQueued;
+static uint32_t txBufferSize;
+
+static timeMs_t fakeMillis;
+
+/*
+ * Plays the receiving end. Takes the frames out of the transmit buffer, keeps those which continue what was
+ * received, and acknowledges every frame. Asks for a resend once when a frame is missing.
+ */
+class DataflashStreamTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        flashMemory.assign(FLASH_SIZE, 0xFF);
+        for (uint32_t i = 0; i < FLASH_USED; i++) {
+            flashMemory[i] = (i * 13) ^ (i >> 8);
+        }
+
+        memset(&fakePort, 0, sizeof(fakePort));
+        memset(&fakeMspPort, 0, sizeof(fakeMspPort));
+        fakeMspPort.port = &fakePort;
+
+        sentFrames.clear();
+        framesToLose.clear();
+        pushedFrameCount = 0;
+        txBytesQueued = 0;
+        txBufferSize = 64 * 1024;
+
+        fakeMillis = 1000;
+        armingFlags = 0;
+        cfTasks[TASK_SERIAL].desiredPeriod = SERIAL_PERIOD_US;
+
+        received.clear();
+        expected = 0;
+        resendRequested = false;
+    }
+
+    virtual void TearDown() {
+        dataflashStreamStop();
+    }
+
+    dataflashStreamRequest_t start(uint32_t address, uint32_t length, uint16_t chunkSize, uint8_t window, uint8_t flags) {
+        dataflashStreamRequest_t request = { address, length, chunkSize, window, flags };
+
+        dataflashStreamRequest(&request);
+        dataflashStreamAttach(&fakePort);
+        expected = request.address;
+        return request;
+    }
+
+    void process(void) {
+        dataflashStreamProcess(fakeMillis * 1000);
+    }
+
+    // Takes the frames sent so far off the link, and acknowledges them. Returns the number of frames taken
+    int receive(bool ack = true) {
+        const int count = sentFrames.size();
+
+        for (const streamFrame_t &frame : sentFrames) {
+            if (frame.address == expected) {
+                if (frame.flags & DATAFLASH_STREAM_CHUNK_ERASED) {
+                    received.insert(received.end(), frame.length, 0xFF);
+                } else {
+                    received.insert(received.end(), frame.data.begin(), frame.data.end());
+                }
+                expected += frame.length;
+                resendRequested = false;
+                if (ack) {
+                    dataflashStreamAck(expected, 0);
+                }
+            } else if (frame.address > expected && !resendRequested && ack) {
+                dataflashStreamAck(expected, DATAFLASH_STREAM_ACK_RESEND);
+                resendRequested = true;
+            }
+        }
+        sentFrames.clear();
+        txBytesQueued = 0;
+        return count;
+    }
+
+    void runToEnd(int maxRuns = 10000) {
+        for (int i = 0; i < maxRuns && dataflashStreamIsActive(); i++) {
+            process();
+            receive();
+            fakeMillis++;
+        }
+    }
+
+    bool receivedMatches(uint32_t address) {
+        return std::equal(received.begin(), received.end(), flashMemory.begin() + address);
+    }
+
+    std::vector<uint8_t> received;
+    uint32_t expected;
+    bool resendRequested;
+};
+
+TEST_F(DataflashStreamTest, TestRangeIsDelivered)
+{
+    start(1000, 300000, 2048, 8, 0);
+    EXPECT_TRUE(dataflashStreamIsActive());
+
+    // The serial task runs faster while streaming
+    EXPECT_EQ(DATAFLASH_STREAM_TASK_PERIOD_US, cfTasks[TASK_SERIAL].desiredPeriod);
+
+    runToEnd();
+
+    EXPECT_FALSE(dataflashStreamIsActive());
+    EXPECT_EQ(300000u, received.size());
+    EXPECT_TRUE(receivedMatches(1000));
+    EXPECT_EQ(SERIAL_PERIOD_US, cfTasks[TASK_SERIAL].desiredPeriod);
+}
+
+TEST_F(DataflashStreamTest, TestRequestIsClipped)
+{
+    dataflashStreamRequest_t request = start(FLASH_SIZE - 100, 1000, 0, 200, 0);
+
+    EXPECT_EQ((uint32_t)FLASH_SIZE - 100, request.address);
+    EXPECT_EQ(100u, request.length);
+    EXPECT_EQ(1, request.chunkSize);
+    EXPECT_EQ(DATAFLASH_STREAM_MAX_WINDOW, request.window);
+
+    request = start(0, 10, DATAFLASH_STREAM_MAX_CHUNK + 1, 0, 0);
+    EXPECT_EQ(DATAFLASH_STREAM_MAX_CHUNK, request.chunkSize);
+    EXPECT_EQ(1, request.window);
+
+    // Nothing to send, nothing starts
+    request = start(FLASH_SIZE + 10, 1000, 256, 4, 0);
+    EXPECT_EQ(0u, request.length);
+    EXPECT_FALSE(dataflashStreamIsActive());
+}
+
+TEST_F(DataflashStreamTest, TestWindowLimitsFramesInFlight)
+{
+    start(0, 100000, 1024, 4, 0);
+
+    process();
+    EXPECT_EQ(4u, sentFrames.size());
+
+    process();
+    EXPECT_EQ(4u, sentFrames.size());
+
+    // Each acknowledged frame lets one more go
+    dataflashStreamAck(2048, 0);
+    process();
+    ASSERT_EQ(6u, sentFrames.size());
+    EXPECT_EQ(4096u, sentFrames[4].address);
+    EXPECT_EQ(5120u, sentFrames[5].address);
+}
+
+TEST_F(DataflashStreamTest, TestFullTransmitBufferHoldsFrames)
+{
+    txBufferSize = 1000;
+    start(0, 10000, 512, 8, 0);
+
+    // A frame is sent into an empty buffer, the next one doesn't fit after it
+    process();
+    EXPECT_EQ(1u, sentFrames.size());
+
+    receive();
+    process();
+    EXPECT_EQ(1u, sentFrames.size());
+    EXPECT_EQ(512u, sentFrames[0].address);
+}
+
+TEST_F(DataflashStreamTest, TestErasedChunksAreSkipped)
+{
+    start(FLASH_USED - 1000, 5000, 2048, 8, DATAFLASH_STREAM_SKIP_ERASED);
+    process();
+
+    ASSERT_EQ(3u, sentFrames.size());
+    EXPECT_EQ(0, sentFrames[0].flags);
+    EXPECT_EQ(2048u, sentFrames[0].data.size());
+    EXPECT_EQ(DATAFLASH_STREAM_CHUNK_ERASED, sentFrames[1].flags);
+    EXPECT_EQ(2048, sentFrames[1].length);
+    EXPECT_EQ(0u, sentFrames[1].data.size());
+    EXPECT_EQ(DATAFLASH_STREAM_CHUNK_ERASED, sentFrames[2].flags);
+    EXPECT_EQ(904, sentFrames[2].length);
+
+    runToEnd();
+    EXPECT_EQ(5000u, received.size());
+    EXPECT_TRUE(receivedMatches(FLASH_USED - 1000));
+}
+
+TEST_F(DataflashStreamTest, TestErasedChunksAreSentWithoutFlag)
+{
+    start(FLASH_USED, 2048, 2048, 8, 0);
+    process();
+
+    ASSERT_EQ(1u, sentFrames.size());
+    EXPECT_EQ(0, sentFrames[0].flags);
+    EXPECT_EQ(2048u, sentFrames[0].data.size());
+}
+
+TEST_F(DataflashStreamTest, TestLostFrameIsSentAgain)
+{
+    framesToLose = { 3, 4, 20 };
+    start(0, 64 * 1024, 1024, 8, 0);
+
+    runToEnd();
+
+    EXPECT_FALSE(dataflashStreamIsActive());
+    EXPECT_EQ(64u * 1024, received.size());
+    EXPECT_TRUE(receivedMatches(0));
+    EXPECT_GT(pushedFrameCount, 64);
+}
+
+TEST_F(DataflashStreamTest, TestLostAckIsCoveredByTimeout)
+{
+    start(0, 8192, 1024, 4, 0);
+
+    process();
+    receive(false);
+    EXPECT_EQ(4u, received.size() / 1024);
+
+    // The acks were lost, the window stays full
+    process();
+    EXPECT_EQ(0u, sentFrames.size());
+
+    fakeMillis += DATAFLASH_STREAM_RESEND_MS + 1;
+    process();
+    ASSERT_EQ(4u, sentFrames.size());
+    EXPECT_EQ(0u, sentFrames[0].address);
+}
+
+TEST_F(DataflashStreamTest, TestStreamGivesUpWithoutAcks)
+{
+    start(0, 8192, 1024, 4, 0);
+
+    for (int i = 0; i < DATAFLASH_STREAM_TIMEOUT_MS / 10 + 1 && dataflashStreamIsActive(); i++) {
+        fakeMillis += 10;
+        process();
+        receive(false);
+    }
+
+    EXPECT_FALSE(dataflashStreamIsActive());
+    EXPECT_EQ(SERIAL_PERIOD_US, cfTasks[TASK_SERIAL].desiredPeriod);
+}
+
+TEST_F(DataflashStreamTest, TestStaleAcksAreIgnored)
+{
+    start(4096, 8192, 1024, 4, 0);
+    process();
+
+    // Acks from before the start, and of frames not sent yet
+    dataflashStreamAck(1024, 0);
+    dataflashStreamAck(4096 + 5 * 1024, 0);
+    process();
+    EXPECT_EQ(4u, sentFrames.size());
+}
+
+TEST_F(DataflashStreamTest, TestStreamStops)
+{
+    start(0, 100000, 1024, 4, 0);
+    process();
+    receive();
+
+    // Arming stops the stream
+    ENABLE_ARMING_FLAG(ARMED);
+    process();
+    EXPECT_FALSE(dataflashStreamIsActive());
+    EXPECT_EQ(0u, sentFrames.size());
+    DISABLE_ARMING_FLAG(ARMED);
+
+    // So does the port being taken over by the CLI
+    start(0, 100000, 1024, 4, 0);
+    fakeMspPort.port = NULL;
+    process();
+    EXPECT_FALSE(dataflashStreamIsActive());
+    fakeMspPort.port = &fakePort;
+
+    // And a new request
+    start(0, 100000, 1024, 4, 0);
+    dataflashStreamRequest_t request = { 0, 0, 1024, 4, 0 };
+    dataflashStreamRequest(&request);
+    EXPECT_FALSE(dataflashStreamIsActive());
+    EXPECT_EQ(SERIAL_PERIOD_US, cfTasks[TASK_SERIAL].desiredPeriod);
+}
+
+// STUBS
+
+extern "C" {
+
+timeMs_t millis(void)
+{
+    return fakeMillis;
+}
+
+timeUs_t micros(void)
+{
+    return fakeMillis * 1000;
+}
+
+uint32_t flashfsGetSize(void)
+{
+    return FLASH_SIZE;
+}
+
+int flashfsReadAbs(uint32_t address, uint8_t *data, unsigned int len)
+{
+    if (address >= FLASH_SIZE) {
+        return 0;
+    }
+    len = MIN(len, FLASH_SIZE - address);
+    memcpy(data, &flashMemory[address], len);
+    return len;
+}
+
+void rescheduleTask(cfTaskId_e taskId, timeDelta_t newPeriodUs)
+{
+    cfTasks[taskId].desiredPeriod = newPeriodUs;
+}
+
+mspPort_t *mspSerialPortFind(const serialPort_t *serialPort)
+{
+    return serialPort == &fakePort ? &fakeMspPort : NULL;
+}
+
+bool isSerialTransmitBufferEmpty(const serialPort_t *instance)
+{
+    UNUSED(instance);
+    return txBytesQueued == 0;
+}
+
+uint32_t serialTxBytesFree(const serialPort_t *instance)
+{
+    UNUSED(instance);
+    return txBufferSize - txBytesQueued;
+}
+
+int mspSerialPushPacket(mspPort_t *mspPort, mspPacket_t *packet, mspVersion_e version)
+{
+    EXPECT_EQ(&fakeMspPort, mspPort);
+    EXPECT_EQ(MSP_V2_NATIVE, version);
+    EXPECT_EQ(MSP2_BLACKBOX_STREAM_DATA, packet->cmd);
+
+    const int frameLength = sbufBytesRemaining(&packet->buf) + FRAME_OVERHEAD;
+    if (txBytesQueued > 0 && serialTxBytesFree(mspPort->port) < (uint32_t)frameLength) {
+        return 0;
+    }
+    txBytesQueued += frameLength;
+
+    if (framesToLose.count(pushedFrameCount++)) {
+        return frameLength;
+    }
+
+    streamFrame_t frame;
+    frame.address = sbufReadU32(&packet->buf);
+    frame.length = sbufReadU16(&packet->buf);
+    frame.flags = sbufReadU8(&packet->buf);
+    frame.data.assign(sbufPtr(&packet->buf), sbufPtr(&packet->buf) + sbufBytesRemaining(&packet->buf));
+    if (!(frame.flags & DATAFLASH_STREAM_CHUNK_ERASED)) {
+        EXPECT_EQ(frame.length, frame.data.size());
+    }
+    sentFrames.push_back(frame);
+
+    return frameLength;
+}
+
+}
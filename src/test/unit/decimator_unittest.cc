@@ -0,0 +1,169 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/decimator.h"
+    #include "common/maths.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define GYRO_RATE_HZ        8000.0
+#define OUTPUT_SAMPLES      4000
+
+static const decimatorType_e decimatorTypes[] = { DECIMATOR_CIC, DECIMATOR_FIR };
+static const char * const decimatorTypeNames[] = { "CIC", "FIR" };
+
+/*
+ * Decimate a tone and return the amplitude of the output at the frequency it folds to,
+ * a single DFT bin over a whole number of periods
+ */
+static double decimatedToneAmplitude(decimatorVec3_t *decimator, double toneHz)
+{
+    const int factor = decimator->factor;
+    const double outputRateHz = GYRO_RATE_HZ / factor;
+    double aliasHz = fmod(toneHz, outputRateHz);
+    if (aliasHz > outputRateHz / 2) {
+        aliasHz = outputRateHz - aliasHz;
+    }
+
+    double re = 0, im = 0;
+    int sample = 0;
+
+    for (int n = 0; n < OUTPUT_SAMPLES + DECIMATOR_MAX_TAPS; n++) {
+        for (int i = 0; i < factor; i++, sample++) {
+            const float value = sin(2.0 * M_PI * toneHz * sample / GYRO_RATE_HZ);
+            const float v[XYZ_AXIS_COUNT] = { value, value, value };
+            decimatorVec3Push(decimator, v);
+        }
+
+        float output[XYZ_AXIS_COUNT];
+        decimatorVec3Apply(decimator, output);
+        EXPECT_EQ(output[X], output[Z]);
+
+        // Skip the filter warm up
+        if (n >= DECIMATOR_MAX_TAPS) {
+            const double phase = 2.0 * M_PI * aliasHz * (n - DECIMATOR_MAX_TAPS) / outputRateHz;
+            re += output[X] * cos(phase);
+            im += output[X] * sin(phase);
+        }
+    }
+
+    return 2.0 * sqrt(re * re + im * im) / OUTPUT_SAMPLES;
+}
+
+static double toDb(double gain)
+{
+    return 20.0 * log10(gain);
+}
+
+/*
+ * 8kHz gyro into a 2kHz PID loop: without a decimation filter, the 1900Hz motor noise
+ * shows up at 100Hz with full amplitude, right where the PID controller works
+ */
+TEST(DecimatorUnittest, TestAliasRejection)
+{
+    static decimatorVec3_t decimator;
+
+    for (int type = 0; type < 2; type++) {
+        for (int factor = 2; factor <= DECIMATOR_MAX_FACTOR; factor *= 2) {
+            const double outputRateHz = GYRO_RATE_HZ / factor;
+
+            decimatorVec3Init(&decimator, decimatorTypes[type], factor);
+            const double passband = decimatedToneAmplitude(&decimator, outputRateHz / 40);
+
+            decimatorVec3Init(&decimator, decimatorTypes[type], factor);
+            const double bandEdge = decimatedToneAmplitude(&decimator, outputRateHz / 4);
+
+            decimatorVec3Init(&decimator, decimatorTypes[type], factor);
+            const double nearAlias = decimatedToneAmplitude(&decimator, outputRateHz - outputRateHz / 20);
+
+            decimatorVec3Init(&decimator, decimatorTypes[type], factor);
+            const double farAlias = decimatedToneAmplitude(&decimator, outputRateHz + outputRateHz / 20);
+
+            printf("[ DECIMATOR  ] %s x%d %2d taps, delay %4.1f samples: passband %5.2f dB, fs/4 %5.2f dB, alias below %5.1f dB, above %5.1f dB\n",
+                decimatorTypeNames[type], factor, decimator.taps, decimatorGroupDelaySamples(&decimator),
+                toDb(passband), toDb(bandEdge), toDb(nearAlias), toDb(farAlias));
+
+            EXPECT_NEAR(1.0, passband, 0.02);
+            EXPECT_GT(toDb(bandEdge), -6.0);
+            EXPECT_LT(toDb(nearAlias), -25.0);
+            EXPECT_LT(toDb(farAlias), -25.0);
+        }
+    }
+}
+
+/*
+ * Linear phase, a ramp comes out delayed by exactly the reported group delay
+ */
+TEST(DecimatorUnittest, TestGroupDelay)
+{
+    static decimatorVec3_t decimator;
+
+    for (int type = 0; type < 2; type++) {
+        for (int factor = 1; factor <= DECIMATOR_MAX_FACTOR; factor++) {
+            decimatorVec3Init(&decimator, decimatorTypes[type], factor);
+
+            int sample = 0;
+            for (int n = 0; n < 3 * DECIMATOR_MAX_TAPS; n++) {
+                for (int i = 0; i < factor; i++, sample++) {
+                    const float v[XYZ_AXIS_COUNT] = { (float)sample, -(float)sample, 0.5f * sample };
+                    decimatorVec3Push(&decimator, v);
+                }
+
+                float output[XYZ_AXIS_COUNT];
+                decimatorVec3Apply(&decimator, output);
+
+                if (n >= DECIMATOR_MAX_TAPS) {
+                    const float expected = (sample - 1) - decimatorGroupDelaySamples(&decimator);
+                    EXPECT_NEAR(expected, output[X], 1e-3f * sample);
+                    EXPECT_NEAR(-expected, output[Y], 1e-3f * sample);
+                    EXPECT_NEAR(0.5f * expected, output[Z], 1e-3f * sample);
+                }
+            }
+        }
+    }
+}
+
+TEST(DecimatorUnittest, TestFactorOneIsPassthrough)
+{
+    static decimatorVec3_t decimator;
+
+    for (int type = 0; type < 2; type++) {
+        decimatorVec3Init(&decimator, decimatorTypes[type], 1);
+        EXPECT_EQ(1, decimator.taps);
+
+        for (int n = 0; n < 10; n++) {
+            const float v[XYZ_AXIS_COUNT] = { 1.5f * n, 2.0f, -3.0f * n };
+            decimatorVec3Push(&decimator, v);
+
+            float output[XYZ_AXIS_COUNT];
+            decimatorVec3Apply(&decimator, output);
+            EXPECT_EQ(v[X], output[X]);
+            EXPECT_EQ(v[Y], output[Y]);
+            EXPECT_EQ(v[Z], output[Z]);
+        }
+    }
+}
@@ -0,0 +1,330 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+
+    #include "drivers/file_sink.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define BUFFER_SIZE     4096
+
+static std::vector<uint8_t> makeData(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    uint32_t seed = 12345;
+
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed >> 24;
+    }
+    return data;
+}
+
+static std::vector<uint8_t> readFile(const char *fileName)
+{
+    std::vector<uint8_t> contents;
+    FILE *file = fopen(fileName, "rb");
+    EXPECT_NE((FILE *)NULL, file);
+
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        contents.push_back(c);
+    }
+    fclose(file);
+    return contents;
+}
+
+static void waitForFlush(fileSink_t *sink)
+{
+    for (int i = 0; i < 1000 && !fileSinkFlush(sink); i++) {
+        usleep(1000);
+    }
+}
+
+class FileSinkTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        memset(&sink, 0, sizeof(sink));
+        strcpy(fileName, "/tmp/file_sink_XXXXXX");
+        close(mkstemp(fileName));
+    }
+
+    virtual void TearDown() {
+        fileSinkClose(&sink);
+        unlink(fileName);
+    }
+
+    char fileName[32];
+    fileSink_t sink;
+};
+
+TEST_F(FileSinkTest, TestWritesReachFile)
+{
+    const std::vector<uint8_t> data = makeData(100 * 1000);
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+
+    // Write in frame sized pieces, and wait for the writer when it falls behind
+    for (size_t offset = 0; offset < data.size(); ) {
+        const uint32_t length = MIN((size_t)100, data.size() - offset);
+        const uint32_t accepted = fileSinkWrite(&sink, &data[offset], length);
+        fileSinkEndFrame(&sink);
+
+        offset += accepted;
+        if (accepted < length) {
+            waitForFlush(&sink);
+        }
+    }
+
+    waitForFlush(&sink);
+    EXPECT_TRUE(readFile(fileName) == data);
+
+    fileSinkClose(&sink);
+    EXPECT_FALSE(fileSinkIsOpen(&sink));
+
+    fileSinkStats_t stats;
+    fileSinkGetStats(&sink, &stats);
+    EXPECT_EQ(data.size(), stats.bytesWritten);
+    EXPECT_EQ(stats.bytesAccepted, stats.bytesWritten);
+    EXPECT_EQ(0u, stats.writeErrorCount);
+    EXPECT_LE(stats.maxPendingBytes, 2u * BUFFER_SIZE);
+}
+
+TEST_F(FileSinkTest, TestCloseWritesPendingData)
+{
+    const std::vector<uint8_t> data = makeData(BUFFER_SIZE + 10);
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+
+    EXPECT_EQ(data.size(), fileSinkWrite(&sink, data.data(), data.size()));
+    fileSinkClose(&sink);
+
+    EXPECT_TRUE(readFile(fileName) == data);
+}
+
+TEST_F(FileSinkTest, TestPartialBufferWrittenWhenIdle)
+{
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+
+    fileSinkWrite(&sink, "H Product:", 10);
+    EXPECT_EQ(0u, readFile(fileName).size());
+
+    usleep(3 * FILE_SINK_IDLE_FLUSH_MS * 1000);
+    EXPECT_EQ(10u, readFile(fileName).size());
+}
+
+TEST_F(FileSinkTest, TestFreeSpace)
+{
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+    EXPECT_EQ(2u * BUFFER_SIZE, fileSinkFreeSpace(&sink));
+
+    fileSinkWrite(&sink, "0123456789", 10);
+    EXPECT_EQ(2u * BUFFER_SIZE - 10, fileSinkFreeSpace(&sink));
+
+    waitForFlush(&sink);
+    EXPECT_EQ(2u * BUFFER_SIZE, fileSinkFreeSpace(&sink));
+}
+
+/*
+ * A pipe nobody reads from stands for a disk which has stalled. Once the pipe is full the writer blocks, and the
+ * caller's writes are dropped when both buffers are full, instead of blocking too.
+ */
+TEST_F(FileSinkTest, TestDropsWhenWriterStalls)
+{
+    unlink(fileName);
+    ASSERT_EQ(0, mkfifo(fileName, 0600));
+    const int reader = open(fileName, O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(reader, 0);
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+
+    const std::vector<uint8_t> data = makeData(BUFFER_SIZE);
+    uint64_t offered = 0;
+    uint64_t accepted = 0;
+
+    for (int i = 0; i < 1000; i++) {
+        offered += data.size();
+        accepted += fileSinkWrite(&sink, data.data(), data.size());
+        fileSinkEndFrame(&sink);
+        if (accepted < offered) {
+            break;
+        }
+        usleep(100);
+    }
+    ASSERT_LT(accepted, offered);
+
+    fileSinkStats_t stats;
+    fileSinkGetStats(&sink, &stats);
+    EXPECT_EQ(accepted, stats.bytesAccepted);
+    EXPECT_EQ(offered - accepted, stats.bytesDropped);
+    EXPECT_EQ(1u, stats.dropCount);
+    EXPECT_EQ(1u, stats.bufferFullCount);
+    EXPECT_EQ(2u * BUFFER_SIZE, stats.maxPendingBytes);
+
+    // Once the disk catches up everything accepted is written
+    uint8_t buffer[BUFFER_SIZE];
+    uint64_t received = 0;
+    while (!fileSinkFlush(&sink) || received < accepted) {
+        const ssize_t length = read(reader, buffer, sizeof(buffer));
+        if (length > 0) {
+            received += length;
+        } else {
+            usleep(100);
+        }
+    }
+    fileSinkClose(&sink);
+    close(reader);
+
+    fileSinkGetStats(&sink, &stats);
+    EXPECT_EQ(accepted, received);
+    EXPECT_EQ(accepted, stats.bytesWritten);
+}
+
+/*
+ * Frames written in several pieces which straddle the buffers. When one doesn't fit, its pieces already in the
+ * buffer are taken back and the rest are dropped, so the file only ever holds whole frames.
+ */
+TEST_F(FileSinkTest, TestDropsWholeFrames)
+{
+    unlink(fileName);
+    ASSERT_EQ(0, mkfifo(fileName, 0600));
+    const int reader = open(fileName, O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(reader, 0);
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+
+    const int pieceLength = 100;
+    const int frameLength = 3 * pieceLength;
+    uint8_t piece[pieceLength];
+    fileSinkStats_t stats;
+    int frames = 0;
+
+    do {
+        memset(piece, frames & 0xFF, sizeof(piece));
+        for (int i = 0; i < frameLength / pieceLength; i++) {
+            fileSinkWrite(&sink, piece, sizeof(piece));
+        }
+        fileSinkEndFrame(&sink);
+        fileSinkGetStats(&sink, &stats);
+        frames++;
+        usleep(10);
+    } while (stats.dropCount < 3 && frames < 100000);
+
+    ASSERT_EQ(3u, stats.dropCount);
+    EXPECT_EQ(3u * frameLength, stats.bytesDropped);
+    EXPECT_EQ((uint64_t)frames * frameLength, stats.bytesAccepted + stats.bytesDropped);
+
+    std::vector<uint8_t> received;
+    uint8_t buffer[BUFFER_SIZE];
+    while (!fileSinkFlush(&sink) || received.size() < stats.bytesAccepted) {
+        const ssize_t length = read(reader, buffer, sizeof(buffer));
+        if (length > 0) {
+            received.insert(received.end(), buffer, buffer + length);
+        } else {
+            usleep(100);
+        }
+    }
+    fileSinkClose(&sink);
+    close(reader);
+
+    ASSERT_EQ(0u, received.size() % frameLength);
+    for (size_t offset = 0; offset < received.size(); offset += frameLength) {
+        const std::vector<uint8_t> expected(frameLength, received[offset]);
+        EXPECT_EQ(0, memcmp(expected.data(), &received[offset], frameLength)) << "frame at " << offset;
+    }
+}
+
+/*
+ * Same stalled disk, but a blocking sink waits for it, and a slow reader eventually gets everything.
+ */
+TEST_F(FileSinkTest, TestBlockingWaitsForWriter)
+{
+    unlink(fileName);
+    ASSERT_EQ(0, mkfifo(fileName, 0600));
+    const int reader = open(fileName, O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(reader, 0);
+    ASSERT_TRUE(fileSinkOpen(&sink, fileName, BUFFER_SIZE));
+    fileSinkSetBlocking(&sink, true);
+
+    const std::vector<uint8_t> data = makeData(20 * BUFFER_SIZE);
+    std::vector<uint8_t> received;
+
+    std::thread readerThread([&]() {
+        uint8_t buffer[BUFFER_SIZE];
+        while (received.size() < data.size()) {
+            const ssize_t length = read(reader, buffer, sizeof(buffer));
+            if (length > 0) {
+                received.insert(received.end(), buffer, buffer + length);
+            }
+            usleep(500);
+        }
+    });
+
+    for (size_t offset = 0; offset < data.size(); offset += 1000) {
+        const uint32_t length = MIN((size_t)1000, data.size() - offset);
+        EXPECT_EQ(2u * BUFFER_SIZE, fileSinkFreeSpace(&sink));
+        ASSERT_EQ(length, fileSinkWrite(&sink, &data[offset], length));
+    }
+    EXPECT_TRUE(fileSinkFlush(&sink));
+
+    readerThread.join();
+    fileSinkClose(&sink);
+    close(reader);
+
+    EXPECT_TRUE(received == data);
+
+    fileSinkStats_t stats;
+    fileSinkGetStats(&sink, &stats);
+    EXPECT_EQ(data.size(), stats.bytesWritten);
+    EXPECT_EQ(0u, stats.bytesDropped);
+    EXPECT_EQ(0u, stats.dropCount);
+    EXPECT_GT(stats.bufferFullCount, 0u);
+}
+
+TEST_F(FileSinkTest, TestWriteErrorsAreCounted)
+{
+    ASSERT_TRUE(fileSinkOpen(&sink, "/dev/full", BUFFER_SIZE));
+
+    EXPECT_EQ(100u, fileSinkWrite(&sink, makeData(100).data(), 100));
+    fileSinkClose(&sink);
+
+    fileSinkStats_t stats;
+    fileSinkGetStats(&sink, &stats);
+    EXPECT_EQ(0u, stats.bytesWritten);
+    EXPECT_EQ(100u, stats.bytesDropped);
+    EXPECT_EQ(1u, stats.writeErrorCount);
+    EXPECT_EQ(0u, stats.dropCount);
+}
+
+TEST_F(FileSinkTest, TestOpenFailure)
+{
+    EXPECT_FALSE(fileSinkOpen(&sink, "/nonexistent/directory/LOG.TXT", BUFFER_SIZE));
+    EXPECT_FALSE(fileSinkIsOpen(&sink));
+}
@@ -0,0 +1,176 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <complex>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/filter.h"
+    #include "common/maths.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TABLE_MAX_RATIO     0.48f   // same range as the dynamic notch and RPM filter tables
+
+static const uint32_t looptimes[] = { 1000, 500, 250, 125 };
+static const float notchQs[] = { 2.5f, 5.0f, 10.0f };     // dynamic notch, RPM filter and a sharp notch
+
+static float tableMaxHz(uint32_t looptime)
+{
+    return TABLE_MAX_RATIO * 1000000.0f / looptime;
+}
+
+/*
+ * Notch center frequency, the zeros of b0 + b1 z^-1 + b0 z^-2 are at cos(omega) = -b1 / (2 b0)
+ */
+static double notchCenterHz(const biquadFilter_t *filter, uint32_t looptime)
+{
+    const double sampleRate = 1000000.0 / looptime;
+    return acos(-(double)filter->b1 / (2.0 * filter->b0)) * sampleRate / (2.0 * M_PI);
+}
+
+static double magnitudeResponse(const biquadFilter_t *filter, double frequencyHz, uint32_t looptime)
+{
+    const std::complex<double> z1 = std::polar(1.0, -2.0 * M_PI * frequencyHz * looptime * 1e-6);
+    const std::complex<double> z2 = z1 * z1;
+    return std::abs(((double)filter->b0 + (double)filter->b1 * z1 + (double)filter->b2 * z2)
+        / (1.0 + (double)filter->a1 * z1 + (double)filter->a2 * z2));
+}
+
+/*
+ * Analytic path: biquadFilterInit() truncates the frequency to whole Hz. The table is
+ * interpolated, so its notch has to land closer to the requested fractional frequency
+ */
+TEST(FilterUnittest, TestNotchTableCenterFrequency)
+{
+    static biquadNotchTable_t table;
+
+    for (uint32_t looptime : looptimes) {
+        for (float Q : notchQs) {
+            biquadNotchTableInit(&table, 0.0f, tableMaxHz(looptime), looptime, Q);
+
+            double tableMaxError = 0;
+            double analyticMaxError = 0;
+            for (float frequency = 20.0f; frequency < tableMaxHz(looptime); frequency += 0.37f) {
+                biquadFilter_t tableNotch;
+                biquadNotchTableLookup(&table, frequency, &tableNotch);
+
+                biquadFilter_t analyticNotch;
+                biquadFilterInit(&analyticNotch, frequency, looptime, Q, FILTER_NOTCH);
+
+                tableMaxError = fmax(tableMaxError, fabs(notchCenterHz(&tableNotch, looptime) - frequency));
+                analyticMaxError = fmax(analyticMaxError, fabs(notchCenterHz(&analyticNotch, looptime) - frequency));
+            }
+
+            printf("[ NOTCH TABLE] %4uus Q %4.1f center error: table %.3f Hz, analytic %.3f Hz\n",
+                (unsigned)looptime, Q, tableMaxError, analyticMaxError);
+
+            EXPECT_LT(tableMaxError, 0.05);
+            EXPECT_LT(tableMaxError, analyticMaxError);
+        }
+    }
+}
+
+/*
+ * At whole Hz both paths compute the same filter, the only difference is the interpolation error
+ */
+TEST(FilterUnittest, TestNotchTableMatchesAnalyticPath)
+{
+    static biquadNotchTable_t table;
+
+    for (uint32_t looptime : looptimes) {
+        for (float Q : notchQs) {
+            biquadNotchTableInit(&table, 0.0f, tableMaxHz(looptime), looptime, Q);
+
+            double coefficientMaxError = 0;
+            double responseMaxError = 0;
+            for (int frequency = 20; frequency < tableMaxHz(looptime); frequency++) {
+                biquadFilter_t tableNotch;
+                biquadNotchTableLookup(&table, frequency, &tableNotch);
+
+                biquadFilter_t analyticNotch;
+                biquadFilterInit(&analyticNotch, frequency, looptime, Q, FILTER_NOTCH);
+
+                EXPECT_EQ(tableNotch.b1, tableNotch.a1);
+                EXPECT_EQ(tableNotch.b2, tableNotch.b0);
+
+                coefficientMaxError = fmax(coefficientMaxError, fabs(tableNotch.b0 - analyticNotch.b0));
+                coefficientMaxError = fmax(coefficientMaxError, fabs(tableNotch.a1 - analyticNotch.a1));
+                coefficientMaxError = fmax(coefficientMaxError, fabs(tableNotch.a2 - analyticNotch.a2));
+
+                // Response compared around the notch, where the difference matters
+                for (float offset = -2.0f; offset <= 2.0f; offset += 0.25f) {
+                    const double probeHz = frequency * powf(2.0f, offset / Q);
+                    if (probeHz < 1000000.0 / looptime / 2) {
+                        responseMaxError = fmax(responseMaxError, fabs(magnitudeResponse(&tableNotch, probeHz, looptime) - magnitudeResponse(&analyticNotch, probeHz, looptime)));
+                    }
+                }
+            }
+
+            printf("[ NOTCH TABLE] %4uus Q %4.1f max error: coefficients %.2e, magnitude response %.2e\n",
+                (unsigned)looptime, Q, coefficientMaxError, responseMaxError);
+
+            EXPECT_LT(coefficientMaxError, 1e-5);
+            EXPECT_LT(responseMaxError, 1e-2);
+        }
+    }
+}
+
+TEST(FilterUnittest, TestNotchTableLookupKeepsState)
+{
+    static biquadNotchTable_t table;
+    biquadNotchTableInit(&table, 100.0f, 900.0f, 500, 5.0f);
+
+    biquadFilter_t filter;
+    biquadFilterInit(&filter, 200, 500, 5.0f, FILTER_NOTCH);
+    for (int i = 0; i < 10; i++) {
+        biquadFilterApplyDF1(&filter, i);
+    }
+
+    const biquadFilter_t before = filter;
+    biquadNotchTableLookup(&table, 300.0f, &filter);
+
+    EXPECT_EQ(before.x1, filter.x1);
+    EXPECT_EQ(before.x2, filter.x2);
+    EXPECT_EQ(before.y1, filter.y1);
+    EXPECT_EQ(before.y2, filter.y2);
+    EXPECT_NEAR(300.0, notchCenterHz(&filter, 500), 0.5);
+}
+
+TEST(FilterUnittest, TestNotchTableClampsToRange)
+{
+    static biquadNotchTable_t table;
+    biquadNotchTableInit(&table, 100.0f, 900.0f, 500, 5.0f);
+
+    biquadFilter_t below, atMin, above, atMax;
+    biquadNotchTableLookup(&table, 10.0f, &below);
+    biquadNotchTableLookup(&table, 100.0f, &atMin);
+    biquadNotchTableLookup(&table, 2000.0f, &above);
+    biquadNotchTableLookup(&table, 900.0f, &atMax);
+
+    EXPECT_EQ(0, memcmp(&below, &atMin, offsetof(biquadFilter_t, x1)));
+    EXPECT_EQ(0, memcmp(&above, &atMax, offsetof(biquadFilter_t, x1)));
+    EXPECT_NEAR(900.0, notchCenterHz(&atMax, 500), 0.5);
+}
@@ -0,0 +1,259 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/filter.h"
+    #include "common/filter_vec3.h"
+    #include "common/maths.h"
+    #include "common/time.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME_US         500     // 2kHz PID loop
+#define NOTCH_PEAK_COUNT    3
+#define TRACE_LENGTH        40000   // 20s of flight
+#define NOTCH_UPDATE_EVERY  12      // one axis retuned every 12 samples, like gyroDataAnalyse()
+
+/*
+ * Gyro trace of a 5" quad: stick inputs, motor noise with harmonics following the
+ * throttle, frame resonance, sensor noise and a few spikes. Deterministic, so both
+ * filter chains see exactly the same samples.
+ */
+typedef struct {
+    uint32_t seed;
+    float motorPhase[XYZ_AXIS_COUNT];
+    float resonancePhase;
+} gyroTrace_t;
+
+static float traceNoise(gyroTrace_t *trace)
+{
+    trace->seed = trace->seed * 1664525U + 1013904223U;
+    return ((trace->seed >> 8) / 16777216.0f) * 2.0f - 1.0f;
+}
+
+static float traceMotorHz(int sample)
+{
+    const float t = sample * LOOPTIME_US * 1e-6f;
+    return 180.0f + 120.0f * sinf(2.0f * M_PIf * 0.15f * t) + 40.0f * sinf(2.0f * M_PIf * 1.3f * t);
+}
+
+static void traceSample(gyroTrace_t *trace, int sample, float *gyro)
+{
+    const float t = sample * LOOPTIME_US * 1e-6f;
+    const float motorHz = traceMotorHz(sample);
+
+    trace->resonancePhase += 2.0f * M_PIf * 142.0f * LOOPTIME_US * 1e-6f;
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        trace->motorPhase[axis] += 2.0f * M_PIf * motorHz * (1.0f + 0.01f * axis) * LOOPTIME_US * 1e-6f;
+
+        const float stick = 250.0f * sinf(2.0f * M_PIf * (0.4f + 0.2f * axis) * t) + ((sample / 3000) % 2 ? 120.0f : -80.0f);
+        const float motorNoise = 35.0f * sinf(trace->motorPhase[axis]) + 12.0f * sinf(2.0f * trace->motorPhase[axis]) + 5.0f * sinf(3.0f * trace->motorPhase[axis]);
+        const float resonance = (axis == FD_YAW ? 4.0f : 15.0f) * sinf(trace->resonancePhase);
+        const float spike = (sample % 4999 == 0) ? 900.0f : 0.0f;
+
+        gyro[axis] = stick + motorNoise + resonance + spike + 3.0f * traceNoise(trace);
+    }
+}
+
+/*
+ * Reference: the per-axis chain as gyroFilter() ran it before the filters were batched
+ */
+typedef struct {
+    pt1Filter_t lpf[XYZ_AXIS_COUNT];
+    biquadFilter_t notch[XYZ_AXIS_COUNT][NOTCH_PEAK_COUNT];
+    biquadFilter_t secondaryNotch[XYZ_AXIS_COUNT];
+} scalarChain_t;
+
+typedef struct {
+    pt1FilterVec3_t lpf;
+    biquadFilterVec3_t notch[NOTCH_PEAK_COUNT];
+    biquadFilterVec3_t secondaryNotch;
+} vec3Chain_t;
+
+static void scalarChainInit(scalarChain_t *chain, uint16_t lpfHz)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        pt1FilterInit(&chain->lpf[axis], lpfHz, US2S(LOOPTIME_US));
+        for (int i = 0; i < NOTCH_PEAK_COUNT; i++) {
+            biquadFilterInit(&chain->notch[axis][i], 350, LOOPTIME_US, 1.0f, FILTER_NOTCH);
+        }
+        biquadFilterInit(&chain->secondaryNotch[axis], 150, LOOPTIME_US, 1.0f, FILTER_NOTCH);
+    }
+}
+
+static void vec3ChainInit(vec3Chain_t *chain, uint16_t lpfHz)
+{
+    pt1FilterVec3Init(&chain->lpf, lpfHz, US2S(LOOPTIME_US));
+    for (int i = 0; i < NOTCH_PEAK_COUNT; i++) {
+        biquadFilterVec3Init(&chain->notch[i], 350, LOOPTIME_US, 1.0f, FILTER_NOTCH);
+    }
+    biquadFilterVec3Init(&chain->secondaryNotch, 150, LOOPTIME_US, 1.0f, FILTER_NOTCH);
+}
+
+static void scalarChainApply(scalarChain_t *chain, float *gyro)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float gyroADCf = gyro[axis];
+
+        gyroADCf = pt1FilterApply(&chain->lpf[axis], gyroADCf);
+        for (int i = 0; i < NOTCH_PEAK_COUNT; i++) {
+            gyroADCf = biquadFilterApplyDF1(&chain->notch[axis][i], gyroADCf);
+        }
+        gyroADCf = biquadFilterApplyDF1(&chain->secondaryNotch[axis], gyroADCf);
+
+        gyro[axis] = gyroADCf;
+    }
+}
+
+static void vec3ChainApply(vec3Chain_t *chain, float *gyro)
+{
+    pt1FilterVec3Apply(&chain->lpf, gyro);
+    for (int i = 0; i < NOTCH_PEAK_COUNT; i++) {
+        biquadFilterVec3ApplyDF1(&chain->notch[i], gyro);
+    }
+    biquadFilterVec3ApplyDF1(&chain->secondaryNotch, gyro);
+}
+
+static void expectBitExact(const float *expected, const float *actual, int sample)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        uint32_t expectedBits, actualBits;
+        memcpy(&expectedBits, &expected[axis], sizeof(expectedBits));
+        memcpy(&actualBits, &actual[axis], sizeof(actualBits));
+        ASSERT_EQ(expectedBits, actualBits) << "sample " << sample << " axis " << axis
+            << " expected " << expected[axis] << " got " << actual[axis];
+    }
+}
+
+TEST(FilterVec3Test, TestPt1BitExact)
+{
+    pt1Filter_t scalar[XYZ_AXIS_COUNT];
+    pt1FilterVec3_t vec3;
+    gyroTrace_t trace = { .seed = 1, .motorPhase = {}, .resonancePhase = 0 };
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        pt1FilterInit(&scalar[axis], 110, US2S(LOOPTIME_US));
+    }
+    pt1FilterVec3Init(&vec3, 110, US2S(LOOPTIME_US));
+
+    for (int sample = 0; sample < TRACE_LENGTH; sample++) {
+        float expected[XYZ_AXIS_COUNT], actual[XYZ_AXIS_COUNT];
+        traceSample(&trace, sample, expected);
+        memcpy(actual, expected, sizeof(actual));
+
+        // Dynamic gyro LPF moves the cutoff with throttle
+        if (sample % 100 == 0) {
+            const float cutoff = 80.0f + traceMotorHz(sample) / 4.0f;
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                pt1FilterUpdateCutoff(&scalar[axis], cutoff);
+            }
+            pt1FilterVec3UpdateCutoff(&vec3, cutoff);
+        }
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            expected[axis] = pt1FilterApply(&scalar[axis], expected[axis]);
+        }
+        pt1FilterVec3Apply(&vec3, actual);
+
+        expectBitExact(expected, actual, sample);
+    }
+}
+
+TEST(FilterVec3Test, TestBiquadUpdatePreservesState)
+{
+    biquadFilter_t scalar;
+    biquadFilterVec3_t vec3;
+    float v[XYZ_AXIS_COUNT];
+
+    biquadFilterInit(&scalar, 200, LOOPTIME_US, 3.0f, FILTER_NOTCH);
+    biquadFilterVec3Init(&vec3, 200, LOOPTIME_US, 3.0f, FILTER_NOTCH);
+
+    for (int sample = 0; sample < 50; sample++) {
+        const float input = sinf(sample * 0.3f) * 100.0f;
+        v[FD_ROLL] = v[FD_PITCH] = v[FD_YAW] = input;
+
+        biquadFilterApplyDF1(&scalar, input);
+        biquadFilterVec3ApplyDF1(&vec3, v);
+    }
+
+    biquadFilterUpdate(&scalar, 260.0f, LOOPTIME_US, 2.0f, FILTER_NOTCH);
+    biquadFilterVec3Update(&vec3, FD_PITCH, 260.0f, LOOPTIME_US, 2.0f, FILTER_NOTCH);
+
+    EXPECT_EQ(scalar.b0, vec3.b0[FD_PITCH]);
+    EXPECT_EQ(scalar.a2, vec3.a2[FD_PITCH]);
+    EXPECT_EQ(scalar.x1, vec3.x1[FD_PITCH]);
+    EXPECT_EQ(scalar.y2, vec3.y2[FD_PITCH]);
+
+    // Other axes keep their tuning
+    EXPECT_NE(vec3.b1[FD_ROLL], vec3.b1[FD_PITCH]);
+    EXPECT_EQ(vec3.b1[FD_ROLL], vec3.b1[FD_YAW]);
+}
+
+TEST(FilterVec3Test, TestGyroChainBitExact)
+{
+    scalarChain_t scalar;
+    vec3Chain_t vec3;
+    gyroTrace_t trace = { .seed = 0x1234, .motorPhase = {}, .resonancePhase = 0 };
+
+    scalarChainInit(&scalar, 110);
+    vec3ChainInit(&vec3, 110);
+
+    for (int sample = 0; sample < TRACE_LENGTH; sample++) {
+        float expected[XYZ_AXIS_COUNT], actual[XYZ_AXIS_COUNT];
+        traceSample(&trace, sample, expected);
+        memcpy(actual, expected, sizeof(actual));
+
+        // Retune one axis at a time, as the dynamic notch does after each FFT step
+        if (sample % NOTCH_UPDATE_EVERY == 0) {
+            const int axis = (sample / NOTCH_UPDATE_EVERY) % XYZ_AXIS_COUNT;
+            const float motorHz = traceMotorHz(sample);
+            float frequency[NOTCH_PEAK_COUNT] = { motorHz, 2.0f * motorHz, 3.0f * motorHz };
+
+            // Peak not detected on this update, filter keeps the previous tuning
+            if ((sample / NOTCH_UPDATE_EVERY) % 7 == 0) {
+                frequency[2] = 0.0f;
+            }
+
+            for (int i = 0; i < NOTCH_PEAK_COUNT; i++) {
+                if (frequency[i] > 0.0f) {
+                    biquadFilterUpdate(&scalar.notch[axis][i], frequency[i], LOOPTIME_US, 2.5f, FILTER_NOTCH);
+                    biquadFilterVec3Update(&vec3.notch[i], axis, frequency[i], LOOPTIME_US, 2.5f, FILTER_NOTCH);
+                }
+            }
+            biquadFilterUpdate(&scalar.secondaryNotch[axis], frequency[0], LOOPTIME_US, 1.2f, FILTER_NOTCH);
+            biquadFilterVec3Update(&vec3.secondaryNotch, axis, frequency[0], LOOPTIME_US, 1.2f, FILTER_NOTCH);
+        }
+
+        scalarChainApply(&scalar, expected);
+        vec3ChainApply(&vec3, actual);
+
+        expectBitExact(expected, actual, sample);
+        if (HasFatalFailure()) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,426 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/time.h"
+    #include "common/utils.h"
+
+    #include "drivers/flash.h"
+    #include "drivers/time.h"
+
+    #include "io/flashfs.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+static flashGeometry_t geometry;
+static flashPartition_t partition;
+static std::vector<uint8_t> flashMemory;
+
+static timeMs_t fakeMillis;
+static int32_t fakeRtcSeconds;
+
+static void setupFlash(flashType_e type, uint16_t pageSize, uint16_t pagesPerSector, flashSector_t sectors)
+{
+    geometry.flashType = type;
+    geometry.pageSize = pageSize;
+    geometry.pagesPerSector = pagesPerSector;
+    geometry.sectorSize = pageSize * pagesPerSector;
+    geometry.sectors = sectors;
+    geometry.totalSize = geometry.sectorSize * sectors;
+
+    partition.type = FLASH_PARTITION_TYPE_FLASHFS;
+    partition.startSector = 0;
+    partition.endSector = sectors - 1;
+
+    flashMemory.assign(geometry.totalSize, 0xFF);
+    fakeMillis = 0;
+    fakeRtcSeconds = 0;
+
+    flashfsInit();
+}
+
+// Where the entries start, after the signature slot
+static uint32_t indexEntryAddress(void)
+{
+    const uint32_t stride = geometry.flashType == FLASH_TYPE_NAND ? geometry.pageSize : sizeof(flashfsLogEntry_t);
+
+    return flashfsGetSize() + stride;
+}
+
+// 256KB NOR chip with 4KB sectors
+static void setupNor(void)
+{
+    setupFlash(FLASH_TYPE_NOR, 256, 16, 64);
+}
+
+// 8MB NAND chip with 2KB pages and 128KB blocks
+static void setupNand(void)
+{
+    setupFlash(FLASH_TYPE_NAND, 2048, 64, 64);
+}
+
+static std::vector<uint8_t> makeData(size_t length, uint8_t seed)
+{
+    std::vector<uint8_t> data(length);
+
+    for (size_t i = 0; i < length; i++) {
+        data[i] = seed + i * 7;
+    }
+    return data;
+}
+
+static void writeLog(size_t length, timeMs_t duration)
+{
+    const std::vector<uint8_t> data = makeData(length, length);
+
+    flashfsBeginLog();
+    flashfsWrite(data.data(), data.size(), true);
+    fakeMillis += duration;
+    flashfsEndLog();
+    flashfsClose();
+}
+
+TEST(FlashfsTest, TestLogsAreIndexed)
+{
+    setupNor();
+    EXPECT_EQ(0, flashfsGetLogCount());
+
+    fakeRtcSeconds = 1700000000;
+    writeLog(1000, 65000);
+    fakeRtcSeconds = 0;
+    writeLog(500, 2000);
+
+    ASSERT_EQ(2, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLog(0, &entry));
+    EXPECT_EQ(0u, entry.start);
+    EXPECT_EQ(1000u, entry.length);
+    EXPECT_EQ(1700000000u, entry.timestamp);
+    EXPECT_EQ(65, entry.duration);
+    EXPECT_EQ(0, entry.flags);
+
+    ASSERT_TRUE(flashfsGetLog(1, &entry));
+    EXPECT_EQ(1000u, entry.start);
+    EXPECT_EQ(500u, entry.length);
+    EXPECT_EQ(0u, entry.timestamp);
+    EXPECT_EQ(2, entry.duration);
+
+    EXPECT_FALSE(flashfsGetLog(2, &entry));
+
+    // Ending the log again doesn't add it twice
+    flashfsEndLog();
+    EXPECT_EQ(2, flashfsGetLogCount());
+}
+
+TEST(FlashfsTest, TestIndexIsFoundAfterRestart)
+{
+    setupNor();
+    writeLog(1000, 1000);
+    writeLog(3000, 1000);
+
+    flashfsInit();
+    ASSERT_EQ(2, flashfsGetLogCount());
+
+    // The next log follows the last one directly
+    writeLog(100, 1000);
+    ASSERT_EQ(3, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLog(2, &entry));
+    EXPECT_EQ(4000u, entry.start);
+    EXPECT_EQ(100u, entry.length);
+    EXPECT_EQ(0, entry.flags);
+}
+
+TEST(FlashfsTest, TestUnfinishedLogIsIndexedByTheNextLog)
+{
+    setupNor();
+    writeLog(1000, 1000);
+
+    const std::vector<uint8_t> data = makeData(5000, 1);
+    flashfsBeginLog();
+    flashfsWrite(data.data(), data.size(), true);
+
+    // The log being written shows up as an unfinished one
+    ASSERT_EQ(2, flashfsGetLogCount());
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLog(1, &entry));
+    EXPECT_EQ(1000u, entry.start);
+    EXPECT_EQ(5000u, entry.length);
+    EXPECT_EQ(FLASHFS_LOG_UNFINISHED, entry.flags);
+
+    // The power goes off before the log ends
+    flashfsInit();
+    ASSERT_EQ(2, flashfsGetLogCount());
+
+    writeLog(200, 1000);
+    ASSERT_EQ(3, flashfsGetLogCount());
+
+    ASSERT_TRUE(flashfsGetLog(1, &entry));
+    EXPECT_EQ(1000u, entry.start);
+    EXPECT_EQ(6144u - 1000u, entry.length);
+    EXPECT_EQ(FLASHFS_LOG_UNFINISHED, entry.flags);
+
+    ASSERT_TRUE(flashfsGetLog(2, &entry));
+    EXPECT_EQ(6144u, entry.start);
+    EXPECT_EQ(200u, entry.length);
+    EXPECT_EQ(0, entry.flags);
+}
+
+TEST(FlashfsTest, TestDamagedEntryIsSkipped)
+{
+    setupNor();
+    writeLog(1000, 1000);
+    writeLog(2000, 1000);
+
+    // The last entry was cut short by a power loss
+    flashMemory[indexEntryAddress() + sizeof(flashfsLogEntry_t) + 4] = 0x00;
+
+    flashfsInit();
+    ASSERT_EQ(3, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    EXPECT_TRUE(flashfsGetLog(0, &entry));
+    EXPECT_FALSE(flashfsGetLog(1, &entry));
+    EXPECT_EQ(0u, entry.length);
+
+    // What followed the last good entry is still listed
+    ASSERT_TRUE(flashfsGetLog(2, &entry));
+    EXPECT_EQ(1000u, entry.start);
+    EXPECT_EQ(FLASHFS_LOG_UNFINISHED, entry.flags);
+}
+
+TEST(FlashfsTest, TestFullIndex)
+{
+    setupNor();
+    const int capacity = geometry.sectorSize / sizeof(flashfsLogEntry_t) - 1;
+
+    for (int i = 0; i < capacity + 3; i++) {
+        writeLog(10, 1000);
+    }
+
+    // The logs which didn't fit the index are listed as one
+    ASSERT_EQ(capacity + 1, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLog(capacity, &entry));
+    EXPECT_EQ(capacity * 10u, entry.start);
+    EXPECT_EQ(30u, entry.length);
+    EXPECT_EQ(FLASHFS_LOG_UNFINISHED, entry.flags);
+}
+
+TEST(FlashfsTest, TestEraseClearsIndex)
+{
+    setupNor();
+    writeLog(1000, 1000);
+
+    flashfsEraseCompletely();
+    EXPECT_EQ(0, flashfsGetLogCount());
+
+    writeLog(100, 1000);
+    flashfsInit();
+    ASSERT_EQ(1, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLog(0, &entry));
+    EXPECT_EQ(0u, entry.start);
+    EXPECT_EQ(100u, entry.length);
+}
+
+TEST(FlashfsTest, TestUnusedIndexIsLeftErased)
+{
+    setupNor();
+    const uint32_t indexSize = geometry.totalSize - flashfsGetSize();
+    EXPECT_EQ(geometry.sectorSize, indexSize);
+
+    flashfsInit();
+    EXPECT_EQ(geometry.totalSize - indexSize, flashfsGetSize());
+    EXPECT_EQ(0, flashfsGetLogCount());
+    for (uint32_t address = flashfsGetSize(); address < geometry.totalSize; address++) {
+        ASSERT_EQ(0xFF, flashMemory[address]);
+    }
+
+    // The signature is written with the first entry
+    writeLog(100, 1000);
+    EXPECT_NE(0xFF, flashMemory[flashfsGetSize()]);
+}
+
+TEST(FlashfsTest, TestOldLogsKeepTheOldLayout)
+{
+    setupNor();
+
+    // Firmware without the index filled the chip up to its end
+    const std::vector<uint8_t> data = makeData(geometry.totalSize, 1);
+    flashMemory = data;
+    flashfsInit();
+
+    EXPECT_EQ(geometry.totalSize, flashfsGetSize());
+    EXPECT_TRUE(flashfsIsEOF());
+    ASSERT_EQ(1, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLog(0, &entry));
+    EXPECT_EQ(0u, entry.start);
+    EXPECT_EQ(FLASHFS_LOG_UNFINISHED, entry.flags);
+
+    // The end of the chip can still be read
+    uint8_t tail[16];
+    ASSERT_EQ((int)sizeof(tail), flashfsReadAbs(geometry.totalSize - sizeof(tail), tail, sizeof(tail)));
+    EXPECT_EQ(0, memcmp(tail, &data[geometry.totalSize - sizeof(tail)], sizeof(tail)));
+
+    // Erasing the chip brings the index in
+    flashfsEraseCompletely();
+    EXPECT_EQ(geometry.totalSize - geometry.sectorSize, flashfsGetSize());
+
+    writeLog(100, 1000);
+    flashfsInit();
+    EXPECT_EQ(geometry.totalSize - geometry.sectorSize, flashfsGetSize());
+    ASSERT_EQ(1, flashfsGetLogCount());
+    ASSERT_TRUE(flashfsGetLog(0, &entry));
+    EXPECT_EQ(100u, entry.length);
+    EXPECT_EQ(0, entry.flags);
+}
+
+TEST(FlashfsTest, TestNandEntriesTakeAPageEach)
+{
+    setupNand();
+
+    // Four blocks for 256 entries of a page each
+    EXPECT_EQ(geometry.totalSize - 4 * geometry.sectorSize, flashfsGetSize());
+
+    writeLog(3000, 1000);
+    writeLog(100, 1000);
+
+    const uint32_t indexAddress = indexEntryAddress();
+    EXPECT_NE(0xFF, flashMemory[indexAddress]);
+    EXPECT_NE(0xFF, flashMemory[indexAddress + geometry.pageSize]);
+    EXPECT_EQ(0xFF, flashMemory[indexAddress + sizeof(flashfsLogEntry_t)]);
+
+    // Logs start on a page
+    flashfsLogEntry_t entry;
+    ASSERT_EQ(2, flashfsGetLogCount());
+    ASSERT_TRUE(flashfsGetLog(1, &entry));
+    EXPECT_EQ(4096u, entry.start);
+    EXPECT_EQ(100u, entry.length);
+}
+
+TEST(FlashfsTest, TestReadsCrossNandPages)
+{
+    setupNand();
+    const std::vector<uint8_t> data = makeData(10000, 3);
+    flashfsWrite(data.data(), data.size(), true);
+
+    std::vector<uint8_t> buffer(4096);
+    ASSERT_EQ(4096, flashfsReadAbs(100, buffer.data(), buffer.size()));
+    EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(), data.begin() + 100));
+
+    // Reads stop at the end of the log space
+    EXPECT_EQ(10, flashfsReadAbs(flashfsGetSize() - 10, buffer.data(), buffer.size()));
+    EXPECT_EQ(0, flashfsReadAbs(flashfsGetSize(), buffer.data(), buffer.size()));
+}
+
+// STUBS
+
+extern "C" {
+
+timeMs_t millis(void)
+{
+    return fakeMillis;
+}
+
+bool rtcGet(rtcTime_t *t)
+{
+    *t = rtcTimeMake(fakeRtcSeconds, 0);
+    return fakeRtcSeconds != 0;
+}
+
+rtcTime_t rtcTimeMake(int32_t secs, uint16_t millis)
+{
+    return ((rtcTime_t)secs) * 1000 + millis;
+}
+
+int32_t rtcTimeGetSeconds(rtcTime_t *t)
+{
+    return *t / 1000;
+}
+
+bool flashIsReady(void)
+{
+    return true;
+}
+
+void flashEraseSector(uint32_t address)
+{
+    memset(&flashMemory[address], 0xFF, geometry.sectorSize);
+}
+
+uint32_t flashPageProgram(uint32_t address, const uint8_t *data, int length)
+{
+    // Programming can only clear bits
+    for (int i = 0; i < length; i++) {
+        flashMemory[address + i] &= data[i];
+    }
+    return address + length;
+}
+
+int flashReadBytes(uint32_t address, uint8_t *buffer, int length)
+{
+    // NAND reads stop at the end of the page
+    if (geometry.flashType == FLASH_TYPE_NAND) {
+        length = MIN(length, (int)(geometry.pageSize - address % geometry.pageSize));
+    }
+    memcpy(buffer, &flashMemory[address], length);
+    return length;
+}
+
+void flashFlush(void)
+{
+}
+
+const flashGeometry_t *flashGetGeometry(void)
+{
+    return &geometry;
+}
+
+flashPartition_t *flashPartitionFindByType(flashPartitionType_e type)
+{
+    return type == FLASH_PARTITION_TYPE_FLASHFS ? &partition : NULL;
+}
+
+uint32_t flashPartitionSize(flashPartition_t *partition)
+{
+    return FLASH_PARTITION_SECTOR_COUNT(partition) * geometry.sectorSize;
+}
+
+void flashPartitionErase(flashPartition_t *partition)
+{
+    UNUSED(partition);
+    memset(flashMemory.data(), 0xFF, flashMemory.size());
+}
+
+}
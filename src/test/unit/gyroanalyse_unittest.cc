@@ -0,0 +1,354 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+
+    #include "flight/gyroanalyse.h"
+
+    #include "sensors/gyro.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME_US     500     // 2kHz, FFT sampling at 1kHz
+
+static gyroAnalyseState_t state;
+
+typedef struct {
+    float frequency;
+    float amplitude;
+} tone_t;
+
+static float toneSample(const tone_t *tones, int toneCount, int loop, int axis)
+{
+    const double t = loop * LOOPTIME_US * 1e-6;
+    float sample = 0.0f;
+    for (int i = 0; i < toneCount; i++) {
+        sample += tones[i].amplitude * sin(2 * M_PI * tones[i].frequency * t + axis);
+    }
+    // some broadband noise
+    return sample + 2.0f * (rand() / (float)RAND_MAX - 0.5f);
+}
+
+static void runLoops(const tone_t *tones, int toneCount, int loops)
+{
+    for (int loop = 0; loop < loops; loop++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroDataAnalysePush(&state, axis, toneSample(tones, toneCount, loop, axis));
+        }
+        gyroDataAnalyse(&state);
+    }
+}
+
+static void expectPeaks(const float *expected, int count, float tolerance)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int i = 0; i < count; i++) {
+            EXPECT_NEAR(expected[i], state.centerFrequency[axis][i], tolerance) << "axis " << axis << " peak " << i << " window " << state.windowSize;
+        }
+    }
+}
+
+static int peaksInRange(int axis, float minHz, float maxHz)
+{
+    int count = 0;
+    for (int i = 0; i < DYN_NOTCH_PEAK_COUNT; i++) {
+        if (state.centerFrequency[axis][i] >= minHz && state.centerFrequency[axis][i] <= maxHz) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int strongestPeakBin(void)
+{
+    int strongest = 0;
+    for (int i = 1; i < DYN_NOTCH_PEAK_COUNT; i++) {
+        if (state.peaks[i].value > state.peaks[strongest].value) {
+            strongest = i;
+        }
+    }
+    return state.peaks[strongest].bin;
+}
+
+/*
+ * The time sliced FFT must give the same spectrum as a plain DFT of the windowed samples
+ */
+TEST(GyroAnalyseTest, TestSpectrumMatchesDft)
+{
+    const uint16_t windowSizes[] = { 64, 128, 256 };
+
+    for (uint16_t windowSize : windowSizes) {
+        gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, DYNAMIC_NOTCH_ANALYSER_FFT);
+
+        // Signal periodic with the window length, so samples arriving during the analysis do not change the window
+        float period[256];
+        for (int i = 0; i < windowSize; i++) {
+            period[i] = 100.0f * (rand() / (float)RAND_MAX - 0.5f);
+        }
+
+        for (int loop = 0; ; loop++) {
+            gyroDataAnalysePush(&state, FD_ROLL, period[(loop / 2) % windowSize]);
+            gyroDataAnalyse(&state);
+            if (loop > windowSize * 2 && state.filterUpdateExecute && state.filterUpdateAxis == FD_ROLL) {
+                break;
+            }
+        }
+
+        float maxMagnitude = 0.0f;
+        double dft[128];
+        for (int k = 0; k < windowSize / 2; k++) {
+            double re = 0, im = 0;
+            for (int n = 0; n < windowSize; n++) {
+                const double x = period[(state.windowStartIdx + n) % windowSize] * state.fft.hanningWindow[n];
+                re += x * cos(2 * M_PI * k * n / windowSize);
+                im -= x * sin(2 * M_PI * k * n / windowSize);
+            }
+            dft[k] = sqrt(re * re + im * im);
+            maxMagnitude = MAX(maxMagnitude, (float)dft[k]);
+        }
+
+        for (int k = 0; k < windowSize / 2; k++) {
+            EXPECT_NEAR(dft[k], state.fftMagnitude[k], maxMagnitude * 1e-4f) << "bin " << k << " window " << windowSize;
+        }
+    }
+}
+
+TEST(GyroAnalyseTest, TestMultiTonePeakAccuracy)
+{
+    const uint16_t windowSizes[] = { 64, 128, 256 };
+    const tone_t tones[] = { { 291.0f, 10.0f }, { 87.0f, 30.0f }, { 173.0f, 20.0f } };
+    const float expected[] = { 87.0f, 173.0f, 291.0f };
+
+    const uint8_t analysers[] = { DYNAMIC_NOTCH_ANALYSER_FFT, DYNAMIC_NOTCH_ANALYSER_SDFT };
+
+    for (uint8_t analyser : analysers) {
+        for (uint16_t windowSize : windowSizes) {
+            srand(1);
+            gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, analyser);
+            runLoops(tones, ARRAYLEN(tones), 20000);
+
+            // Parabolic interpolation keeps the error within a fraction of a bin
+            expectPeaks(expected, ARRAYLEN(expected), state.fftResolution * 0.3f);
+        }
+    }
+}
+
+/*
+ * Low RPM frame: two props 12Hz apart below 100Hz, only the 256 point window resolves them
+ */
+TEST(GyroAnalyseTest, TestLowFrequencyResolution)
+{
+    const tone_t tones[] = { { 72.0f, 20.0f }, { 84.0f, 20.0f } };
+    const float expected[] = { 72.0f, 84.0f };
+
+    srand(1);
+    gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, 256, true, DYNAMIC_NOTCH_ANALYSER_FFT);
+    runLoops(tones, ARRAYLEN(tones), 20000);
+    EXPECT_LT(state.fftResolution, 4.0f);
+    expectPeaks(expected, ARRAYLEN(expected), 1.5f);
+
+    srand(1);
+    gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, 64, true, DYNAMIC_NOTCH_ANALYSER_FFT);
+    runLoops(tones, ARRAYLEN(tones), 20000);
+    EXPECT_GT(state.fftResolution, 12.0f);
+    EXPECT_LE(peaksInRange(FD_ROLL, 65.0f, 91.0f), 1);
+}
+
+/*
+ * Work per call is bounded, larger windows take more calls. Without overlap every
+ * analysis of an axis waits for a full window of new samples.
+ */
+TEST(GyroAnalyseTest, TestUpdateCadence)
+{
+    const uint16_t windowSizes[] = { 64, 128, 256 };
+    const bool overlaps[] = { true, false };
+    const tone_t tones[] = { { 150.0f, 20.0f } };
+    uint16_t previousSteps = 0;
+
+    for (uint16_t windowSize : windowSizes) {
+        for (bool overlap : overlaps) {
+            gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, overlap, DYNAMIC_NOTCH_ANALYSER_FFT);
+            const uint16_t steps = gyroDataAnalyseStepsPerAxis(&state);
+            if (overlap) {
+                EXPECT_GT(steps, previousSteps);
+                previousSteps = steps;
+            }
+
+            int lastUpdate[XYZ_AXIS_COUNT] = { -1, -1, -1 };
+            int updates = 0;
+            for (int loop = 0; loop < 20000; loop++) {
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    gyroDataAnalysePush(&state, axis, toneSample(tones, 1, loop, axis));
+                }
+                gyroDataAnalyse(&state);
+
+                if (state.filterUpdateExecute) {
+                    const int axis = state.filterUpdateAxis;
+                    if (lastUpdate[axis] >= 0) {
+                        const int interval = loop - lastUpdate[axis];
+                        if (overlap) {
+                            EXPECT_EQ(steps * XYZ_AXIS_COUNT, interval) << "window " << windowSize;
+                        } else {
+                            EXPECT_GE(interval, windowSize * 2) << "window " << windowSize;
+                        }
+                    }
+                    lastUpdate[axis] = loop;
+                    updates++;
+
+                    // With a single tone the smoothed slots also track noise peaks, check the strongest raw peak instead
+                    if (loop > 10000) {
+                        EXPECT_NEAR(150.0f, strongestPeakBin() * state.fftResolution, state.fftResolution) << "window " << windowSize;
+                    }
+                }
+            }
+            EXPECT_GT(updates, 30);
+
+        }
+    }
+}
+
+/*
+ * The sliding DFT bins must hold the DFT of the most recent samples, weighted by the damping factor
+ */
+TEST(GyroAnalyseTest, TestSdftMatchesDampedDft)
+{
+    const uint16_t windowSizes[] = { 64, 128, 256 };
+
+    for (uint16_t windowSize : windowSizes) {
+        gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, DYNAMIC_NOTCH_ANALYSER_SDFT);
+
+        float samples[2000];
+        for (int i = 0; i < 2000; i++) {
+            samples[i] = 100.0f * (rand() / (float)RAND_MAX - 0.5f);
+        }
+
+        // Every second loop takes a sample, stop right after the last one
+        for (int loop = 0; loop < 4000; loop++) {
+            gyroDataAnalysePush(&state, FD_ROLL, samples[loop / 2]);
+            gyroDataAnalyse(&state);
+        }
+        const int lastSample = state.sampleCount - 1;
+
+        float maxMagnitude = 0.0f;
+        double dftRe[129], dftIm[129];
+        for (int k = state.sdft.startBin; k <= windowSize / 2; k++) {
+            dftRe[k] = 0;
+            dftIm[k] = 0;
+            for (int n = 0; n < windowSize; n++) {
+                const double x = samples[lastSample - windowSize + 1 + n] * pow(DYN_NOTCH_SDFT_DAMPING, windowSize - n);
+                dftRe[k] += x * cos(2 * M_PI * k * n / windowSize);
+                dftIm[k] -= x * sin(2 * M_PI * k * n / windowSize);
+            }
+            maxMagnitude = MAX(maxMagnitude, (float)sqrt(dftRe[k] * dftRe[k] + dftIm[k] * dftIm[k]));
+        }
+
+        for (int k = state.sdft.startBin; k <= windowSize / 2; k++) {
+            EXPECT_NEAR(dftRe[k], state.sdft.re[FD_ROLL][k], maxMagnitude * 1e-4f) << "bin " << k << " window " << windowSize;
+            EXPECT_NEAR(dftIm[k], state.sdft.im[FD_ROLL][k], maxMagnitude * 1e-4f) << "bin " << k << " window " << windowSize;
+        }
+    }
+}
+
+TEST(GyroAnalyseTest, TestSdftUpdatesMoreOften)
+{
+    const uint16_t windowSizes[] = { 64, 128, 256 };
+
+    for (uint16_t windowSize : windowSizes) {
+        gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, DYNAMIC_NOTCH_ANALYSER_FFT);
+        const uint16_t fftSteps = gyroDataAnalyseStepsPerAxis(&state);
+
+        gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, DYNAMIC_NOTCH_ANALYSER_SDFT);
+        const uint16_t sdftSteps = gyroDataAnalyseStepsPerAxis(&state);
+
+        EXPECT_LT(sdftSteps, fftSteps) << "window " << windowSize;
+    }
+}
+
+/*
+ * Loops until the strongest peak of the pitch axis follows a step from 120Hz to 200Hz
+ */
+static int trackingLatencyLoops(uint8_t analyser, uint16_t windowSize)
+{
+    tone_t tone = { 120.0f, 20.0f };
+
+    srand(1);
+    gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, analyser);
+    runLoops(&tone, 1, 4000);
+
+    tone.frequency = 200.0f;
+    for (int loop = 0; loop < 20000; loop++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroDataAnalysePush(&state, axis, toneSample(&tone, 1, 4000 + loop, axis));
+        }
+        gyroDataAnalyse(&state);
+
+        if (state.filterUpdateExecute && state.filterUpdateAxis == FD_PITCH && fabsf(strongestPeakBin() * state.fftResolution - 200.0f) <= state.fftResolution) {
+            return loop;
+        }
+    }
+
+    return -1;
+}
+
+TEST(GyroAnalyseTest, TestBenchmark)
+{
+    const uint16_t windowSizes[] = { 64, 128, 256 };
+    const uint8_t analysers[] = { DYNAMIC_NOTCH_ANALYSER_FFT, DYNAMIC_NOTCH_ANALYSER_SDFT };
+    const char *analyserNames[] = { "FFT ", "SDFT" };
+    const tone_t tones[] = { { 291.0f, 10.0f }, { 87.0f, 30.0f }, { 173.0f, 20.0f } };
+    const int loops = 20000;
+
+    static float samples[20000][XYZ_AXIS_COUNT];
+    for (int loop = 0; loop < loops; loop++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            samples[loop][axis] = toneSample(tones, ARRAYLEN(tones), loop, axis);
+        }
+    }
+
+    for (uint16_t windowSize : windowSizes) {
+        for (uint8_t analyser : analysers) {
+            gyroDataAnalyseStateInit(&state, 50, LOOPTIME_US, windowSize, true, analyser);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int loop = 0; loop < loops; loop++) {
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    gyroDataAnalysePush(&state, axis, samples[loop][axis]);
+                }
+                gyroDataAnalyse(&state);
+            }
+            const double averageCallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / loops;
+
+            const uint16_t updateLoops = gyroDataAnalyseStepsPerAxis(&state) * XYZ_AXIS_COUNT;
+            const int latencyLoops = trackingLatencyLoops(analyser, windowSize);
+            EXPECT_GE(latencyLoops, 0);
+
+            printf("[ GYRO ANALYSE] %s window %3d: %6.1f ns/call, axis update every %3d loops, step latency %5.1f ms\n",
+                analyserNames[analyser], windowSize, averageCallNs, updateLoops, latencyLoops * LOOPTIME_US * 1e-3);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/time.h"
+
+    #include "target/SITL/lockstep.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+static timeDelta_t nextTaskDueIn;
+
+TEST(LockstepUnittest, TestFreeRunning)
+{
+    EXPECT_FALSE(lockstepIsEnabled());
+    lockstepInit(LOCKSTEP_DEFAULT_FRAME_US, false);
+    EXPECT_TRUE(lockstepIsEnabled());
+
+    const uint64_t start = lockstepMicros();
+    lockstepAdvance(250);
+    EXPECT_EQ(start + 250, lockstepMicros());
+
+    // Jumps to the next task after one idle scheduler pass, but not further than the longest step
+    nextTaskDueIn = 40;
+    lockstepIdle();
+    EXPECT_EQ(start + 250, lockstepMicros());
+    lockstepIdle();
+    EXPECT_EQ(start + 290, lockstepMicros());
+
+    nextTaskDueIn = 100000;
+    lockstepIdle();
+    lockstepIdle();
+    EXPECT_EQ(start + 290 + LOCKSTEP_MAX_STEP_US, lockstepMicros());
+
+    // A task is due, the clock stays
+    nextTaskDueIn = 0;
+    lockstepIdle();
+    EXPECT_EQ(start + 290 + LOCKSTEP_MAX_STEP_US, lockstepMicros());
+
+    // Without a simulator these don't wait for anything
+    lockstepWaitForStep();
+    lockstepGrant();
+    EXPECT_EQ(start + 290 + LOCKSTEP_MAX_STEP_US, lockstepMicros());
+}
+
+TEST(LockstepUnittest, TestSimulatorDriven)
+{
+    const uint32_t frameUs = 1000;
+    const int frames = 5;
+
+    lockstepInit(frameUs, true);
+    const uint64_t start = lockstepMicros();
+
+    // The simulator thread only gets to apply a frame when the firmware has used up the previous one
+    std::vector<uint64_t> frameTimes;
+    std::thread simulator([&]() {
+        for (int i = 0; i < frames; i++) {
+            lockstepWaitForStep();
+            frameTimes.push_back(lockstepMicros());
+            lockstepGrant();
+        }
+    });
+
+    lockstepAdvance(frames * frameUs - 500);
+    EXPECT_EQ(start + frames * frameUs - 500, lockstepMicros());
+    simulator.join();
+
+    ASSERT_EQ((size_t)frames, frameTimes.size());
+    for (int i = 0; i < frames; i++) {
+        EXPECT_EQ(start + i * frameUs, frameTimes[i]);
+    }
+
+    // The simulator didn't start after all, the clock runs freely again
+    std::thread advance([]() { lockstepAdvance(10000); });
+    lockstepInit(frameUs, false);
+    advance.join();
+    EXPECT_EQ(start + frames * frameUs - 500 + 10000, lockstepMicros());
+}
+
+// STUBS
+
+extern "C" {
+    timeUs_t schedulerGetNextDueTime(timeUs_t currentTimeUs, timeDelta_t maxWaitUs)
+    {
+        return currentTimeUs + MIN(nextTaskDueIn, maxWaitUs);
+    }
+}
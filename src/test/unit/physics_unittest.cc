@@ -0,0 +1,276 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+
+    #include "target/SITL/sim/physics.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define DT  0.001f
+
+static simAirframe_t airframe;
+static simState_t state;
+static simInput_t input;
+
+static void simulate(float seconds)
+{
+    for (int i = 0; i < lrintf(seconds / DT); i++) {
+        simPhysicsStep(&state, &airframe, &input, DT);
+    }
+}
+
+static void setThrottle(float throttle)
+{
+    for (int i = 0; i < SIM_MAX_MOTORS; i++) {
+        input.throttle[i] = throttle;
+    }
+}
+
+static void setUpMultirotor(float altitude)
+{
+    simPhysicsDefaultAirframe(&airframe);
+    simPhysicsReset(&state, &airframe);
+    memset(&input, 0, sizeof(input));
+    state.position[2] = -altitude;
+}
+
+static float hoverThrottle(void)
+{
+    return sqrtf(airframe.mass * SIM_GRAVITY / (airframe.motorCount * airframe.motorThrust));
+}
+
+TEST(PhysicsUnittest, TestRestOnGround)
+{
+    setUpMultirotor(0);
+    setThrottle(0.1f);
+
+    simulate(1);
+
+    EXPECT_TRUE(state.onGround);
+    EXPECT_DOUBLE_EQ(0, state.position[2]);
+    EXPECT_FLOAT_EQ(0, state.velocity.z);
+    // The ground pushes up, which the accelerometer can't tell from climbing
+    EXPECT_NEAR(-SIM_GRAVITY, state.specificForce.z, 1e-3f);
+    EXPECT_NEAR(0, state.specificForce.x, 1e-3f);
+}
+
+TEST(PhysicsUnittest, TestFreeFall)
+{
+    setUpMultirotor(100);
+    airframe.drag = (fpVector3_t) { .v = { 0, 0, 0 } };
+
+    simulate(1);
+
+    EXPECT_FALSE(state.onGround);
+    EXPECT_NEAR(SIM_GRAVITY, state.velocity.z, 0.01f);
+    EXPECT_NEAR(-100 + SIM_GRAVITY / 2, state.position[2], 0.01);
+    EXPECT_NEAR(0, state.specificForce.z, 1e-3f);
+}
+
+TEST(PhysicsUnittest, TestHover)
+{
+    setUpMultirotor(10);
+    setThrottle(hoverThrottle());
+    // Spun up already
+    for (int i = 0; i < airframe.motorCount; i++) {
+        state.motorState[i] = hoverThrottle();
+    }
+
+    simulate(5);
+
+    EXPECT_FALSE(state.onGround);
+    EXPECT_NEAR(-10, state.position[2], 0.01);
+    EXPECT_NEAR(0, state.velocity.z, 0.001f);
+    EXPECT_NEAR(-SIM_GRAVITY, state.specificForce.z, 0.01f);
+    EXPECT_NEAR(0, state.rates.z, 1e-4f);
+    EXPECT_GT(state.current, 0);
+    EXPECT_GT(state.consumedMah, 0);
+    EXPECT_LT(state.voltage, airframe.batteryCells * 4.2f);
+}
+
+TEST(PhysicsUnittest, TestMultirotorTorques)
+{
+    setUpMultirotor(10);
+    const float hover = hoverThrottle();
+
+    // Motors 1 and 4 of QUADX turn clockwise, speeding them up yaws the other way
+    setThrottle(hover);
+    input.throttle[0] = input.throttle[3] = hover + 0.05f;
+    simulate(0.2f);
+    EXPECT_LT(state.rates.z, -0.1f);
+
+    // Left motors faster rolls right
+    setUpMultirotor(10);
+    setThrottle(hover);
+    input.throttle[2] = input.throttle[3] = hover + 0.05f;
+    simulate(0.2f);
+    EXPECT_GT(state.rates.x, 0.1f);
+    EXPECT_NEAR(0, state.rates.y, 1e-3f);
+
+    // Rear motors faster pitches down
+    setUpMultirotor(10);
+    setThrottle(hover);
+    input.throttle[0] = input.throttle[2] = hover + 0.05f;
+    simulate(0.2f);
+    EXPECT_LT(state.rates.y, -0.1f);
+    EXPECT_NEAR(0, state.rates.x, 1e-3f);
+
+    float roll, pitch, yaw;
+    simPhysicsGetEuler(&state, &roll, &pitch, &yaw);
+    EXPECT_LT(pitch, 0);
+}
+
+TEST(PhysicsUnittest, TestTiltedFlight)
+{
+    setUpMultirotor(50);
+    setThrottle(hoverThrottle() * 1.1f);
+    // Pitched 20 degrees nose down flies north
+    const float pitch = DEGREES_TO_RADIANS(-20);
+    state.attitude.q0 = cosf(pitch / 2);
+    state.attitude.q2 = sinf(pitch / 2);
+
+    simulate(2);
+
+    EXPECT_GT(state.velocity.x, 3);
+    EXPECT_NEAR(0, state.velocity.y, 0.01f);
+    EXPECT_GT(state.airspeed, 3);
+}
+
+static void setUpAirplane(float altitude, float speed)
+{
+    simPhysicsDefaultAirframe(&airframe);
+    ASSERT_TRUE(simPhysicsParseLine(&airframe, "type airplane"));
+    airframe.mass = 1.2f;
+    airframe.inertia = (fpVector3_t) { .v = { 0.05f, 0.06f, 0.1f } };
+    airframe.motorCount = 1;
+    airframe.motors[0] = (simMotor_t) { { .v = { 0.3f, 0, 0 } }, 1.0f };
+    airframe.servos[0].aileron = 1;
+    airframe.servos[1].elevator = 1;
+    airframe.servos[2].rudder = 1;
+
+    simPhysicsReset(&state, &airframe);
+    memset(&input, 0, sizeof(input));
+    state.position[2] = -altitude;
+    state.velocity.x = speed;
+    state.onGround = altitude <= 0;
+}
+
+TEST(PhysicsUnittest, TestAirplaneGlides)
+{
+    setUpAirplane(200, 12);
+
+    simulate(20);
+
+    float roll, pitch, yaw;
+    simPhysicsGetEuler(&state, &roll, &pitch, &yaw);
+
+    // Settles into a stable glide, still heading north
+    EXPECT_FALSE(state.onGround);
+    EXPECT_GT(state.airspeed, 8);
+    EXPECT_LT(state.airspeed, 20);
+    EXPECT_GT(state.velocity.z, 0.2f);
+    EXPECT_LT(state.velocity.z, 3);
+    EXPECT_NEAR(0, roll, DEGREES_TO_RADIANS(5));
+    EXPECT_NEAR(0, state.velocity.y, 0.5f);
+}
+
+TEST(PhysicsUnittest, TestAirplaneControls)
+{
+    setUpAirplane(200, 12);
+    input.servo[0] = 0.3f;
+    simulate(0.5f);
+    EXPECT_GT(state.rates.x, 0.1f);
+
+    setUpAirplane(200, 12);
+    input.servo[1] = 0.3f;
+    simulate(0.5f);
+    float roll, pitch, yaw;
+    simPhysicsGetEuler(&state, &roll, &pitch, &yaw);
+    EXPECT_GT(pitch, DEGREES_TO_RADIANS(3));
+
+    setUpAirplane(200, 12);
+    input.servo[2] = 0.3f;
+    simulate(0.5f);
+    EXPECT_GT(state.rates.z, 0.05f);
+}
+
+TEST(PhysicsUnittest, TestAirplaneTakesOff)
+{
+    setUpAirplane(0, 0);
+    // Without the roll of the propeller's torque, which the flight controller would have to counter
+    airframe.motorTorque = 0;
+    setThrottle(0.7f);
+
+    simulate(1);
+    EXPECT_TRUE(state.onGround);
+    EXPECT_GT(state.velocity.x, 3);
+    EXPECT_FLOAT_EQ(0, state.velocity.y);
+
+    input.servo[1] = 0.05f;
+    simulate(5);
+    EXPECT_FALSE(state.onGround);
+    EXPECT_LT(state.position[2], -10);
+}
+
+TEST(PhysicsUnittest, TestParseAirframe)
+{
+    simPhysicsDefaultAirframe(&airframe);
+    airframe.motorCount = 0;
+
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, ""));
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "   # just a comment\n"));
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "type airplane\n"));
+    EXPECT_EQ(SIM_AIRFRAME_AIRPLANE, airframe.type);
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "mass 2.5   # kg\r\n"));
+    EXPECT_FLOAT_EQ(2.5f, airframe.mass);
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "inertia 0.1 0.2 0.3"));
+    EXPECT_FLOAT_EQ(0.2f, airframe.inertia.y);
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "battery_cells 6"));
+    EXPECT_EQ(6, airframe.batteryCells);
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "home_lat 51.123456789 "));
+    EXPECT_DOUBLE_EQ(51.123456789, airframe.homeLat);
+
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "motor 1 0.2 -0.1 ccw"));
+    EXPECT_EQ(2, airframe.motorCount);
+    EXPECT_FLOAT_EQ(0.2f, airframe.motors[1].position.x);
+    EXPECT_FLOAT_EQ(-0.1f, airframe.motors[1].position.y);
+    EXPECT_FLOAT_EQ(-1, airframe.motors[1].spin);
+    EXPECT_TRUE(simPhysicsParseLine(&airframe, "servo 3 0 -1 0.5"));
+    EXPECT_FLOAT_EQ(-1, airframe.servos[3].elevator);
+    EXPECT_FLOAT_EQ(0.5f, airframe.servos[3].rudder);
+
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "wingspan 1.2"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "type helicopter"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "mass"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "mass heavy"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "inertia 0.1 0.2"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "motor 8 0 0 cw"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "motor 0 0 0 left"));
+    EXPECT_FALSE(simPhysicsParseLine(&airframe, "servo 0 1 1"));
+    EXPECT_EQ(2, airframe.motorCount);
+    EXPECT_FLOAT_EQ(2.5f, airframe.mass);
+}
@@ -0,0 +1,243 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/filter.h"
+    #include "common/maths.h"
+    #include "common/time.h"
+
+    #include "flight/rpm_filter.h"
+
+    #include "sensors/esc_sensor.h"
+
+    uint8_t getMotorCount(void);
+    uint32_t getLooptime(void);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME_US         250     // 4kHz gyro loop
+#define MOTOR_COUNT         8       // X8
+#define HARMONICS           3
+#define UPDATE_EVERY        (1000000 / LOOPTIME_US / RPM_FILTER_UPDATE_RATE_HZ)    // gyro samples per rpm update
+
+static uint8_t motorCount = MOTOR_COUNT;
+static escSensorData_t escData[MOTOR_COUNT];
+
+extern "C" {
+    uint8_t getMotorCount(void) { return motorCount; }
+    uint32_t getLooptime(void) { return LOOPTIME_US; }
+    escSensorData_t *getEscTelemetry(uint8_t esc) { return &escData[esc]; }
+}
+
+/*
+ * Reference: the notch bank as it was before the cascade layout, one biquadFilter_t
+ * per axis, motor and harmonic, applied as a chain of biquadFilterApplyDF1() calls.
+ * Coefficients come from the same notch table as in the bank, table accuracy is
+ * covered by filter_unittest
+ */
+typedef struct {
+    float q;
+    float minHz;
+    float maxHz;
+    pt1Filter_t motorFrequencyFilter[MOTOR_COUNT];
+    biquadNotchTable_t notchTable;
+    biquadFilter_t filters[XYZ_AXIS_COUNT][MOTOR_COUNT][HARMONICS];
+} referenceBank_t;
+
+static void referenceInit(referenceBank_t *bank, uint16_t q, uint8_t minHz)
+{
+    bank->q = q / 100.0f;
+    bank->minHz = minHz;
+    bank->maxHz = 0.48f * 1000000.0f / LOOPTIME_US;
+    biquadNotchTableInit(&bank->notchTable, bank->minHz, bank->maxHz, LOOPTIME_US, bank->q);
+
+    for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+        pt1FilterInit(&bank->motorFrequencyFilter[motor], 150, US2S(RPM_FILTER_UPDATE_RATE_US));
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            for (int harmonic = 0; harmonic < HARMONICS; harmonic++) {
+                biquadFilter_t *filter = &bank->filters[axis][motor][harmonic];
+                memset(filter, 0, sizeof(*filter));
+                biquadNotchTableLookup(&bank->notchTable, bank->minHz * (harmonic + 1), filter);
+            }
+        }
+    }
+}
+
+static void referenceUpdate(referenceBank_t *bank)
+{
+    for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+        const float baseFrequency = pt1FilterApply(&bank->motorFrequencyFilter[motor], escData[motor].rpm / 60.0f);
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            for (int harmonic = 0; harmonic < HARMONICS; harmonic++) {
+                const float harmonicFrequency = constrainf(baseFrequency * (harmonic + 1), bank->minHz, bank->maxHz);
+                biquadNotchTableLookup(&bank->notchTable, (uint16_t)harmonicFrequency, &bank->filters[axis][motor][harmonic]);
+            }
+        }
+    }
+}
+
+static void referenceApply(referenceBank_t *bank, float *gyro)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float output = gyro[axis];
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            for (int harmonic = 0; harmonic < HARMONICS; harmonic++) {
+                output = biquadFilterApplyDF1(&bank->filters[axis][motor][harmonic], output);
+            }
+        }
+        gyro[axis] = output;
+    }
+}
+
+static void setMotorRpm(int sample)
+{
+    const float t = sample * LOOPTIME_US * 1e-6f;
+    for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+        // 9000-30000 rpm, each motor on its own throttle curve
+        escData[motor].rpm = 19500 + 10500 * sinf(2.0f * M_PIf * (0.3f + 0.05f * motor) * t + motor);
+    }
+}
+
+static void gyroSample(int sample, float *gyro)
+{
+    const float t = sample * LOOPTIME_US * 1e-6f;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        gyro[axis] = 200.0f * sinf(2.0f * M_PIf * 0.7f * t + axis);
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            gyro[axis] += 10.0f * sinf(2.0f * M_PIf * escData[motor].rpm / 60.0f * t + axis);
+        }
+    }
+}
+
+static void initFilters(referenceBank_t *reference)
+{
+    rpmFilterConfigMutable()->gyro_filter_enabled = 1;
+    rpmFilterConfigMutable()->gyro_harmonics = HARMONICS;
+    rpmFilterConfigMutable()->gyro_min_hz = 100;
+    rpmFilterConfigMutable()->gyro_q = 500;
+    motorCount = MOTOR_COUNT;
+
+    memset(escData, 0, sizeof(escData));
+    rpmFiltersInit();
+    referenceInit(reference, rpmFilterConfig()->gyro_q, rpmFilterConfig()->gyro_min_hz);
+}
+
+TEST(RpmFilterTest, TestBitExactWithBiquadChain)
+{
+    static referenceBank_t reference;
+    initFilters(&reference);
+
+    for (int sample = 0; sample < 80000; sample++) {
+        if (sample % UPDATE_EVERY == 0) {
+            setMotorRpm(sample);
+            rpmFilterUpdateTask(0);
+            referenceUpdate(&reference);
+        }
+
+        float expected[XYZ_AXIS_COUNT], actual[XYZ_AXIS_COUNT];
+        gyroSample(sample, expected);
+        memcpy(actual, expected, sizeof(actual));
+
+        referenceApply(&reference, expected);
+        rpmFilterGyroApply(actual);
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            uint32_t expectedBits, actualBits;
+            memcpy(&expectedBits, &expected[axis], sizeof(expectedBits));
+            memcpy(&actualBits, &actual[axis], sizeof(actualBits));
+            ASSERT_EQ(expectedBits, actualBits) << "sample " << sample << " axis " << axis;
+        }
+    }
+}
+
+TEST(RpmFilterTest, TestDisabled)
+{
+    static referenceBank_t reference;
+    initFilters(&reference);
+    disableRpmFilters();
+
+    float gyro[XYZ_AXIS_COUNT] = { 1.0f, -2.0f, 3.0f };
+    rpmFilterGyroApply(gyro);
+
+    EXPECT_EQ(1.0f, gyro[FD_ROLL]);
+    EXPECT_EQ(-2.0f, gyro[FD_PITCH]);
+    EXPECT_EQ(3.0f, gyro[FD_YAW]);
+}
+
+/*
+ * Cost per gyro sample (all three axes) of the notch bank and of the 500Hz
+ * coefficient update, compared with the per-axis biquad chain
+ */
+TEST(RpmFilterTest, TestBenchmark)
+{
+    static referenceBank_t reference;
+    const int iterations = 200000;
+    float gyro[XYZ_AXIS_COUNT];
+    volatile float sink = 0.0f;
+
+    initFilters(&reference);
+    setMotorRpm(0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int ii = 0; ii < iterations; ii++) {
+        gyro[FD_ROLL] = gyro[FD_PITCH] = gyro[FD_YAW] = ii & 0xff;
+        referenceApply(&reference, gyro);
+        sink = sink + gyro[FD_ROLL];
+    }
+    const double referenceApplyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    start = std::chrono::steady_clock::now();
+    for (int ii = 0; ii < iterations; ii++) {
+        gyro[FD_ROLL] = gyro[FD_PITCH] = gyro[FD_YAW] = ii & 0xff;
+        rpmFilterGyroApply(gyro);
+        sink = sink + gyro[FD_ROLL];
+    }
+    const double bankApplyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    const int updates = iterations / 20;
+
+    start = std::chrono::steady_clock::now();
+    for (int ii = 0; ii < updates; ii++) {
+        setMotorRpm(ii * UPDATE_EVERY);
+        referenceUpdate(&reference);
+    }
+    const double referenceUpdateNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / updates;
+
+    start = std::chrono::steady_clock::now();
+    for (int ii = 0; ii < updates; ii++) {
+        setMotorRpm(ii * UPDATE_EVERY);
+        rpmFilterUpdateTask(0);
+    }
+    const double bankUpdateNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / updates;
+
+    printf("[ RPM FILTER] %d motors x %d harmonics\n", MOTOR_COUNT, HARMONICS);
+    printf("[ RPM FILTER] apply  biquad chain %7.1f ns/sample, cascade bank %7.1f ns/sample\n", referenceApplyNs, bankApplyNs);
+    printf("[ RPM FILTER] update biquad chain %7.1f ns/update, cascade bank %7.1f ns/update\n", referenceUpdateNs, bankUpdateNs);
+
+    EXPECT_TRUE(isfinite(sink));
+}
@@ -0,0 +1,187 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "target/SITL/sim/scenario.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define DT  0.001f
+
+static simScenario_t scenario;
+static simState_t state;
+
+static bool run(float seconds)
+{
+    for (int i = 0; i < lrintf(seconds / DT); i++) {
+        if (!simScenarioStep(&scenario, &state, DT, true, 10)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void setUp(void)
+{
+    simScenarioInit(&scenario);
+    memset(&state, 0, sizeof(state));
+    state.onGround = true;
+    state.voltage = 16.8f;
+}
+
+TEST(ScenarioUnittest, TestParse)
+{
+    setUp();
+
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "# comment only\n"));
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "   \r\n"));
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "1.5 rc 3=1600 5=1800   # arm\n"));
+    EXPECT_EQ(2u, scenario.eventCount);
+    EXPECT_EQ(1500u, scenario.events[0].timeMs);
+    EXPECT_EQ(SIM_EVENT_RC, scenario.events[0].type);
+    EXPECT_EQ(2, scenario.events[0].rc.channel);
+    EXPECT_EQ(1600, scenario.events[0].rc.value);
+    EXPECT_EQ(4, scenario.events[1].rc.channel);
+
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "2 wind 1 -2 0.5"));
+    EXPECT_FLOAT_EQ(-2, scenario.events[2].wind.y);
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "2 motor 3 0.5"));
+    EXPECT_EQ(3, scenario.events[3].motor.index);
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "3 gps fail"));
+    EXPECT_TRUE(scenario.events[4].gpsFailed);
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "3 target 10 0 5"));
+    EXPECT_FLOAT_EQ(-5, scenario.events[5].target.position.z);
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "4 target off"));
+    EXPECT_FALSE(scenario.events[6].target.enabled);
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "4 settle 0.5"));
+    EXPECT_TRUE(simScenarioParseLine(&scenario, "10 end"));
+    EXPECT_EQ(9u, scenario.eventCount);
+
+    // Nothing is added from a bad line
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 rc 3=1600 17=1500"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 rc 3=3000"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 rc 3"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 wind 1 2"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 motor 8 0"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 gps lost"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 settle 0"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "11 fly"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "soon end"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "-1 end"));
+    EXPECT_FALSE(simScenarioParseLine(&scenario, "5 end"));
+    EXPECT_EQ(9u, scenario.eventCount);
+}
+
+TEST(ScenarioUnittest, TestEvents)
+{
+    setUp();
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "1 rc 3=1600"));
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "2 wind 3 0 0"));
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "2 motor 1 0"));
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "3 end"));
+
+    EXPECT_EQ(1000, scenario.rc[2]);
+    EXPECT_EQ(1500, scenario.rc[0]);
+    EXPECT_TRUE(run(1.0f));
+    EXPECT_EQ(1600, scenario.rc[2]);
+
+    EXPECT_TRUE(run(1.0f));
+    simInput_t input;
+    memset(&input, 0, sizeof(input));
+    input.throttle[0] = input.throttle[1] = 0.5f;
+    simScenarioApplyInput(&scenario, &input);
+    EXPECT_FLOAT_EQ(3, input.wind.x);
+    EXPECT_FLOAT_EQ(0.5f, input.throttle[0]);
+    EXPECT_FLOAT_EQ(0, input.throttle[1]);
+
+    EXPECT_FALSE(run(1.5f));
+    EXPECT_TRUE(scenario.ended);
+    EXPECT_FLOAT_EQ(3, scenario.metrics.duration);
+    EXPECT_NEAR(3, scenario.metrics.armedTime, 1e-3f);
+}
+
+TEST(ScenarioUnittest, TestTracking)
+{
+    setUp();
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "0 target 0 0 10"));
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "10 target 20 0 10"));
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "20 end"));
+    state.onGround = false;
+
+    // Getting to the first target takes 2s
+    state.position[2] = -5;
+    run(2);
+    state.position[2] = -10;
+    run(7.5f);
+    EXPECT_NEAR(5, scenario.metrics.trackingMax, 1e-3f);
+
+    // The second one is reached after 4s
+    run(4.5f);
+    state.position[0] = 20;
+    run(6);
+
+    EXPECT_TRUE(scenario.ended);
+    EXPECT_FALSE(scenario.metrics.settleFailed);
+    EXPECT_NEAR(4, scenario.metrics.settleTime, 0.01f);
+    EXPECT_NEAR(20, scenario.metrics.trackingMax, 1e-3f);
+
+    char report[1024];
+    FILE *file = fmemopen(report, sizeof(report), "w");
+    simScenarioWriteReport(&scenario, file, "test \"run\"", 1.0f, 2.0f);
+    fclose(file);
+    EXPECT_NE(nullptr, strstr(report, "\"scenario\":\"test \\\"run\\\"\""));
+    EXPECT_NE(nullptr, strstr(report, "\"settle_time_s\":4.00"));
+    EXPECT_NE(nullptr, strstr(report, "\"realtime_factor\":10.000"));
+}
+
+TEST(ScenarioUnittest, TestUnsettledAndCrash)
+{
+    setUp();
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "0 target 0 0 10"));
+    ASSERT_TRUE(simScenarioParseLine(&scenario, "5 end"));
+
+    state.onGround = false;
+    state.position[2] = -20;
+    state.velocity.z = 5;
+    run(1);
+    state.onGround = true;
+    state.position[2] = 0;
+    state.velocity.z = 0;
+    run(4);
+
+    EXPECT_TRUE(scenario.metrics.settleFailed);
+    EXPECT_TRUE(scenario.metrics.crashed);
+    EXPECT_FLOAT_EQ(5, scenario.metrics.maxImpactSpeed);
+    EXPECT_NEAR(20, scenario.metrics.maxAltitude, 1e-3f);
+
+    char report[1024];
+    FILE *file = fmemopen(report, sizeof(report), "w");
+    simScenarioWriteReport(&scenario, file, "crash", 0, 0);
+    fclose(file);
+    EXPECT_NE(nullptr, strstr(report, "\"settle_time_s\":null"));
+    EXPECT_NE(nullptr, strstr(report, "\"crashed\":true"));
+    EXPECT_NE(nullptr, strstr(report, "\"realtime_factor\":null"));
+}
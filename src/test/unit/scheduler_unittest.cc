@@ -0,0 +1,310 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+    #include "scheduler/scheduler.h"
+
+    extern cfTask_t* taskQueueArray[];
+    extern void queueClear(void);
+    extern int queueSize(void);
+    extern bool queueContains(cfTask_t *task);
+    extern bool queueAdd(cfTask_t *task);
+    extern bool queueRemove(cfTask_t *task);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+static timeUs_t simulatedTime;
+static int rxFrameInterval;
+static std::vector<int> dispatchLog;
+
+static void logDispatch(cfTaskId_e taskId, timeUs_t executionTime)
+{
+    dispatchLog.push_back(taskId);
+    simulatedTime += executionTime;
+}
+
+extern "C" {
+    timeUs_t micros(void) { return simulatedTime; }
+
+    // Idle pass of the scheduler, let the time flow
+    void taskRunRealtimeCallbacks(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); simulatedTime += 10; }
+
+    static void taskSystemTest(timeUs_t currentTimeUs) { taskSystem(currentTimeUs); logDispatch(TASK_SYSTEM, 5); }
+    static void taskPid(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_PID, 120); }
+    static void taskGyro(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_GYRO, 40); }
+    static bool taskRxCheck(timeUs_t currentTimeUs, timeDelta_t currentDeltaTimeUs) { UNUSED(currentTimeUs); return currentDeltaTimeUs >= rxFrameInterval; }
+    static void taskRx(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_RX, 35); }
+    static void taskSerial(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_SERIAL, 25); }
+    static void taskBattery(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_BATTERY, 8); }
+    static void taskTemperature(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_TEMPERATURE, 11); }
+    static void taskGps(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_GPS, 60); }
+    static void taskCompass(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_COMPASS, 95); }
+    static void taskBaro(timeUs_t currentTimeUs) { UNUSED(currentTimeUs); logDispatch(TASK_BARO, 70); }
+
+    // Layout of the first entries follows cfTaskId_e
+    static_assert(TASK_GPS == 7 && TASK_COMPASS == 8 && TASK_BARO == 9, "task layout changed");
+    cfTask_t cfTasks[TASK_COUNT] = {
+        { "SYSTEM", NULL, taskSystemTest, TASK_PERIOD_HZ(10), TASK_PRIORITY_MEDIUM_HIGH, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "PID", NULL, taskPid, TASK_PERIOD_HZ(1000), TASK_PRIORITY_REALTIME, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "GYRO", NULL, taskGyro, TASK_PERIOD_HZ(1000), TASK_PRIORITY_REALTIME, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "RX", taskRxCheck, taskRx, TASK_PERIOD_HZ(10), TASK_PRIORITY_HIGH, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "SERIAL", NULL, taskSerial, TASK_PERIOD_HZ(500), TASK_PRIORITY_LOW, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "BATTERY", NULL, taskBattery, TASK_PERIOD_HZ(50), TASK_PRIORITY_MEDIUM, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "TEMPERATURE", NULL, taskTemperature, TASK_PERIOD_HZ(100), TASK_PRIORITY_LOW, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "GPS", NULL, taskGps, TASK_PERIOD_HZ(50), TASK_PRIORITY_MEDIUM, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "COMPASS", NULL, taskCompass, TASK_PERIOD_HZ(10), TASK_PRIORITY_LOW, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+        { "BARO", NULL, taskBaro, TASK_PERIOD_HZ(20), TASK_PRIORITY_MEDIUM, 0, 0, 0, 0, 0, 0, 0, 0, {} },
+    };
+}
+
+static void resetTasks(schedulerMode_e mode)
+{
+    static timeDelta_t defaultPeriod[TASK_COUNT];
+    if (defaultPeriod[TASK_SYSTEM] == 0) {
+        for (int ii = 0; ii < TASK_COUNT; ++ii) {
+            defaultPeriod[ii] = cfTasks[ii].desiredPeriod;
+        }
+    }
+
+    simulatedTime = 5000;
+    rxFrameInterval = 6000;
+    dispatchLog.clear();
+
+    for (int ii = 0; ii < TASK_COUNT; ++ii) {
+        cfTasks[ii].desiredPeriod = defaultPeriod[ii];
+        cfTasks[ii].dynamicPriority = 0;
+        cfTasks[ii].taskAgeCycles = 0;
+        cfTasks[ii].lastExecutedAt = 0;
+        cfTasks[ii].lastSignaledAt = 0;
+        cfTasks[ii].taskLatestDeltaTime = 0;
+        cfTasks[ii].movingSumExecutionTime = 0;
+        cfTasks[ii].maxExecutionTime = 0;
+        cfTasks[ii].totalExecutionTime = 0;
+    }
+
+    schedulerResetTaskHistograms();
+    schedulerInit();
+    schedulerSetMode(mode);
+    for (int ii = 0; ii < TASK_COUNT; ++ii) {
+        setTaskEnabled((cfTaskId_e)ii, true);
+    }
+}
+
+static std::vector<int> runScheduler(schedulerMode_e mode, int iterations)
+{
+    resetTasks(mode);
+    for (int ii = 0; ii < iterations; ++ii) {
+        scheduler();
+        if (ii == iterations / 2) {
+            // Change periods and task set half way through
+            rescheduleTask(TASK_GPS, TASK_PERIOD_HZ(10));
+            rescheduleTask(TASK_SERIAL, TASK_PERIOD_HZ(100));
+            setTaskEnabled(TASK_TEMPERATURE, false);
+        }
+    }
+    return dispatchLog;
+}
+
+TEST(SchedulerUnittest, TestQueueOrder)
+{
+    queueClear();
+    EXPECT_EQ(0, queueSize());
+
+    queueAdd(&cfTasks[TASK_SERIAL]);
+    queueAdd(&cfTasks[TASK_PID]);
+    queueAdd(&cfTasks[TASK_BATTERY]);
+    EXPECT_FALSE(queueAdd(&cfTasks[TASK_PID]));
+    EXPECT_EQ(3, queueSize());
+
+    EXPECT_EQ(&cfTasks[TASK_PID], taskQueueArray[0]);
+    EXPECT_EQ(&cfTasks[TASK_BATTERY], taskQueueArray[1]);
+    EXPECT_EQ(&cfTasks[TASK_SERIAL], taskQueueArray[2]);
+    EXPECT_EQ(NULL, taskQueueArray[3]);
+
+    EXPECT_TRUE(queueRemove(&cfTasks[TASK_BATTERY]));
+    EXPECT_FALSE(queueContains(&cfTasks[TASK_BATTERY]));
+    EXPECT_EQ(&cfTasks[TASK_SERIAL], taskQueueArray[1]);
+    EXPECT_EQ(2, queueSize());
+}
+
+TEST(SchedulerUnittest, TestRealtimeTaskFirst)
+{
+    const schedulerMode_e modes[] = { SCHEDULER_MODE_PRIORITY_SCAN, SCHEDULER_MODE_DEADLINE_QUEUE };
+
+    for (schedulerMode_e mode : modes) {
+        resetTasks(mode);
+        scheduler();
+        // Both GYRO and PID are overdue, the last one in the queue wins
+        ASSERT_EQ(1u, dispatchLog.size());
+        EXPECT_EQ(TASK_GYRO, dispatchLog[0]);
+        scheduler();
+        EXPECT_EQ(TASK_PID, dispatchLog[1]);
+    }
+}
+
+TEST(SchedulerUnittest, TestDeadlineQueueMatchesPriorityScan)
+{
+    const int iterations = 200000;
+
+    const std::vector<int> scanOrder = runScheduler(SCHEDULER_MODE_PRIORITY_SCAN, iterations);
+    cfTaskInfo_t scanInfo[TASK_COUNT];
+    for (int ii = 0; ii < TASK_COUNT; ++ii) {
+        getTaskInfo((cfTaskId_e)ii, &scanInfo[ii]);
+    }
+    const uint16_t scanLoad = averageSystemLoadPercent;
+
+    const std::vector<int> deadlineOrder = runScheduler(SCHEDULER_MODE_DEADLINE_QUEUE, iterations);
+    const uint16_t deadlineLoad = averageSystemLoadPercent;
+
+    ASSERT_GT(scanOrder.size(), 1000u);
+    ASSERT_EQ(scanOrder.size(), deadlineOrder.size());
+    for (size_t ii = 0; ii < scanOrder.size(); ++ii) {
+        ASSERT_EQ(scanOrder[ii], deadlineOrder[ii]) << "dispatch order differs at " << ii;
+    }
+
+    for (int ii = 0; ii < TASK_COUNT; ++ii) {
+        cfTaskInfo_t info;
+        getTaskInfo((cfTaskId_e)ii, &info);
+        EXPECT_EQ(scanInfo[ii].isEnabled, info.isEnabled);
+        EXPECT_EQ(scanInfo[ii].desiredPeriod, info.desiredPeriod);
+        EXPECT_EQ(scanInfo[ii].maxExecutionTime, info.maxExecutionTime);
+        EXPECT_EQ(scanInfo[ii].totalExecutionTime, info.totalExecutionTime);
+        EXPECT_EQ(scanInfo[ii].averageExecutionTime, info.averageExecutionTime);
+        EXPECT_EQ(scanInfo[ii].latestDeltaTime, info.latestDeltaTime);
+    }
+    EXPECT_EQ(scanLoad, deadlineLoad);
+}
+
+TEST(SchedulerUnittest, TestEventTaskPolledWithDueTasks)
+{
+    resetTasks(SCHEDULER_MODE_DEADLINE_QUEUE);
+    rxFrameInterval = INT32_MAX;
+
+    // Jump from one due task to the next, the RX check is only polled in passes that run a time-driven task
+    while (simulatedTime < 50000) {
+        scheduler();
+        simulatedTime = schedulerGetNextDueTime(simulatedTime, 100000);
+    }
+    for (int taskId : dispatchLog) {
+        EXPECT_NE(TASK_RX, taskId);
+    }
+
+    // A frame arrives, the next pass picks it up and RX runs right after the task that was due
+    dispatchLog.clear();
+    rxFrameInterval = 0;
+    while (dispatchLog.empty() || dispatchLog.back() != TASK_RX) {
+        scheduler();
+        simulatedTime = schedulerGetNextDueTime(simulatedTime, 100000);
+        ASSERT_LT(dispatchLog.size(), 3u);
+    }
+}
+
+TEST(SchedulerUnittest, TestNextDueTime)
+{
+    resetTasks(SCHEDULER_MODE_DEADLINE_QUEUE);
+    rxFrameInterval = INT32_MAX;
+
+    // Everything is overdue at the start
+    EXPECT_EQ(simulatedTime, schedulerGetNextDueTime(simulatedTime, 100));
+
+    // Run the scheduler on a virtual clock, every task has to run on time
+    while (simulatedTime < 200000) {
+        scheduler();
+        const timeUs_t nextDueAt = schedulerGetNextDueTime(simulatedTime, 100000);
+        ASSERT_LE(nextDueAt - simulatedTime, 100000u);
+        simulatedTime = nextDueAt;
+    }
+
+    for (int ii = 0; ii < TASK_COUNT; ++ii) {
+        if (ii != TASK_RX) {
+            EXPECT_LE(getTaskDeltaTime((cfTaskId_e)ii), cfTasks[ii].desiredPeriod + 200) << cfTasks[ii].taskName;
+        }
+    }
+
+    // Realtime tasks are due one microsecond after their period, the others right at it
+    for (int ii = 0; ii < TASK_COUNT; ++ii) {
+        cfTasks[ii].lastExecutedAt = simulatedTime + 10000;
+    }
+    cfTasks[TASK_GYRO].lastExecutedAt = simulatedTime;
+    cfTasks[TASK_PID].lastExecutedAt = simulatedTime;
+    EXPECT_EQ(simulatedTime + 1001, schedulerGetNextDueTime(simulatedTime, 100000));
+    EXPECT_EQ(simulatedTime + 50, schedulerGetNextDueTime(simulatedTime, 50));
+
+    cfTasks[TASK_SYSTEM].lastExecutedAt = simulatedTime - TASK_PERIOD_HZ(10) + 300;
+    EXPECT_EQ(simulatedTime + 300, schedulerGetNextDueTime(simulatedTime, 100000));
+
+    // Signalled event tasks are due right away
+    cfTasks[TASK_RX].dynamicPriority = 1;
+    EXPECT_EQ(simulatedTime, schedulerGetNextDueTime(simulatedTime, 100000));
+}
+
+TEST(SchedulerUnittest, TestTaskHistograms)
+{
+    runScheduler(SCHEDULER_MODE_DEADLINE_QUEUE, 20000);
+
+    int pidDispatchCount = 0;
+    for (int taskId : dispatchLog) {
+        pidDispatchCount += (taskId == TASK_PID);
+    }
+
+    cfTaskHistogram_t histogram;
+    getTaskHistogram(TASK_PID, &histogram);
+
+    // PID takes 120us to execute: [64, 128) bucket
+    int startLatencyCount = 0;
+    for (int bucket = 0; bucket < TASK_HISTOGRAM_BUCKET_COUNT; bucket++) {
+        startLatencyCount += histogram.startLatency[bucket];
+        if (bucket != 7) {
+            EXPECT_EQ(0, histogram.executionTime[bucket]);
+        }
+    }
+    EXPECT_EQ(pidDispatchCount, histogram.executionTime[7]);
+    EXPECT_EQ(pidDispatchCount, startLatencyCount);
+    EXPECT_EQ(128u, taskHistogramBucketUpperBound(7));
+
+    schedulerResetTaskHistograms();
+    getTaskHistogram(TASK_PID, &histogram);
+    EXPECT_EQ(0, histogram.executionTime[7]);
+}
+
+TEST(SchedulerUnittest, TestSchedulerOverhead)
+{
+    const schedulerMode_e modes[] = { SCHEDULER_MODE_PRIORITY_SCAN, SCHEDULER_MODE_DEADLINE_QUEUE };
+    const char *modeNames[] = { "PRIORITY_SCAN", "DEADLINE_QUEUE" };
+    const int iterations = 200000;
+
+    for (schedulerMode_e mode : modes) {
+        resetTasks(mode);
+        dispatchLog.reserve(iterations);
+        const auto start = std::chrono::steady_clock::now();
+        for (int ii = 0; ii < iterations; ++ii) {
+            scheduler();
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        printf("[ SCHEDULER] %-15s %7.1f ns/call, %zu tasks dispatched\n", modeNames[mode], (double)elapsed / iterations, dispatchLog.size());
+    }
+}
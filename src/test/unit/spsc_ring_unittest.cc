@@ -0,0 +1,139 @@
+/*
+ * This file is part of INAV.
+ *
+ * INAV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * INAV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with INAV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+extern "C" {
+    #include "common/spsc_ring.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+TEST(SpscRingUnittest, TestWrapAround)
+{
+    spscRing_t ring;
+    uint8_t buffer[16];
+    spscRingInit(&ring, buffer, sizeof(buffer));
+
+    EXPECT_EQ(0u, spscRingWaiting(&ring));
+    EXPECT_EQ(16u, spscRingFree(&ring));
+
+    uint8_t data[32];
+    for (unsigned i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+
+    // Only what fits is taken
+    EXPECT_EQ(12u, spscRingWrite(&ring, data, 12));
+    EXPECT_EQ(4u, spscRingWrite(&ring, data + 12, 10));
+    EXPECT_EQ(0u, spscRingFree(&ring));
+
+    uint8_t out[32];
+    EXPECT_EQ(10u, spscRingRead(&ring, out, 10));
+    EXPECT_EQ(0, memcmp(out, data, 10));
+
+    // This one wraps
+    EXPECT_EQ(10u, spscRingWrite(&ring, data + 16, 10));
+    EXPECT_EQ(16u, spscRingWaiting(&ring));
+    EXPECT_EQ(16u, spscRingRead(&ring, out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(out, data + 10, 16));
+
+    uint8_t byte = 0xAA;
+    EXPECT_FALSE(spscRingReadByte(&ring, &byte));
+    EXPECT_EQ(0xAA, byte);
+    EXPECT_EQ(1u, spscRingWrite(&ring, data + 5, 1));
+    EXPECT_TRUE(spscRingReadByte(&ring, &byte));
+    EXPECT_EQ(5, byte);
+}
+
+TEST(SpscRingUnittest, TestIndexOverflow)
+{
+    spscRing_t ring;
+    uint8_t buffer[8];
+    spscRingInit(&ring, buffer, sizeof(buffer));
+
+    // The indices count up freely, make them wrap past 2^32
+    ring.head = ring.tail = UINT32_MAX - 2;
+
+    const uint8_t data[6] = { 1, 2, 3, 4, 5, 6 };
+    EXPECT_EQ(6u, spscRingWrite(&ring, data, sizeof(data)));
+    EXPECT_EQ(6u, spscRingWaiting(&ring));
+    EXPECT_EQ(2u, spscRingFree(&ring));
+
+    uint8_t out[6];
+    EXPECT_EQ(6u, spscRingRead(&ring, out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(out, data, sizeof(data)));
+    EXPECT_EQ(0u, spscRingWaiting(&ring));
+}
+
+TEST(SpscRingUnittest, TestTwoThreads)
+{
+    static const uint32_t total = 1024 * 1024;
+    spscRing_t ring;
+    uint8_t buffer[256];
+    spscRingInit(&ring, buffer, sizeof(buffer));
+
+    // Odd sizes on both sides so the copies are split at every possible place
+    std::thread producer([&ring]() {
+        uint8_t chunk[37];
+        uint32_t sent = 0;
+        while (sent < total) {
+            const uint32_t length = std::min<uint32_t>(sizeof(chunk), total - sent);
+            for (uint32_t i = 0; i < length; i++) {
+                chunk[i] = (sent + i) * 7;
+            }
+            uint32_t written = 0;
+            while (written < length) {
+                const uint32_t count = spscRingWrite(&ring, chunk + written, length - written);
+                if (count == 0) {
+                    std::this_thread::yield();
+                }
+                written += count;
+            }
+            sent += length;
+        }
+    });
+
+    uint32_t received = 0;
+    uint32_t errors = 0;
+    uint8_t chunk[53];
+    while (received < total) {
+        const uint32_t length = spscRingRead(&ring, chunk, sizeof(chunk));
+        for (uint32_t i = 0; i < length; i++) {
+            errors += chunk[i] != (uint8_t)((received + i) * 7);
+        }
+        received += length;
+        if (length == 0) {
+            std::this_thread::yield();
+        }
+
+        uint8_t byte;
+        if (received < total && spscRingReadByte(&ring, &byte)) {
+            errors += byte != (uint8_t)(received * 7);
+            received++;
+        }
+    }
+    producer.join();
+
+    EXPECT_EQ(0u, errors);
+    EXPECT_EQ(0u, spscRingWaiting(&ring));
+}
@@ -42,6 +42,8 @@
 
 #define NAV_MAX_WAYPOINTS       60
 
+#define SCHEDULER_DELAY_LIMIT   10
+
 #define SERIAL_PORT_COUNT 8
 
 #define MAX_SIMULTANEOUS_ADJUSTMENT_COUNT 6
@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+#
+# This file is part of INAV.
+#
+# Runs many SITL flights with the built-in simulator in parallel, e.g. to compare PID gains or navigation settings,
+# and collects the summary of every flight into a single CSV or JSON report.
+#
+# Every run gets its own SITL process, working directory, copy of the EEPROM file and block of TCP ports. Settings
+# are applied through the CLI before the flight, which then runs in lockstep mode from a scenario file. See
+# docs/SITL/SITL.md.
+#
+# Example, 3 x 2 runs of each scenario:
+#   sitl_batch.py --sitl build_SITL/bin/SITL.elf --eeprom quad.bin --scenario docs/SITL/scenarios/poshold.txt \
+#       --sweep nav_mc_pos_xy_p=40,65,90 --sweep nav_mc_vel_xy_p=20,40 --csv results.csv
+
+import argparse
+import csv
+import itertools
+import json
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+SERIAL_PORT_COUNT = 8       # SITL binds UART1..8 to the base port and the ones after it
+CLI_TIMEOUT = 10            # s
+BIND_RETRIES = 3
+
+
+class PortAllocator:
+    """Hands out blocks of ports which are free on this host and not used by another run"""
+
+    def __init__(self, first_port):
+        self.next_port = first_port
+        self.free_blocks = []
+        self.lock = threading.Lock()
+
+    @staticmethod
+    def block_is_free(base):
+        for port in range(base, base + SERIAL_PORT_COUNT):
+            # SITL listens on all addresses, v4 and v6
+            with socket.socket(socket.AF_INET6, socket.SOCK_STREAM) as s:
+                try:
+                    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+                    s.bind(('::', port))
+                except OSError:
+                    return False
+        return True
+
+    def acquire(self):
+        with self.lock:
+            while self.free_blocks:
+                base = self.free_blocks.pop()
+                if self.block_is_free(base):
+                    return base
+            while True:
+                base = self.next_port
+                self.next_port += SERIAL_PORT_COUNT
+                if base + SERIAL_PORT_COUNT > 65535:
+                    raise RuntimeError("out of TCP ports")
+                if self.block_is_free(base):
+                    return base
+
+    def release(self, base):
+        with self.lock:
+            self.free_blocks.append(base)
+
+
+def format_value(value):
+    return str(value).strip()
+
+
+def build_runs(scenarios, fixed, sweeps):
+    """Every scenario with every combination of the swept values"""
+    names = [name for name, _ in sweeps]
+    runs = []
+    for scenario in scenarios:
+        for values in itertools.product(*[values for _, values in sweeps]):
+            settings = dict(fixed)
+            settings.update(zip(names, values))
+            runs.append({'run': len(runs), 'scenario': scenario, 'settings': settings})
+    return runs
+
+
+def parse_assignment(text, multiple):
+    name, sep, value = text.partition('=')
+    if not sep or not name.strip() or not value.strip():
+        raise argparse.ArgumentTypeError("expected name=value, got '{}'".format(text))
+    if multiple:
+        return name.strip(), [format_value(v) for v in value.split(',')]
+    return name.strip(), format_value(value)
+
+
+def read_until(sock, markers, timeout):
+    """Reads from the CLI until one of the markers shows up, or the connection is closed"""
+    deadline = time.time() + timeout
+    data = b''
+    while time.time() < deadline:
+        sock.settimeout(max(0.01, deadline - time.time()))
+        try:
+            chunk = sock.recv(4096)
+        except socket.timeout:
+            break
+        if not chunk:
+            break
+        data += chunk
+        if any(marker in data for marker in markers):
+            break
+    return data.decode(errors='replace')
+
+
+def connect(port, process, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if process.poll() is not None:
+            return None
+        try:
+            return socket.create_connection(('127.0.0.1', port), timeout=1)
+        except OSError:
+            time.sleep(0.1)
+    return None
+
+
+def configure(args, workdir, eeprom, port, settings, log):
+    """Starts SITL without a simulator, applies the settings through the CLI and saves them to the EEPROM file"""
+    process = subprocess.Popen([args.sitl, '--path=' + eeprom, '--baseport={}'.format(port)],
+        cwd=workdir, stdout=log, stderr=log)
+    try:
+        sock = connect(port, process, CLI_TIMEOUT)
+        if sock is None:
+            return "SITL did not start for the configuration"
+
+        with sock:
+            sock.sendall(b'#')
+            read_until(sock, [b'\n# '], CLI_TIMEOUT)
+            for name, value in settings.items():
+                sock.sendall('set {} = {}\n'.format(name, value).encode())
+                reply = read_until(sock, [b'\n# '], CLI_TIMEOUT)
+                problems = [line.strip() for line in reply.splitlines() if 'Invalid' in line or 'ERROR' in line]
+                if problems:
+                    return "set {} = {}: {}".format(name, value, problems[0])
+            sock.sendall(b'save\n')
+            if 'Rebooting' not in read_until(sock, [b'Rebooting'], CLI_TIMEOUT):
+                return "settings were not saved"
+        return None
+    finally:
+        process.terminate()
+        process.wait()
+
+
+def fly(args, run, ports, results_lock, results):
+    workdir = tempfile.mkdtemp(prefix='run{:04d}-'.format(run['run']), dir=args.workdir)
+    eeprom = os.path.join(workdir, 'eeprom.bin')
+    shutil.copyfile(args.eeprom, eeprom)
+
+    result = {'run': run['run'], 'scenario': run['scenario']}
+    result.update(run['settings'])
+    error = None
+    report = None
+
+    with open(os.path.join(workdir, 'sitl.log'), 'w') as log:
+        for _ in range(BIND_RETRIES):
+            port = ports.acquire()
+            try:
+                if run['settings']:
+                    error = configure(args, workdir, eeprom, port, run['settings'], log)
+                    if error:
+                        break
+
+                # No --flash: a run only gets a flash.bin in its directory when it logs to SPIFLASH
+                command = [args.sitl, '--path=' + eeprom, '--baseport={}'.format(port), '--sim=builtin', '--lockstep',
+                    '--scenario=' + run['scenario']]
+                if args.airframe:
+                    command.append('--airframe=' + args.airframe)
+
+                log.flush()
+                log_start = log.tell()
+                try:
+                    process = subprocess.run(command, cwd=workdir, stdout=subprocess.PIPE, stderr=log,
+                        timeout=args.timeout, universal_newlines=True)
+                except subprocess.TimeoutExpired:
+                    error = "timeout after {}s".format(args.timeout)
+                    break
+            finally:
+                ports.release(port)
+
+            with open(log.name) as f:
+                f.seek(log_start)
+                if 'Unable to bind socket' in f.read():
+                    # Taken by someone else since we checked, try other ports
+                    error = "TCP ports in use"
+                    continue
+
+            lines = process.stdout.strip().splitlines()
+            if process.returncode != 0 or not lines:
+                error = "SITL exited with {}".format(process.returncode)
+            else:
+                try:
+                    report = json.loads(lines[-1])
+                    error = None
+                except ValueError:
+                    error = "no report"
+            break
+
+    if report:
+        report.pop('scenario', None)
+        result.update(report)
+    result['error'] = error or ''
+
+    if not args.keep and not error:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    with results_lock:
+        results.append(result)
+        summary = ', '.join('{}={}'.format(k, v) for k, v in run['settings'].items())
+        print("[{}/{}] {} {}: {}".format(len(results), args.run_count, os.path.basename(run['scenario']), summary,
+            error or "{} s in {} s".format(result.get('duration_s'), result.get('host_cpu_s'))), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run SITL flights with the built-in simulator in parallel")
+    parser.add_argument('--sitl', required=True, help="SITL executable")
+    parser.add_argument('--eeprom', required=True, help="EEPROM file with the base configuration, it is not changed")
+    parser.add_argument('--scenario', required=True, action='append', help="scenario file, may be given more than once")
+    parser.add_argument('--airframe', help="airframe file for the built-in simulator")
+    parser.add_argument('--set', dest='fixed', default=[], action='append', type=lambda s: parse_assignment(s, False),
+        metavar='NAME=VALUE', help="setting for all runs")
+    parser.add_argument('--sweep', default=[], action='append', type=lambda s: parse_assignment(s, True),
+        metavar='NAME=V1,V2,...', help="setting to try with each value, sweeps are combined with each other")
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help="runs at the same time (default: all cores)")
+    parser.add_argument('--base-port', type=int, default=20000, help="first TCP port to use (default: 20000)")
+    parser.add_argument('--timeout', type=float, default=600, help="host time limit per run, s (default: 600)")
+    parser.add_argument('--workdir', help="where the runs' directories go (default: system temporary directory)")
+    parser.add_argument('--keep', action='store_true', help="keep the directories of successful runs too")
+    parser.add_argument('--csv', help="write the results to this CSV file")
+    parser.add_argument('--json', help="write the results to this JSON file")
+    args = parser.parse_args()
+
+    for path in [args.sitl, args.eeprom, args.airframe] + args.scenario:
+        if path and not os.path.isfile(path):
+            parser.error("{} not found".format(path))
+    args.sitl = os.path.abspath(args.sitl)
+    args.eeprom = os.path.abspath(args.eeprom)
+    args.airframe = args.airframe and os.path.abspath(args.airframe)
+    if args.workdir:
+        os.makedirs(args.workdir, exist_ok=True)
+
+    runs = build_runs([os.path.abspath(s) for s in args.scenario], args.fixed, args.sweep)
+    args.run_count = len(runs)
+
+    ports = PortAllocator(args.base_port)
+    results = []
+    results_lock = threading.Lock()
+    started = time.time()
+
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as executor:
+        for future in [executor.submit(fly, args, run, ports, results_lock, results) for run in runs]:
+            future.result()
+
+    results.sort(key=lambda r: r['run'])
+    failed = sum(1 for r in results if r['error'])
+    print("{} runs, {} failed, {:.1f}s".format(len(results), failed, time.time() - started), file=sys.stderr)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'runs': results}, f, indent=2)
+
+    columns = []
+    for result in results:
+        columns += [key for key in result if key not in columns]
+    columns.remove('error')
+    columns.append('error')
+
+    out = open(args.csv, 'w', newline='') if args.csv else sys.stdout
+    writer = csv.DictWriter(out, fieldnames=columns, restval='')
+    writer.writeheader()
+    writer.writerows(results)
+    if args.csv:
+        out.close()
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())